@@ -0,0 +1,121 @@
+/**
+ * @file CommandMux.hpp
+ * @brief Arbitrates the setpoints that teleop and the autonomy nodes send to the six SPARKs, so
+ *        that a single writer sends one command per device and control tick.
+ */
+
+#ifndef COMMANDMUX_HPP
+#define COMMANDMUX_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class CommandMux
+ * @brief Per source and device slots of the latest setpoint, written without locks by the sources
+ *        and read by the control tick, which decides the owner of every device.
+ *
+ * A setpoint holds its device for its lease; the source renews it by sending again. The device
+ * goes to the highest priority source with an unexpired lease, and on a tie stays with the source
+ * that owns it, so two equal autonomy nodes do not take turns. A device nobody holds gets the
+ * neutral command, duty cycle 0, which the SPARKs' brake mode holds.
+ *
+ * Every slot field is an atomic and the slot's version is odd while it is rewritten, so the tick
+ * copies a consistent setpoint without waiting for the writer, and a writer never waits for the
+ * tick. Each slot has one writer: the source's own thread or the subscription delivering it. A slot
+ * still being rewritten after a few reads (its writer was preempted) leaves the device with its
+ * previous decision for that tick, so the tick never spins on a writer.
+ */
+class CommandMux
+{
+public:
+  static const std::size_t DEVICE_COUNT = 6; // CAN ids 1 to 6
+  static const std::size_t MAX_SOURCES = 8;
+  static const int READ_ATTEMPTS = 4; // Reads of a slot in one tick before its device keeps its previous decision
+
+  // Values of interfaces_pkg/MotorCommand's modes
+  enum class Mode : uint8_t
+  {
+    DUTY_CYCLE = 0,
+    VELOCITY = 1,
+    POSITION = 2
+  };
+
+  /**
+   * @struct Decision
+   * @brief The command of one device for this tick.
+   */
+  struct Decision
+  {
+    int owner = -1; // Source index, -1 for the neutral command
+    Mode mode = Mode::DUTY_CYCLE;
+    float value = 0.0f;
+    int64_t received_ns = 0; // The mux got the setpoint, 0 for the neutral command
+  };
+
+  /**
+   * @brief Registers a source, before any setpoint is sent.
+   * @param priority Higher takes the devices from lower
+   * @returns Index of the source, -1 once MAX_SOURCES are registered
+   */
+  int addSource(const std::string &name, int priority);
+
+  /**
+   * @returns Index of the named source, -1 if it is not registered
+   */
+  int sourceIndex(const std::string &name) const;
+  const std::string &sourceName(int source) const { return sources_[source].name; }
+  std::size_t sourceCount() const { return sources_.size(); }
+
+  /**
+   * @brief Latest setpoint of a source for one device. One thread per source.
+   *
+   * The same setpoint sent again while it holds only extends its lease and keeps the time it first
+   * arrived, so renewals do not count as new setpoints in the arbitration latency.
+   * @param device CAN id - 1
+   * @param now_ns Time the setpoint arrived
+   * @param lease_ns How long it holds the device, 0 releases it
+   */
+  void submit(int source, std::size_t device, Mode mode, float value, int64_t now_ns, int64_t lease_ns);
+
+  /**
+   * @brief Gives up every device of a source at once, as when teleop's safety triggers are let go.
+   */
+  void releaseAll(int source);
+
+  /**
+   * @brief Decides the command of every device. Only the control tick calls it.
+   * @returns One decision per device, valid until the next call
+   */
+  const std::array<Decision, DEVICE_COUNT> &decide(int64_t now_ns);
+
+private:
+  struct Slot
+  {
+    std::atomic<uint32_t> version{0}; // Odd while the writer is in the slot
+    std::atomic<uint8_t> mode{0};
+    std::atomic<float> value{0.0f};
+    std::atomic<int64_t> received_ns{0};
+    std::atomic<int64_t> expires_ns{0};
+  };
+
+  struct Source
+  {
+    std::string name;
+    int priority = 0;
+  };
+
+  void write(Slot &slot, Mode mode, float value, int64_t received_ns, int64_t expires_ns);
+  static bool read(const Slot &slot, Decision &setpoint, int64_t &expires_ns);
+
+  std::vector<Source> sources_;
+  std::array<std::array<Slot, DEVICE_COUNT>, MAX_SOURCES> slots_;
+  std::array<Decision, DEVICE_COUNT> decisions_; // Tick only
+};
+
+#endif // COMMANDMUX_HPP
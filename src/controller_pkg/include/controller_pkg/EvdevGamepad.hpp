@@ -0,0 +1,111 @@
+/**
+ * @file EvdevGamepad.hpp
+ * @brief Reads a gamepad straight from /dev/input and maps it to the layout ControllerNode expects.
+ */
+
+#ifndef EVDEVGAMEPAD_HPP
+#define EVDEVGAMEPAD_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <linux/input.h>
+
+#include "controller_pkg/Gamepad.hpp"
+
+/**
+ * @struct GamepadState
+ * @brief Axes in [-1, 1] and buttons 0 or 1, indexed by Gp::Axes and Gp::Buttons.
+ */
+struct GamepadState
+{
+  std::array<float, Gp::AXIS_COUNT> axes{};
+  std::array<int32_t, Gp::BUTTON_COUNT> buttons{};
+};
+
+/**
+ * @class EvdevGamepad
+ * @brief Follows one evdev gamepad from its own thread, blocked in epoll until the kernel has events.
+ *
+ * The device is grabbed (EVIOCGRAB) so a browser or desktop on the same machine does not act on it
+ * too. Buttons and sticks are mapped like the browser's standard gamepad, which is what the pilot
+ * page sends: xpad's BTN_X/BTN_Y are the Xbox X and Y buttons, analog triggers and the hat switch
+ * become buttons. A gamepad that is unplugged is looked for again every reconnect_s.
+ */
+class EvdevGamepad
+{
+public:
+  struct Config
+  {
+    std::string device = "auto";   // A /dev/input/event* path, "auto" for the first gamepad, or part of its name
+    bool grab = true;
+    float trigger_threshold = 0.1f; // Fraction of its travel an analog trigger counts as pressed from
+    double reconnect_s = 1.0;
+  };
+
+  /**
+   * @param state The whole gamepad after the change
+   * @param event_ns Kernel time of the event on the system clock
+   */
+  using StateHandler = std::function<void(const GamepadState &state, int64_t event_ns)>;
+  using ConnectionHandler = std::function<void(bool connected, const std::string &name)>;
+
+  EvdevGamepad() : EvdevGamepad(Config()) {}
+  explicit EvdevGamepad(const Config &config);
+  ~EvdevGamepad();
+
+  EvdevGamepad(const EvdevGamepad &) = delete;
+  EvdevGamepad &operator=(const EvdevGamepad &) = delete;
+
+  // Called from the reader thread, set before start(). A gamepad found reports its state, then its connection
+  void onState(StateHandler handler) { on_state_ = std::move(handler); }
+  void onConnection(ConnectionHandler handler) { on_connection_ = std::move(handler); }
+
+  /**
+   * @brief Starts the reader thread, which waits for the device if it is not there yet.
+   * @returns false if epoll cannot be set up, lastError() says why
+   */
+  bool start();
+  void stop();
+
+  /**
+   * @brief Resolves a device setting to the path of an event device.
+   * @param device A path, "auto" or part of a device name
+   * @returns The path, empty if no gamepad matches
+   */
+  static std::string findDevice(const std::string &device);
+
+  const std::string &lastError() const { return last_error_; }
+
+private:
+  bool openDevice();
+  void closeDevice();
+  void resync();
+  void handle(const struct input_event &event);
+  float normalized(int code, int value) const;
+  void run();
+
+  Config config_;
+  int fd_ = -1;
+  int epoll_fd_ = -1;
+  int wake_fd_ = -1;
+  std::string name_;
+  std::array<struct input_absinfo, ABS_CNT> abs_info_{};
+  GamepadState state_;
+  bool changed_ = false;
+  bool dropped_ = false; // The kernel buffer overflowed, events are skipped up to the next report
+
+  std::string last_error_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+
+  StateHandler on_state_;
+  ConnectionHandler on_connection_;
+};
+
+#endif // EVDEVGAMEPAD_HPP
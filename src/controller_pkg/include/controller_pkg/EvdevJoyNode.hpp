@@ -0,0 +1,55 @@
+/**
+ * @file EvdevJoyNode.hpp
+ * @brief Publishes a locally plugged gamepad on /joy, in place of the pilot page.
+ */
+
+#ifndef EVDEVJOYNODE_HPP
+#define EVDEVJOYNODE_HPP
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "rclcpp/rclcpp.hpp"
+#include "sensor_msgs/msg/joy.hpp"
+
+#include "controller_pkg/EvdevGamepad.hpp"
+
+/**
+ * @class EvdevJoyNode
+ * @brief Publishes every change of an evdev gamepad as soon as the kernel reports it, from the
+ *        reader thread, and repeats the state every repeat_ms like the page does, so the
+ *        controller keeps sending SPARK heartbeats while the sticks are held still.
+ *
+ * Messages are numbered in frame_id and stamped with the kernel time of the event, as the page
+ * does with its own clock, so joy_latency_report covers this path too. Run in the same process
+ * as ControllerNode with intra-process communication (controller_node's joy_device parameter),
+ * /joy is handed over without serialization.
+ */
+class EvdevJoyNode : public rclcpp::Node
+{
+public:
+  explicit EvdevJoyNode(const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
+  ~EvdevJoyNode() override;
+
+private:
+  void state_callback(const GamepadState &state, int64_t event_ns);
+  void connection_callback(bool connected, const std::string &name);
+  void repeat_callback();
+  void publish(int64_t stamp_ns);
+
+  std::unique_ptr<EvdevGamepad> gamepad_;
+  rclcpp::Publisher<sensor_msgs::msg::Joy>::SharedPtr joy_pub_;
+  rclcpp::TimerBase::SharedPtr repeat_timer_;
+  std::chrono::steady_clock::duration repeat_period_;
+
+  std::mutex mutex_; // The reader thread and the timer both publish
+  GamepadState state_;
+  bool connected_ = false;
+  uint32_t frame_id_ = 0;
+  std::chrono::steady_clock::time_point last_publish_;
+};
+
+#endif // EVDEVJOYNODE_HPP
@@ -0,0 +1,147 @@
+/**
+ * @file JoyTrace.hpp
+ * @brief Follows gamepad messages from the pilot page to the CAN bus: a lock-free ring of
+ *        per-message times and a SocketCAN listener that stamps the frames leaving the interface.
+ */
+
+#ifndef JOYTRACE_HPP
+#define JOYTRACE_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @struct JoyTraceRecord
+ * @brief Times of one Joy message in ns on the system clock, 0 for a hop that was not seen.
+ */
+struct JoyTraceRecord
+{
+  uint64_t sequence = 0;     // Order the controller handled the messages in
+  uint32_t trace_id = 0;     // frame_id of the Joy message, counted by the page
+  int64_t page_ns = 0;       // The page read the gamepad, on the browser's clock
+  int64_t published_ns = 0;  // DDS source timestamp
+  int64_t received_ns = 0;   // DDS reception timestamp
+  int64_t callback_ns = 0;   // joy_callback started
+  int64_t commanded_ns = 0;  // joy_callback returned
+  int64_t can_tx_ns = 0;     // Last motor command frame of the callback on the interface
+  uint32_t can_frames = 0;
+};
+
+/**
+ * @class JoyTraceRing
+ * @brief Fixed ring of the latest JoyTraceRecords, written without locks from the joy callback,
+ *        the control tick and the CAN listener and read from a timer.
+ *
+ * Every field is an atomic and every slot carries the sequence of its record, 0 while it is
+ * rewritten, so a reader that finds the same sequence before and after copying a slot has a
+ * consistent record. CAN frames count towards the newest record whose callback started before
+ * them, up to the echo of the control tick that wrote its setpoints; a frame echoed after the
+ * next callback started counts towards that one instead, which at the page's 50 ms period only
+ * happens on a congested bus.
+ */
+class JoyTraceRing
+{
+public:
+  static const std::size_t SIZE = 256; // 12 s of the page's 20 Hz gamepad
+
+  /**
+   * @brief Starts the record of a Joy message reaching the callback. One thread only.
+   * @returns Sequence of the record, for finish()
+   */
+  uint64_t begin(uint32_t trace_id, int64_t page_ns, int64_t published_ns, int64_t received_ns, int64_t callback_ns);
+
+  /**
+   * @brief Ends the record once the callback has written its CAN frames. Same thread as begin().
+   */
+  void finish(uint64_t sequence, int64_t commanded_ns);
+
+  /**
+   * @brief The control tick wrote the setpoints of the newest finished record to the bus. Frames
+   *        echoed well after that belong to later ticks and no longer count towards it.
+   * @param written_ns The tick's last frame was written
+   */
+  void applied(int64_t written_ns);
+
+  /**
+   * @brief Counts a motor command frame towards the newest record. Called from the CAN listener.
+   * @param tx_ns Time the frame left the interface
+   */
+  void canFrame(int64_t tx_ns);
+
+  /**
+   * @brief Copies out the records finished at least settle_ns before now_ns, oldest first, each once.
+   *        One thread only. Stops at the first record still in its callback or waiting for its frames.
+   * @param out Records are appended
+   * @returns Number of records overwritten before they could be copied
+   */
+  std::size_t drain(int64_t now_ns, int64_t settle_ns, std::vector<JoyTraceRecord> &out);
+
+private:
+  struct Slot
+  {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint32_t> trace_id{0};
+    std::atomic<int64_t> page_ns{0};
+    std::atomic<int64_t> published_ns{0};
+    std::atomic<int64_t> received_ns{0};
+    std::atomic<int64_t> callback_ns{0};
+    std::atomic<int64_t> commanded_ns{0};
+    std::atomic<int64_t> applied_ns{0};
+    std::atomic<int64_t> can_tx_ns{0};
+    std::atomic<uint32_t> can_frames{0};
+  };
+
+  std::array<Slot, SIZE> slots_;
+  std::atomic<uint64_t> newest_{0}; // Sequence of the newest record, 0 before the first
+  uint64_t next_sequence_ = 1;      // Writer only
+  uint64_t drained_ = 0;            // Reader only
+};
+
+/**
+ * @class CanTxMonitor
+ * @brief Listens on a SocketCAN interface for the frames this host sends and reports when each
+ *        left, using the kernel timestamp of its echo.
+ *
+ * Drivers that echo on transmit completion (IFF_ECHO, as gs_usb, mcp251x and the Jetson's mttcan)
+ * give the time the frame was on the bus; others echo when the frame is queued to the driver.
+ * Frames received from other nodes on the bus are ignored.
+ */
+class CanTxMonitor
+{
+public:
+  using FrameHandler = std::function<void(uint32_t can_id, int64_t tx_ns)>;
+
+  CanTxMonitor(const std::string &interface, FrameHandler handler);
+  ~CanTxMonitor();
+
+  CanTxMonitor(const CanTxMonitor &) = delete;
+  CanTxMonitor &operator=(const CanTxMonitor &) = delete;
+
+  /**
+   * @brief Opens the interface and starts the listener thread.
+   * @returns false if the interface cannot be opened, lastError() says why
+   */
+  bool start();
+  void stop();
+
+  const std::string &lastError() const { return last_error_; }
+
+private:
+  void run();
+
+  std::string interface_;
+  FrameHandler handler_;
+  int fd_ = -1;
+  std::string last_error_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+};
+
+#endif // JOYTRACE_HPP
@@ -0,0 +1,118 @@
+/**
+ * @file MotionEngine.hpp
+ * @brief Runs a MotionRecipe one tick at a time, from readings to the setpoints of the bucket,
+ *        drivetrain and vibrator.
+ */
+
+#ifndef MOTIONENGINE_HPP
+#define MOTIONENGINE_HPP
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "controller_pkg/MotionRecipe.hpp"
+
+/**
+ * @class MotionEngine
+ * @brief Interprets a recipe that was read and checked before, without allocating or blocking.
+ *
+ * Every tick first ends the current stage if its exit conditions hold, then returns the setpoints of
+ * the stage that runs, so the next stage's setpoints go out in the tick the previous one ends. Devices
+ * a stage does not mention get no setpoint and keep their last one, except for the drivetrain and the
+ * vibrator of a recipe that uses them, which are stopped. While the lift sides are further apart than
+ * realign_above, both are sent to the right side's position and the tilt waits.
+ */
+class MotionEngine
+{
+public:
+  enum Device
+  {
+    LEFT_DRIVE,
+    RIGHT_DRIVE,
+    LEFT_LIFT,
+    RIGHT_LIFT,
+    TILT,
+    VIBRATOR,
+    DEVICE_COUNT
+  };
+
+  struct Setpoint
+  {
+    enum Mode : uint8_t
+    {
+      NONE, // Leave the device alone
+      DUTY_CYCLE,
+      VELOCITY,
+      POSITION
+    };
+    Mode mode = NONE;
+    float value = 0.0f;
+
+    bool operator==(const Setpoint &other) const { return mode == other.mode && value == other.value; }
+    bool operator!=(const Setpoint &other) const { return !(*this == other); }
+  };
+
+  struct Readings
+  {
+    float left_lift = 0.0f;
+    float right_lift = 0.0f;
+    float tilt = 0.0f;
+    bool fill_known = false; // A recent, calibrated /bucket_fill reading
+    bool full = false;
+  };
+
+  enum class Status
+  {
+    RUNNING,
+    DONE,
+    ABORTED // The lift sides were further apart than abort_above
+  };
+
+  struct Tick
+  {
+    Status status = Status::RUNNING;
+    std::array<Setpoint, DEVICE_COUNT> setpoints;
+    bool misaligned = false; // The lift sides are further apart than warn_above
+    int ended = -1;          // Stage that ended in this tick, -1 for none
+    double ended_duration_s = 0.0;
+    bool ended_timed_out = false;
+  };
+
+  /**
+   * @param recipe Kept by reference and must outlive the engine
+   */
+  explicit MotionEngine(const MotionRecipe &recipe) : recipe_(recipe) {}
+
+  /**
+   * @brief Starts the first stage.
+   * @param now_s Time on any steady clock
+   * @param readings Tilt position that tilt_relative recipes count from
+   */
+  void start(double now_s, const Readings &readings);
+
+  /**
+   * @brief Ends the stage if it is done and returns what to send to the devices.
+   * @param now_s Same clock as start()
+   */
+  Tick tick(double now_s, const Readings &readings);
+
+  /**
+   * @returns Index of the running stage, the stage count once done
+   */
+  int stage() const { return stage_; }
+
+  float tiltOffset() const { return tilt_offset_; }
+
+private:
+  bool reached(const MotionStage &stage, const Readings &readings) const;
+  void command(const MotionStage &stage, const Readings &readings, Tick &tick) const;
+
+  const MotionRecipe &recipe_;
+  int stage_ = 0;
+  double stage_start_s_ = 0.0;
+  float tilt_offset_ = 0.0f;
+  bool aborted_ = false;
+};
+
+#endif // MOTIONENGINE_HPP
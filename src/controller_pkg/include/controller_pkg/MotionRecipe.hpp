@@ -0,0 +1,74 @@
+/**
+ * @file MotionRecipe.hpp
+ * @brief Excavation and depositing sequences read from YAML, so they can be tuned without a rebuild.
+ */
+
+#ifndef MOTIONRECIPE_HPP
+#define MOTIONRECIPE_HPP
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @struct MotionStage
+ * @brief One step of a recipe: what the bucket, drivetrain and vibrator do and when the step ends.
+ *
+ * Positions are in SPARK rotations, the drive velocity in RPM and duty cycles from -1 to 1. A stage
+ * ends once all of its exit conditions hold, or when its timeout runs out.
+ */
+struct MotionStage
+{
+  std::string name;
+
+  bool has_lift = false;
+  float lift = 0.0f;
+  bool has_tilt = false;
+  float tilt = 0.0f; // From the tilt when the recipe started if the recipe is tilt_relative
+  bool has_tilt_duty = false;
+  float tilt_duty = 0.0f; // Instead of a tilt position, e.g. to seat the bucket against its stop
+  bool has_drive = false;
+  float drive_velocity = 0.0f; // Both sides, the drivetrain stops in stages without one
+  float vibrator_duty = 0.0f;
+
+  bool until_reached = false; // Lift and tilt within the recipe's tolerance
+  double after_s = 0.0;       // At least this long in the stage
+  bool until_full = false;    // /bucket_fill reports a full bucket, never without a calibrated reading
+  double timeout_s = 0.0;     // 0 for never
+};
+
+/**
+ * @struct MotionRecipe
+ * @brief A sequence of stages and the limits it runs under, checked when it is read.
+ */
+struct MotionRecipe
+{
+  std::string name;
+  std::string source; // File it was read from
+
+  float tolerance = 0.1f;     // A position is reached within this many rotations
+  float realign_above = 0.2f; // Lift sides further apart than this are brought together before moving on
+  float warn_above = 0.75f;   // Lift sides further apart than this are logged
+  float abort_above = 0.0f;   // Lift sides further apart than this stop the recipe, 0 for never
+  bool tilt_relative = false; // Tilt positions count from the tilt when the recipe starts
+
+  bool drives = false;   // Some stage drives, the others stop the drivetrain
+  bool vibrates = false; // Some stage vibrates, the others stop the vibrator
+  std::vector<MotionStage> stages;
+
+  /**
+   * @brief Reads and checks a recipe file.
+   * @param path YAML file, see recipes/ in controller_pkg
+   * @returns The recipe
+   * @throws std::runtime_error naming the file and the key when the file cannot be read or is not a valid recipe
+   */
+  static MotionRecipe load(const std::string &path);
+
+  /**
+   * @brief Reads and checks a recipe from YAML text.
+   * @param source Name of the text in errors
+   */
+  static MotionRecipe parse(const std::string &yaml, const std::string &source);
+};
+
+#endif // MOTIONRECIPE_HPP
@@ -0,0 +1,102 @@
+/**
+ * @file MuxedSparkMax.hpp
+ * @brief SPARK MAX setpoints of an autonomy node, sent to controller_node's command mux instead
+ *        of to the bus.
+ */
+
+#ifndef MUXEDSPARKMAX_HPP
+#define MUXEDSPARKMAX_HPP
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "SparkMax.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "interfaces_pkg/msg/motor_command.hpp"
+
+/**
+ * @class MotorCommandSource
+ * @brief Publishes the setpoints of one source on motor_commands and keeps its devices.
+ *
+ * A SPARK keeps its last setpoint, so the nodes set a position once and go on. The mux only keeps
+ * a setpoint for its lease, so the latest setpoint of every device is sent again from a thread of
+ * its own until release(): the service callbacks of the autonomy nodes block their executor for
+ * seconds. A node that dies stops renewing and loses its devices a lease later.
+ */
+class MotorCommandSource
+{
+public:
+  /**
+   * @param source Name in controller_node's mux_sources
+   * @param lease How long the mux keeps a setpoint, renewed every quarter of it
+   */
+  explicit MotorCommandSource(const std::string &source,
+                              std::chrono::milliseconds lease = std::chrono::milliseconds(250));
+  ~MotorCommandSource();
+
+  MotorCommandSource(const MotorCommandSource &) = delete;
+  MotorCommandSource &operator=(const MotorCommandSource &) = delete;
+
+  /**
+   * @brief Creates the publisher and starts renewing. Setpoints sent before are kept and go out then.
+   */
+  void attach(rclcpp::Node &node);
+
+  /**
+   * @brief Sends a setpoint at once if it differs from the device's last one, and keeps renewing it.
+   * @param mode interfaces_pkg::msg::MotorCommand::DUTY_CYCLE, VELOCITY or POSITION
+   */
+  void send(uint8_t can_id, uint8_t mode, float value);
+
+  /**
+   * @brief Gives the devices back to the mux, which sends them the neutral command if nobody else wants them.
+   */
+  void release();
+
+private:
+  void publish(const std::map<uint8_t, std::pair<uint8_t, float>> &setpoints, uint32_t lease_ms);
+  void renew();
+
+  std::string source_;
+  std::chrono::milliseconds lease_;
+  rclcpp::Publisher<interfaces_pkg::msg::MotorCommand>::SharedPtr publisher_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::map<uint8_t, std::pair<uint8_t, float>> held_; // CAN id -> mode, value
+  std::thread thread_;
+  bool running_ = false;
+};
+
+/**
+ * @class MuxedSparkMax
+ * @brief Drop-in for the SparkMax calls of the autonomy nodes: setpoints go through the mux,
+ *        readings come from the SPARK's status frames as before.
+ */
+class MuxedSparkMax
+{
+public:
+  MuxedSparkMax(MotorCommandSource &source, const std::string &can_interface, uint8_t can_id)
+      : source_(source), spark_(can_interface, can_id), can_id_(can_id) {}
+
+  void SetDutyCycle(float duty_cycle) { source_.send(can_id_, interfaces_pkg::msg::MotorCommand::DUTY_CYCLE, duty_cycle); }
+  void SetVelocity(float velocity) { source_.send(can_id_, interfaces_pkg::msg::MotorCommand::VELOCITY, velocity); }
+  void SetPosition(float position) { source_.send(can_id_, interfaces_pkg::msg::MotorCommand::POSITION, position); }
+
+  float GetPosition() const { return spark_.GetPosition(); }
+
+private:
+  MotorCommandSource &source_;
+  SparkMax spark_;
+  uint8_t can_id_;
+};
+
+#endif // MUXEDSPARKMAX_HPP
@@ -0,0 +1,70 @@
+/**
+ * @file RecipeRunner.hpp
+ * @brief Runs a motion recipe file on the SPARKs of an autonomy node, inside its service callback.
+ */
+
+#ifndef RECIPERUNNER_HPP
+#define RECIPERUNNER_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "controller_pkg/MotionEngine.hpp"
+#include "controller_pkg/MuxedSparkMax.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "interfaces_pkg/msg/bucket_fill.hpp"
+
+/**
+ * @class RecipeRunner
+ * @brief Reads a recipe on every run, ticks a MotionEngine with it and logs how long every stage took.
+ *
+ * The recipe is read again on every run, so a file tuned between cycles applies to the next one
+ * without a restart. /bucket_fill is received in a callback group of its own, so the node must be
+ * spun by a MultiThreadedExecutor for the full exit condition to see it while a run blocks.
+ */
+class RecipeRunner
+{
+public:
+  using Devices = std::array<MuxedSparkMax *, MotionEngine::DEVICE_COUNT>; // nullptr for devices the node does not drive
+
+  /**
+   * @param devices Must have both lifts and the tilt
+   */
+  RecipeRunner(MotorCommandSource &commands, const Devices &devices) : commands_(commands), devices_(devices) {}
+
+  /**
+   * @brief Subscribes to /bucket_fill.
+   */
+  void attach(rclcpp::Node &node);
+
+  /**
+   * @brief Runs a recipe to its end, then gives the devices back to the mux.
+   * @param path Recipe file
+   * @returns Whether the recipe could be read and ran without being aborted
+   */
+  bool run(const std::string &path);
+
+private:
+  MotionEngine::Readings read() const;
+
+  static constexpr std::chrono::milliseconds TICK{5}; // Keeps the CAN buffer from overflowing
+  static constexpr int64_t FILL_STALE_NS = 1000000000;
+
+  MotorCommandSource &commands_;
+  Devices devices_;
+  rclcpp::Node *node_ = nullptr;
+  rclcpp::CallbackGroup::SharedPtr fill_group_;
+  rclcpp::Subscription<interfaces_pkg::msg::BucketFill>::SharedPtr fill_subscriber_;
+  std::atomic<int64_t> fill_received_ns_{0}; // Steady clock, 0 before the first calibrated reading
+  std::atomic<bool> full_{false};
+};
+
+/**
+ * @returns Path of a recipe installed with controller_pkg
+ */
+std::string InstalledRecipe(const std::string &file);
+
+#endif // RECIPERUNNER_HPP
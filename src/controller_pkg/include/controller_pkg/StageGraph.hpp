@@ -0,0 +1,99 @@
+/**
+ * @file StageGraph.hpp
+ * @brief Runs the stages of an autonomy mission side by side when neither waits for the other
+ *        and they use different actuators.
+ */
+
+#ifndef STAGEGRAPH_HPP
+#define STAGEGRAPH_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @class StageGraph
+ * @brief Stages with dependencies and the actuators they hold, stepped from one timer.
+ *
+ * A stage starts once every stage it comes after has finished and none of its resources (a bit
+ * mask, e.g. drive, bucket, vibrator) is held by a running stage. Ready stages start in the order
+ * they were added, and one blocked on a resource keeps later stages off that resource, so stages
+ * that share an actuator keep their order. Stages may be added while the graph runs, such as the
+ * next cycle of a mission, and can only come after stages added before them.
+ */
+class StageGraph
+{
+public:
+  /**
+   * @brief Moves the stage on, called on every tick while it runs, starting with the tick it starts in.
+   * @param first Whether this is the stage's first step
+   * @returns true once the stage is done
+   */
+  using Step = std::function<bool(bool first)>;
+
+  /**
+   * @struct Timing
+   * @brief When a finished stage could have started, started and ended, in the graph's seconds.
+   */
+  struct Timing
+  {
+    int stage = -1;
+    std::string name;
+    double ready_s = 0.0; // Its dependencies were done, it may have waited for a resource after
+    double start_s = 0.0;
+    double end_s = 0.0;
+    bool timed_out = false;
+  };
+
+  /**
+   * @brief Adds a stage.
+   * @param resources Actuators it holds while it runs
+   * @param after Stages that must finish first, added before this one
+   * @param timeout_s The stage ends after this long even if not done, 0 for never
+   * @returns Index of the stage
+   */
+  int add(const std::string &name, uint32_t resources, const std::vector<int> &after, Step step, double timeout_s = 0.0);
+
+  /**
+   * @brief Starts the stages that can start and steps the running ones.
+   * @param now_s Time on any steady clock
+   * @returns Timings of the stages that ended in this tick
+   */
+  std::vector<Timing> tick(double now_s);
+
+  bool finished(int stage) const { return stages_[stage].state == State::FINISHED; }
+
+  /**
+   * @returns Whether every stage added has finished
+   */
+  bool idle() const;
+
+private:
+  enum class State
+  {
+    WAITING,
+    RUNNING,
+    FINISHED
+  };
+
+  struct Stage
+  {
+    std::string name;
+    uint32_t resources = 0;
+    std::vector<int> after;
+    Step step;
+    double timeout_s = 0.0;
+    State state = State::WAITING;
+    Timing timing;
+    bool ready = false;
+    bool stepped = false;
+  };
+
+  std::vector<Stage> stages_;
+  std::size_t first_open_ = 0; // Stages before it have all finished
+};
+
+#endif // STAGEGRAPH_HPP
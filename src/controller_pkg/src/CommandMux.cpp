@@ -0,0 +1,124 @@
+#include "controller_pkg/CommandMux.hpp"
+
+int CommandMux::addSource(const std::string &name, int priority)
+{
+  if (sources_.size() >= MAX_SOURCES)
+  {
+    return -1;
+  }
+  sources_.push_back({name, priority});
+  return static_cast<int>(sources_.size() - 1);
+}
+
+int CommandMux::sourceIndex(const std::string &name) const
+{
+  for (std::size_t i = 0; i < sources_.size(); i++)
+  {
+    if (sources_[i].name == name)
+    {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+void CommandMux::write(Slot &slot, Mode mode, float value, int64_t received_ns, int64_t expires_ns)
+{
+  const uint32_t version = slot.version.load(std::memory_order_relaxed);
+  slot.version.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.mode.store(static_cast<uint8_t>(mode), std::memory_order_relaxed);
+  slot.value.store(value, std::memory_order_relaxed);
+  slot.received_ns.store(received_ns, std::memory_order_relaxed);
+  slot.expires_ns.store(expires_ns, std::memory_order_relaxed);
+  slot.version.store(version + 2, std::memory_order_release);
+}
+
+bool CommandMux::read(const Slot &slot, Decision &setpoint, int64_t &expires_ns)
+{
+  const uint32_t before = slot.version.load(std::memory_order_acquire);
+  if (before & 1u)
+  {
+    return false;
+  }
+  setpoint.mode = static_cast<Mode>(slot.mode.load(std::memory_order_relaxed));
+  setpoint.value = slot.value.load(std::memory_order_relaxed);
+  setpoint.received_ns = slot.received_ns.load(std::memory_order_relaxed);
+  expires_ns = slot.expires_ns.load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.version.load(std::memory_order_relaxed) == before;
+}
+
+void CommandMux::submit(int source, std::size_t device, Mode mode, float value, int64_t now_ns, int64_t lease_ns)
+{
+  if (source < 0 || static_cast<std::size_t>(source) >= sources_.size() || device >= DEVICE_COUNT)
+  {
+    return;
+  }
+  Slot &slot = slots_[source][device];
+  int64_t received_ns = now_ns;
+  // Only this thread writes the slot, so its own last setpoint can be read without the version
+  if (slot.expires_ns.load(std::memory_order_relaxed) > now_ns &&
+      slot.mode.load(std::memory_order_relaxed) == static_cast<uint8_t>(mode) &&
+      slot.value.load(std::memory_order_relaxed) == value)
+  {
+    received_ns = slot.received_ns.load(std::memory_order_relaxed);
+  }
+  write(slot, mode, value, received_ns, lease_ns > 0 ? now_ns + lease_ns : 0);
+}
+
+void CommandMux::releaseAll(int source)
+{
+  if (source < 0 || static_cast<std::size_t>(source) >= sources_.size())
+  {
+    return;
+  }
+  for (Slot &slot : slots_[source])
+  {
+    if (slot.expires_ns.load(std::memory_order_relaxed) != 0) // Only this thread writes the slot
+    {
+      write(slot, Mode::DUTY_CYCLE, 0.0f, 0, 0);
+    }
+  }
+}
+
+const std::array<CommandMux::Decision, CommandMux::DEVICE_COUNT> &CommandMux::decide(int64_t now_ns)
+{
+  for (std::size_t device = 0; device < DEVICE_COUNT; device++)
+  {
+    const int owner = decisions_[device].owner;
+    Decision best;
+    int best_priority = 0;
+    bool torn = false;
+    for (std::size_t source = 0; source < sources_.size() && !torn; source++)
+    {
+      Decision setpoint;
+      int64_t expires_ns = 0;
+      int attempts = 1;
+      while (!read(slots_[source][device], setpoint, expires_ns) && !torn)
+      {
+        // The writer is in the slot for four stores, unless it was preempted there
+        torn = ++attempts > READ_ATTEMPTS;
+      }
+      if (torn || expires_ns <= now_ns)
+      {
+        continue;
+      }
+      const int priority = sources_[source].priority;
+      const bool wins = best.owner < 0 || priority > best_priority ||
+                        (priority == best_priority && static_cast<int>(source) == owner);
+      if (wins)
+      {
+        setpoint.owner = static_cast<int>(source);
+        best = setpoint;
+        best_priority = priority;
+      }
+    }
+    if (torn)
+    {
+      continue; // The device keeps its previous decision for this tick, the next one reads the slot again
+    }
+    decisions_[device] = best;
+  }
+  return decisions_;
+}
@@ -0,0 +1,435 @@
+#include "controller_pkg/EvdevGamepad.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace
+{
+  const int LONG_BITS = 8 * sizeof(unsigned long);
+
+  // Absolute axes the mapping uses, queried on connect and after an overflow
+  const int MAPPED_AXES[] = {ABS_X, ABS_Y, ABS_RX, ABS_RY, ABS_Z, ABS_RZ, ABS_GAS, ABS_BRAKE, ABS_HAT0X, ABS_HAT0Y};
+
+  bool testBit(const unsigned long *bits, int bit)
+  {
+    return (bits[bit / LONG_BITS] >> (bit % LONG_BITS)) & 1UL;
+  }
+
+  /**
+   * @brief Gp button of an evdev key, -1 for the keys the controller has no use for.
+   */
+  int buttonOf(int code)
+  {
+    switch (code)
+    {
+    case BTN_SOUTH:
+      return Gp::_A;
+    case BTN_EAST:
+      return Gp::_B;
+    case BTN_NORTH: // BTN_X, the Xbox X button on xpad
+      return Gp::_X;
+    case BTN_WEST: // BTN_Y
+      return Gp::_Y;
+    case BTN_TL:
+      return Gp::_LEFT_BUMPER;
+    case BTN_TR:
+      return Gp::_RIGHT_BUMPER;
+    case BTN_TL2:
+      return Gp::_LEFT_TRIGGER;
+    case BTN_TR2:
+      return Gp::_RIGHT_TRIGGER;
+    case BTN_SELECT:
+      return Gp::_WINDOW_KEY;
+    case BTN_START:
+      return Gp::_START;
+    case BTN_THUMBL:
+      return Gp::_LEFT_STICK;
+    case BTN_THUMBR:
+      return Gp::_RIGHT_STICK;
+    case BTN_DPAD_UP:
+      return Gp::_D_PAD_UP;
+    case BTN_DPAD_DOWN:
+      return Gp::_D_PAD_DOWN;
+    case BTN_DPAD_LEFT:
+      return Gp::_D_PAD_LEFT;
+    case BTN_DPAD_RIGHT:
+      return Gp::_D_PAD_RIGHT;
+    case BTN_MODE:
+      return Gp::_X_BOX_KEY;
+    default:
+      return -1;
+    }
+  }
+
+  bool isGamepad(int fd)
+  {
+    unsigned long keys[KEY_MAX / LONG_BITS + 1] = {};
+    unsigned long axes[ABS_MAX / LONG_BITS + 1] = {};
+    if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) < 0 || ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(axes)), axes) < 0)
+    {
+      return false;
+    }
+    return testBit(keys, BTN_GAMEPAD) && testBit(axes, ABS_X) && testBit(axes, ABS_Y);
+  }
+
+  std::string deviceName(int fd)
+  {
+    char name[256] = {};
+    ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+    return name;
+  }
+
+  int64_t eventNs(const struct input_event &event)
+  {
+    return static_cast<int64_t>(event.input_event_sec) * 1000000000LL + static_cast<int64_t>(event.input_event_usec) * 1000;
+  }
+}
+
+EvdevGamepad::EvdevGamepad(const Config &config) : config_(config)
+{
+}
+
+EvdevGamepad::~EvdevGamepad()
+{
+  stop();
+}
+
+std::string EvdevGamepad::findDevice(const std::string &device)
+{
+  if (device.rfind("/dev/", 0) == 0)
+  {
+    return device;
+  }
+
+  std::vector<std::string> paths;
+  DIR *dir = opendir("/dev/input");
+  if (dir == nullptr)
+  {
+    return "";
+  }
+  while (const struct dirent *entry = readdir(dir))
+  {
+    if (std::strncmp(entry->d_name, "event", 5) == 0)
+    {
+      paths.push_back(std::string("/dev/input/") + entry->d_name);
+    }
+  }
+  closedir(dir);
+  // event2 before event10
+  std::sort(paths.begin(), paths.end(), [](const std::string &a, const std::string &b)
+            { return a.size() != b.size() ? a.size() < b.size() : a < b; });
+
+  for (const std::string &path : paths)
+  {
+    const int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+      continue;
+    }
+    const bool match = isGamepad(fd) && (device == "auto" || deviceName(fd).find(device) != std::string::npos);
+    close(fd);
+    if (match)
+    {
+      return path;
+    }
+  }
+  return "";
+}
+
+bool EvdevGamepad::start()
+{
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wake_fd_ < 0)
+  {
+    last_error_ = std::string("epoll: ") + std::strerror(errno);
+    return false;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = wake_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+  running_ = true;
+  thread_ = std::thread(&EvdevGamepad::run, this);
+  return true;
+}
+
+void EvdevGamepad::stop()
+{
+  running_ = false;
+  if (wake_fd_ >= 0)
+  {
+    const uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0)
+    {
+      // The counter is full, the thread is awake anyway
+    }
+  }
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+  if (epoll_fd_ >= 0)
+  {
+    close(epoll_fd_);
+    epoll_fd_ = -1;
+  }
+  if (wake_fd_ >= 0)
+  {
+    close(wake_fd_);
+    wake_fd_ = -1;
+  }
+}
+
+bool EvdevGamepad::openDevice()
+{
+  const std::string path = findDevice(config_.device);
+  if (path.empty())
+  {
+    return false;
+  }
+  fd_ = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd_ < 0)
+  {
+    return false;
+  }
+  if (config_.grab && ioctl(fd_, EVIOCGRAB, 1) < 0) // Another program has it, try again later
+  {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  int clock = CLOCK_REALTIME; // Same clock as the DDS timestamps
+  ioctl(fd_, EVIOCSCLOCKID, &clock);
+
+  name_ = deviceName(fd_);
+  abs_info_ = {};
+  for (int code : MAPPED_AXES)
+  {
+    ioctl(fd_, EVIOCGABS(code), &abs_info_[code]);
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd_, &event);
+
+  resync();
+  if (on_state_)
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    on_state_(state_, static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec);
+  }
+  // Only after the first state, so a handler that sees the gamepad connected also has its state
+  if (on_connection_)
+  {
+    on_connection_(true, name_);
+  }
+  return true;
+}
+
+void EvdevGamepad::closeDevice()
+{
+  if (fd_ < 0)
+  {
+    return;
+  }
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd_, nullptr);
+  close(fd_);
+  fd_ = -1;
+  state_ = GamepadState();
+  changed_ = false;
+  dropped_ = false;
+  if (on_connection_)
+  {
+    on_connection_(false, name_);
+  }
+}
+
+void EvdevGamepad::resync()
+{
+  state_ = GamepadState();
+  unsigned long keys[KEY_MAX / LONG_BITS + 1] = {};
+  ioctl(fd_, EVIOCGKEY(sizeof(keys)), keys);
+  for (int code = 0; code <= KEY_MAX; code++)
+  {
+    const int button = buttonOf(code);
+    if (button >= 0 && testBit(keys, code))
+    {
+      state_.buttons[button] = 1;
+    }
+  }
+  for (int code : MAPPED_AXES)
+  {
+    struct input_absinfo info;
+    if (ioctl(fd_, EVIOCGABS(code), &info) == 0)
+    {
+      abs_info_[code] = info;
+      struct input_event event = {};
+      event.type = EV_ABS;
+      event.code = static_cast<uint16_t>(code);
+      event.value = info.value;
+      handle(event);
+    }
+  }
+  changed_ = false;
+}
+
+float EvdevGamepad::normalized(int code, int value) const
+{
+  const struct input_absinfo &info = abs_info_[code];
+  if (info.maximum <= info.minimum)
+  {
+    return 0.0f;
+  }
+  const float fraction = static_cast<float>(value - info.minimum) / static_cast<float>(info.maximum - info.minimum);
+  return std::max(-1.0f, std::min(1.0f, 2.0f * fraction - 1.0f));
+}
+
+void EvdevGamepad::handle(const struct input_event &event)
+{
+  if (event.type == EV_SYN)
+  {
+    if (event.code == SYN_DROPPED)
+    {
+      dropped_ = true;
+    }
+    else if (event.code == SYN_REPORT)
+    {
+      if (dropped_)
+      {
+        dropped_ = false;
+        resync();
+        changed_ = true;
+      }
+      if (changed_ && on_state_)
+      {
+        on_state_(state_, eventNs(event));
+      }
+      changed_ = false;
+    }
+    return;
+  }
+  if (dropped_)
+  {
+    return;
+  }
+
+  if (event.type == EV_KEY)
+  {
+    const int button = buttonOf(event.code);
+    if (button >= 0)
+    {
+      state_.buttons[button] = event.value != 0 ? 1 : 0; // 2 is autorepeat
+      changed_ = true;
+    }
+    return;
+  }
+  if (event.type != EV_ABS)
+  {
+    return;
+  }
+
+  changed_ = true;
+  switch (event.code)
+  {
+  case ABS_X:
+    state_.axes[Gp::_LEFT_HORIZONTAL_STICK] = normalized(event.code, event.value);
+    break;
+  case ABS_Y:
+    state_.axes[Gp::_LEFT_VERTICAL_STICK] = normalized(event.code, event.value);
+    break;
+  case ABS_RX:
+    state_.axes[Gp::_RIGHT_HORIZONTAL_STICK] = normalized(event.code, event.value);
+    break;
+  case ABS_RY:
+    state_.axes[Gp::_RIGHT_VERTICAL_STICK] = normalized(event.code, event.value);
+    break;
+  case ABS_Z:
+  case ABS_BRAKE:
+    state_.buttons[Gp::_LEFT_TRIGGER] = (normalized(event.code, event.value) + 1.0f) / 2.0f > config_.trigger_threshold;
+    break;
+  case ABS_RZ:
+  case ABS_GAS:
+    state_.buttons[Gp::_RIGHT_TRIGGER] = (normalized(event.code, event.value) + 1.0f) / 2.0f > config_.trigger_threshold;
+    break;
+  case ABS_HAT0X:
+    state_.buttons[Gp::_D_PAD_LEFT] = event.value < 0;
+    state_.buttons[Gp::_D_PAD_RIGHT] = event.value > 0;
+    break;
+  case ABS_HAT0Y:
+    state_.buttons[Gp::_D_PAD_UP] = event.value < 0;
+    state_.buttons[Gp::_D_PAD_DOWN] = event.value > 0;
+    break;
+  default:
+    changed_ = false;
+    break;
+  }
+}
+
+void EvdevGamepad::run()
+{
+  const auto reconnect = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(config_.reconnect_s));
+  auto retry_at = std::chrono::steady_clock::now();
+  struct input_event buffer[64];
+  while (running_)
+  {
+    int timeout_ms = -1;
+    if (fd_ < 0)
+    {
+      const auto now = std::chrono::steady_clock::now();
+      if (now >= retry_at && !openDevice())
+      {
+        retry_at = now + reconnect;
+      }
+      if (fd_ < 0)
+      {
+        timeout_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(retry_at - now).count()) + 1;
+      }
+    }
+
+    struct epoll_event events[2];
+    const int count = epoll_wait(epoll_fd_, events, 2, timeout_ms);
+    for (int i = 0; i < count && running_; i++)
+    {
+      if (events[i].data.fd != fd_ || fd_ < 0)
+      {
+        continue; // stop() woke us up
+      }
+      bool lost = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+      while (!lost)
+      {
+        const ssize_t got = read(fd_, buffer, sizeof(buffer));
+        if (got <= 0)
+        {
+          lost = got == 0 || errno != EAGAIN;
+          break;
+        }
+        for (std::size_t k = 0; k < static_cast<std::size_t>(got) / sizeof(struct input_event); k++)
+        {
+          handle(buffer[k]);
+        }
+      }
+      if (lost) // Unplugged
+      {
+        closeDevice();
+        retry_at = std::chrono::steady_clock::now() + reconnect;
+      }
+    }
+  }
+  closeDevice();
+}
@@ -0,0 +1,91 @@
+#include "controller_pkg/EvdevJoyNode.hpp"
+
+#include <stdexcept>
+#include <string>
+
+EvdevJoyNode::EvdevJoyNode(const rclcpp::NodeOptions &options) : Node("evdev_joy_node", options)
+{
+  EvdevGamepad::Config config;
+  config.device = this->declare_parameter<std::string>("device", config.device);
+  config.grab = this->declare_parameter<bool>("grab", config.grab);
+  config.trigger_threshold = static_cast<float>(this->declare_parameter<double>("trigger_threshold", config.trigger_threshold));
+  repeat_period_ = std::chrono::milliseconds(this->declare_parameter<int>("repeat_ms", 50));
+
+  joy_pub_ = this->create_publisher<sensor_msgs::msg::Joy>(this->declare_parameter<std::string>("joy_topic", "/joy"), 10);
+
+  gamepad_ = std::make_unique<EvdevGamepad>(config);
+  gamepad_->onState(std::bind(&EvdevJoyNode::state_callback, this, std::placeholders::_1, std::placeholders::_2));
+  gamepad_->onConnection(std::bind(&EvdevJoyNode::connection_callback, this, std::placeholders::_1, std::placeholders::_2));
+  if (!gamepad_->start())
+  {
+    RCLCPP_FATAL(this->get_logger(), "Cannot read gamepads: %s", gamepad_->lastError().c_str());
+    throw std::runtime_error(gamepad_->lastError());
+  }
+  RCLCPP_INFO(this->get_logger(), "Waiting for gamepad '%s'", config.device.c_str());
+
+  repeat_timer_ = this->create_wall_timer(std::chrono::milliseconds(10), std::bind(&EvdevJoyNode::repeat_callback, this));
+}
+
+EvdevJoyNode::~EvdevJoyNode()
+{
+  gamepad_->stop(); // No callback may run into a half destroyed node
+}
+
+/**
+ * @brief Publishes a change of the gamepad, on the reader thread.
+ * @param state Whole gamepad
+ * @param event_ns Kernel time of the event
+ *******************************************************/
+void EvdevJoyNode::state_callback(const GamepadState &state, int64_t event_ns)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_ = state;
+  publish(event_ns);
+}
+
+/**
+ * @brief Logs the gamepad coming and going. A lost gamepad gets one neutral message, then silence,
+ *        as when the page loses its gamepad.
+ * @param connected Whether the gamepad is there
+ * @param name Device name
+ *******************************************************/
+void EvdevJoyNode::connection_callback(bool connected, const std::string &name)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  connected_ = connected;
+  if (connected)
+  {
+    RCLCPP_INFO(this->get_logger(), "Gamepad '%s' connected", name.c_str());
+    return;
+  }
+  RCLCPP_WARN(this->get_logger(), "Gamepad '%s' disconnected, stopping the robot", name.c_str());
+  state_ = GamepadState();
+  publish(this->now().nanoseconds());
+}
+
+/**
+ * @brief Repeats the state when the gamepad has been still for repeat_ms.
+ *******************************************************/
+void EvdevJoyNode::repeat_callback()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (connected_ && std::chrono::steady_clock::now() - last_publish_ >= repeat_period_)
+  {
+    publish(this->now().nanoseconds());
+  }
+}
+
+/**
+ * @brief Publishes the current state, called with mutex_ held.
+ * @param stamp_ns Time the state was read, on the system clock
+ *******************************************************/
+void EvdevJoyNode::publish(int64_t stamp_ns)
+{
+  auto joy = std::make_unique<sensor_msgs::msg::Joy>();
+  joy->header.stamp = rclcpp::Time(stamp_ns, RCL_ROS_TIME);
+  joy->header.frame_id = std::to_string(++frame_id_);
+  joy->axes.assign(state_.axes.begin(), state_.axes.end());
+  joy->buttons.assign(state_.buttons.begin(), state_.buttons.end());
+  joy_pub_->publish(std::move(joy)); // Moved to an intra-process subscriber without a copy
+  last_publish_ = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,258 @@
+#include "controller_pkg/JoyTrace.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const int64_t CAN_ECHO_WINDOW_NS = 20000000; // Frames this long after the callback returned are someone else's
+const int64_t APPLIED_ECHO_NS = 3000000;     // Echo of the frames a control tick wrote, well before the next tick
+
+uint64_t JoyTraceRing::begin(uint32_t trace_id, int64_t page_ns, int64_t published_ns, int64_t received_ns, int64_t callback_ns)
+{
+  const uint64_t sequence = next_sequence_++;
+  Slot &slot = slots_[sequence % SIZE];
+
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.trace_id.store(trace_id, std::memory_order_relaxed);
+  slot.page_ns.store(page_ns, std::memory_order_relaxed);
+  slot.published_ns.store(published_ns, std::memory_order_relaxed);
+  slot.received_ns.store(received_ns, std::memory_order_relaxed);
+  slot.callback_ns.store(callback_ns, std::memory_order_relaxed);
+  slot.commanded_ns.store(0, std::memory_order_relaxed);
+  slot.applied_ns.store(0, std::memory_order_relaxed);
+  slot.can_tx_ns.store(0, std::memory_order_relaxed);
+  slot.can_frames.store(0, std::memory_order_relaxed);
+  slot.sequence.store(sequence, std::memory_order_release);
+
+  newest_.store(sequence, std::memory_order_release);
+  return sequence;
+}
+
+void JoyTraceRing::finish(uint64_t sequence, int64_t commanded_ns)
+{
+  Slot &slot = slots_[sequence % SIZE];
+  if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+  {
+    slot.commanded_ns.store(commanded_ns, std::memory_order_release);
+  }
+}
+
+void JoyTraceRing::applied(int64_t written_ns)
+{
+  const uint64_t sequence = newest_.load(std::memory_order_acquire);
+  if (sequence == 0)
+  {
+    return;
+  }
+  Slot &slot = slots_[sequence % SIZE];
+  if (slot.sequence.load(std::memory_order_acquire) == sequence && slot.commanded_ns.load(std::memory_order_acquire) != 0 &&
+      slot.applied_ns.load(std::memory_order_relaxed) == 0) // The tick is the only writer
+  {
+    slot.applied_ns.store(written_ns, std::memory_order_release);
+  }
+}
+
+void JoyTraceRing::canFrame(int64_t tx_ns)
+{
+  const uint64_t sequence = newest_.load(std::memory_order_acquire);
+  if (sequence == 0)
+  {
+    return;
+  }
+  Slot &slot = slots_[sequence % SIZE];
+  if (slot.sequence.load(std::memory_order_acquire) != sequence || tx_ns < slot.callback_ns.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  const int64_t commanded_ns = slot.commanded_ns.load(std::memory_order_acquire);
+  if (commanded_ns != 0 && tx_ns > commanded_ns + CAN_ECHO_WINDOW_NS)
+  {
+    return;
+  }
+  const int64_t applied_ns = slot.applied_ns.load(std::memory_order_acquire);
+  if (applied_ns != 0 && tx_ns > applied_ns + APPLIED_ECHO_NS)
+  {
+    return;
+  }
+  slot.can_frames.fetch_add(1, std::memory_order_relaxed);
+  if (tx_ns > slot.can_tx_ns.load(std::memory_order_relaxed)) // The listener is the only other writer
+  {
+    slot.can_tx_ns.store(tx_ns, std::memory_order_relaxed);
+  }
+}
+
+std::size_t JoyTraceRing::drain(int64_t now_ns, int64_t settle_ns, std::vector<JoyTraceRecord> &out)
+{
+  std::size_t lost = 0;
+  const uint64_t newest = newest_.load(std::memory_order_acquire);
+  if (newest > drained_ + SIZE)
+  {
+    lost += newest - SIZE - drained_;
+    drained_ = newest - SIZE;
+  }
+
+  while (drained_ < newest)
+  {
+    const uint64_t sequence = drained_ + 1;
+    const Slot &slot = slots_[sequence % SIZE];
+    if (slot.sequence.load(std::memory_order_acquire) != sequence)
+    {
+      lost++; // Rewritten for a newer record
+      drained_ = sequence;
+      continue;
+    }
+
+    JoyTraceRecord record;
+    record.commanded_ns = slot.commanded_ns.load(std::memory_order_acquire);
+    if (record.commanded_ns == 0 || now_ns - record.commanded_ns < settle_ns)
+    {
+      break;
+    }
+    record.sequence = sequence;
+    record.trace_id = slot.trace_id.load(std::memory_order_relaxed);
+    record.page_ns = slot.page_ns.load(std::memory_order_relaxed);
+    record.published_ns = slot.published_ns.load(std::memory_order_relaxed);
+    record.received_ns = slot.received_ns.load(std::memory_order_relaxed);
+    record.callback_ns = slot.callback_ns.load(std::memory_order_relaxed);
+    record.can_tx_ns = slot.can_tx_ns.load(std::memory_order_relaxed);
+    record.can_frames = slot.can_frames.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    drained_ = sequence;
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+    {
+      lost++;
+      continue;
+    }
+    out.push_back(record);
+  }
+  return lost;
+}
+
+CanTxMonitor::CanTxMonitor(const std::string &interface, FrameHandler handler)
+    : interface_(interface), handler_(std::move(handler))
+{
+}
+
+CanTxMonitor::~CanTxMonitor()
+{
+  stop();
+}
+
+bool CanTxMonitor::start()
+{
+  fd_ = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (fd_ < 0)
+  {
+    last_error_ = std::string("socket: ") + std::strerror(errno);
+    return false;
+  }
+
+  struct ifreq ifr;
+  std::memset(&ifr, 0, sizeof(ifr));
+  std::strncpy(ifr.ifr_name, interface_.c_str(), IFNAMSIZ - 1);
+  if (ioctl(fd_, SIOCGIFINDEX, &ifr) < 0)
+  {
+    last_error_ = interface_ + ": " + std::strerror(errno);
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  // SPARK commands are extended data frames
+  struct can_filter filter;
+  filter.can_id = CAN_EFF_FLAG;
+  filter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG;
+  setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter));
+  const int on = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+
+  struct sockaddr_can addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (bind(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+  {
+    last_error_ = std::string("bind: ") + std::strerror(errno);
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  running_ = true;
+  thread_ = std::thread(&CanTxMonitor::run, this);
+  return true;
+}
+
+void CanTxMonitor::stop()
+{
+  running_ = false;
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+  if (fd_ >= 0)
+  {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void CanTxMonitor::run()
+{
+  struct can_frame frame;
+  char control[CMSG_SPACE(sizeof(struct timespec))];
+  struct iovec iov;
+  iov.iov_base = &frame;
+  iov.iov_len = sizeof(frame);
+
+  while (running_)
+  {
+    struct pollfd poll_fd = {fd_, POLLIN, 0};
+    if (poll(&poll_fd, 1, 100) <= 0) // Wakes up to notice stop()
+    {
+      continue;
+    }
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd_, &msg, 0) < static_cast<ssize_t>(sizeof(frame)))
+    {
+      continue;
+    }
+    if (!(msg.msg_flags & MSG_DONTROUTE)) // Received from the bus, not sent by this host
+    {
+      continue;
+    }
+
+    int64_t tx_ns = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+      {
+        struct timespec stamp;
+        std::memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+        tx_ns = static_cast<int64_t>(stamp.tv_sec) * 1000000000LL + stamp.tv_nsec;
+      }
+    }
+    if (tx_ns == 0)
+    {
+      tx_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::system_clock::now().time_since_epoch())
+                  .count();
+    }
+    handler_(frame.can_id & CAN_EFF_MASK, tx_ns);
+  }
+}
@@ -0,0 +1,115 @@
+#include "controller_pkg/MotionEngine.hpp"
+
+#include <cmath>
+
+void MotionEngine::start(double now_s, const Readings &readings)
+{
+  stage_ = 0;
+  stage_start_s_ = now_s;
+  tilt_offset_ = recipe_.tilt_relative ? readings.tilt : 0.0f;
+  aborted_ = false;
+}
+
+MotionEngine::Tick MotionEngine::tick(double now_s, const Readings &readings)
+{
+  Tick tick;
+  const int count = static_cast<int>(recipe_.stages.size());
+  if (aborted_)
+  {
+    tick.status = Status::ABORTED;
+    return tick;
+  }
+
+  const float misalignment = std::fabs(readings.left_lift - readings.right_lift);
+  tick.misaligned = misalignment >= recipe_.warn_above;
+
+  if (stage_ < count)
+  {
+    const MotionStage &stage = recipe_.stages[stage_];
+    if (stage.has_lift && recipe_.abort_above > 0.0f && misalignment >= recipe_.abort_above)
+    {
+      aborted_ = true;
+      tick.status = Status::ABORTED;
+      return tick;
+    }
+
+    const double elapsed_s = now_s - stage_start_s_;
+    const bool done = (!stage.until_reached || reached(stage, readings)) && elapsed_s >= stage.after_s &&
+                      (!stage.until_full || (readings.fill_known && readings.full));
+    const bool timed_out = !done && stage.timeout_s > 0.0 && elapsed_s >= stage.timeout_s;
+    if (done || timed_out)
+    {
+      tick.ended = stage_;
+      tick.ended_duration_s = elapsed_s;
+      tick.ended_timed_out = timed_out;
+      stage_++;
+      stage_start_s_ = now_s;
+    }
+  }
+
+  if (stage_ < count)
+  {
+    command(recipe_.stages[stage_], readings, tick);
+  }
+  else
+  {
+    // Stop what the recipe moved, the bucket holds its last position
+    if (recipe_.drives)
+    {
+      tick.setpoints[LEFT_DRIVE] = tick.setpoints[RIGHT_DRIVE] = {Setpoint::DUTY_CYCLE, 0.0f};
+    }
+    if (recipe_.vibrates)
+    {
+      tick.setpoints[VIBRATOR] = {Setpoint::DUTY_CYCLE, 0.0f};
+    }
+    tick.status = Status::DONE;
+  }
+  return tick;
+}
+
+/**
+ * @brief Whether the lift and tilt of a stage are at their positions.
+ *******************************************************/
+bool MotionEngine::reached(const MotionStage &stage, const Readings &readings) const
+{
+  const float tolerance = recipe_.tolerance;
+  const bool lift = !stage.has_lift || (std::fabs(stage.lift - readings.left_lift) <= tolerance &&
+                                        std::fabs(stage.lift - readings.right_lift) <= tolerance);
+  const bool tilt = !stage.has_tilt || std::fabs(stage.tilt + tilt_offset_ - readings.tilt) <= tolerance;
+  return lift && tilt;
+}
+
+/**
+ * @brief Fills in the setpoints of a running stage.
+ *******************************************************/
+void MotionEngine::command(const MotionStage &stage, const Readings &readings, Tick &tick) const
+{
+  bool realigning = false;
+  if (stage.has_lift)
+  {
+    realigning = std::fabs(readings.left_lift - readings.right_lift) >= recipe_.realign_above;
+    const float lift = realigning ? readings.right_lift : stage.lift;
+    tick.setpoints[LEFT_LIFT] = tick.setpoints[RIGHT_LIFT] = {Setpoint::POSITION, lift};
+  }
+  if (stage.has_tilt && !realigning)
+  {
+    tick.setpoints[TILT] = {Setpoint::POSITION, stage.tilt + tilt_offset_};
+  }
+  else if (stage.has_tilt_duty)
+  {
+    tick.setpoints[TILT] = {Setpoint::DUTY_CYCLE, stage.tilt_duty};
+  }
+
+  if (stage.has_drive)
+  {
+    tick.setpoints[LEFT_DRIVE] = tick.setpoints[RIGHT_DRIVE] = {Setpoint::VELOCITY, stage.drive_velocity};
+  }
+  else if (recipe_.drives)
+  {
+    tick.setpoints[LEFT_DRIVE] = tick.setpoints[RIGHT_DRIVE] = {Setpoint::DUTY_CYCLE, 0.0f};
+  }
+  if (recipe_.vibrates)
+  {
+    tick.setpoints[VIBRATOR] = {Setpoint::DUTY_CYCLE, stage.vibrator_duty};
+  }
+}
@@ -0,0 +1,204 @@
+#include "controller_pkg/MotionRecipe.hpp"
+
+#include <cmath>
+#include <initializer_list>
+#include <stdexcept>
+
+#include <yaml-cpp/yaml.h>
+
+namespace
+{
+  /**
+   * @brief Error naming where in the recipe it is.
+   *******************************************************/
+  std::runtime_error RecipeError(const std::string &source, const std::string &where, const std::string &what)
+  {
+    return std::runtime_error(source + ": " + where + ": " + what);
+  }
+
+  /**
+   * @brief Rejects keys the recipe does not know, so a misspelt key does not silently keep its default.
+   *******************************************************/
+  void CheckKeys(const YAML::Node &map, std::initializer_list<const char *> known, const std::string &source,
+                 const std::string &where)
+  {
+    if (!map.IsMap())
+    {
+      throw RecipeError(source, where, "expected a map");
+    }
+    for (const auto &entry : map)
+    {
+      const std::string key = entry.first.as<std::string>();
+      bool found = false;
+      for (const char *name : known)
+      {
+        found = found || key == name;
+      }
+      if (!found)
+      {
+        throw RecipeError(source, where, "unknown key '" + key + "'");
+      }
+    }
+  }
+
+  /**
+   * @brief Reads an optional finite number.
+   * @returns Whether the key is there
+   *******************************************************/
+  template <typename T>
+  bool ReadNumber(const YAML::Node &map, const char *key, T &value, const std::string &source, const std::string &where)
+  {
+    const YAML::Node node = map[key];
+    if (!node)
+    {
+      return false;
+    }
+    try
+    {
+      value = node.as<T>();
+    }
+    catch (const YAML::Exception &)
+    {
+      throw RecipeError(source, where + "." + key, "expected a number");
+    }
+    if (!std::isfinite(value))
+    {
+      throw RecipeError(source, where + "." + key, "expected a finite number");
+    }
+    return true;
+  }
+
+  bool ReadBool(const YAML::Node &map, const char *key, bool &value, const std::string &source, const std::string &where)
+  {
+    const YAML::Node node = map[key];
+    if (!node)
+    {
+      return false;
+    }
+    try
+    {
+      value = node.as<bool>();
+    }
+    catch (const YAML::Exception &)
+    {
+      throw RecipeError(source, where + "." + key, "expected true or false");
+    }
+    return true;
+  }
+
+  /**
+   * @brief Reads and checks one entry of stages.
+   *******************************************************/
+  MotionStage ReadStage(const YAML::Node &node, const std::string &source, const std::string &where)
+  {
+    CheckKeys(node, {"name", "lift", "tilt", "tilt_duty", "drive_velocity", "vibrator_duty", "exit", "timeout_s"},
+              source, where);
+    MotionStage stage;
+    stage.name = node["name"] ? node["name"].as<std::string>() : where;
+    const std::string at = node["name"] ? where + " (" + stage.name + ")" : where;
+
+    stage.has_lift = ReadNumber(node, "lift", stage.lift, source, at);
+    stage.has_tilt = ReadNumber(node, "tilt", stage.tilt, source, at);
+    stage.has_tilt_duty = ReadNumber(node, "tilt_duty", stage.tilt_duty, source, at);
+    stage.has_drive = ReadNumber(node, "drive_velocity", stage.drive_velocity, source, at);
+    ReadNumber(node, "vibrator_duty", stage.vibrator_duty, source, at);
+    ReadNumber(node, "timeout_s", stage.timeout_s, source, at);
+
+    if (node["exit"])
+    {
+      const YAML::Node exit = node["exit"];
+      CheckKeys(exit, {"reached", "after_s", "full"}, source, at + ".exit");
+      ReadBool(exit, "reached", stage.until_reached, source, at + ".exit");
+      ReadNumber(exit, "after_s", stage.after_s, source, at + ".exit");
+      ReadBool(exit, "full", stage.until_full, source, at + ".exit");
+    }
+
+    if (stage.has_tilt && stage.has_tilt_duty)
+    {
+      throw RecipeError(source, at, "tilt and tilt_duty both set");
+    }
+    if (std::fabs(stage.tilt_duty) > 1.0f || std::fabs(stage.vibrator_duty) > 1.0f)
+    {
+      throw RecipeError(source, at, "duty cycles go from -1 to 1");
+    }
+    if (stage.after_s < 0.0 || stage.timeout_s < 0.0)
+    {
+      throw RecipeError(source, at, "negative time");
+    }
+    if (stage.until_reached && !stage.has_lift && !stage.has_tilt)
+    {
+      throw RecipeError(source, at, "exit.reached without a lift or tilt position");
+    }
+    if (stage.until_full && stage.timeout_s <= 0.0)
+    {
+      throw RecipeError(source, at, "exit.full needs a timeout_s, the bucket may never fill");
+    }
+    if (!stage.until_reached && !stage.until_full && stage.after_s <= 0.0 && stage.timeout_s <= 0.0)
+    {
+      throw RecipeError(source, at, "no exit condition or timeout");
+    }
+    return stage;
+  }
+
+  /**
+   * @brief Reads and checks a whole recipe.
+   *******************************************************/
+  MotionRecipe ReadRecipe(const YAML::Node &root, const std::string &source)
+  {
+    CheckKeys(root, {"name", "tolerance", "realign_above", "warn_above", "abort_above", "tilt_relative", "stages"},
+              source, "recipe");
+    MotionRecipe recipe;
+    recipe.source = source;
+    recipe.name = root["name"] ? root["name"].as<std::string>() : source;
+    ReadNumber(root, "tolerance", recipe.tolerance, source, "recipe");
+    ReadNumber(root, "realign_above", recipe.realign_above, source, "recipe");
+    ReadNumber(root, "warn_above", recipe.warn_above, source, "recipe");
+    ReadNumber(root, "abort_above", recipe.abort_above, source, "recipe");
+    ReadBool(root, "tilt_relative", recipe.tilt_relative, source, "recipe");
+    if (recipe.tolerance <= 0.0f || recipe.realign_above <= 0.0f)
+    {
+      throw RecipeError(source, "recipe", "tolerance and realign_above must be above 0");
+    }
+
+    const YAML::Node stages = root["stages"];
+    if (!stages || !stages.IsSequence() || stages.size() == 0)
+    {
+      throw RecipeError(source, "recipe.stages", "expected a list of stages");
+    }
+    for (std::size_t i = 0; i < stages.size(); i++)
+    {
+      recipe.stages.push_back(ReadStage(stages[i], source, "stages[" + std::to_string(i) + "]"));
+      recipe.drives = recipe.drives || recipe.stages.back().has_drive;
+      recipe.vibrates = recipe.vibrates || recipe.stages.back().vibrator_duty != 0.0f;
+    }
+    return recipe;
+  }
+}
+
+MotionRecipe MotionRecipe::load(const std::string &path)
+{
+  YAML::Node root;
+  try
+  {
+    root = YAML::LoadFile(path);
+  }
+  catch (const YAML::Exception &ex)
+  {
+    throw std::runtime_error(path + ": " + ex.what());
+  }
+  return ReadRecipe(root, path);
+}
+
+MotionRecipe MotionRecipe::parse(const std::string &yaml, const std::string &source)
+{
+  YAML::Node root;
+  try
+  {
+    root = YAML::Load(yaml);
+  }
+  catch (const YAML::Exception &ex)
+  {
+    throw std::runtime_error(source + ": " + ex.what());
+  }
+  return ReadRecipe(root, source);
+}
@@ -0,0 +1,105 @@
+#include "controller_pkg/MuxedSparkMax.hpp"
+
+MotorCommandSource::MotorCommandSource(const std::string &source, std::chrono::milliseconds lease)
+    : source_(source), lease_(lease)
+{
+}
+
+MotorCommandSource::~MotorCommandSource()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  wake_.notify_all();
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+/**
+ * @brief Creates the publisher and starts the renewal thread.
+ * @param node Node the source publishes from
+ *******************************************************/
+void MotorCommandSource::attach(rclcpp::Node &node)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  publisher_ = node.create_publisher<interfaces_pkg::msg::MotorCommand>("/motor_commands", 10);
+  if (!running_)
+  {
+    running_ = true;
+    thread_ = std::thread(&MotorCommandSource::renew, this);
+  }
+}
+
+/**
+ * @brief Keeps one setpoint and publishes it if it changed, renew() keeps it alive.
+ * @param can_id Device
+ * @param mode MotorCommand mode
+ * @param value Setpoint in the unit of the mode
+ *******************************************************/
+void MotorCommandSource::send(uint8_t can_id, uint8_t mode, float value)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto held = held_.find(can_id);
+  if (held != held_.end() && held->second.first == mode && held->second.second == value)
+  {
+    return;
+  }
+  held_[can_id] = {mode, value};
+  publish({{can_id, {mode, value}}}, static_cast<uint32_t>(lease_.count()));
+}
+
+/**
+ * @brief Releases every device this source holds.
+ *******************************************************/
+void MotorCommandSource::release()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  publish(held_, 0);
+  held_.clear();
+}
+
+/**
+ * @brief Publishes setpoints, called with mutex_ held. Dropped before attach().
+ * @param setpoints CAN id -> mode, value
+ * @param lease_ms Lease of the setpoints, 0 releases the devices
+ *******************************************************/
+void MotorCommandSource::publish(const std::map<uint8_t, std::pair<uint8_t, float>> &setpoints, uint32_t lease_ms)
+{
+  if (!publisher_ || setpoints.empty())
+  {
+    return;
+  }
+  interfaces_pkg::msg::MotorCommand msg;
+  msg.source = source_;
+  msg.lease_ms = lease_ms;
+  for (const auto &setpoint : setpoints)
+  {
+    msg.can_ids.push_back(setpoint.first);
+    msg.modes.push_back(setpoint.second.first);
+    msg.values.push_back(setpoint.second.second);
+  }
+  try
+  {
+    publisher_->publish(msg);
+  }
+  catch (const std::exception &)
+  {
+    // The context was shut down while the node exits, the lease ends the setpoints
+  }
+}
+
+/**
+ * @brief Sends the held setpoints again every quarter lease, until the source is destroyed.
+ *******************************************************/
+void MotorCommandSource::renew()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_)
+  {
+    publish(held_, static_cast<uint32_t>(lease_.count()));
+    wake_.wait_for(lock, lease_ / 4, [this] { return !running_; });
+  }
+}
@@ -0,0 +1,161 @@
+#include "controller_pkg/RecipeRunner.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+#include "ament_index_cpp/get_package_share_directory.hpp"
+
+namespace
+{
+  int64_t SteadyNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+}
+
+/**
+ * @brief Subscribes to /bucket_fill in a callback group of its own.
+ * @param node Node the runner's service runs in
+ *******************************************************/
+void RecipeRunner::attach(rclcpp::Node &node)
+{
+  node_ = &node;
+  fill_group_ = node.create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  rclcpp::SubscriptionOptions options;
+  options.callback_group = fill_group_;
+  fill_subscriber_ = node.create_subscription<interfaces_pkg::msg::BucketFill>(
+      "/bucket_fill", 10,
+      [this](const interfaces_pkg::msg::BucketFill::SharedPtr msg)
+      {
+        if (msg->calibrated)
+        {
+          full_.store(msg->full, std::memory_order_relaxed);
+          fill_received_ns_.store(SteadyNs(), std::memory_order_release);
+        }
+      },
+      options);
+}
+
+/**
+ * @brief Reads the recipe, runs it tick by tick and logs the time of every stage.
+ * @param path Recipe file
+ * @returns false if the recipe could not be read or was aborted
+ *******************************************************/
+bool RecipeRunner::run(const std::string &path)
+{
+  MotionRecipe recipe;
+  try
+  {
+    recipe = MotionRecipe::load(path);
+  }
+  catch (const std::runtime_error &ex)
+  {
+    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Cannot run recipe: %s", ex.what());
+    return false;
+  }
+
+  MotionEngine engine(recipe);
+  const auto start = std::chrono::steady_clock::now();
+  auto seconds = [&start]()
+  { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+  engine.start(seconds(), read());
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Starting %s from %s, tilt offset %f", recipe.name.c_str(), path.c_str(),
+              engine.tiltOffset());
+
+  std::array<MotionEngine::Setpoint, MotionEngine::DEVICE_COUNT> sent{};
+  std::string summary;
+  MotionEngine::Tick tick;
+  do
+  {
+    tick = engine.tick(seconds(), read());
+    if (tick.ended >= 0)
+    {
+      const MotionStage &stage = recipe.stages[tick.ended];
+      RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "%s %-10s %6.2f s%s", recipe.name.c_str(), stage.name.c_str(),
+                  tick.ended_duration_s, tick.ended_timed_out ? ", timed out" : "");
+      char entry[64];
+      std::snprintf(entry, sizeof(entry), "%s%s %.2f%s", summary.empty() ? "" : ", ", stage.name.c_str(),
+                    tick.ended_duration_s, tick.ended_timed_out ? " (timed out)" : "");
+      summary += entry;
+    }
+    if (tick.misaligned && node_)
+    {
+      RCLCPP_WARN_THROTTLE(rclcpp::get_logger("rclcpp"), *node_->get_clock(), 1000, "WARNING: ACTUATORS GREATELY MISALIGNED");
+    }
+
+    // The mux keeps renewing a setpoint, so only changes go out
+    for (int device = 0; device < MotionEngine::DEVICE_COUNT; device++)
+    {
+      const MotionEngine::Setpoint &setpoint = tick.setpoints[device];
+      if (setpoint.mode == MotionEngine::Setpoint::NONE || !devices_[device] || setpoint == sent[device])
+      {
+        continue;
+      }
+      switch (setpoint.mode)
+      {
+      case MotionEngine::Setpoint::DUTY_CYCLE:
+        devices_[device]->SetDutyCycle(setpoint.value);
+        break;
+      case MotionEngine::Setpoint::VELOCITY:
+        devices_[device]->SetVelocity(setpoint.value);
+        break;
+      default:
+        devices_[device]->SetPosition(setpoint.value);
+        break;
+      }
+      sent[device] = setpoint;
+    }
+
+    if (tick.status == MotionEngine::Status::RUNNING)
+    {
+      std::this_thread::sleep_for(TICK);
+    }
+  } while (tick.status == MotionEngine::Status::RUNNING && rclcpp::ok());
+
+  commands_.release(); //Lets teleop or the next autonomy node have the motors
+  if (tick.status == MotionEngine::Status::ABORTED)
+  {
+    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "%s aborted in stage %s, lift sides more than %.2f apart",
+                 recipe.name.c_str(), recipe.stages[engine.stage()].name.c_str(), recipe.abort_above);
+    return false;
+  }
+  if (tick.status == MotionEngine::Status::RUNNING)
+  {
+    RCLCPP_WARN(rclcpp::get_logger("rclcpp"), "%s stopped by shutdown", recipe.name.c_str());
+    return false;
+  }
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "%s done in %.2f s: %s", recipe.name.c_str(), seconds(), summary.c_str());
+  return true;
+}
+
+/**
+ * @brief Positions of the lift and tilt, and whether a recent /bucket_fill reports a full bucket.
+ *******************************************************/
+MotionEngine::Readings RecipeRunner::read() const
+{
+  MotionEngine::Readings readings;
+  readings.left_lift = devices_[MotionEngine::LEFT_LIFT]->GetPosition();
+  readings.right_lift = devices_[MotionEngine::RIGHT_LIFT]->GetPosition();
+  readings.tilt = devices_[MotionEngine::TILT]->GetPosition();
+  const int64_t received_ns = fill_received_ns_.load(std::memory_order_acquire);
+  readings.fill_known = received_ns != 0 && SteadyNs() - received_ns < FILL_STALE_NS;
+  readings.full = full_.load(std::memory_order_relaxed);
+  return readings;
+}
+
+/**
+ * @brief Path of a recipe in controller_pkg's share directory.
+ * @param file Name in recipes/
+ *******************************************************/
+std::string InstalledRecipe(const std::string &file)
+{
+  try
+  {
+    return ament_index_cpp::get_package_share_directory("controller_pkg") + "/recipes/" + file;
+  }
+  catch (const std::exception &)
+  {
+    return "recipes/" + file; // Not installed, run from the package directory
+  }
+}
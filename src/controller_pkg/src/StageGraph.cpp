@@ -0,0 +1,101 @@
+#include "controller_pkg/StageGraph.hpp"
+
+#include <utility>
+
+int StageGraph::add(const std::string &name, uint32_t resources, const std::vector<int> &after, Step step, double timeout_s)
+{
+  Stage stage;
+  stage.name = name;
+  stage.resources = resources;
+  stage.step = std::move(step);
+  stage.timeout_s = timeout_s;
+  const int index = static_cast<int>(stages_.size());
+  for (int dependency : after)
+  {
+    if (dependency >= 0 && dependency < index) // Later stages cannot be waited for, the graph stays acyclic
+    {
+      stage.after.push_back(dependency);
+    }
+  }
+  stage.timing.stage = index;
+  stage.timing.name = name;
+  stages_.push_back(std::move(stage));
+  return index;
+}
+
+std::vector<StageGraph::Timing> StageGraph::tick(double now_s)
+{
+  std::vector<Timing> ended;
+
+  uint32_t busy = 0;
+  for (std::size_t i = first_open_; i < stages_.size(); i++)
+  {
+    if (stages_[i].state == State::RUNNING)
+    {
+      busy |= stages_[i].resources;
+    }
+  }
+
+  // Start what can start, in order, without passing a stage waiting for the same resource
+  uint32_t wanted = 0;
+  for (std::size_t i = first_open_; i < stages_.size(); i++)
+  {
+    Stage &stage = stages_[i];
+    if (stage.state != State::WAITING)
+    {
+      continue;
+    }
+    if (!stage.ready)
+    {
+      bool ready = true;
+      for (int dependency : stage.after)
+      {
+        ready = ready && stages_[dependency].state == State::FINISHED;
+      }
+      if (!ready)
+      {
+        continue;
+      }
+      stage.ready = true;
+      stage.timing.ready_s = now_s;
+    }
+    if (stage.resources & (busy | wanted))
+    {
+      wanted |= stage.resources;
+      continue;
+    }
+    stage.state = State::RUNNING;
+    stage.timing.start_s = now_s;
+    busy |= stage.resources;
+  }
+
+  for (std::size_t i = first_open_; i < stages_.size(); i++)
+  {
+    Stage &stage = stages_[i];
+    if (stage.state != State::RUNNING)
+    {
+      continue;
+    }
+    const bool done = stage.step(!stage.stepped);
+    stage.stepped = true;
+    const bool timed_out = !done && stage.timeout_s > 0.0 && now_s - stage.timing.start_s >= stage.timeout_s;
+    if (done || timed_out)
+    {
+      stage.state = State::FINISHED;
+      stage.timing.end_s = now_s;
+      stage.timing.timed_out = timed_out;
+      ended.push_back(stage.timing);
+    }
+  }
+
+  while (first_open_ < stages_.size() && stages_[first_open_].state == State::FINISHED)
+  {
+    first_open_++;
+  }
+  return ended;
+}
+
+bool StageGraph::idle() const
+{
+  return first_open_ == stages_.size();
+}
@@ -1,7 +1,15 @@
 #include "SparkMax.hpp"
+#include "controller_pkg/CommandMux.hpp"
+#include "controller_pkg/EvdevJoyNode.hpp"
+#include "controller_pkg/Gamepad.hpp"
+#include "controller_pkg/JoyTrace.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/joy.hpp"
 #include "std_msgs/msg/string.hpp"
+#include "interfaces_pkg/msg/callback_duration.hpp"
+#include "interfaces_pkg/msg/command_mux_status.hpp"
+#include "interfaces_pkg/msg/joy_trace.hpp"
+#include "interfaces_pkg/msg/motor_command.hpp"
 #include "interfaces_pkg/msg/motor_health.hpp"
 #include "interfaces_pkg/srv/depositing_request.hpp"
 #include "interfaces_pkg/srv/excavation_request.hpp"
@@ -9,9 +17,18 @@
 #include <string>
 #include <cstdlib>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 const float VELOCITY_MAX = 2500.0;  // rpm, after gearbox turns into 11.1 RPM
 const float VIBRATOR_OUTPUT = 1.0f; // Constant value for vibrator output
+const int64_t TRACE_SETTLE_NS = 100000000; // Time the CAN echoes of a callback get before its trace is published
+const int AUTONOMY_DISPATCH_MS = 20;       // How often the autonomy callback group looks for button presses to act on
+const int MUX_STATUS_PERIOD_MS = 100;      // command_mux is published this often
 
 enum CAN_IDs
 {
@@ -23,33 +40,21 @@ enum CAN_IDs
   VIBRATOR = 6
 };
 
-namespace Gp
+// Autonomy work asked for by joy_callback and done in the autonomy callback group, as bits of pending_autonomy_
+enum AutonomyRequest : unsigned
 {
-  enum Buttons
-  {
-    _A = 0,             // Excavation Autonomy
-    _B = 1,             // Stop Automation
-    _X = 2,             // Excavation Reset
-    _Y = 3,             // Deposit Autonomy
-    _LEFT_BUMPER = 4,   // Alternate between control modes
-    _RIGHT_BUMPER = 5,  // Vibration Toggle
-    _LEFT_TRIGGER = 6,  // Safety Trigger
-    _RIGHT_TRIGGER = 7, // Safety Trigger
-    _WINDOW_KEY = 8,    // Button 8 /** I do not know what else to call this key */
-    _D_PAD_UP = 12,     // Lift Actuator UP
-    _D_PAD_DOWN = 13,   // Lift Actuator DOWN
-    _D_PAD_LEFT = 14,   // Tilt Actuator Up   /** CHECK THESE */
-    _D_PAD_RIGHT = 15,  // Tilt Actuator Down /** CHECK THESE */
-    _X_BOX_KEY = 16
-  };
-
-  enum Axes
-  {
-    _LEFT_HORIZONTAL_STICK = 0,
-    _LEFT_VERTICAL_STICK = 1,
-    _RIGHT_HORIZONTAL_STICK = 2,
-    _RIGHT_VERTICAL_STICK = 3,
-  };
+  CANCEL_AUTONOMY = 1u << 0,
+  DEPOSIT = 1u << 1,
+  EXCAVATE = 1u << 2,
+  FULL_CYCLE = 1u << 3
+};
+
+/**
+ * @brief System clock in ns, the clock of the DDS and SocketCAN timestamps.
+ */
+static int64_t system_now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
 class ControllerNode : public rclcpp::Node
@@ -62,10 +67,11 @@ public:
    *        joy_topic, health_subscriber, depositing client, excavation client, heartbeat pub, and a timer to publisher heatbeat.
    * @param can_interface The interface used by the operating system to communicate
    *                      on the Controller Area Network, listed under 'ip link list' (i.e., can0)
+   * @param options Node options, intra-process communication when the gamepad is read in this process
    * @returns None
    */
-  ControllerNode(const std::string &can_interface)
-      : Node("controller_node"),
+  ControllerNode(const std::string &can_interface, const rclcpp::NodeOptions &options = rclcpp::NodeOptions())
+      : Node("controller_node", options),
         leftMotor(can_interface, LEFT_MOTOR),
         rightMotor(can_interface, RIGHT_MOTOR),
         leftLift(can_interface, LEFT_LIFT),
@@ -154,22 +160,94 @@ public:
     vibrator.BurnFlash();
     RCLCPP_INFO(this->get_logger(), "Motor Controllers Initialized");
 
+    // ---COMMAND MUX--- //
+    // This node alone writes setpoints to the SPARKs: teleop and the autonomy nodes (on motor_commands)
+    // hand theirs to the mux, and a control tick in its own callback group sends one command per device.
+    RCLCPP_INFO(this->get_logger(), "Initializing Command Mux");
+    const auto sources = this->declare_parameter<std::vector<std::string>>(
+        "mux_sources", {"teleop", "excavation", "depositing", "odometry"});
+    const auto priorities = this->declare_parameter<std::vector<int64_t>>("mux_priorities", {100, 50, 50, 50});
+    const int control_period_ms = this->declare_parameter<int>("control_period_ms", 10); // Keep under the 20 ms CAN echo window of the joy traces
+    teleop_lease_ns_ = this->declare_parameter<int>("teleop_lease_ms", 250) * 1000000LL;
+    if (sources.size() != priorities.size())
+    {
+      throw std::invalid_argument("mux_sources and mux_priorities differ in length");
+    }
+    for (std::size_t i = 0; i < sources.size(); i++)
+    {
+      if (mux_.addSource(sources[i], static_cast<int>(priorities[i])) < 0)
+      {
+        throw std::invalid_argument("More than " + std::to_string(CommandMux::MAX_SOURCES) + " mux_sources");
+      }
+    }
+    teleop_source_ = mux_.sourceIndex("teleop");
+    if (teleop_source_ < 0)
+    {
+      throw std::invalid_argument("mux_sources must list teleop");
+    }
+    motors_ = {&leftMotor, &rightMotor, &leftLift, &rightLift, &tilt, &vibrator};
+    status_every_ticks_ = std::max(1, MUX_STATUS_PERIOD_MS / std::max(1, control_period_ms));
+
+    motor_command_subscriber_ = this->create_subscription<interfaces_pkg::msg::MotorCommand>(
+        "/motor_commands", 50,
+        std::bind(&ControllerNode::motor_command_callback, this, std::placeholders::_1));
+    mux_status_pub_ = this->create_publisher<interfaces_pkg::msg::CommandMuxStatus>("command_mux", 10);
+    control_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+    control_timer_ = this->create_wall_timer(
+        std::chrono::milliseconds(std::max(1, control_period_ms)),
+        std::bind(&ControllerNode::control_tick, this), control_group_);
+    RCLCPP_INFO(this->get_logger(), "Command Mux Initialized");
+
     // ---ROS SUBSCRIPTIONS--- //
     RCLCPP_INFO(this->get_logger(), "Initializing Joy Subscription");
     joy_subscriber_ = this->create_subscription<sensor_msgs::msg::Joy>(
         "/joy", 10,
-        std::bind(&ControllerNode::joy_callback, this, std::placeholders::_1));
+        std::bind(&ControllerNode::joy_trace_callback, this, std::placeholders::_1, std::placeholders::_2));
     RCLCPP_INFO(this->get_logger(), "Joy Subscription Initialized");
 
+    // ---JOY TRACING--- //
+    // Every Joy message is followed to the CAN bus, joy_latency_report shows where the time goes
+    can_monitor_ = std::make_unique<CanTxMonitor>(can_interface, [this](uint32_t can_id, int64_t tx_ns)
+                                                  {
+      if (is_motor_command(can_id)) {
+        trace_ring_.canFrame(tx_ns);
+      } });
+    if (!can_monitor_->start())
+    {
+      RCLCPP_WARN(this->get_logger(), "Joy traces without CAN transmit times: %s", can_monitor_->lastError().c_str());
+    }
+    trace_pub_ = this->create_publisher<interfaces_pkg::msg::JoyTrace>("joy_trace", 50);
+    trace_timer_ = this->create_wall_timer(
+        std::chrono::milliseconds(500),
+        std::bind(&ControllerNode::publish_joy_traces, this));
+
     health_subscriber_ = this->create_subscription<interfaces_pkg::msg::MotorHealth>(
         "/health_topic", 10,
         std::bind(&ControllerNode::position_callback, this, std::placeholders::_1));
 
+    // ---AUTONOMY--- //
+    // Requests, their responses and the process restarts run in their own callback group, so that
+    // joy_callback never waits for a service. Availability follows the ROS graph instead of being polled.
     RCLCPP_INFO(this->get_logger(), "Initializing depositing, excavation, and travel client");
-    depositing_client_ = (this->create_client<interfaces_pkg::srv::DepositingRequest>("depositing_service"));
-    excavation_client_ = (this->create_client<interfaces_pkg::srv::ExcavationRequest>("excavation_service"));
+    autonomy_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+    match_time_s_ = this->declare_parameter<double>("match_time_s", 600.0); // Counted from when this node starts
+    match_start_ = std::chrono::steady_clock::now();
+    depositing_client_ = this->create_client<interfaces_pkg::srv::DepositingRequest>(
+        "depositing_service", rmw_qos_profile_services_default, autonomy_group_);
+    excavation_client_ = this->create_client<interfaces_pkg::srv::ExcavationRequest>(
+        "excavation_service", rmw_qos_profile_services_default, autonomy_group_);
+    graph_event_ = this->get_graph_event();
+    update_service_availability();
+    autonomy_timer_ = this->create_wall_timer(
+        std::chrono::milliseconds(AUTONOMY_DISPATCH_MS),
+        std::bind(&ControllerNode::autonomy_callback, this), autonomy_group_);
     RCLCPP_INFO(this->get_logger(), "Excavation, depositing clients initialized");
 
+    duration_pub_ = this->create_publisher<interfaces_pkg::msg::CallbackDuration>("joy_callback_duration", 10);
+    duration_timer_ = this->create_wall_timer(
+        std::chrono::milliseconds(1000),
+        std::bind(&ControllerNode::publish_callback_duration, this));
+
     RCLCPP_INFO(this->get_logger(), "Initializing Heartbeat Publisher");
     heartbeatPub = this->create_publisher<std_msgs::msg::String>("/heartbeat", 10);
     RCLCPP_INFO(this->get_logger(), "Heartbeat Publisher Initialized");
@@ -199,6 +277,50 @@ private:
   rclcpp::Publisher<std_msgs::msg::String>::SharedPtr heartbeatPub;
   rclcpp::TimerBase::SharedPtr timer;
 
+  // Command mux, the control tick is the only writer to the SPARKs
+  CommandMux mux_;
+  int teleop_source_ = -1;
+  int64_t teleop_lease_ns_ = 0;
+  std::array<SparkMax *, CommandMux::DEVICE_COUNT> motors_{};
+  rclcpp::Subscription<interfaces_pkg::msg::MotorCommand>::SharedPtr motor_command_subscriber_;
+  rclcpp::Publisher<interfaces_pkg::msg::CommandMuxStatus>::SharedPtr mux_status_pub_;
+  rclcpp::CallbackGroup::SharedPtr control_group_;
+  rclcpp::TimerBase::SharedPtr control_timer_;
+  std::atomic<uint32_t> rejected_commands_{0};
+
+  // Control tick only
+  std::array<int, CommandMux::DEVICE_COUNT> owners_{-1, -1, -1, -1, -1, -1};
+  std::array<int64_t, CommandMux::DEVICE_COUNT> applied_received_ns_{};
+  int status_every_ticks_ = 10;
+  uint32_t ticks_ = 0;
+  int64_t decide_max_ns_ = 0;
+  std::vector<double> arbitration_ms_;
+
+  // Autonomy requests, written by joy_callback and taken by autonomy_callback
+  rclcpp::CallbackGroup::SharedPtr autonomy_group_;
+  rclcpp::TimerBase::SharedPtr autonomy_timer_;
+  rclcpp::Event::SharedPtr graph_event_;
+  std::atomic<unsigned> pending_autonomy_{0};
+  double match_time_s_ = 600.0;
+  std::chrono::steady_clock::time_point match_start_; // A full cycle gets the time left from here
+  std::atomic<bool> depositing_available_{false};
+  std::atomic<bool> excavation_available_{false};
+
+  // Time spent in joy_callback, published on joy_callback_duration
+  rclcpp::Publisher<interfaces_pkg::msg::CallbackDuration>::SharedPtr duration_pub_;
+  rclcpp::TimerBase::SharedPtr duration_timer_;
+  uint32_t joy_calls_ = 0;
+  int64_t joy_total_ns_ = 0;
+  int64_t joy_max_ns_ = 0;
+  int64_t joy_max_since_start_ns_ = 0;
+
+  // Joy tracing, the monitor is declared after the ring it writes to so it stops first
+  JoyTraceRing trace_ring_;
+  std::unique_ptr<CanTxMonitor> can_monitor_;
+  std::vector<JoyTraceRecord> trace_records_;
+  rclcpp::Publisher<interfaces_pkg::msg::JoyTrace>::SharedPtr trace_pub_;
+  rclcpp::TimerBase::SharedPtr trace_timer_;
+
   // Autonomy flag
   bool is_autonomy_active_ = false;
 
@@ -239,13 +361,252 @@ private:
   }
 
   /**
-   * @brief Sends request to depositing node and manages response
+   * @brief Hands a teleop setpoint to the command mux, held for teleop_lease_ms.
+   * @param device CAN id of the SPARK
+   * @param mode Control mode of the setpoint
+   * @param value Setpoint in the unit of the mode
+   * @returns None
+   */
+  void teleop(CAN_IDs device, CommandMux::Mode mode, float value)
+  {
+    mux_.submit(teleop_source_, device - 1, mode, value, system_now_ns(), teleop_lease_ns_);
+  }
+
+  /**
+   * @brief Hands the setpoints of an autonomy node to the command mux.
+   * @param command Setpoints of one source, from motor_commands
+   * @returns None
+   */
+  void motor_command_callback(const interfaces_pkg::msg::MotorCommand::SharedPtr command)
+  {
+    const int source = mux_.sourceIndex(command->source);
+    if (source < 0 || source == teleop_source_ || command->modes.size() != command->can_ids.size() ||
+        command->values.size() != command->can_ids.size())
+    {
+      rejected_commands_ += std::max<uint32_t>(1, command->can_ids.size());
+      RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                           "Rejected motor commands from '%s', not a mux source or malformed", command->source.c_str());
+      return;
+    }
+    const int64_t now_ns = system_now_ns();
+    for (std::size_t i = 0; i < command->can_ids.size(); i++)
+    {
+      const uint8_t can_id = command->can_ids[i];
+      if (can_id < 1 || can_id > CommandMux::DEVICE_COUNT || command->modes[i] > interfaces_pkg::msg::MotorCommand::POSITION ||
+          !valid_setpoint(command->modes[i], command->values[i]))
+      { // A setpoint the SPARK would throw on is never handed to the mux
+        rejected_commands_++;
+        continue;
+      }
+      mux_.submit(source, can_id - 1, static_cast<CommandMux::Mode>(command->modes[i]), command->values[i], now_ns,
+                  command->lease_ms * 1000000LL);
+    }
+  }
+
+  /**
+   * @brief Whether a SPARK accepts the setpoint: finite, and a duty cycle in [-1, 1].
+   * @param mode MotorCommand mode
+   * @param value Setpoint in the unit of the mode
+   * @returns true if the setpoint can be sent
+   */
+  static bool valid_setpoint(uint8_t mode, float value)
+  {
+    if (!std::isfinite(value))
+    {
+      return false;
+    }
+    return mode != interfaces_pkg::msg::MotorCommand::DUTY_CYCLE || std::fabs(value) <= 1.0f;
+  }
+
+  /**
+   * @brief One control tick: the mux decides every device and its command goes on the bus,
+   *        the neutral command for a device nobody holds.
+   * @param None
+   * @returns None
+   */
+  void control_tick()
+  {
+    const int64_t start_ns = system_now_ns();
+    const auto &decisions = mux_.decide(start_ns);
+    decide_max_ns_ = std::max(decide_max_ns_, system_now_ns() - start_ns);
+
+    for (std::size_t device = 0; device < CommandMux::DEVICE_COUNT; device++)
+    {
+      // A failing device must not keep the others, and their neutral commands, off the bus
+      const CommandMux::Decision &decision = decisions[device];
+      try
+      {
+        switch (decision.mode)
+        {
+        case CommandMux::Mode::DUTY_CYCLE:
+          motors_[device]->SetDutyCycle(decision.value);
+          break;
+        case CommandMux::Mode::VELOCITY:
+          motors_[device]->SetVelocity(decision.value);
+          break;
+        case CommandMux::Mode::POSITION:
+          motors_[device]->SetPosition(decision.value);
+          break;
+        }
+      }
+      catch (const std::exception &ex)
+      {
+        RCLCPP_ERROR_THROTTLE(this->get_logger(), *this->get_clock(), 1000, "Error sending CAN command to SPARK %zu: %s",
+                              device + 1, ex.what());
+      }
+    }
+    const int64_t written_ns = system_now_ns();
+
+    bool teleop_applied = false;
+    for (std::size_t device = 0; device < CommandMux::DEVICE_COUNT; device++)
+    {
+      const CommandMux::Decision &decision = decisions[device];
+      if (decision.owner >= 0 && decision.received_ns != applied_received_ns_[device])
+      { // A new setpoint, renewals and resends keep the received_ns of the first one (CommandMux::submit)
+        arbitration_ms_.push_back((written_ns - decision.received_ns) / 1e6);
+        applied_received_ns_[device] = decision.received_ns;
+      }
+      // The first tick after a joy message applies it even when it repeats the last setpoints
+      teleop_applied = teleop_applied || decision.owner == teleop_source_;
+      if (decision.owner != owners_[device])
+      {
+        RCLCPP_INFO(this->get_logger(), "SPARK %zu: %s -> %s", device + 1,
+                    owners_[device] < 0 ? "neutral" : mux_.sourceName(owners_[device]).c_str(),
+                    decision.owner < 0 ? "neutral" : mux_.sourceName(decision.owner).c_str());
+        owners_[device] = decision.owner;
+      }
+    }
+
+    if (teleop_applied)
+    {
+      trace_ring_.applied(written_ns); // The joy trace ends with this tick's frames
+    }
+
+    if (++ticks_ >= static_cast<uint32_t>(status_every_ticks_))
+    {
+      publish_mux_status(decisions);
+    }
+  }
+
+  /**
+   * @brief Publishes the owner and command of every device and the arbitration times since the last status.
+   * @param decisions Commands of the last tick
+   * @returns None
+   */
+  void publish_mux_status(const std::array<CommandMux::Decision, CommandMux::DEVICE_COUNT> &decisions)
+  {
+    interfaces_pkg::msg::CommandMuxStatus msg;
+    msg.header.stamp = this->now();
+    for (std::size_t device = 0; device < CommandMux::DEVICE_COUNT; device++)
+    {
+      msg.can_ids.push_back(static_cast<uint8_t>(device + 1));
+      msg.owners.push_back(decisions[device].owner < 0 ? "" : mux_.sourceName(decisions[device].owner));
+      msg.modes.push_back(static_cast<uint8_t>(decisions[device].mode));
+      msg.values.push_back(decisions[device].value);
+    }
+    msg.ticks = ticks_;
+    msg.decide_max_us = static_cast<float>(decide_max_ns_ / 1e3);
+    if (!arbitration_ms_.empty())
+    {
+      std::sort(arbitration_ms_.begin(), arbitration_ms_.end());
+      msg.latency_p50_ms = static_cast<float>(arbitration_ms_[arbitration_ms_.size() / 2]);
+      msg.latency_max_ms = static_cast<float>(arbitration_ms_.back());
+    }
+    msg.rejected = rejected_commands_.exchange(0);
+    mux_status_pub_->publish(msg);
+
+    ticks_ = 0;
+    decide_max_ns_ = 0;
+    arbitration_ms_.clear();
+  }
+
+  /**
+   * @brief Caches whether the autonomy services have a server, so the joystick path can tell
+   *        without asking the middleware. Called at start and whenever the ROS graph changes.
+   * @param None
+   * @returns None
+   */
+  void update_service_availability()
+  {
+    const bool depositing = depositing_client_->service_is_ready();
+    const bool excavation = excavation_client_->service_is_ready();
+    if (depositing_available_.exchange(depositing) != depositing)
+    {
+      RCLCPP_INFO(this->get_logger(), "depositing_service %s", depositing ? "available" : "gone");
+    }
+    if (excavation_available_.exchange(excavation) != excavation)
+    {
+      RCLCPP_INFO(this->get_logger(), "excavation_service %s", excavation ? "available" : "gone");
+    }
+  }
+
+  /**
+   * @brief Asks joy_callback's autonomy work to be done in the autonomy callback group.
+   * @param request An AutonomyRequest
+   * @returns None
+   */
+  void request_autonomy(AutonomyRequest request)
+  {
+    pending_autonomy_.fetch_or(request);
+  }
+
+  /**
+   * @brief Runs in the autonomy callback group: follows the graph and does the work joy_callback
+   *        asked for. Restarting the autonomy nodes takes seconds, the joystick keeps working meanwhile.
+   * @param None
+   * @returns None
+   */
+  void autonomy_callback()
+  {
+    if (graph_event_->check_and_clear())
+    {
+      update_service_availability();
+    }
+    const unsigned pending = pending_autonomy_.exchange(0);
+    if (pending & CANCEL_AUTONOMY)
+    {
+      std::system("pkill -9 -f depositing_node");
+      std::system("pkill -9 -f excavation_node");
+      std::system("pkill -9 -f odometry_node");
+      // std::system("pkill -9 -f navigation_node");
+
+      std::this_thread::sleep_for(std::chrono::seconds(2)); // Allows time for the nodes to restarted
+
+      std::system("ros2 run controller_pkg excavation_node &");
+      std::system("ros2 run controller_pkg depositing_node &");
+      pending_autonomy_.store(0); // Requests made during the restart are void
+      return;
+    }
+    if (pending & DEPOSIT)
+    {
+      send_deposit_request();
+    }
+    if (pending & EXCAVATE)
+    {
+      send_excavation_request();
+    }
+    if (pending & FULL_CYCLE)
+    {
+      const double remaining_s = match_time_s_ - std::chrono::duration<double>(std::chrono::steady_clock::now() - match_start_).count();
+      if (remaining_s <= 0.0)
+      {
+        RCLCPP_WARN(this->get_logger(), "Full cycle not launched, the %.0f s match is over", match_time_s_);
+        return;
+      }
+      RCLCPP_INFO(this->get_logger(), "Full cycle launched with %.0f s left", remaining_s);
+      const std::string command = "ros2 run controller_pkg odometry_node --ros-args -p match_time_s:=" + std::to_string(remaining_s) + " &";
+      std::system(command.c_str());
+    }
+  }
+
+  /**
+   * @brief Sends request to depositing node and manages response, in the autonomy callback group
    * @param None
    * @returns None
    */
   void send_deposit_request()
   {
-    if (!depositing_client_ || !depositing_client_->wait_for_service(std::chrono::seconds(1)))
+    if (!depositing_client_->service_is_ready())
     {
       RCLCPP_ERROR(this->get_logger(), "Service not available");
       return;
@@ -263,13 +624,13 @@ private:
   }
 
   /**
-   * @brief Sends request to excavation node and manages node response
+   * @brief Sends request to excavation node and manages node response, in the autonomy callback group
    * @param None
    * @returns None
    */
   void send_excavation_request()
   {
-    if (!excavation_client_ || !excavation_client_->wait_for_service(std::chrono::seconds(1)))
+    if (!excavation_client_->service_is_ready())
     {
       RCLCPP_ERROR(this->get_logger(), "Service not available");
       return;
@@ -297,15 +658,127 @@ private:
     right_lift_position = health_msg->right_lift_position;
   }
 
+  /**
+   * @brief Whether a frame sent on the bus carries a SPARK setpoint (duty cycle, velocity, position...).
+   * @param can_id Extended CAN id, the low 6 bits are the device id
+   * @returns true for the MotorControl commands
+   */
+  static bool is_motor_command(uint32_t can_id)
+  {
+    switch (static_cast<MotorControl>(can_id & ~0x3Fu))
+    {
+    case MotorControl::Setpoint:
+    case MotorControl::DutyCycle:
+    case MotorControl::Velocity:
+    case MotorControl::SmartVelocity:
+    case MotorControl::Position:
+    case MotorControl::Voltage:
+    case MotorControl::Current:
+    case MotorControl::SmartMotion:
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Records the times of a Joy message around joy_callback: the page's stamp and trace id
+   *        from its header, the DDS publication and reception times, and when the callback ran.
+   *        Also keeps the callback's duration for joy_callback_duration.
+   * @param joy_msg A subscription pointer to a joy interface topic.
+   * @param info DDS timestamps of the message
+   * @returns None
+   */
+  void joy_trace_callback(const sensor_msgs::msg::Joy::SharedPtr joy_msg, const rclcpp::MessageInfo &info)
+  {
+    const rmw_message_info_t &rmw_info = info.get_rmw_message_info();
+    const int64_t start_ns = system_now_ns();
+    const uint64_t sequence = trace_ring_.begin(
+        static_cast<uint32_t>(std::strtoul(joy_msg->header.frame_id.c_str(), nullptr, 10)),
+        rclcpp::Time(joy_msg->header.stamp).nanoseconds(),
+        rmw_info.source_timestamp,
+        rmw_info.received_timestamp,
+        start_ns);
+    try
+    {
+      joy_callback(joy_msg);
+    }
+    catch (...)
+    {
+      trace_ring_.finish(sequence, system_now_ns());
+      throw;
+    }
+    const int64_t end_ns = system_now_ns();
+    trace_ring_.finish(sequence, end_ns);
+
+    joy_calls_++;
+    joy_total_ns_ += end_ns - start_ns;
+    joy_max_ns_ = std::max(joy_max_ns_, end_ns - start_ns);
+  }
+
+  /**
+   * @brief Publishes how long joy_callback took over the last second and its worst call since start.
+   * @param None
+   * @returns None
+   */
+  void publish_callback_duration()
+  {
+    joy_max_since_start_ns_ = std::max(joy_max_since_start_ns_, joy_max_ns_);
+    interfaces_pkg::msg::CallbackDuration msg;
+    msg.header.stamp = this->now();
+    msg.callback = "joy_callback";
+    msg.calls = joy_calls_;
+    msg.mean_ms = joy_calls_ > 0 ? static_cast<float>(joy_total_ns_ / 1e6 / joy_calls_) : 0.0f;
+    msg.max_ms = static_cast<float>(joy_max_ns_ / 1e6);
+    msg.max_since_start_ms = static_cast<float>(joy_max_since_start_ns_ / 1e6);
+    duration_pub_->publish(msg);
+    joy_calls_ = 0;
+    joy_total_ns_ = 0;
+    joy_max_ns_ = 0;
+  }
+
+  /**
+   * @brief Publishes the Joy traces whose CAN frames had time to be echoed, while someone listens.
+   * @param None
+   * @returns None
+   */
+  void publish_joy_traces()
+  {
+    trace_records_.clear();
+    const std::size_t lost = trace_ring_.drain(system_now_ns(), TRACE_SETTLE_NS, trace_records_);
+    if (lost > 0)
+    {
+      RCLCPP_WARN(this->get_logger(), "%zu Joy traces overwritten before they were published", lost);
+    }
+    if (trace_pub_->get_subscription_count() == 0)
+    {
+      return;
+    }
+    for (const JoyTraceRecord &record : trace_records_)
+    {
+      interfaces_pkg::msg::JoyTrace msg;
+      msg.sequence = record.sequence;
+      msg.trace_id = record.trace_id;
+      msg.page_ns = record.page_ns;
+      msg.published_ns = record.published_ns;
+      msg.received_ns = record.received_ns;
+      msg.callback_ns = record.callback_ns;
+      msg.commanded_ns = record.commanded_ns;
+      msg.can_tx_ns = record.can_tx_ns;
+      msg.can_frames = record.can_frames;
+      trace_pub_->publish(msg);
+    }
+  }
+
   /**
    * @brief Manual control callback for the robot. This subscriber callback handles all
-   *        control requests received from the joy interface.
+   *        control requests received from the joy interface. Motor setpoints go to the
+   *        command mux as teleop, which outranks the autonomy nodes while a trigger is held.
    * @param joy_msg A subscription pointer to a joy interface topic.
    * @returns None
    */
   void joy_callback(const sensor_msgs::msg::Joy::SharedPtr joy_msg)
   {
-    if (joy_msg->axes.size() < 2 || joy_msg->buttons.size() < 17)
+    if (joy_msg->axes.size() < 2 || joy_msg->buttons.size() < Gp::BUTTON_COUNT)
     {
       RCLCPP_WARN(this->get_logger(), "Insufficient axes/buttons in Joy message");
       return;
@@ -329,27 +802,15 @@ private:
     // CANCEL AUTONOMY (B Button)
     if (joy_msg->buttons[Gp::Buttons::_B] > 0)
     {
-      std::system("pkill -9 -f depositing_node");
-      std::system("pkill -9 -f excavation_node");
-      std::system("pkill -9 -f odometry_node");
-      // std::system("pkill -9 -f navigation_node");
-
-      std::this_thread::sleep_for(std::chrono::seconds(2)); // Allows time for the nodes to restarted
-
-      std::system("ros2 run controller_pkg excavation_node &");
-      std::system("ros2 run controller_pkg depositing_node &");
+      request_autonomy(CANCEL_AUTONOMY); // Restarted in the autonomy callback group
     }
 
     // SAFETY LOCK (Right or left trigger)
     bool triggersPressed = (joy_msg->buttons[Gp::Buttons::_LEFT_TRIGGER] > 0 || joy_msg->buttons[Gp::Buttons::_RIGHT_TRIGGER] > 0);
 
     if (!triggersPressed)
-    {
-      leftMotor.SetDutyCycle(0.0f);
-      rightMotor.SetDutyCycle(0.0f);
-      leftLift.SetDutyCycle(0.0f);
-      rightLift.SetDutyCycle(0.0f);
-      tilt.SetDutyCycle(0.0f);
+    { // Teleop lets go of the motors: an autonomy node keeps them, otherwise the mux stops them
+      mux_.releaseAll(teleop_source_);
       return;
     }
 
@@ -364,14 +825,14 @@ private:
     prev_vibrator_button_ = current_vibrator_button;
     float vibrator_duty = vibrator_active_ ? VIBRATOR_OUTPUT : 0.0f;
 
-    vibrator.SetDutyCycle(vibrator_duty);
+    teleop(VIBRATOR, CommandMux::Mode::DUTY_CYCLE, vibrator_duty);
 
     // EXCAVATION RESET BUTTON (X button)
     if (joy_msg->buttons[Gp::Buttons::_X] > 0)
     {
-      leftLift.SetPosition(0.0f);
-      rightLift.SetPosition(0.0f);
-      tilt.SetDutyCycle(1.0f);
+      teleop(LEFT_LIFT, CommandMux::Mode::POSITION, 0.0f);
+      teleop(RIGHT_LIFT, CommandMux::Mode::POSITION, 0.0f);
+      teleop(TILT, CommandMux::Mode::DUTY_CYCLE, 1.0f);
     }
     else
     {
@@ -385,7 +846,7 @@ private:
       {
         tilt_duty = -1.0f;
       }
-      tilt.SetDutyCycle(tilt_duty);
+      teleop(TILT, CommandMux::Mode::DUTY_CYCLE, tilt_duty);
 
       // LIFT ACTUATOR (D pad up and down)
       float lift_duty = 0.0f;
@@ -399,13 +860,13 @@ private:
       }
       if (fabs(left_lift_position - right_lift_position) >= 0.2)
       {
-        leftLift.SetPosition(left_lift_position);
-        rightLift.SetPosition(left_lift_position);
+        teleop(LEFT_LIFT, CommandMux::Mode::POSITION, left_lift_position);
+        teleop(RIGHT_LIFT, CommandMux::Mode::POSITION, left_lift_position);
       } // Lift correction
       else
       {
-        leftLift.SetDutyCycle(lift_duty);
-        rightLift.SetDutyCycle(lift_duty);
+        teleop(LEFT_LIFT, CommandMux::Mode::DUTY_CYCLE, lift_duty);
+        teleop(RIGHT_LIFT, CommandMux::Mode::DUTY_CYCLE, lift_duty);
       }
     }
 
@@ -438,8 +899,8 @@ private:
       left_drive = computeStepOutput(left_drive_raw);
       right_drive = computeStepOutput(right_drive_raw);
 
-      leftMotor.SetDutyCycle(left_drive);
-      rightMotor.SetDutyCycle(right_drive);
+      teleop(LEFT_MOTOR, CommandMux::Mode::DUTY_CYCLE, left_drive);
+      teleop(RIGHT_MOTOR, CommandMux::Mode::DUTY_CYCLE, right_drive);
     }
 
     else
@@ -464,13 +925,13 @@ private:
 
       if (fabs(joy_msg->axes[Gp::Axes::_LEFT_VERTICAL_STICK]) > 0 || fabs(joy_msg->axes[Gp::Axes::_LEFT_HORIZONTAL_STICK]) > 0)
       {
-        leftMotor.SetVelocity(left_drive);
-        rightMotor.SetVelocity(right_drive);
+        teleop(LEFT_MOTOR, CommandMux::Mode::VELOCITY, left_drive);
+        teleop(RIGHT_MOTOR, CommandMux::Mode::VELOCITY, right_drive);
       }
       else
       {
-        leftMotor.SetVelocity(1500 * left_drive_slow);
-        rightMotor.SetVelocity(1500 * right_drive_slow);
+        teleop(LEFT_MOTOR, CommandMux::Mode::VELOCITY, 1500 * left_drive_slow);
+        teleop(RIGHT_MOTOR, CommandMux::Mode::VELOCITY, 1500 * right_drive_slow);
       }
     }
     //----------DRIVETRAIN----------//
@@ -481,7 +942,14 @@ private:
     static bool prev_deposit_button = false;
     if (current_deposit_button && !prev_deposit_button)
     {
-      send_deposit_request();
+      if (depositing_available_)
+      {
+        request_autonomy(DEPOSIT);
+      }
+      else
+      {
+        RCLCPP_ERROR(this->get_logger(), "Service not available");
+      }
     }
     prev_deposit_button = current_deposit_button;
 
@@ -490,7 +958,14 @@ private:
     static bool prev_excavate_button = false;
     if (current_excavate_button && !prev_excavate_button)
     {
-      send_excavation_request();
+      if (excavation_available_)
+      {
+        request_autonomy(EXCAVATE);
+      }
+      else
+      {
+        RCLCPP_ERROR(this->get_logger(), "Service not available");
+      }
     }
     prev_excavate_button = current_excavate_button;
 
@@ -498,8 +973,7 @@ private:
     static bool prev_cycle_button = false;
     if (current_cycle_button && !prev_cycle_button)
     {
-      RCLCPP_INFO(this->get_logger(), "Full cycle launched");
-      std::system("ros2 run controller_pkg odometry_node &");
+      request_autonomy(FULL_CYCLE);
     }
     prev_cycle_button = current_cycle_button;
 
@@ -535,8 +1009,30 @@ int main(int argc, char **argv)
   auto temp_node = rclcpp::Node::make_shared("controller_param_node");
   temp_node->declare_parameter<std::string>("can_interface", "can0");
   temp_node->get_parameter("can_interface", can_interface);
-  auto node = std::make_shared<ControllerNode>(can_interface);
-  rclcpp::spin(node);
+  std::string joy_device = "";
+  temp_node->declare_parameter<std::string>("joy_device", "");
+  temp_node->get_parameter("joy_device", joy_device);
+
+  if (joy_device.empty())
+  {
+    // joy_callback and the autonomy requests run on separate threads
+    auto node = std::make_shared<ControllerNode>(can_interface);
+    rclcpp::executors::MultiThreadedExecutor executor;
+    executor.add_node(node);
+    executor.spin();
+  }
+  else
+  {
+    // Local pilot station: the gamepad is read in this process and /joy is delivered intra-process
+    rclcpp::NodeOptions options;
+    options.use_intra_process_comms(true);
+    auto node = std::make_shared<ControllerNode>(can_interface, options);
+    auto joy_node = std::make_shared<EvdevJoyNode>(rclcpp::NodeOptions(options).append_parameter_override("device", joy_device));
+    rclcpp::executors::MultiThreadedExecutor executor;
+    executor.add_node(node);
+    executor.add_node(joy_node);
+    executor.spin();
+  }
   rclcpp::shutdown();
   return 0;
 }
@@ -1,66 +1,22 @@
-#include "SparkMax.hpp"
+#include "controller_pkg/RecipeRunner.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "interfaces_pkg/srv/depositing_request.hpp"
-#include "std_msgs/msg/bool.hpp"
 
-const float VIBRATOR_DUTY = 1.0f;
-const float ERROR = 0.1;
-
-SparkMax leftLift("can0", 3);
-SparkMax rightLift("can0", 4);
-SparkMax tilt("can0", 5);
-SparkMax vibrator("can0", 6);
+MotorCommandSource commands("depositing"); //Setpoints go through controller_node's command mux
+MuxedSparkMax leftLift(commands, "can0", 3);
+MuxedSparkMax rightLift(commands, "can0", 4);
+MuxedSparkMax tilt(commands, "can0", 5);
+MuxedSparkMax vibrator(commands, "can0", 6);
 //Initalizes motor controllers
 
-
-/**
- * @brief Move the bucket to a setpoint and activate as specified by the parameters. 
- * @param lift_setpoint Setpoint for the lift actuators expressed as a float
- * @param tilt_setpoint Setpoint for the tilt actuators expressed as a float
- * @param activate_vibrator Should the vibrator be set on? (true == yes)
- * @returns None
- */
-void MoveBucket (float lift_setpoint, float tilt_setpoint, bool activate_vibrator) {
-    auto timer_start = std::chrono::high_resolution_clock::now();
-    bool leftLiftReached = (fabs(lift_setpoint - leftLift.GetPosition() ) <=  ERROR);
-    bool rightLiftReached = (fabs(lift_setpoint - rightLift.GetPosition() ) <=  ERROR);
-    bool tiltReached = (fabs(tilt_setpoint - tilt.GetPosition() ) <=  ERROR);
-
-    while (!((leftLiftReached && rightLiftReached) && tiltReached)){
-        std::this_thread::sleep_for(std::chrono::milliseconds(5)); //prevents CAN buffer from overflowing
-        if (fabs(leftLift.GetPosition() - rightLift.GetPosition()) >= 0.2){
-            if (fabs(leftLift.GetPosition() - rightLift.GetPosition()) >= 0.75){
-                RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "WARNING: ACTUATORS GREATELY MISALIGNEDT");
-                rclcpp::shutdown();
-            }
-            leftLift.SetPosition(rightLift.GetPosition());
-            rightLift.SetPosition(rightLift.GetPosition());
-
-        } //block for lift realignment
-        else {
-            leftLift.SetPosition(lift_setpoint);
-            rightLift.SetPosition(lift_setpoint);
-            tilt.SetPosition(tilt_setpoint);
-        } //block for normal bucket movement
-
-        if (activate_vibrator) vibrator.SetDutyCycle(VIBRATOR_DUTY);
-
-        if (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - timer_start).count() > 5) {
-            RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "ERROR: Depositing Cancelled");
-            break;
-        } //Timer for when to quit a stage due to timeout
-
-        leftLiftReached = (fabs(lift_setpoint - leftLift.GetPosition() ) <=  ERROR);
-        rightLiftReached = (fabs(lift_setpoint - rightLift.GetPosition() ) <=  ERROR);
-        tiltReached = (fabs(tilt_setpoint - tilt.GetPosition() ) <=  ERROR); //Updates statuses
-    }
-}
+RecipeRunner runner(commands, {nullptr, nullptr, &leftLift, &rightLift, &tilt, &vibrator}); //No drivetrain
+std::string recipe; //Read again on every request, see recipes/deposit.yaml
 
 
 //Fix depositing to be under the bar
 /**
- * @brief Begins autonomous depositing cycle. If request is TRUE, a cycle is begun with a 20 second 
- *        duration used to shake material out of the bucket. Afterwards, resets bucket.
+ * @brief Begins autonomous depositing cycle. If request is TRUE, the depositing recipe raises and tilts the
+ *        bucket, shakes material out of it and resets it.
  * @param request interfaces_pkg::srv::DepositingRequest::Request is the request from the client node (controller_node)
  * @param response interfaces_pkg::srv::DepositingRequest::Response is the response to the client node
  * @returns None
@@ -74,39 +30,30 @@ void Deposit(const std::shared_ptr<interfaces_pkg::srv::DepositingRequest::Reque
         } //Checks to make sure start_depositing is set to true
 
         RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Starting depositing process");
-
-        MoveBucket(3.2, 2.0, false); //Moves bucket up, tilts bucket
-        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Stage 1 complete");
-
-        auto jiggleout_start = std::chrono::high_resolution_clock::now();
-        while (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - jiggleout_start).count() < 20) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(5)); //prevents CAN buffer from overflowing
-            vibrator.SetDutyCycle(VIBRATOR_DUTY);
-        } //Vibrates sand out of bucket
-
-        vibrator.SetDutyCycle(0.0f); //ensures vibrator turns off
-        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Stage 2 complete, resetting bucket");
-
-        MoveBucket(0.0, 0.0, false); //Resets bucket
-        auto reset_tilt = std::chrono::high_resolution_clock::now();
-        while (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - reset_tilt).count() < 1){
-            tilt.SetDutyCycle(1.0f);
-            std::this_thread::sleep_for(std::chrono::milliseconds(5)); //prevents CAN buffer from overflowing
-        }
-        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Bucket successfully reset");
-        response->depositing_successful = true;
+        response->depositing_successful = runner.run(recipe);
 }
 
 int main(int argc, char **argv) {
     rclcpp::init(argc, argv);
 
     std::shared_ptr<rclcpp::Node> node = rclcpp::Node::make_shared("depositing_node");
+    recipe = node->declare_parameter<std::string>("recipe", InstalledRecipe("deposit.yaml"));
+    commands.attach(*node);
+    runner.attach(*node);
+
+    try {
+        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Recipe %s has %zu stages", recipe.c_str(), MotionRecipe::load(recipe).stages.size());
+    } catch (const std::runtime_error &ex) {
+        RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "%s, depositing requests fail until it is fixed", ex.what());
+    } //Reports a broken recipe at startup rather than at the first request
 
     rclcpp::Service<interfaces_pkg::srv::DepositingRequest>::SharedPtr service =
     node->create_service<interfaces_pkg::srv::DepositingRequest>("depositing_service", &Deposit);
 
     RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Depositing Initalized");
 
-    rclcpp::spin(node);
+    rclcpp::executors::MultiThreadedExecutor executor; //Lets /bucket_fill in while a request runs
+    executor.add_node(node);
+    executor.spin();
     rclcpp::shutdown();
 }
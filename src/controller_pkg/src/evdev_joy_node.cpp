@@ -0,0 +1,9 @@
+#include "controller_pkg/EvdevJoyNode.hpp"
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+  rclcpp::spin(std::make_shared<EvdevJoyNode>());
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,225 @@
+// Creates a virtual gamepad with uinput, checks that EvdevGamepad grabs and maps it like the pilot
+// page's gamepad, then times how long a stick movement takes from the write to the kernel until the
+// state callback. No ROS needed; run as root or with write access to /dev/uinput.
+//
+// usage: evdev_latency_benchmark [events]
+
+#include "controller_pkg/EvdevGamepad.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+const char *DEVICE_NAME = "neptune-uinput-gamepad";
+
+int64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void emit(int fd, int type, int code, int value)
+{
+  struct input_event event;
+  std::memset(&event, 0, sizeof(event));
+  event.type = static_cast<uint16_t>(type);
+  event.code = static_cast<uint16_t>(code);
+  event.value = value;
+  if (write(fd, &event, sizeof(event)) != sizeof(event))
+  {
+    std::perror("uinput write");
+  }
+}
+
+void abs_setup(int fd, int code, int minimum, int maximum)
+{
+  struct uinput_abs_setup setup;
+  std::memset(&setup, 0, sizeof(setup));
+  setup.code = static_cast<uint16_t>(code);
+  setup.absinfo.minimum = minimum;
+  setup.absinfo.maximum = maximum;
+  ioctl(fd, UI_SET_ABSBIT, code);
+  ioctl(fd, UI_ABS_SETUP, &setup);
+}
+
+/**
+ * @brief An Xbox-like pad as xpad presents it: 11 buttons, two sticks, analog triggers and a hat.
+ */
+int create_gamepad()
+{
+  const int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+  if (fd < 0)
+  {
+    std::perror("/dev/uinput");
+    return -1;
+  }
+  ioctl(fd, UI_SET_EVBIT, EV_KEY);
+  for (int key : {BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST, BTN_TL, BTN_TR, BTN_SELECT, BTN_START, BTN_MODE, BTN_THUMBL, BTN_THUMBR})
+  {
+    ioctl(fd, UI_SET_KEYBIT, key);
+  }
+  ioctl(fd, UI_SET_EVBIT, EV_ABS);
+  for (int axis : {ABS_X, ABS_Y, ABS_RX, ABS_RY})
+  {
+    abs_setup(fd, axis, -32768, 32767);
+  }
+  abs_setup(fd, ABS_Z, 0, 1023);
+  abs_setup(fd, ABS_RZ, 0, 1023);
+  abs_setup(fd, ABS_HAT0X, -1, 1);
+  abs_setup(fd, ABS_HAT0Y, -1, 1);
+
+  struct uinput_setup setup;
+  std::memset(&setup, 0, sizeof(setup));
+  setup.id.bustype = BUS_VIRTUAL;
+  setup.id.vendor = 0x045e;
+  setup.id.product = 0x028e;
+  std::strncpy(setup.name, DEVICE_NAME, UINPUT_MAX_NAME_SIZE - 1);
+  if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0)
+  {
+    std::perror("uinput device");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+double percentile(const std::vector<double> &sorted, double fraction)
+{
+  return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(fraction * sorted.size()))];
+}
+
+void print_row(const char *name, std::vector<double> &us)
+{
+  std::sort(us.begin(), us.end());
+  std::printf("%-26s %8.1f %8.1f %8.1f %8.1f  us\n", name, percentile(us, 0.5), percentile(us, 0.95),
+              percentile(us, 0.99), us.back());
+}
+
+int main(int argc, char **argv)
+{
+  const int events = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+  const int uinput = create_gamepad();
+  if (uinput < 0)
+  {
+    return 2;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(300)); // udev creates the event node
+
+  std::atomic<int> connected{0};
+  std::atomic<int64_t> callback_ns{0};
+  std::atomic<int64_t> event_ns{0};
+  std::atomic<int> reports{0};
+  GamepadState last; // Read by this thread only after reports moved
+
+  EvdevGamepad::Config config;
+  config.device = DEVICE_NAME;
+  EvdevGamepad gamepad(config);
+  gamepad.onConnection([&](bool on, const std::string &) { connected = on ? 1 : 0; });
+  gamepad.onState([&](const GamepadState &state, int64_t stamp_ns)
+                  {
+    last = state;
+    event_ns.store(stamp_ns);
+    callback_ns.store(now_ns());
+    reports.fetch_add(1, std::memory_order_release); });
+  if (!gamepad.start())
+  {
+    std::fprintf(stderr, "%s\n", gamepad.lastError().c_str());
+    return 2;
+  }
+  for (int i = 0; i < 200 && !connected; i++)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (!connected)
+  {
+    std::fprintf(stderr, "EvdevGamepad did not find %s\n", DEVICE_NAME);
+    return 2;
+  }
+
+  int failures = 0;
+  auto check = [&](bool ok, const char *what)
+  {
+    std::printf("%-44s %s\n", what, ok ? "ok" : "FAILED");
+    failures += ok ? 0 : 1;
+  };
+
+  // Nobody else may read the pad while it drives the robot
+  const std::string path = EvdevGamepad::findDevice(DEVICE_NAME);
+  const int other = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+  check(other >= 0 && ioctl(other, EVIOCGRAB, 1) < 0, "grabbed, a second reader cannot grab it");
+  if (other >= 0)
+  {
+    close(other);
+  }
+
+  // One change and its report, waiting for the callback
+  auto send = [&](std::initializer_list<std::array<int, 3>> changes)
+  {
+    const int before = reports.load(std::memory_order_acquire);
+    for (const auto &change : changes)
+    {
+      emit(uinput, change[0], change[1], change[2]);
+    }
+    emit(uinput, EV_SYN, SYN_REPORT, 0);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while (reports.load(std::memory_order_acquire) == before && std::chrono::steady_clock::now() < deadline)
+    {
+    }
+    return reports.load(std::memory_order_acquire) != before;
+  };
+
+  check(send({{EV_KEY, BTN_SOUTH, 1}, {EV_KEY, BTN_NORTH, 1}}) && last.buttons[Gp::_A] && last.buttons[Gp::_X],
+        "A and X buttons");
+  check(send({{EV_KEY, BTN_SOUTH, 0}, {EV_KEY, BTN_NORTH, 0}, {EV_KEY, BTN_SELECT, 1}}) && !last.buttons[Gp::_A] &&
+            last.buttons[Gp::_WINDOW_KEY],
+        "release, select is the window key");
+  check(send({{EV_ABS, ABS_Z, 1023}, {EV_ABS, ABS_RZ, 50}}) && last.buttons[Gp::_LEFT_TRIGGER] &&
+            !last.buttons[Gp::_RIGHT_TRIGGER],
+        "analog triggers are the safety buttons");
+  check(send({{EV_ABS, ABS_HAT0Y, -1}, {EV_ABS, ABS_HAT0X, 1}}) && last.buttons[Gp::_D_PAD_UP] &&
+            last.buttons[Gp::_D_PAD_RIGHT] && !last.buttons[Gp::_D_PAD_DOWN],
+        "hat is the d-pad");
+  check(send({{EV_ABS, ABS_Y, -32768}, {EV_ABS, ABS_RX, 32767}}) && last.axes[Gp::_LEFT_VERTICAL_STICK] < -0.99f &&
+            last.axes[Gp::_RIGHT_HORIZONTAL_STICK] > 0.99f,
+        "sticks in [-1, 1], up is negative");
+
+  // Latency of stick movements, one at a time like a pilot
+  std::vector<double> write_to_callback;
+  std::vector<double> event_to_callback;
+  for (int i = 0; i < events; i++)
+  {
+    const int value = (i % 2 == 0 ? 1 : -1) * (1000 + (i % 30000));
+    const int64_t written = now_ns();
+    if (!send({{EV_ABS, ABS_X, value}}))
+    {
+      failures++;
+      continue;
+    }
+    write_to_callback.push_back((callback_ns.load() - written) / 1e3);
+    event_to_callback.push_back((callback_ns.load() - event_ns.load()) / 1e3);
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+
+  gamepad.stop();
+  ioctl(uinput, UI_DEV_DESTROY);
+  close(uinput);
+
+  if (!write_to_callback.empty())
+  {
+    std::printf("\n%zu stick movements\n%-26s %8s %8s %8s %8s\n", write_to_callback.size(), "", "p50", "p95", "p99", "max");
+    print_row("uinput write -> callback", write_to_callback);
+    print_row("kernel event -> callback", event_to_callback);
+    std::printf("\nCompare with the pilot page: joy_latency_report's \"page -> callback\" hop.\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+// Listens to controller_node's joy_trace for a while and prints where the time goes between the
+// pilot page's gamepad and the CAN bus, hop by hop.
+//
+// usage: ros2 run controller_pkg joy_latency_report [seconds]
+
+#include "rclcpp/rclcpp.hpp"
+#include "interfaces_pkg/msg/joy_trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+const double BUCKET_EDGES_MS[] = {1, 2, 5, 10, 20, 50, 100, 200, 500}; // The last bucket is unbounded
+
+struct Hop
+{
+  const char *name;
+  int64_t interfaces_pkg::msg::JoyTrace::*from;
+  int64_t interfaces_pkg::msg::JoyTrace::*to;
+  bool page_clock; // Spans the browser and robot clocks
+  std::vector<double> ms;
+};
+
+double percentile(const std::vector<double> &sorted, double fraction)
+{
+  const std::size_t index = std::min(sorted.size() - 1, static_cast<std::size_t>(fraction * sorted.size()));
+  return sorted[index];
+}
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+  const double seconds = argc > 1 ? std::atof(argv[1]) : 30.0;
+
+  using Trace = interfaces_pkg::msg::JoyTrace;
+  std::vector<Hop> hops = {
+      {"page -> published", &Trace::page_ns, &Trace::published_ns, true, {}},
+      {"published -> received", &Trace::published_ns, &Trace::received_ns, false, {}},
+      {"received -> callback", &Trace::received_ns, &Trace::callback_ns, false, {}},
+      {"page -> callback", &Trace::page_ns, &Trace::callback_ns, true, {}},
+      {"callback -> commanded", &Trace::callback_ns, &Trace::commanded_ns, false, {}},
+      {"callback -> CAN TX", &Trace::callback_ns, &Trace::can_tx_ns, false, {}},
+      {"published -> CAN TX", &Trace::published_ns, &Trace::can_tx_ns, false, {}},
+      {"page -> CAN TX", &Trace::page_ns, &Trace::can_tx_ns, true, {}}};
+
+  std::size_t traces = 0;
+  std::size_t lost = 0;       // Gaps in the page's frame ids: lost between the page and the controller
+  std::size_t without_can = 0;
+  bool have_previous = false;
+  uint32_t previous_id = 0;
+
+  auto node = rclcpp::Node::make_shared("joy_latency_report");
+  auto subscription = node->create_subscription<Trace>(
+      "joy_trace", 100, [&](const Trace::SharedPtr trace)
+      {
+        traces++;
+        if (have_previous && trace->trace_id > previous_id)
+        {
+          lost += trace->trace_id - previous_id - 1; // The page restarts its count on reconnect
+        }
+        have_previous = true;
+        previous_id = trace->trace_id;
+        if (trace->can_frames == 0)
+        {
+          without_can++;
+        }
+        for (Hop &hop : hops)
+        {
+          const int64_t from = (*trace).*hop.from;
+          const int64_t to = (*trace).*hop.to;
+          if (from != 0 && to != 0)
+          {
+            hop.ms.push_back((to - from) / 1e6);
+          }
+        } });
+
+  std::printf("Listening to joy_trace for %.0f s, drive with the pilot page...\n", seconds);
+  const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+  while (rclcpp::ok() && std::chrono::steady_clock::now() < end)
+  {
+    rclcpp::spin_some(node);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+
+  std::printf("\n%zu Joy messages, %zu lost before the controller, %zu without a motor command on the bus\n\n",
+              traces, lost, without_can);
+  std::printf("%-24s %6s %8s %8s %8s %8s  ms\n", "hop", "n", "p50", "p95", "p99", "max");
+  for (Hop &hop : hops)
+  {
+    if (hop.ms.empty())
+    {
+      std::printf("%-24s %6d %8s\n", hop.name, 0, "-");
+      continue;
+    }
+    std::sort(hop.ms.begin(), hop.ms.end());
+    std::printf("%-24s %6zu %8.2f %8.2f %8.2f %8.2f%s\n", hop.name, hop.ms.size(), percentile(hop.ms, 0.5),
+                percentile(hop.ms, 0.95), percentile(hop.ms, 0.99), hop.ms.back(), hop.page_clock ? "  *" : "");
+  }
+  std::printf("\n* from the browser clock, only meaningful with the laptop and the robot synced (chrony or NTP).\n"
+              "  With evdev_joy_node it is the kernel time of the gamepad event, on the robot's clock; in the\n"
+              "  controller's process (joy_device) /joy is delivered intra-process and has no DDS timestamps.\n");
+
+  // Distribution of the part the robot controls, from the gamepad event for intra-process /joy
+  const Hop &shown = !hops[6].ms.empty() ? hops[6] : hops[7];
+  const std::vector<double> &robot = shown.ms;
+  if (!robot.empty())
+  {
+    std::printf("\n%s\n", shown.name);
+    std::size_t first = 0;
+    for (std::size_t bucket = 0; bucket <= sizeof(BUCKET_EDGES_MS) / sizeof(double); bucket++)
+    {
+      const bool last = bucket == sizeof(BUCKET_EDGES_MS) / sizeof(double);
+      const std::size_t end_index = last ? robot.size()
+                                         : std::lower_bound(robot.begin(), robot.end(), BUCKET_EDGES_MS[bucket]) - robot.begin();
+      const std::size_t count = end_index - first;
+      const std::string label = last ? ">= " + std::to_string(static_cast<int>(BUCKET_EDGES_MS[bucket - 1]))
+                                     : "< " + std::to_string(static_cast<int>(BUCKET_EDGES_MS[bucket]));
+      std::printf("  %7s ms %6zu %s\n", label.c_str(), count, std::string(60 * count / robot.size(), '#').c_str());
+      first = end_index;
+    }
+  }
+
+  rclcpp::shutdown();
+  return 0;
+}
@@ -1,161 +1,295 @@
-#include "SparkMax.hpp"
+#include "controller_pkg/MuxedSparkMax.hpp"
+#include "controller_pkg/StageGraph.hpp"
 #include "rclcpp/rclcpp.hpp"
+#include "interfaces_pkg/msg/bucket_fill.hpp"
 #include "interfaces_pkg/msg/motor_health.hpp"
 #include "std_msgs/msg/float32.hpp"
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 const float VIBRATOR_DUTY = 0.1f;
 const float ERROR = 0.1f;
-float buffer = 0.0;
+const double BUCKET_TIMEOUT_S = 5.0; //A bucket move that has not arrived by then is skipped
+const float BACK_ROTATIONS = 200.0f; //Drive rotations from the deposit spot to the dig spot
+
+//Actuators a mission stage holds while it runs
+enum Actuator : uint32_t {DRIVE = 1, BUCKET = 2, VIBRATOR = 4};
 
 class OdometryNode : public rclcpp::Node{
 public:
-    OdometryNode() : Node("odometry_node"), leftMotor("can0", 1),
-    rightMotor("can0", 2), leftLift("can0", 3), rightLift("can0", 4), tilt("can0", 5), vibrator("can0", 6) {
+    OdometryNode() : Node("odometry_node"), commands("odometry"), leftMotor(commands, "can0", 1),
+    rightMotor(commands, "can0", 2), leftLift(commands, "can0", 3), rightLift(commands, "can0", 4),
+    tilt(commands, "can0", 5), vibrator(commands, "can0", 6) {
+      commands.attach(*this);
+
+      match_time_s = this->declare_parameter<double>("match_time_s", 600.0); //Time left in the run when the node starts, controller_node passes it
+      cycle_estimate_s = this->declare_parameter<double>("cycle_estimate_s", 120.0); //Length of the first cycle, later ones use the last
+      end_margin_s = this->declare_parameter<double>("end_margin_s", 15.0);
+      max_cycles = this->declare_parameter<int>("max_cycles", 3); //Bounds a run whose match time is wrong, 0 lets the match time decide
+
       depth_detection_pub_ = this->create_subscription<std_msgs::msg::Float32>(
         "/depth_detection", 5,
         std::bind(&OdometryNode::depth_callback, this, std::placeholders::_1)
-      );   
+      );
 
       buffer = tilt.GetPosition();
 
       health_subscriber_ = this->create_subscription<interfaces_pkg::msg::MotorHealth>(
       "/health_topic", 10,
-      std::bind(&OdometryNode::positional_test, this, std::placeholders::_1)
+      std::bind(&OdometryNode::health_callback, this, std::placeholders::_1)
     );
+      bucket_fill_subscriber_ = this->create_subscription<interfaces_pkg::msg::BucketFill>(
+      "/bucket_fill", 5,
+      std::bind(&OdometryNode::bucket_fill_callback, this, std::placeholders::_1)
+    );
+
+      mission_start = std::chrono::steady_clock::now();
+      timer_ = this->create_wall_timer(std::chrono::milliseconds(10), std::bind(&OdometryNode::mission_tick, this));
 }
 private:
-    SparkMax leftMotor;
-    SparkMax rightMotor;
-    SparkMax leftLift;
-    SparkMax rightLift;
-    SparkMax tilt;
-    SparkMax vibrator;
+    MotorCommandSource commands; //Setpoints go through controller_node's command mux
+    MuxedSparkMax leftMotor;
+    MuxedSparkMax rightMotor;
+    MuxedSparkMax leftLift;
+    MuxedSparkMax rightLift;
+    MuxedSparkMax tilt;
+    MuxedSparkMax vibrator;
     //Motor controllers
 
     rclcpp::Subscription<std_msgs::msg::Float32>::SharedPtr depth_detection_pub_;
     rclcpp::Subscription<interfaces_pkg::msg::MotorHealth>::SharedPtr health_subscriber_;
+    rclcpp::Subscription<interfaces_pkg::msg::BucketFill>::SharedPtr bucket_fill_subscriber_;
+    rclcpp::TimerBase::SharedPtr timer_;
 
-    bool begin_excavation = false;
-    bool begin_depositing = false;
     float distance = 0.0;
-    float initialPosition = 0.0;
-    bool initialized = false;
-    int cycleNumber = 0;
     float buffer;
+    double drivePosition = 0.0; //Left drive rotations from the health topic
+    bool haveDrivePosition = false;
+    float bucketVolume = 0.0f; //m3, 0 while the bucket camera is not calibrated
+    bool haveBucketVolume = false;
 
-    enum class EXDEP {BACK, EXCAVATE, FORWARD, DEPOSIT, DONE};
-
-    EXDEP state = EXDEP::BACK;
-
-    void MoveBucket (float lift_setpoint, float tilt_setpoint, bool activate_vibrator, float drive_speed) {
-        auto timer_start = std::chrono::high_resolution_clock::now();
-        bool leftLiftReached = (fabs(lift_setpoint - leftLift.GetPosition() ) <=  ERROR);
-        bool rightLiftReached = (fabs(lift_setpoint - rightLift.GetPosition() ) <=  ERROR);
-        bool tiltReached = (fabs(tilt_setpoint - tilt.GetPosition()) <=  ERROR);
-
-        while (!((leftLiftReached && rightLiftReached) && tiltReached)){
-            std::this_thread::sleep_for(std::chrono::milliseconds(5)); //prevents CAN buffer from overflowing
-            if (fabs(leftLift.GetPosition() - rightLift.GetPosition()) >= 0.2){
-                if (fabs(leftLift.GetPosition() - rightLift.GetPosition()) >= 0.75){
-                    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "WARNING: ACTUATORS GREATELY MISALIGNED");
-                }
-                leftLift.SetPosition(rightLift.GetPosition());
-                rightLift.SetPosition(rightLift.GetPosition());
-            } //block for lift realignment
-            else {
-                leftLift.SetPosition(lift_setpoint);
-                rightLift.SetPosition(lift_setpoint);
-                tilt.SetPosition(tilt_setpoint);
-            } //block for normal bucket movement
-
-            if (activate_vibrator) vibrator.SetDutyCycle(VIBRATOR_DUTY);
-
-            leftMotor.SetVelocity(drive_speed);
-            rightMotor.SetVelocity(drive_speed);
-
-            if (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - timer_start).count() > 5) {
-                RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Skipping stage...");
-                break;
-            } //Timer for when to quit a stage due to timeout
-            
-            leftLiftReached = (fabs(lift_setpoint - leftLift.GetPosition() ) <=  ERROR);
-            rightLiftReached = (fabs(lift_setpoint - rightLift.GetPosition() ) <=  ERROR);
-            tiltReached = (fabs(tilt_setpoint - tilt.GetPosition() ) <=  ERROR); //Updates statuses
-        }
-    }
+    //Mission parameters
+    double match_time_s;
+    double cycle_estimate_s;
+    double end_margin_s;
+    int max_cycles;
 
-    void depth_callback(const std_msgs::msg::Float32::SharedPtr depth_msg){
-        distance = depth_msg->data;
-    }
+    //Stages of one excavate, carry, deposit cycle
+    struct Cycle {
+        int number;
+        int back, lower, dig, stow, forward, raise, dump, reset;
+        double depositPosition; //Drive position the cycle left from and returns to
+        double start_s;
+        float fullVolume; //Measured before dumping
+        float leftVolume; //Measured after the reset
+    };
+
+    StageGraph mission;
+    std::vector<Cycle> cycles;
+    std::chrono::steady_clock::time_point mission_start;
+    bool started = false;
+    bool finished = false;
+    double lastDump_s = -1.0;
+    double previousDump_s = -1.0;
+    float deliveredVolume = 0.0f; //m3 over all cycles, from the bucket camera
 
-    void positional_test(const interfaces_pkg::msg::MotorHealth::SharedPtr health_msg){
-    if (!initialized) {
-        initialPosition = health_msg->left_motor_position;
-        initialized = true;
-        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Initalized at : %f", initialPosition);
+    double now_s() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - mission_start).count();
     }
 
-    switch (state){
-        case EXDEP::BACK:
-        if (health_msg->left_motor_position - initialPosition <= -200){
-            state = EXDEP::EXCAVATE;
-            leftMotor.SetDutyCycle(0.0f);
-            rightMotor.SetDutyCycle(0.0f);
-            std::this_thread::sleep_for(std::chrono::milliseconds(5)); //prevents CAN buffer from overflowing
+    /**
+     * @brief One step of moving the bucket, keeping both lift actuators aligned.
+     * @param lift_setpoint Lift actuator setpoint
+     * @param tilt_setpoint Tilt actuator setpoint
+     * @returns true once both lifts and the tilt are within ERROR of their setpoints
+     */
+    bool StepBucket(float lift_setpoint, float tilt_setpoint) {
+        const float left = leftLift.GetPosition();
+        const float right = rightLift.GetPosition();
+        if (fabs(lift_setpoint - left) <= ERROR && fabs(lift_setpoint - right) <= ERROR &&
+            fabs(tilt_setpoint - tilt.GetPosition()) <= ERROR) {
+            return true;
         }
+        if (fabs(left - right) >= 0.2){
+            if (fabs(left - right) >= 0.75){
+                RCLCPP_WARN_THROTTLE(rclcpp::get_logger("rclcpp"), *this->get_clock(), 1000, "WARNING: ACTUATORS GREATELY MISALIGNED");
+            }
+            leftLift.SetPosition(right);
+            rightLift.SetPosition(right);
+        } //block for lift realignment
         else {
+            leftLift.SetPosition(lift_setpoint);
+            rightLift.SetPosition(lift_setpoint);
+            tilt.SetPosition(tilt_setpoint);
+        } //block for normal bucket movement
+        return false;
+    }
+
+    /**
+     * @brief Adds the stages of a cycle. Independent stages overlap: the bucket is lowered while
+     *        reversing, stowed and raised while driving forward, and reset while reversing again.
+     * @param number Cycle number, from 0
+     * @param previous The cycle before, nullptr for the first
+     * @returns None
+     */
+    void AddCycle(int number, const Cycle *previous) {
+        Cycle cycle;
+        cycle.number = number;
+        cycle.depositPosition = drivePosition;
+        cycle.start_s = now_s();
+        cycle.fullVolume = 0.0f;
+        cycle.leftVolume = 0.0f;
+        const std::size_t index = cycles.size();
+
+        cycle.back = mission.add("back", DRIVE, {previous ? previous->dump : -1}, [this, index](bool first) {
+            Cycle &c = cycles[index];
+            if (first) c.depositPosition = drivePosition;
+            if (drivePosition - c.depositPosition <= -BACK_ROTATIONS) {
+                leftMotor.SetDutyCycle(0.0f);
+                rightMotor.SetDutyCycle(0.0f);
+                return true;
+            }
             leftMotor.SetVelocity(-1500.0f);
             rightMotor.SetVelocity(-1500.0f);
-            RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Current position %f", health_msg->left_motor_position - initialPosition);
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
-        }
-        break;
-
-        case EXDEP::EXCAVATE:
-        MoveBucket(-2.0, -2.6 + buffer, false, false);
-        MoveBucket(-3.2 + (-0.1 * cycleNumber), -3.0 + buffer, true, 500);
-        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Current position %f", health_msg->left_motor_position - initialPosition);
-        MoveBucket(0.0, 0.0, false, false);
-        vibrator.SetDutyCycle(0.0);
-        state = EXDEP::FORWARD;
-        break;
-
-        case EXDEP::FORWARD:
-        if ((health_msg->left_motor_position - initialPosition) >= 0){
-            state = EXDEP::DEPOSIT;
-        } 
-        else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            return false;
+        });
+        cycle.lower = mission.add("lower", BUCKET, {previous ? previous->reset : -1}, [this](bool) {
+            return StepBucket(-2.0, -2.6 + buffer);
+        }, BUCKET_TIMEOUT_S);
+        cycle.dig = mission.add("dig", DRIVE | BUCKET | VIBRATOR, {cycle.back, cycle.lower}, [this, number](bool) {
+            vibrator.SetDutyCycle(VIBRATOR_DUTY);
+            leftMotor.SetVelocity(500.0f);
+            rightMotor.SetVelocity(500.0f);
+            return StepBucket(-3.2 + (-0.1 * number), -3.0 + buffer);
+        }, BUCKET_TIMEOUT_S);
+        cycle.stow = mission.add("stow", BUCKET | VIBRATOR, {cycle.dig}, [this](bool first) {
+            if (first) vibrator.SetDutyCycle(0.0f);
+            return StepBucket(0.0, 0.0);
+        }, BUCKET_TIMEOUT_S);
+        cycle.forward = mission.add("forward", DRIVE, {cycle.dig}, [this, index](bool) {
+            if (drivePosition - cycles[index].depositPosition >= 0) {
+                leftMotor.SetVelocity(0.0f);
+                rightMotor.SetVelocity(0.0f);
+                return true;
+            }
             leftMotor.SetVelocity(1500.0f);
             rightMotor.SetVelocity(1500.0f);
-            RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Current position %f", leftMotor.GetPosition() - initialPosition);
-            
+            return false;
+        });
+        cycle.raise = mission.add("raise", BUCKET, {cycle.stow}, [this](bool) {
+            return StepBucket(1.9, 0.0 + buffer);
+        }, BUCKET_TIMEOUT_S);
+        cycle.dump = mission.add("dump", BUCKET | VIBRATOR, {cycle.forward, cycle.raise}, [this, index](bool first) {
+            if (first) cycles[index].fullVolume = bucketVolume;
+            vibrator.SetDutyCycle(VIBRATOR_DUTY);
+            return StepBucket(2.9, 0.0 + buffer);
+        }, BUCKET_TIMEOUT_S);
+        cycle.reset = mission.add("reset", BUCKET | VIBRATOR, {cycle.dump}, [this](bool first) {
+            if (first) vibrator.SetDutyCycle(0.0f);
+            return StepBucket(0.0, 0.0 + buffer);
+        }, BUCKET_TIMEOUT_S);
+
+        cycles.push_back(cycle);
+        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Cycle %d planned at %.1f s", number + 1, cycle.start_s);
+    }
+
+    /**
+     * @brief Whether another cycle fits in the match, from how long the last one took.
+     * @returns true to plan the next cycle
+     */
+    bool AnotherCycleFits() {
+        if (max_cycles > 0 && static_cast<int>(cycles.size()) >= max_cycles) {
+            return false;
         }
-        break;
-
-        case EXDEP::DEPOSIT:
-        MoveBucket(1.9, 0.0 + buffer, false, 0);  
-        MoveBucket(2.9, 0.0 + buffer, true, 0);
-        MoveBucket(0.0, 0.0 + buffer, false, 0);  
-        vibrator.SetDutyCycle(0.0);
-        leftMotor.SetDutyCycle(0.0);
-        rightMotor.SetDutyCycle(0.0);
-        cycleNumber++;
-        if (cycleNumber == 3){
-            state = EXDEP::DONE;
-        } else {
-            initialized = false;
-            state = EXDEP::BACK;
+        //The next cycle starts while this one resets, so after the first it costs dump to dump
+        const double estimate = previousDump_s >= 0 ? lastDump_s - previousDump_s : lastDump_s - cycles.front().start_s;
+        const double remaining = match_time_s - now_s();
+        if (remaining < estimate + end_margin_s) {
+            RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "%.0f s left and a cycle takes %.0f s, this is the last one", remaining, estimate);
+            return false;
         }
-        break;
+        return true;
+    }
+
+    /**
+     * @brief Logs how long a stage ran and waited for an actuator, plans the next cycle after a
+     *        dump and logs the yield once the bucket is reset.
+     * @param timing The stage that ended
+     * @returns None
+     */
+    void StageEnded(const StageGraph::Timing &timing) {
+        std::size_t index = 0;
+        while (index + 1 < cycles.size() && timing.stage > cycles[index].reset) index++;
+        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Cycle %zu %-7s ran %5.2f s, waited %4.2f s%s", index + 1,
+                    timing.name.c_str(), timing.end_s - timing.start_s, timing.start_s - timing.ready_s,
+                    timing.timed_out ? ", skipped after timeout" : "");
+
+        if (timing.stage == cycles[index].dump) {
+            previousDump_s = lastDump_s;
+            lastDump_s = timing.end_s;
+            if (AnotherCycleFits()) {
+                const Cycle previous = cycles[index];
+                AddCycle(previous.number + 1, &previous);
+            }
+        }
+        else if (timing.stage == cycles[index].reset) {
+            Cycle &cycle = cycles[index];
+            cycle.leftVolume = bucketVolume;
+            const float delivered = haveBucketVolume ? std::max(0.0f, cycle.fullVolume - cycle.leftVolume) : 0.0f;
+            deliveredVolume += delivered;
+            const double minutes = timing.end_s / 60.0;
+            RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Cycle %zu done in %.1f s, %.4f m3 delivered, %.4f m3/min over %.1f min",
+                        index + 1, timing.end_s - cycle.start_s, delivered, minutes > 0 ? deliveredVolume / minutes : 0.0,
+                        minutes);
+        }
+    }
+
+    void depth_callback(const std_msgs::msg::Float32::SharedPtr depth_msg){
+        distance = depth_msg->data;
+    }
 
-        case EXDEP::DONE:
-        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    void health_callback(const interfaces_pkg::msg::MotorHealth::SharedPtr health_msg){
+        drivePosition = health_msg->left_motor_position;
+        haveDrivePosition = true;
+    }
+
+    void bucket_fill_callback(const interfaces_pkg::msg::BucketFill::SharedPtr fill_msg){
+        haveBucketVolume = fill_msg->calibrated;
+        bucketVolume = fill_msg->calibrated ? fill_msg->volume_m3 : 0.0f;
+    }
+
+    /**
+     * @brief Steps the mission every 10 ms without blocking, so the health topic keeps flowing.
+     * @returns None
+     */
+    void mission_tick(){
+        if (finished) return;
+        if (!started) {
+            if (!haveDrivePosition) return; //Waits for the first drive position
+            RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Initalized at : %f", drivePosition);
+            started = true;
+            if (match_time_s - now_s() < cycle_estimate_s + end_margin_s) {
+                RCLCPP_WARN(rclcpp::get_logger("rclcpp"), "No time for a %.0f s cycle in a %.0f s match", cycle_estimate_s, match_time_s);
+            } else {
+                AddCycle(0, nullptr);
+            }
+        }
 
-        RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "THE AUTO WORKED!!!");
-        rclcpp::shutdown();
-        break;
-      }
+        for (const StageGraph::Timing &timing : mission.tick(now_s())) {
+            StageEnded(timing);
+        }
+
+        if (mission.idle()) {
+            finished = true;
+            leftMotor.SetDutyCycle(0.0f);
+            rightMotor.SetDutyCycle(0.0f);
+            vibrator.SetDutyCycle(0.0f);
+            commands.release();
+            RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "THE AUTO WORKED!!! %zu cycles in %.1f s", cycles.size(), now_s());
+            rclcpp::shutdown();
+        }
     }
 };
 
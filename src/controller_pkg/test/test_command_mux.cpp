@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include "controller_pkg/CommandMux.hpp"
+
+namespace
+{
+  const int64_t LEASE_NS = 100;
+
+  class CommandMuxTest : public ::testing::Test
+  {
+  protected:
+    void SetUp() override
+    {
+      teleop_ = mux_.addSource("teleop", 10);
+      excavation_ = mux_.addSource("excavation", 5);
+      depositing_ = mux_.addSource("depositing", 5);
+    }
+
+    CommandMux mux_;
+    int teleop_ = -1;
+    int excavation_ = -1;
+    int depositing_ = -1;
+  };
+}
+
+TEST_F(CommandMuxTest, NobodyHoldingGivesTheNeutralCommand)
+{
+  const CommandMux::Decision &decision = mux_.decide(0)[0];
+  EXPECT_EQ(decision.owner, -1);
+  EXPECT_EQ(decision.mode, CommandMux::Mode::DUTY_CYCLE);
+  EXPECT_EQ(decision.value, 0.0f);
+}
+
+TEST_F(CommandMuxTest, HigherPriorityPreempts)
+{
+  mux_.submit(excavation_, 2, CommandMux::Mode::POSITION, -2.5f, 0, LEASE_NS);
+  EXPECT_EQ(mux_.decide(1)[2].owner, excavation_);
+
+  mux_.submit(teleop_, 2, CommandMux::Mode::DUTY_CYCLE, 0.3f, 2, LEASE_NS);
+  const CommandMux::Decision &decision = mux_.decide(3)[2];
+  EXPECT_EQ(decision.owner, teleop_);
+  EXPECT_EQ(decision.mode, CommandMux::Mode::DUTY_CYCLE);
+  EXPECT_EQ(decision.value, 0.3f);
+  EXPECT_EQ(decision.received_ns, 2);
+}
+
+TEST_F(CommandMuxTest, TieStaysWithTheOwner)
+{
+  mux_.submit(depositing_, 0, CommandMux::Mode::VELOCITY, 500.0f, 0, LEASE_NS);
+  EXPECT_EQ(mux_.decide(1)[0].owner, depositing_);
+
+  // An equal priority source added before it does not take the device
+  mux_.submit(excavation_, 0, CommandMux::Mode::VELOCITY, 1500.0f, 2, LEASE_NS);
+  EXPECT_EQ(mux_.decide(3)[0].owner, depositing_);
+  EXPECT_EQ(mux_.decide(4)[0].value, 500.0f);
+}
+
+TEST_F(CommandMuxTest, ExpiredLeaseHandsTheDeviceDown)
+{
+  mux_.submit(teleop_, 1, CommandMux::Mode::DUTY_CYCLE, 0.5f, 0, LEASE_NS);
+  mux_.submit(excavation_, 1, CommandMux::Mode::VELOCITY, 1500.0f, 0, 10 * LEASE_NS);
+  EXPECT_EQ(mux_.decide(LEASE_NS - 1)[1].owner, teleop_);
+  EXPECT_EQ(mux_.decide(LEASE_NS)[1].owner, excavation_);
+  EXPECT_EQ(mux_.decide(10 * LEASE_NS)[1].owner, -1);
+}
+
+TEST_F(CommandMuxTest, RenewalKeepsTheArrivalTime)
+{
+  mux_.submit(teleop_, 3, CommandMux::Mode::DUTY_CYCLE, 0.5f, 0, LEASE_NS);
+  mux_.submit(teleop_, 3, CommandMux::Mode::DUTY_CYCLE, 0.5f, 50, LEASE_NS);
+  EXPECT_EQ(mux_.decide(LEASE_NS)[3].received_ns, 0); // Held by the renewal past the first lease
+
+  mux_.submit(teleop_, 3, CommandMux::Mode::DUTY_CYCLE, 0.6f, 120, LEASE_NS);
+  EXPECT_EQ(mux_.decide(121)[3].received_ns, 120);
+
+  mux_.submit(teleop_, 3, CommandMux::Mode::DUTY_CYCLE, 0.6f, 500, LEASE_NS);
+  EXPECT_EQ(mux_.decide(501)[3].received_ns, 500); // Expired in between, so a new setpoint
+}
+
+TEST_F(CommandMuxTest, ZeroLeaseReleases)
+{
+  mux_.submit(teleop_, 4, CommandMux::Mode::DUTY_CYCLE, 1.0f, 0, LEASE_NS);
+  mux_.submit(teleop_, 4, CommandMux::Mode::DUTY_CYCLE, 1.0f, 1, 0);
+  EXPECT_EQ(mux_.decide(2)[4].owner, -1);
+}
+
+TEST_F(CommandMuxTest, ReleaseAllGivesUpEveryDevice)
+{
+  for (std::size_t device = 0; device < CommandMux::DEVICE_COUNT; device++)
+  {
+    mux_.submit(teleop_, device, CommandMux::Mode::DUTY_CYCLE, 0.5f, 0, LEASE_NS);
+  }
+  mux_.submit(excavation_, 5, CommandMux::Mode::DUTY_CYCLE, 1.0f, 0, LEASE_NS);
+  EXPECT_EQ(mux_.decide(1)[5].owner, teleop_);
+
+  mux_.releaseAll(teleop_);
+  const auto &decisions = mux_.decide(2);
+  for (std::size_t device = 0; device < 5; device++)
+  {
+    EXPECT_EQ(decisions[device].owner, -1);
+    EXPECT_EQ(decisions[device].value, 0.0f);
+  }
+  EXPECT_EQ(decisions[5].owner, excavation_);
+}
+
+TEST_F(CommandMuxTest, IgnoresUnknownSourcesAndDevices)
+{
+  mux_.submit(7, 0, CommandMux::Mode::DUTY_CYCLE, 1.0f, 0, LEASE_NS);
+  mux_.submit(teleop_, CommandMux::DEVICE_COUNT, CommandMux::Mode::DUTY_CYCLE, 1.0f, 0, LEASE_NS);
+  mux_.releaseAll(-1);
+  for (const CommandMux::Decision &decision : mux_.decide(1))
+  {
+    EXPECT_EQ(decision.owner, -1);
+  }
+  EXPECT_EQ(mux_.sourceIndex("depositing"), depositing_);
+  EXPECT_EQ(mux_.sourceIndex("navigation"), -1);
+}
+
+TEST(CommandMux, RefusesSourcesPastTheLimit)
+{
+  CommandMux mux;
+  for (std::size_t i = 0; i < CommandMux::MAX_SOURCES; i++)
+  {
+    EXPECT_EQ(mux.addSource("source" + std::to_string(i), 0), static_cast<int>(i));
+  }
+  EXPECT_EQ(mux.addSource("extra", 0), -1);
+}
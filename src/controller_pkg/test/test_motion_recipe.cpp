@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "controller_pkg/MotionEngine.hpp"
+#include "controller_pkg/MotionRecipe.hpp"
+
+namespace
+{
+  const char *const RECIPE = R"(
+name: test
+tolerance: 0.1
+realign_above: 0.2
+abort_above: 1.0
+tilt_relative: true
+stages:
+  - name: lower
+    lift: -2.0
+    tilt: -1.0
+    exit: {reached: true}
+    timeout_s: 5.0
+  - name: dig
+    lift: -3.0
+    drive_velocity: 1500.0
+    vibrator_duty: 1.0
+    exit: {reached: true, after_s: 2.0}
+    timeout_s: 6.0
+  - name: crawl
+    drive_velocity: 500.0
+    vibrator_duty: 1.0
+    exit: {full: true}
+    timeout_s: 4.0
+)";
+
+  MotionEngine::Readings At(float lift, float tilt)
+  {
+    MotionEngine::Readings readings;
+    readings.left_lift = lift;
+    readings.right_lift = lift;
+    readings.tilt = tilt;
+    return readings;
+  }
+
+  /**
+   * @brief Parses a recipe that must be rejected and returns the error.
+   *******************************************************/
+  std::string Rejection(const std::string &yaml)
+  {
+    try
+    {
+      MotionRecipe::parse(yaml, "bad.yaml");
+    }
+    catch (const std::runtime_error &ex)
+    {
+      return ex.what();
+    }
+    ADD_FAILURE() << "accepted:\n" << yaml;
+    return "";
+  }
+}
+
+TEST(MotionRecipe, ReadsStagesAndLimits)
+{
+  const MotionRecipe recipe = MotionRecipe::parse(RECIPE, "test.yaml");
+  EXPECT_EQ(recipe.name, "test");
+  EXPECT_EQ(recipe.source, "test.yaml");
+  EXPECT_FLOAT_EQ(recipe.abort_above, 1.0f);
+  EXPECT_TRUE(recipe.tilt_relative);
+  EXPECT_TRUE(recipe.drives);
+  EXPECT_TRUE(recipe.vibrates);
+  ASSERT_EQ(recipe.stages.size(), 3u);
+  EXPECT_TRUE(recipe.stages[0].has_lift);
+  EXPECT_TRUE(recipe.stages[0].until_reached);
+  EXPECT_FALSE(recipe.stages[1].has_tilt);
+  EXPECT_DOUBLE_EQ(recipe.stages[1].after_s, 2.0);
+  EXPECT_TRUE(recipe.stages[2].until_full);
+}
+
+TEST(MotionRecipe, RejectsUnknownKeys)
+{
+  EXPECT_NE(Rejection("tolerence: 0.1\nstages: [{after_s: 1}]").find("unknown key 'tolerence'"), std::string::npos);
+  EXPECT_NE(Rejection("stages: [{name: dig, lift: 1, timeout: 5, exit: {reached: true}}]").find("stages[0]: unknown key 'timeout'"),
+            std::string::npos);
+  EXPECT_NE(Rejection("stages: [{lift: 1, exit: {reach: true}}]").find("stages[0].exit: unknown key 'reach'"),
+            std::string::npos);
+}
+
+TEST(MotionRecipe, RejectsInvalidStages)
+{
+  Rejection("stages: []");
+  Rejection("stages: [{lift: 1}]");                                  // Never ends
+  Rejection("stages: [{tilt: 1, tilt_duty: 1, exit: {reached: true}}]");
+  Rejection("stages: [{vibrator_duty: 2, exit: {after_s: 1}}]");
+  Rejection("stages: [{exit: {full: true}}]");                       // May never fill
+  Rejection("stages: [{vibrator_duty: 1, exit: {reached: true}}]"); // Nothing to reach
+  Rejection("stages: [{lift: .nan, exit: {reached: true}}]");
+  Rejection("stages: [{lift: low, exit: {reached: true}}]");
+  Rejection("stages: [{exit: {after_s: -1}}]");
+  Rejection("tolerance: 0\nstages: [{exit: {after_s: 1}}]");
+}
+
+TEST(MotionEngine, ReachedStartsTheNextStageInTheSameTick)
+{
+  const MotionRecipe recipe = MotionRecipe::parse(RECIPE, "test.yaml");
+  MotionEngine engine(recipe);
+  engine.start(0.0, At(0.0f, 0.5f));
+  EXPECT_FLOAT_EQ(engine.tiltOffset(), 0.5f);
+
+  MotionEngine::Tick tick = engine.tick(0.1, At(0.0f, 0.5f));
+  EXPECT_EQ(tick.status, MotionEngine::Status::RUNNING);
+  EXPECT_EQ(tick.ended, -1);
+  EXPECT_EQ(tick.setpoints[MotionEngine::LEFT_LIFT], (MotionEngine::Setpoint{MotionEngine::Setpoint::POSITION, -2.0f}));
+  EXPECT_EQ(tick.setpoints[MotionEngine::TILT], (MotionEngine::Setpoint{MotionEngine::Setpoint::POSITION, -0.5f}));
+  // A recipe that drives stops the drivetrain in stages that do not
+  EXPECT_EQ(tick.setpoints[MotionEngine::LEFT_DRIVE], (MotionEngine::Setpoint{MotionEngine::Setpoint::DUTY_CYCLE, 0.0f}));
+
+  tick = engine.tick(1.5, At(-2.05f, -0.45f));
+  EXPECT_EQ(tick.ended, 0);
+  EXPECT_DOUBLE_EQ(tick.ended_duration_s, 1.5);
+  EXPECT_FALSE(tick.ended_timed_out);
+  EXPECT_EQ(engine.stage(), 1);
+  EXPECT_EQ(tick.setpoints[MotionEngine::RIGHT_LIFT], (MotionEngine::Setpoint{MotionEngine::Setpoint::POSITION, -3.0f}));
+  EXPECT_EQ(tick.setpoints[MotionEngine::RIGHT_DRIVE], (MotionEngine::Setpoint{MotionEngine::Setpoint::VELOCITY, 1500.0f}));
+  EXPECT_EQ(tick.setpoints[MotionEngine::VIBRATOR], (MotionEngine::Setpoint{MotionEngine::Setpoint::DUTY_CYCLE, 1.0f}));
+  EXPECT_EQ(tick.setpoints[MotionEngine::TILT].mode, MotionEngine::Setpoint::NONE);
+}
+
+TEST(MotionEngine, AfterAndTimeoutExits)
+{
+  const MotionRecipe recipe = MotionRecipe::parse(RECIPE, "test.yaml");
+  MotionEngine engine(recipe);
+  engine.start(0.0, At(0.0f, 0.0f));
+  engine.tick(1.0, At(-2.0f, -1.0f));
+  ASSERT_EQ(engine.stage(), 1);
+
+  // dig is at its position but must run for 2 s
+  EXPECT_EQ(engine.tick(2.0, At(-3.0f, -1.0f)).ended, -1);
+  MotionEngine::Tick tick = engine.tick(3.0, At(-3.0f, -1.0f));
+  EXPECT_EQ(tick.ended, 1);
+  EXPECT_FALSE(tick.ended_timed_out);
+
+  // crawl without a calibrated reading never sees a full bucket, the timeout ends it
+  MotionEngine::Readings full = At(-3.0f, -1.0f);
+  full.full = true;
+  EXPECT_EQ(engine.tick(6.0, full).ended, -1);
+  tick = engine.tick(7.0, full);
+  EXPECT_EQ(tick.ended, 2);
+  EXPECT_TRUE(tick.ended_timed_out);
+  EXPECT_EQ(tick.status, MotionEngine::Status::DONE);
+  EXPECT_EQ(tick.setpoints[MotionEngine::LEFT_DRIVE], (MotionEngine::Setpoint{MotionEngine::Setpoint::DUTY_CYCLE, 0.0f}));
+  EXPECT_EQ(tick.setpoints[MotionEngine::VIBRATOR], (MotionEngine::Setpoint{MotionEngine::Setpoint::DUTY_CYCLE, 0.0f}));
+  EXPECT_EQ(tick.setpoints[MotionEngine::LEFT_LIFT].mode, MotionEngine::Setpoint::NONE);
+}
+
+TEST(MotionEngine, FullExitNeedsACalibratedReading)
+{
+  const MotionRecipe recipe = MotionRecipe::parse("stages: [{drive_velocity: 500, exit: {full: true}, timeout_s: 4}]", "crawl");
+  MotionEngine engine(recipe);
+  engine.start(0.0, At(0.0f, 0.0f));
+  MotionEngine::Readings readings;
+  readings.fill_known = true;
+  EXPECT_EQ(engine.tick(1.0, readings).ended, -1);
+  readings.full = true;
+  const MotionEngine::Tick tick = engine.tick(1.1, readings);
+  EXPECT_EQ(tick.ended, 0);
+  EXPECT_FALSE(tick.ended_timed_out);
+  EXPECT_EQ(tick.status, MotionEngine::Status::DONE);
+}
+
+TEST(MotionEngine, RealignsBeforeMovingOn)
+{
+  const MotionRecipe recipe = MotionRecipe::parse(RECIPE, "test.yaml");
+  MotionEngine engine(recipe);
+  engine.start(0.0, At(0.0f, 0.0f));
+
+  MotionEngine::Readings readings = At(-2.0f, -1.0f);
+  readings.left_lift = -1.6f;
+  const MotionEngine::Tick tick = engine.tick(0.5, readings);
+  EXPECT_EQ(tick.ended, -1); // Not reached while the left side is behind
+  EXPECT_EQ(tick.setpoints[MotionEngine::LEFT_LIFT], (MotionEngine::Setpoint{MotionEngine::Setpoint::POSITION, -2.0f}));
+  EXPECT_EQ(tick.setpoints[MotionEngine::RIGHT_LIFT], (MotionEngine::Setpoint{MotionEngine::Setpoint::POSITION, -2.0f}));
+  EXPECT_EQ(tick.setpoints[MotionEngine::TILT].mode, MotionEngine::Setpoint::NONE);
+  EXPECT_FALSE(tick.misaligned);
+
+  readings.right_lift = -1.0f;
+  readings.left_lift = -1.3f;
+  const MotionEngine::Tick realign = engine.tick(0.6, readings);
+  EXPECT_EQ(realign.setpoints[MotionEngine::LEFT_LIFT], (MotionEngine::Setpoint{MotionEngine::Setpoint::POSITION, -1.0f}));
+  EXPECT_EQ(realign.setpoints[MotionEngine::TILT].mode, MotionEngine::Setpoint::NONE);
+}
+
+TEST(MotionEngine, AbortsOnMisalignedLift)
+{
+  const MotionRecipe recipe = MotionRecipe::parse(RECIPE, "test.yaml");
+  MotionEngine engine(recipe);
+  engine.start(0.0, At(0.0f, 0.0f));
+
+  MotionEngine::Readings readings = At(-1.0f, 0.0f);
+  readings.left_lift = 0.0f;
+  MotionEngine::Tick tick = engine.tick(0.5, readings);
+  EXPECT_EQ(tick.status, MotionEngine::Status::ABORTED);
+  EXPECT_TRUE(tick.misaligned);
+  EXPECT_EQ(engine.stage(), 0);
+
+  // Stays aborted and sends nothing
+  tick = engine.tick(0.6, At(-2.0f, -1.0f));
+  EXPECT_EQ(tick.status, MotionEngine::Status::ABORTED);
+  EXPECT_EQ(tick.setpoints[MotionEngine::LEFT_LIFT].mode, MotionEngine::Setpoint::NONE);
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include "controller_pkg/StageGraph.hpp"
+
+namespace
+{
+  const uint32_t DRIVE = 1u << 0;
+  const uint32_t BUCKET = 1u << 1;
+
+  /**
+   * @brief Step that is done on its steps-th call and records whether its first call said so.
+   *******************************************************/
+  StageGraph::Step Steps(int steps, int &calls, bool *first_seen = nullptr)
+  {
+    return [steps, &calls, first_seen](bool first)
+    {
+      if (first && first_seen)
+      {
+        *first_seen = calls == 0;
+      }
+      return ++calls >= steps;
+    };
+  }
+}
+
+TEST(StageGraph, StagesOnDifferentResourcesRunSideBySide)
+{
+  StageGraph graph;
+  int drive_calls = 0;
+  int bucket_calls = 0;
+  graph.add("drive", DRIVE, {}, Steps(2, drive_calls));
+  graph.add("lower", BUCKET, {}, Steps(2, bucket_calls));
+
+  EXPECT_TRUE(graph.tick(0.0).empty());
+  EXPECT_EQ(drive_calls, 1);
+  EXPECT_EQ(bucket_calls, 1);
+
+  const std::vector<StageGraph::Timing> ended = graph.tick(1.0);
+  ASSERT_EQ(ended.size(), 2u);
+  EXPECT_EQ(ended[0].name, "drive");
+  EXPECT_EQ(ended[1].name, "lower");
+  EXPECT_EQ(ended[1].start_s, 0.0);
+  EXPECT_EQ(ended[1].end_s, 1.0);
+  EXPECT_TRUE(graph.idle());
+}
+
+TEST(StageGraph, SharedResourceKeepsTheOrder)
+{
+  StageGraph graph;
+  int first_calls = 0;
+  int second_calls = 0;
+  int third_calls = 0;
+  bool first_seen = false;
+  const int first = graph.add("first", BUCKET, {}, Steps(2, first_calls));
+  const int second = graph.add("second", BUCKET | DRIVE, {}, Steps(1, second_calls, &first_seen));
+  graph.add("third", DRIVE, {}, Steps(1, third_calls));
+
+  graph.tick(0.0);
+  // third is free but would pass second, which waits for the bucket and also wants the drivetrain
+  EXPECT_EQ(second_calls, 0);
+  EXPECT_EQ(third_calls, 0);
+
+  graph.tick(1.0);
+  EXPECT_TRUE(graph.finished(first));
+  EXPECT_EQ(second_calls, 0);
+
+  const std::vector<StageGraph::Timing> ended = graph.tick(2.0);
+  ASSERT_EQ(ended.size(), 1u);
+  EXPECT_EQ(ended[0].stage, second);
+  EXPECT_EQ(ended[0].ready_s, 0.0);
+  EXPECT_EQ(ended[0].start_s, 2.0);
+  EXPECT_TRUE(first_seen);
+  EXPECT_EQ(third_calls, 0);
+
+  graph.tick(3.0);
+  EXPECT_EQ(third_calls, 1);
+  EXPECT_TRUE(graph.idle());
+}
+
+TEST(StageGraph, DependencyWaitsForItsStage)
+{
+  StageGraph graph;
+  int dig_calls = 0;
+  int drive_calls = 0;
+  const int dig = graph.add("dig", BUCKET, {}, Steps(3, dig_calls));
+  graph.add("drive", DRIVE, {dig}, Steps(1, drive_calls));
+
+  graph.tick(0.0);
+  graph.tick(1.0);
+  EXPECT_EQ(drive_calls, 0);
+
+  // The dependent stage starts in the tick after the one its dependency ends in
+  graph.tick(2.0);
+  EXPECT_EQ(drive_calls, 0);
+  const std::vector<StageGraph::Timing> ended = graph.tick(3.0);
+  ASSERT_EQ(ended.size(), 1u);
+  EXPECT_EQ(ended[0].ready_s, 3.0);
+  EXPECT_TRUE(graph.idle());
+}
+
+TEST(StageGraph, LaterStagesCannotBeWaitedFor)
+{
+  StageGraph graph;
+  int calls = 0;
+  graph.add("first", DRIVE, {1, -1}, Steps(1, calls));
+  graph.tick(0.0);
+  EXPECT_EQ(calls, 1);
+  EXPECT_TRUE(graph.idle());
+}
+
+TEST(StageGraph, TimeoutEndsAStage)
+{
+  StageGraph graph;
+  int calls = 0;
+  graph.add("stuck", BUCKET, {}, Steps(1000, calls), 2.0);
+
+  EXPECT_TRUE(graph.tick(0.0).empty());
+  EXPECT_TRUE(graph.tick(1.9).empty());
+  const std::vector<StageGraph::Timing> ended = graph.tick(2.0);
+  ASSERT_EQ(ended.size(), 1u);
+  EXPECT_TRUE(ended[0].timed_out);
+  EXPECT_TRUE(graph.idle());
+}
+
+TEST(StageGraph, StagesAddedWhileRunning)
+{
+  StageGraph graph;
+  int first_calls = 0;
+  int next_calls = 0;
+  const int first = graph.add("cycle 1", BUCKET, {}, Steps(1, first_calls));
+  graph.tick(0.0);
+  EXPECT_TRUE(graph.idle());
+
+  graph.add("cycle 2", BUCKET, {first}, Steps(1, next_calls));
+  EXPECT_FALSE(graph.idle());
+  graph.tick(1.0);
+  EXPECT_EQ(next_calls, 1);
+  EXPECT_TRUE(graph.idle());
+}
@@ -0,0 +1,94 @@
+/**
+ * @file Protocol.hpp
+ * @brief Messages exchanged between the gateway and the pilot page over one WebSocket.
+ */
+
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Binary messages start with a type byte; every number is little endian.
+ *
+ * Gateway to page:
+ *   VIDEO_JPEG, VIDEO_H264   VideoHeader followed by the JPEG or the H.264 access unit (Annex B)
+ *   text                     JSON: {"type":"hello","channels":[...]} on connect,
+ *                            {"type":"motor_health",...} with the fields of MotorHealth
+ *
+ * Page to gateway:
+ *   SUBSCRIBE                [type, channel, format, 0] format is VIDEO_JPEG or VIDEO_H264, 0 unsubscribes
+ *   JOY                      [type, axis count, button count, 0] uint32 frame id, int64 time the page read the gamepad
+ *                            in ns on its clock (0 if unknown), float32 axes, then one byte per button
+ *   VIDEO_FEEDBACK           [type, channel, 0, 0, 0, 0, 0, 0] int64 capture stamp in ns of the newest frame shown
+ */
+namespace Gateway
+{
+  enum MessageType : uint8_t
+  {
+    VIDEO_JPEG = 1,
+    VIDEO_H264 = 2,
+    SUBSCRIBE = 16,
+    JOY = 17,
+    VIDEO_FEEDBACK = 18
+  };
+
+  enum VideoFlags : uint8_t
+  {
+    KEYFRAME = 1
+  };
+
+  const std::size_t VIDEO_HEADER_SIZE = 20;
+  const std::size_t SUBSCRIBE_SIZE = 4;
+  const std::size_t JOY_HEADER_SIZE = 16;
+  const std::size_t VIDEO_FEEDBACK_SIZE = 16;
+
+  /**
+   * @struct VideoHeader
+   * @brief Prefix of a video frame: type, channel, flags, 0, uint32 sequence, int64 capture stamp in ns,
+   *        uint16 width, uint16 height.
+   */
+  struct VideoHeader
+  {
+    uint8_t type = VIDEO_JPEG;
+    uint8_t channel = 0; // Index into the channels of the hello message
+    uint8_t flags = 0;
+    uint32_t sequence = 0;
+    int64_t stamp_ns = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+
+    void write(uint8_t *out) const
+    {
+      out[0] = type;
+      out[1] = channel;
+      out[2] = flags;
+      out[3] = 0;
+      std::memcpy(out + 4, &sequence, 4); // The robot and every browser are little endian
+      std::memcpy(out + 8, &stamp_ns, 8);
+      std::memcpy(out + 16, &width, 2);
+      std::memcpy(out + 18, &height, 2);
+    }
+
+    bool read(const uint8_t *in, std::size_t size)
+    {
+      if (size < VIDEO_HEADER_SIZE || (in[0] != VIDEO_JPEG && in[0] != VIDEO_H264))
+      {
+        return false;
+      }
+      type = in[0];
+      channel = in[1];
+      flags = in[2];
+      std::memcpy(&sequence, in + 4, 4);
+      std::memcpy(&stamp_ns, in + 8, 8);
+      std::memcpy(&width, in + 16, 2);
+      std::memcpy(&height, in + 18, 2);
+      return true;
+    }
+  };
+} // namespace Gateway
+
+#endif // PROTOCOL_HPP
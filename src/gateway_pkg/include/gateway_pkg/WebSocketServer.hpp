@@ -0,0 +1,194 @@
+/**
+ * @file WebSocketServer.hpp
+ * @brief Small RFC 6455 WebSocket server with per-client send queues that drop stale video.
+ */
+
+#ifndef WEBSOCKETSERVER_HPP
+#define WEBSOCKETSERVER_HPP
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class WebSocketServer
+ * @brief Serves WebSocket clients from one thread that polls every socket.
+ *
+ * Outgoing messages are framed once with binaryFrame() or textFrame() and shared by every
+ * client they go to. Each client has its own queue. A message sent with a slot replaces the
+ * queued message of the same slot that has not started to go out yet, so a slow client gets
+ * the newest video frame instead of a backlog. Once a client has max_queued_bytes waiting,
+ * further slotted messages are dropped until it catches up; messages without a slot
+ * (telemetry, control) are always queued. Kernel send buffers are kept small so the
+ * queues, not the socket, absorb a slow link.
+ *
+ * Clients that answer no ping within timeout_s are disconnected. The callbacks run on the
+ * server thread and must be set before start().
+ */
+class WebSocketServer
+{
+public:
+  struct Config
+  {
+    uint16_t port = 9091;                    // 0 picks a free port, see port()
+    int max_clients = 8;
+    std::size_t max_queued_bytes = 1 << 20;  // Per client, before slotted messages are dropped
+    int send_buffer_bytes = 64 * 1024;       // SO_SNDBUF of every client socket
+    std::size_t max_message_bytes = 1 << 16; // Largest message accepted from a client
+    double ping_interval_s = 2.0;
+    double timeout_s = 6.0;                  // Without any data from a client
+  };
+
+  using Frame = std::shared_ptr<const std::vector<uint8_t>>;
+
+  enum class SendResult
+  {
+    QUEUED,
+    REPLACED, // Took the place of an older message of the same slot
+    DROPPED,  // The client is too far behind
+    CLOSED    // No such client
+  };
+
+  struct ClientStats
+  {
+    int id;
+    std::string address;
+    uint64_t sent_messages;
+    uint64_t sent_bytes;
+    uint64_t replaced; // Stale messages overwritten by newer ones
+    uint64_t dropped;  // Messages refused because the queue was full
+    std::size_t queued_bytes;
+  };
+
+  using ConnectHandler = std::function<void(int client, const std::string &address)>;
+  using DisconnectHandler = std::function<void(int client)>;
+  using MessageHandler = std::function<void(int client, const uint8_t *data, std::size_t size, bool binary)>;
+
+  WebSocketServer() : WebSocketServer(Config()) {}
+  explicit WebSocketServer(const Config &config);
+  ~WebSocketServer();
+
+  WebSocketServer(const WebSocketServer &) = delete;
+  WebSocketServer &operator=(const WebSocketServer &) = delete;
+
+  void onConnect(ConnectHandler handler) { on_connect_ = std::move(handler); }
+  void onDisconnect(DisconnectHandler handler) { on_disconnect_ = std::move(handler); }
+  void onMessage(MessageHandler handler) { on_message_ = std::move(handler); }
+
+  /**
+   * @brief Binds the port and starts the server thread.
+   * @returns false if the port cannot be bound, lastError() says why
+   */
+  bool start();
+  void stop();
+
+  /**
+   * @brief Frames a binary message made of a header and a payload, copying each once.
+   */
+  static Frame binaryFrame(const uint8_t *header, std::size_t header_size, const uint8_t *payload, std::size_t size);
+  static Frame textFrame(const std::string &text);
+
+  /**
+   * @brief Queues a framed message for a client. Safe to call from any thread.
+   * @param client Id given to the connect handler
+   * @param frame Message from binaryFrame() or textFrame()
+   * @param slot Messages of the same slot supersede each other, -1 never drops the message
+   * @param replace If false a slotted message is only dropped when the queue is full,
+   *                for streams where every message counts until the next keyframe
+   */
+  SendResult send(int client, const Frame &frame, int slot = -1, bool replace = true);
+
+  /**
+   * @brief Closes a client's connection with a close frame.
+   */
+  void disconnect(int client);
+
+  std::vector<ClientStats> stats() const;
+  std::size_t clientCount() const;
+  uint16_t port() const { return bound_port_; }
+  const std::string &lastError() const { return last_error_; }
+
+private:
+  struct Outgoing
+  {
+    Frame frame;
+    std::size_t offset = 0; // Bytes already written
+    int slot = -1;
+  };
+
+  struct Client
+  {
+    int fd = -1;
+    std::string address;
+    bool open = false;            // Handshake done
+    bool closing = false;         // Close frame queued, the socket goes once it is out
+    std::vector<uint8_t> in;      // Bytes received and not yet parsed
+    std::vector<uint8_t> message; // Fragments of the message being received
+    bool message_binary = false;
+    std::deque<Outgoing> queue;
+    std::size_t queued_bytes = 0;
+    std::chrono::steady_clock::time_point last_heard{};
+    std::chrono::steady_clock::time_point last_ping{};
+    ClientStats stats{};
+  };
+
+  /**
+   * @struct Event
+   * @brief Collected while the clients are locked, handed to the callbacks afterwards.
+   */
+  struct Event
+  {
+    enum Kind
+    {
+      CONNECT,
+      DISCONNECT,
+      MESSAGE
+    };
+    Kind kind;
+    int client;
+    std::string address;
+    std::vector<uint8_t> data;
+    bool binary = false;
+  };
+
+  void run();
+  void acceptClients();
+  bool readClient(int id, Client &client);
+  bool writeClient(Client &client);
+  bool handshake(int id, Client &client);
+  bool parseFrames(int id, Client &client);
+  void queueControl(Client &client, uint8_t opcode, const uint8_t *payload, std::size_t size);
+  void queueRaw(Client &client, const std::string &bytes);
+  void dispatch();
+  void wake();
+
+  Config config_;
+  int listen_fd_ = -1;
+  int wake_fd_ = -1;
+  uint16_t bound_port_ = 0;
+  std::string last_error_;
+
+  mutable std::mutex mutex_;       // Guards clients_
+  std::map<int, Client> clients_;
+  int next_id_ = 1;
+  std::vector<Event> events_;      // Server thread only
+
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+
+  ConnectHandler on_connect_;
+  DisconnectHandler on_disconnect_;
+  MessageHandler on_message_;
+};
+
+#endif // WEBSOCKETSERVER_HPP
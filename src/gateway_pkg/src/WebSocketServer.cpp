@@ -0,0 +1,702 @@
+#include "gateway_pkg/WebSocketServer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+  const char *WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+  enum Opcode : uint8_t
+  {
+    CONTINUATION = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xA
+  };
+
+  const uint16_t CLOSE_PROTOCOL_ERROR = 1002;
+  const uint16_t CLOSE_TOO_BIG = 1009;
+
+  /**
+   * @brief SHA-1 of the handshake key, the only hash WebSocket needs.
+   */
+  void sha1(const std::string &text, uint8_t digest[20])
+  {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    std::vector<uint8_t> data(text.begin(), text.end());
+    const uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+    data.push_back(0x80);
+    while (data.size() % 64 != 56)
+    {
+      data.push_back(0);
+    }
+    for (int i = 7; i >= 0; i--)
+    {
+      data.push_back(static_cast<uint8_t>(bits >> (i * 8)));
+    }
+
+    auto rotate = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+    for (std::size_t chunk = 0; chunk < data.size(); chunk += 64)
+    {
+      uint32_t w[80];
+      for (int i = 0; i < 16; i++)
+      {
+        const uint8_t *p = &data[chunk + i * 4];
+        w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+      }
+      for (int i = 16; i < 80; i++)
+      {
+        w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+      }
+      uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+      for (int i = 0; i < 80; i++)
+      {
+        uint32_t f, k;
+        if (i < 20)
+        {
+          f = (b & c) | (~b & d);
+          k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+          f = b ^ c ^ d;
+          k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+          f = (b & c) | (b & d) | (c & d);
+          k = 0x8F1BBCDC;
+        }
+        else
+        {
+          f = b ^ c ^ d;
+          k = 0xCA62C1D6;
+        }
+        const uint32_t t = rotate(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotate(b, 30);
+        b = a;
+        a = t;
+      }
+      h[0] += a;
+      h[1] += b;
+      h[2] += c;
+      h[3] += d;
+      h[4] += e;
+    }
+    for (int i = 0; i < 5; i++)
+    {
+      digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+      digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+      digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+      digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+    }
+  }
+
+  std::string base64(const uint8_t *data, std::size_t size)
+  {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (std::size_t i = 0; i < size; i += 3)
+    {
+      const uint32_t n = (uint32_t(data[i]) << 16) | (i + 1 < size ? uint32_t(data[i + 1]) << 8 : 0) |
+                         (i + 2 < size ? uint32_t(data[i + 2]) : 0);
+      out += table[(n >> 18) & 63];
+      out += table[(n >> 12) & 63];
+      out += i + 1 < size ? table[(n >> 6) & 63] : '=';
+      out += i + 2 < size ? table[n & 63] : '=';
+    }
+    return out;
+  }
+
+  /**
+   * @returns The value of an HTTP header, matched without regard to case, empty if missing
+   */
+  std::string headerValue(const std::string &request, const std::string &name)
+  {
+    std::string lower(request);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    std::string key = "\r\n" + name + ":";
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+    const std::size_t at = lower.find(key);
+    if (at == std::string::npos)
+    {
+      return "";
+    }
+    std::size_t begin = at + key.size();
+    const std::size_t end = request.find("\r\n", begin);
+    while (begin < end && (request[begin] == ' ' || request[begin] == '\t'))
+    {
+      begin++;
+    }
+    std::size_t last = end;
+    while (last > begin && (request[last - 1] == ' ' || request[last - 1] == '\t'))
+    {
+      last--;
+    }
+    return request.substr(begin, last - begin);
+  }
+
+  /**
+   * @brief Writes a frame header for an unmasked server frame.
+   * @returns Bytes written, at most 10
+   */
+  std::size_t frameHeader(uint8_t opcode, std::size_t size, uint8_t *out)
+  {
+    out[0] = static_cast<uint8_t>(0x80 | opcode);
+    if (size < 126)
+    {
+      out[1] = static_cast<uint8_t>(size);
+      return 2;
+    }
+    if (size <= 0xFFFF)
+    {
+      out[1] = 126;
+      out[2] = static_cast<uint8_t>(size >> 8);
+      out[3] = static_cast<uint8_t>(size);
+      return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++)
+    {
+      out[2 + i] = static_cast<uint8_t>(static_cast<uint64_t>(size) >> ((7 - i) * 8));
+    }
+    return 10;
+  }
+
+  WebSocketServer::Frame makeFrame(uint8_t opcode, const uint8_t *header, std::size_t header_size, const uint8_t *payload,
+                                   std::size_t size)
+  {
+    auto frame = std::make_shared<std::vector<uint8_t>>(10 + header_size + size);
+    const std::size_t prefix = frameHeader(opcode, header_size + size, frame->data());
+    if (header_size > 0)
+    {
+      std::memcpy(frame->data() + prefix, header, header_size);
+    }
+    if (size > 0)
+    {
+      std::memcpy(frame->data() + prefix + header_size, payload, size);
+    }
+    frame->resize(prefix + header_size + size);
+    return frame;
+  }
+
+  double secondsSince(std::chrono::steady_clock::time_point then, std::chrono::steady_clock::time_point now)
+  {
+    return std::chrono::duration<double>(now - then).count();
+  }
+} // namespace
+
+WebSocketServer::WebSocketServer(const Config &config) : config_(config)
+{
+}
+
+WebSocketServer::~WebSocketServer()
+{
+  stop();
+}
+
+bool WebSocketServer::start()
+{
+  if (running_)
+  {
+    return true;
+  }
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0)
+  {
+    last_error_ = std::string("socket: ") + std::strerror(errno);
+    return false;
+  }
+  const int yes = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(config_.port);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listen_fd_, 16) < 0)
+  {
+    last_error_ = "port " + std::to_string(config_.port) + ": " + std::strerror(errno);
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  socklen_t length = sizeof(address);
+  getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&address), &length);
+  bound_port_ = ntohs(address.sin_port);
+
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  running_ = true;
+  thread_ = std::thread(&WebSocketServer::run, this);
+  return true;
+}
+
+void WebSocketServer::stop()
+{
+  if (!running_)
+  {
+    return;
+  }
+  running_ = false;
+  wake();
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : clients_)
+  {
+    close(entry.second.fd);
+  }
+  clients_.clear();
+  close(listen_fd_);
+  close(wake_fd_);
+  listen_fd_ = -1;
+  wake_fd_ = -1;
+}
+
+WebSocketServer::Frame WebSocketServer::binaryFrame(const uint8_t *header, std::size_t header_size, const uint8_t *payload,
+                                                    std::size_t size)
+{
+  return makeFrame(BINARY, header, header_size, payload, size);
+}
+
+WebSocketServer::Frame WebSocketServer::textFrame(const std::string &text)
+{
+  return makeFrame(TEXT, nullptr, 0, reinterpret_cast<const uint8_t *>(text.data()), text.size());
+}
+
+WebSocketServer::SendResult WebSocketServer::send(int client, const Frame &frame, int slot, bool replace)
+{
+  SendResult result = SendResult::QUEUED;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = clients_.find(client);
+    if (it == clients_.end() || !it->second.open || it->second.closing)
+    {
+      return SendResult::CLOSED;
+    }
+    Client &c = it->second;
+
+    // A message that has started to go out must finish, the one behind it can be replaced
+    auto stale = c.queue.end();
+    if (slot >= 0 && replace)
+    {
+      stale = std::find_if(c.queue.begin(), c.queue.end(),
+                           [slot](const Outgoing &out) { return out.slot == slot && out.offset == 0; });
+    }
+    if (stale != c.queue.end())
+    {
+      c.queued_bytes = c.queued_bytes - stale->frame->size() + frame->size();
+      stale->frame = frame;
+      c.stats.replaced++;
+      result = SendResult::REPLACED;
+    }
+    else if (slot >= 0 && c.queued_bytes + frame->size() > config_.max_queued_bytes)
+    {
+      c.stats.dropped++;
+      return SendResult::DROPPED;
+    }
+    else
+    {
+      c.queue.push_back({frame, 0, slot});
+      c.queued_bytes += frame->size();
+    }
+  }
+  wake();
+  return result;
+}
+
+void WebSocketServer::disconnect(int client)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = clients_.find(client);
+    if (it == clients_.end() || it->second.closing)
+    {
+      return;
+    }
+    const uint8_t code[2] = {1000 >> 8, 1000 & 0xFF};
+    queueControl(it->second, CLOSE, code, sizeof(code));
+    it->second.closing = true;
+  }
+  wake();
+}
+
+std::vector<WebSocketServer::ClientStats> WebSocketServer::stats() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<ClientStats> out;
+  for (const auto &entry : clients_)
+  {
+    if (entry.second.open)
+    {
+      out.push_back(entry.second.stats);
+      out.back().queued_bytes = entry.second.queued_bytes;
+    }
+  }
+  return out;
+}
+
+std::size_t WebSocketServer::clientCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::count_if(clients_.begin(), clients_.end(), [](const auto &entry) { return entry.second.open; });
+}
+
+void WebSocketServer::wake()
+{
+  const uint64_t one = 1;
+  if (wake_fd_ >= 0 && write(wake_fd_, &one, sizeof(one)) < 0)
+  {
+    // Already signalled, the counter is full
+  }
+}
+
+void WebSocketServer::queueControl(Client &client, uint8_t opcode, const uint8_t *payload, std::size_t size)
+{
+  // Ahead of queued data, but never inside a message that is half written
+  const auto at = (!client.queue.empty() && client.queue.front().offset > 0) ? client.queue.begin() + 1 : client.queue.begin();
+  Frame frame = makeFrame(opcode, nullptr, 0, payload, size);
+  client.queued_bytes += frame->size();
+  client.queue.insert(at, {frame, 0, -1});
+}
+
+void WebSocketServer::queueRaw(Client &client, const std::string &bytes)
+{
+  client.queue.push_back({std::make_shared<std::vector<uint8_t>>(bytes.begin(), bytes.end()), 0, -1});
+  client.queued_bytes += bytes.size();
+}
+
+void WebSocketServer::run()
+{
+  std::vector<pollfd> fds;
+  std::vector<int> ids;
+  while (running_)
+  {
+    fds.clear();
+    ids.clear();
+    fds.push_back({listen_fd_, POLLIN, 0});
+    fds.push_back({wake_fd_, POLLIN, 0});
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto &entry : clients_)
+      {
+        const short events = static_cast<short>(POLLIN | (entry.second.queue.empty() ? 0 : POLLOUT));
+        fds.push_back({entry.second.fd, events, 0});
+        ids.push_back(entry.first);
+      }
+    }
+
+    const int timeout_ms = static_cast<int>(std::max(10.0, config_.ping_interval_s * 250.0));
+    if (poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR)
+    {
+      break;
+    }
+    if (fds[1].revents & POLLIN)
+    {
+      uint64_t count = 0;
+      if (read(wake_fd_, &count, sizeof(count)) < 0)
+      {
+        // Spurious wakeup
+      }
+    }
+    if (fds[0].revents & POLLIN)
+    {
+      acceptClients();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto now = std::chrono::steady_clock::now();
+      std::vector<int> dead;
+      for (std::size_t i = 0; i < ids.size(); i++)
+      {
+        auto it = clients_.find(ids[i]);
+        if (it == clients_.end())
+        {
+          continue;
+        }
+        Client &client = it->second;
+        const short revents = fds[i + 2].revents;
+        bool alive = (revents & (POLLERR | POLLNVAL)) == 0;
+        if (alive && (revents & (POLLIN | POLLHUP)))
+        {
+          alive = readClient(ids[i], client);
+        }
+        if (alive && (revents & POLLOUT))
+        {
+          alive = writeClient(client);
+        }
+        if (alive && secondsSince(client.last_heard, now) > config_.timeout_s)
+        {
+          alive = false;
+        }
+        if (alive && client.open && !client.closing && secondsSince(client.last_ping, now) >= config_.ping_interval_s)
+        {
+          queueControl(client, PING, nullptr, 0);
+          client.last_ping = now;
+        }
+        if (!alive)
+        {
+          dead.push_back(ids[i]);
+        }
+      }
+      for (int id : dead)
+      {
+        auto it = clients_.find(id);
+        if (it->second.open)
+        {
+          events_.push_back({Event::DISCONNECT, id, it->second.address, {}, false});
+        }
+        close(it->second.fd);
+        clients_.erase(it);
+      }
+    }
+    dispatch();
+  }
+}
+
+void WebSocketServer::dispatch()
+{
+  for (Event &event : events_)
+  {
+    switch (event.kind)
+    {
+    case Event::CONNECT:
+      if (on_connect_)
+        on_connect_(event.client, event.address);
+      break;
+    case Event::DISCONNECT:
+      if (on_disconnect_)
+        on_disconnect_(event.client);
+      break;
+    case Event::MESSAGE:
+      if (on_message_)
+        on_message_(event.client, event.data.data(), event.data.size(), event.binary);
+      break;
+    }
+  }
+  events_.clear();
+}
+
+void WebSocketServer::acceptClients()
+{
+  while (true)
+  {
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    const int fd = accept4(listen_fd_, reinterpret_cast<sockaddr *>(&address), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      return; // EAGAIN once every pending connection is taken
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (static_cast<int>(clients_.size()) >= config_.max_clients)
+    {
+      close(fd);
+      continue;
+    }
+    const int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &config_.send_buffer_bytes, sizeof(config_.send_buffer_bytes));
+
+    char host[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+    const int id = next_id_++;
+    Client &client = clients_[id];
+    client.fd = fd;
+    client.address = std::string(host) + ":" + std::to_string(ntohs(address.sin_port));
+    client.last_heard = client.last_ping = std::chrono::steady_clock::now();
+    client.stats.id = id;
+    client.stats.address = client.address;
+  }
+}
+
+bool WebSocketServer::readClient(int id, Client &client)
+{
+  uint8_t buffer[16384];
+  while (true)
+  {
+    const ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (n == 0)
+    {
+      return false; // Closed by the peer
+    }
+    if (n < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        break;
+      }
+      return false;
+    }
+    client.in.insert(client.in.end(), buffer, buffer + n);
+    client.last_heard = std::chrono::steady_clock::now();
+    if (client.in.size() > config_.max_message_bytes + 16384)
+    {
+      break; // Parse before reading more, a flood cannot grow the buffer
+    }
+  }
+  return client.open ? parseFrames(id, client) : handshake(id, client);
+}
+
+bool WebSocketServer::handshake(int id, Client &client)
+{
+  const std::string request(client.in.begin(), client.in.end());
+  const std::size_t end = request.find("\r\n\r\n");
+  if (end == std::string::npos)
+  {
+    return request.size() < 8192; // Still arriving, unless it is no HTTP request at all
+  }
+  const std::string head = request.substr(0, end + 2);
+  const std::string key = headerValue(head, "Sec-WebSocket-Key");
+  std::string upgrade = headerValue(head, "Upgrade");
+  std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(), [](unsigned char c) { return std::tolower(c); });
+  if (head.compare(0, 4, "GET ") != 0 || upgrade != "websocket" || key.empty())
+  {
+    queueRaw(client, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+    client.closing = true;
+    client.in.clear();
+    return true;
+  }
+
+  uint8_t digest[20];
+  sha1(key + WEBSOCKET_GUID, digest);
+  queueRaw(client, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Accept: " + base64(digest, sizeof(digest)) + "\r\n\r\n");
+  client.open = true;
+  client.in.erase(client.in.begin(), client.in.begin() + end + 4);
+  events_.push_back({Event::CONNECT, id, client.address, {}, false});
+  return parseFrames(id, client);
+}
+
+bool WebSocketServer::parseFrames(int id, Client &client)
+{
+  std::size_t at = 0;
+  const std::vector<uint8_t> &in = client.in;
+  while (!client.closing && in.size() - at >= 2)
+  {
+    const bool fin = in[at] & 0x80;
+    const uint8_t opcode = in[at] & 0x0F;
+    const bool masked = in[at + 1] & 0x80;
+    uint64_t length = in[at + 1] & 0x7F;
+    std::size_t header = 2;
+    if (length == 126)
+    {
+      if (in.size() - at < 4)
+        break;
+      length = (uint64_t(in[at + 2]) << 8) | in[at + 3];
+      header = 4;
+    }
+    else if (length == 127)
+    {
+      if (in.size() - at < 10)
+        break;
+      length = 0;
+      for (int i = 0; i < 8; i++)
+      {
+        length = (length << 8) | in[at + 2 + i];
+      }
+      header = 10;
+    }
+
+    uint16_t error = 0;
+    if (!masked)
+    {
+      error = CLOSE_PROTOCOL_ERROR; // Clients must mask every frame
+    }
+    else if (length > config_.max_message_bytes - client.message.size())
+    {
+      error = CLOSE_TOO_BIG;
+    }
+    if (error != 0)
+    {
+      const uint8_t code[2] = {static_cast<uint8_t>(error >> 8), static_cast<uint8_t>(error & 0xFF)};
+      queueControl(client, CLOSE, code, sizeof(code));
+      client.closing = true;
+      break;
+    }
+    if (in.size() - at < header + 4 + length)
+    {
+      break; // Wait for the rest of the frame
+    }
+
+    const uint8_t *mask = &in[at + header];
+    std::vector<uint8_t> payload(in.begin() + at + header + 4, in.begin() + at + header + 4 + length);
+    for (std::size_t i = 0; i < payload.size(); i++)
+    {
+      payload[i] ^= mask[i & 3];
+    }
+    at += header + 4 + length;
+
+    switch (opcode)
+    {
+    case TEXT:
+    case BINARY:
+      client.message_binary = opcode == BINARY;
+      client.message = std::move(payload);
+      break;
+    case CONTINUATION:
+      client.message.insert(client.message.end(), payload.begin(), payload.end());
+      break;
+    case PING:
+      queueControl(client, PONG, payload.data(), payload.size());
+      continue;
+    case PONG:
+      continue;
+    case CLOSE:
+      queueControl(client, CLOSE, payload.data(), std::min<std::size_t>(payload.size(), 2));
+      client.closing = true;
+      continue;
+    default:
+      continue;
+    }
+    if (fin)
+    {
+      events_.push_back({Event::MESSAGE, id, "", std::move(client.message), client.message_binary});
+      client.message.clear();
+    }
+  }
+  client.in.erase(client.in.begin(), client.in.begin() + at);
+  return true;
+}
+
+bool WebSocketServer::writeClient(Client &client)
+{
+  while (!client.queue.empty())
+  {
+    Outgoing &out = client.queue.front();
+    const ssize_t n = ::send(client.fd, out.frame->data() + out.offset, out.frame->size() - out.offset, MSG_NOSIGNAL);
+    if (n < 0)
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    out.offset += n;
+    if (out.offset < out.frame->size())
+    {
+      return true; // Socket buffer full
+    }
+    client.stats.sent_messages++;
+    client.stats.sent_bytes += out.frame->size();
+    client.queued_bytes -= out.frame->size();
+    client.queue.pop_front();
+  }
+  return !client.closing; // Everything out, including the close frame
+}
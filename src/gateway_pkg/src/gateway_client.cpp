@@ -0,0 +1,368 @@
+// Connects to the gateway like the pilot page does and reports what arrives: frames per second,
+// throughput, frame age and lost frames per channel. --read-kbps throttles reading to play a
+// slow link, which shows the gateway dropping stale frames instead of building a backlog.
+// --joy sends a neutral joystick at 20 Hz. No ROS needed.
+//
+// usage: gateway_client [host] [port] [seconds] [--h264] [--joy] [--read-kbps N] [channels...]
+// Channels are indices into the hello message, all of them by default.
+#include "gateway_pkg/Protocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+  struct ChannelStats
+  {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t keyframes = 0;
+    uint64_t lost = 0; // Sequence numbers skipped
+    double age_ms = 0.0;
+    double max_age_ms = 0.0;
+    int64_t last_sequence = -1;
+  };
+
+  int64_t nowNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  int connectTo(const std::string &host, const std::string &port)
+  {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+    {
+      return -1;
+    }
+    int fd = -1;
+    for (addrinfo *ai = result; ai != nullptr && fd < 0; ai = ai->ai_next)
+    {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0)
+      {
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(result);
+    return fd;
+  }
+
+  bool sendAll(int fd, const uint8_t *data, std::size_t size)
+  {
+    while (size > 0)
+    {
+      const ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+      if (n <= 0)
+      {
+        return false;
+      }
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Sends one masked client frame, as browsers do.
+   */
+  bool sendFrame(int fd, uint8_t opcode, const uint8_t *payload, std::size_t size)
+  {
+    static std::mt19937 rng(std::random_device{}());
+    std::vector<uint8_t> frame;
+    frame.push_back(0x80 | opcode);
+    if (size < 126)
+    {
+      frame.push_back(0x80 | static_cast<uint8_t>(size));
+    }
+    else
+    {
+      frame.push_back(0x80 | 126);
+      frame.push_back(static_cast<uint8_t>(size >> 8));
+      frame.push_back(static_cast<uint8_t>(size));
+    }
+    uint8_t mask[4];
+    for (uint8_t &m : mask)
+    {
+      m = static_cast<uint8_t>(rng());
+      frame.push_back(m);
+    }
+    for (std::size_t i = 0; i < size; i++)
+    {
+      frame.push_back(payload[i] ^ mask[i & 3]);
+    }
+    return sendAll(fd, frame.data(), frame.size());
+  }
+
+  /**
+   * @brief Reads the channel names out of the hello message without a JSON parser.
+   */
+  std::vector<std::string> helloChannels(const std::string &text)
+  {
+    std::vector<std::string> channels;
+    const std::size_t key = text.find("\"channels\"");
+    const std::size_t open = key == std::string::npos ? std::string::npos : text.find('[', key);
+    const std::size_t end = open == std::string::npos ? std::string::npos : text.find(']', open);
+    std::size_t at = open;
+    while (end != std::string::npos)
+    {
+      const std::size_t first = text.find('"', at + 1);
+      if (first >= end)
+        break;
+      const std::size_t last = text.find('"', first + 1);
+      channels.push_back(text.substr(first + 1, last - first - 1));
+      at = last;
+    }
+    return channels;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::string host = "localhost";
+  std::string port = "9091";
+  double seconds = 10.0;
+  bool h264 = false;
+  bool joy = false;
+  double read_kbps = 0.0;
+  std::vector<int> wanted;
+  int positional = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--h264")
+      h264 = true;
+    else if (arg == "--joy")
+      joy = true;
+    else if (arg == "--read-kbps" && i + 1 < argc)
+      read_kbps = std::atof(argv[++i]);
+    else if (positional == 0 && ++positional)
+      host = arg;
+    else if (positional == 1 && ++positional)
+      port = arg;
+    else if (positional == 2 && ++positional)
+      seconds = std::atof(arg.c_str());
+    else
+      wanted.push_back(std::atoi(arg.c_str()));
+  }
+
+  const int fd = connectTo(host, port);
+  if (fd < 0)
+  {
+    std::fprintf(stderr, "cannot connect to %s:%s\n", host.c_str(), port.c_str());
+    return 1;
+  }
+  const int yes = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  if (read_kbps > 0.0)
+  {
+    const int receive_buffer = 16 * 1024; // Let the throttle show up at the sender quickly
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+  }
+
+  const std::string request = "GET / HTTP/1.1\r\nHost: " + host + ":" + port +
+                              "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                              "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+  sendAll(fd, reinterpret_cast<const uint8_t *>(request.data()), request.size());
+
+  std::vector<uint8_t> in;
+  bool upgraded = false;
+  std::vector<std::string> channels;
+  std::map<int, ChannelStats> stats;
+  uint64_t telemetry = 0;
+  const auto start = std::chrono::steady_clock::now();
+  auto last_report = start;
+  auto next_joy = start;
+  uint32_t joy_frame_id = 0;
+  uint64_t received_bytes = 0;
+
+  while (std::chrono::steady_clock::now() - start < std::chrono::duration<double>(seconds))
+  {
+    pollfd pfd{fd, POLLIN, 0};
+    poll(&pfd, 1, 20);
+    if (pfd.revents & POLLIN)
+    {
+      uint8_t buffer[16384];
+      std::size_t budget = sizeof(buffer);
+      if (read_kbps > 0.0)
+      {
+        // Read no faster than the link being played
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double allowed = elapsed * read_kbps * 1000.0 / 8.0 - received_bytes;
+        budget = static_cast<std::size_t>(std::clamp(allowed, 0.0, static_cast<double>(sizeof(buffer))));
+      }
+      const ssize_t n = budget > 0 ? recv(fd, buffer, budget, 0) : 0;
+      if (budget > 0 && n <= 0)
+      {
+        std::fprintf(stderr, "connection closed\n");
+        break;
+      }
+      if (n > 0)
+      {
+        received_bytes += n;
+        in.insert(in.end(), buffer, buffer + n);
+      }
+      else
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+
+    if (!upgraded)
+    {
+      const std::string head(in.begin(), in.end());
+      const std::size_t end = head.find("\r\n\r\n");
+      if (end == std::string::npos)
+        continue;
+      if (head.compare(0, 12, "HTTP/1.1 101") != 0 ||
+          head.find("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == std::string::npos)
+      {
+        std::fprintf(stderr, "handshake refused:\n%s\n", head.substr(0, end).c_str());
+        return 1;
+      }
+      upgraded = true;
+      in.erase(in.begin(), in.begin() + end + 4);
+    }
+
+    // Server frames are never masked
+    std::size_t at = 0;
+    while (in.size() - at >= 2)
+    {
+      const uint8_t opcode = in[at] & 0x0F;
+      uint64_t length = in[at + 1] & 0x7F;
+      std::size_t header = 2;
+      if (length == 126)
+      {
+        if (in.size() - at < 4)
+          break;
+        length = (uint64_t(in[at + 2]) << 8) | in[at + 3];
+        header = 4;
+      }
+      else if (length == 127)
+      {
+        if (in.size() - at < 10)
+          break;
+        length = 0;
+        for (int i = 0; i < 8; i++)
+          length = (length << 8) | in[at + 2 + i];
+        header = 10;
+      }
+      if (in.size() - at < header + length)
+        break;
+      const uint8_t *payload = in.data() + at + header;
+      at += header + length;
+
+      if (opcode == 0x9)
+      {
+        sendFrame(fd, 0xA, payload, length);
+      }
+      else if (opcode == 0x1)
+      {
+        const std::string text(reinterpret_cast<const char *>(payload), length);
+        if (text.find("\"hello\"") != std::string::npos)
+        {
+          channels = helloChannels(text);
+          for (std::size_t c = 0; c < channels.size(); c++)
+          {
+            if (wanted.empty() || std::find(wanted.begin(), wanted.end(), static_cast<int>(c)) != wanted.end())
+            {
+              const uint8_t subscribe[Gateway::SUBSCRIBE_SIZE] = {Gateway::SUBSCRIBE, static_cast<uint8_t>(c),
+                                                                  h264 ? Gateway::VIDEO_H264 : Gateway::VIDEO_JPEG, 0};
+              sendFrame(fd, 0x2, subscribe, sizeof(subscribe));
+              stats[static_cast<int>(c)];
+            }
+          }
+        }
+        else
+        {
+          telemetry++;
+        }
+      }
+      else if (opcode == 0x2)
+      {
+        Gateway::VideoHeader video;
+        if (!video.read(payload, length))
+          continue;
+        ChannelStats &s = stats[video.channel];
+        const double age_ms = (nowNs() - video.stamp_ns) * 1e-6;
+        if (s.last_sequence >= 0 && video.sequence > s.last_sequence + 1)
+          s.lost += video.sequence - s.last_sequence - 1;
+        s.last_sequence = video.sequence;
+        s.frames++;
+        s.bytes += length;
+        s.keyframes += (video.flags & Gateway::KEYFRAME) ? 1 : 0;
+        s.age_ms += age_ms;
+        s.max_age_ms = std::max(s.max_age_ms, age_ms);
+
+        // Tell the gateway what is on screen, as the pilot page does
+        uint8_t feedback[Gateway::VIDEO_FEEDBACK_SIZE] = {Gateway::VIDEO_FEEDBACK, video.channel};
+        std::memcpy(feedback + 8, &video.stamp_ns, 8);
+        sendFrame(fd, 0x2, feedback, sizeof(feedback));
+      }
+      else if (opcode == 0x8)
+      {
+        std::fprintf(stderr, "closed by the gateway\n");
+        return 1;
+      }
+    }
+    in.erase(in.begin(), in.begin() + at);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (joy && upgraded && now >= next_joy)
+    {
+      // 8 axes and 17 buttons, the size the controller node expects
+      uint8_t message[Gateway::JOY_HEADER_SIZE + 8 * 4 + 17] = {Gateway::JOY, 8, 17, 0};
+      const uint32_t frame_id = ++joy_frame_id;
+      const int64_t page_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch())
+                                  .count();
+      std::memcpy(message + 4, &frame_id, 4);
+      std::memcpy(message + 8, &page_ns, 8);
+      sendFrame(fd, 0x2, message, sizeof(message));
+      next_joy = now + std::chrono::milliseconds(50);
+    }
+    const double since = std::chrono::duration<double>(now - last_report).count();
+    if (since >= 1.0)
+    {
+      for (auto &entry : stats)
+      {
+        ChannelStats &s = entry.second;
+        const std::string name = entry.first < static_cast<int>(channels.size()) ? channels[entry.first] : "?";
+        std::printf("%-36s %5.1f fps %8.1f kB/s  age %6.1f ms (max %6.1f)  keyframes %3llu  lost %llu\n", name.c_str(),
+                    s.frames / since, s.bytes / since / 1000.0, s.frames > 0 ? s.age_ms / s.frames : 0.0, s.max_age_ms,
+                    static_cast<unsigned long long>(s.keyframes), static_cast<unsigned long long>(s.lost));
+        const int64_t sequence = s.last_sequence;
+        s = ChannelStats();
+        s.last_sequence = sequence;
+      }
+      if (telemetry > 0)
+      {
+        std::printf("telemetry %5.1f msg/s\n", telemetry / since);
+        telemetry = 0;
+      }
+      std::fflush(stdout);
+      last_report = now;
+    }
+  }
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "sensor_msgs/msg/compressed_image.hpp"
+#include "sensor_msgs/msg/joy.hpp"
+#include "interfaces_pkg/msg/encoded_video.hpp"
+#include "interfaces_pkg/msg/motor_health.hpp"
+#include "interfaces_pkg/msg/video_feedback.hpp"
+
+#include "gateway_pkg/Protocol.hpp"
+#include "gateway_pkg/WebSocketServer.hpp"
+
+using namespace std::chrono_literals;
+
+const double JOY_TIMEOUT_S = 0.5; // The page sends the gamepad every 50 ms; silence this long stops the robot
+const int TELEMETRY_SLOT = 255;   // Send queue slot of the motor health, after the video channels
+
+/**
+ * @struct Channel
+ * @brief One camera topic and the subscriptions that exist while a client watches it.
+ */
+struct Channel
+{
+  std::string topic;
+  rclcpp::Subscription<sensor_msgs::msg::CompressedImage>::SharedPtr jpeg_sub;
+  rclcpp::Subscription<interfaces_pkg::msg::EncodedVideo>::SharedPtr h264_sub;
+  uint32_t jpeg_sequence = 0;
+};
+
+/**
+ * @struct PageClient
+ * @brief What one connected page has asked for.
+ */
+struct PageClient
+{
+  std::string address;
+  std::vector<uint8_t> formats;       // Gateway::VIDEO_JPEG or VIDEO_H264 per channel, 0 for none
+  std::vector<bool> waiting_keyframe; // H.264 is skipped until a keyframe, after a drop or on subscribing
+};
+
+/**
+ * @class GatewayNode
+ * @brief Serves camera video and motor health to the pilot page over one WebSocket and
+ *        publishes the page's gamepad on /joy, without going through rosbridge.
+ *
+ * Video goes out as binary messages (see Protocol.hpp), one framed copy shared by every client.
+ * A client that falls behind gets the newest frame of each camera rather than a backlog. Camera
+ * topics are only subscribed while a page watches them, so the camera node keeps its lazy
+ * publishing. One page drives at a time; if it disconnects or goes quiet, a neutral joystick is
+ * published so the robot stops.
+ ******************************************************************************/
+class GatewayNode : public rclcpp::Node
+{
+public:
+  /**
+   * @brief Declares the parameters, creates the publishers and starts the WebSocket server.
+   * @exception std::runtime_error if the port cannot be bound
+   */
+  GatewayNode() : Node("gateway_node")
+  {
+    WebSocketServer::Config server_config;
+    server_config.port = static_cast<uint16_t>(this->declare_parameter<int>("port", server_config.port));
+    server_config.max_clients = this->declare_parameter<int>("max_clients", server_config.max_clients);
+    server_config.max_queued_bytes = 1024 * this->declare_parameter<int>("max_client_queue_kb", 256);
+    server_ = std::make_unique<WebSocketServer>(server_config);
+
+    const auto topics = this->declare_parameter<std::vector<std::string>>(
+        "camera_topics", {"rs_node/camera1/compressed_video", "rs_node/camera2/compressed_video",
+                          "rgb_cam1/compressed", "rgb_cam2/compressed"});
+    channels_.resize(topics.size());
+    for (std::size_t i = 0; i < topics.size(); i++)
+    {
+      channels_[i].topic = topics[i];
+    }
+
+    /////
+    // Motor health to the page at most health_rate_hz, gamepad from the page to joy_topic
+    health_period_ = 1.0 / std::max(0.1, this->declare_parameter<double>("health_rate_hz", 10.0));
+    health_sub_ = this->create_subscription<interfaces_pkg::msg::MotorHealth>(
+        this->declare_parameter<std::string>("health_topic", "/health_topic"), 10,
+        std::bind(&GatewayNode::health_callback, this, std::placeholders::_1));
+    joy_pub_ = this->create_publisher<sensor_msgs::msg::Joy>(this->declare_parameter<std::string>("joy_topic", "/joy"), 10);
+    feedback_pub_ = this->create_publisher<interfaces_pkg::msg::VideoFeedback>("rs_node/video_feedback", 5);
+
+    /////
+    // The server calls back on its own thread, clients_ is shared with the executor
+    server_->onConnect(std::bind(&GatewayNode::client_connected, this, std::placeholders::_1, std::placeholders::_2));
+    server_->onDisconnect(std::bind(&GatewayNode::client_disconnected, this, std::placeholders::_1));
+    server_->onMessage(std::bind(&GatewayNode::client_message, this, std::placeholders::_1, std::placeholders::_2,
+                                 std::placeholders::_3, std::placeholders::_4));
+    if (!server_->start())
+    {
+      RCLCPP_FATAL(this->get_logger(), "Cannot start the WebSocket server: %s", server_->lastError().c_str());
+      throw std::runtime_error(server_->lastError());
+    }
+    RCLCPP_INFO(this->get_logger(), "Serving %zu cameras on ws://0.0.0.0:%u", channels_.size(), server_->port());
+
+    demand_timer_ = this->create_wall_timer(100ms, std::bind(&GatewayNode::demand_callback, this));
+    stats_timer_ = this->create_wall_timer(5s, std::bind(&GatewayNode::stats_callback, this));
+  }
+
+  ~GatewayNode()
+  {
+    server_->stop(); // No callback may run into a half destroyed node
+  }
+
+private:
+  std::unique_ptr<WebSocketServer> server_;
+  std::vector<Channel> channels_;
+
+  std::mutex clients_mutex_;              // Guards clients_ and the joystick state
+  std::map<int, PageClient> clients_;
+  int driver_ = 0;                        // Client whose gamepad drives, 0 for none
+  std::chrono::steady_clock::time_point last_joy_;
+  std::size_t joy_axes_ = 0;              // Size of the last joystick, for the neutral one
+  std::size_t joy_buttons_ = 0;           //
+
+  double health_period_ = 0.1;
+  rclcpp::Time last_health_{0, 0, RCL_ROS_TIME};
+
+  rclcpp::Subscription<interfaces_pkg::msg::MotorHealth>::SharedPtr health_sub_;
+  rclcpp::Publisher<sensor_msgs::msg::Joy>::SharedPtr joy_pub_;
+  rclcpp::Publisher<interfaces_pkg::msg::VideoFeedback>::SharedPtr feedback_pub_;
+  rclcpp::TimerBase::SharedPtr demand_timer_; // Subscribes the cameras clients want, watches the driver
+  rclcpp::TimerBase::SharedPtr stats_timer_;  // Logs what every client gets
+
+  /**
+   * @brief Greets a new page with the list of channels it can subscribe to.
+   * @param client Id of the client
+   * @param address Address and port of the client
+   *******************************************************/
+  void client_connected(int client, const std::string &address)
+  {
+    {
+      std::lock_guard<std::mutex> lock(clients_mutex_);
+      PageClient &page = clients_[client];
+      page.address = address;
+      page.formats.assign(channels_.size(), 0);
+      page.waiting_keyframe.assign(channels_.size(), true);
+    }
+    std::string hello = "{\"type\":\"hello\",\"channels\":[";
+    for (std::size_t i = 0; i < channels_.size(); i++)
+    {
+      hello += (i > 0 ? ",\"" : "\"") + channels_[i].topic + "\"";
+    }
+    hello += "]}";
+    server_->send(client, WebSocketServer::textFrame(hello));
+    RCLCPP_INFO(this->get_logger(), "Client %d connected from %s", client, address.c_str());
+  }
+
+  /**
+   * @brief Forgets a page. If it was driving, the robot gets a neutral joystick.
+   * @param client Id of the client
+   *******************************************************/
+  void client_disconnected(int client)
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    RCLCPP_INFO(this->get_logger(), "Client %d (%s) disconnected", client, clients_[client].address.c_str());
+    clients_.erase(client);
+    if (client == driver_)
+    {
+      RCLCPP_WARN(this->get_logger(), "Driving client left, stopping the robot");
+      publish_neutral_joy();
+    }
+  }
+
+  /**
+   * @brief Handles a binary message from a page: subscriptions, gamepad and video feedback.
+   * @param client Id of the client
+   * @param data Message bytes
+   * @param size Message size
+   * @param binary false for text messages, which are ignored
+   *******************************************************/
+  void client_message(int client, const uint8_t *data, std::size_t size, bool binary)
+  {
+    if (!binary || size == 0)
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    auto it = clients_.find(client);
+    if (it == clients_.end())
+    {
+      return;
+    }
+    PageClient &page = it->second;
+
+    switch (data[0])
+    {
+    case Gateway::SUBSCRIBE:
+      if (size >= Gateway::SUBSCRIBE_SIZE && data[1] < channels_.size() &&
+          (data[2] == 0 || data[2] == Gateway::VIDEO_JPEG || data[2] == Gateway::VIDEO_H264))
+      {
+        page.formats[data[1]] = data[2];
+        page.waiting_keyframe[data[1]] = true;
+      }
+      break;
+
+    case Gateway::JOY:
+    {
+      const std::size_t axes = size >= Gateway::JOY_HEADER_SIZE ? data[1] : 0;
+      const std::size_t buttons = size >= Gateway::JOY_HEADER_SIZE ? data[2] : 0;
+      if (size != Gateway::JOY_HEADER_SIZE + axes * 4 + buttons)
+      {
+        break;
+      }
+      const auto now = std::chrono::steady_clock::now();
+      if (driver_ != 0 && driver_ != client &&
+          std::chrono::duration<double>(now - last_joy_).count() < JOY_TIMEOUT_S)
+      {
+        RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 2000,
+                             "Client %d sends a gamepad while client %d drives, ignored", client, driver_);
+        break;
+      }
+      if (driver_ != client)
+      {
+        RCLCPP_INFO(this->get_logger(), "Client %d (%s) drives", client, page.address.c_str());
+      }
+      driver_ = client;
+      last_joy_ = now;
+      joy_axes_ = axes;
+      joy_buttons_ = buttons;
+
+      // The page's frame id and stamp let controller_node trace the message back to the gamepad
+      uint32_t frame_id = 0;
+      int64_t page_ns = 0;
+      std::memcpy(&frame_id, data + 4, 4);
+      std::memcpy(&page_ns, data + 8, 8);
+      sensor_msgs::msg::Joy joy;
+      joy.header.stamp = page_ns != 0 ? rclcpp::Time(page_ns, RCL_ROS_TIME) : this->now();
+      joy.header.frame_id = std::to_string(frame_id);
+      joy.axes.resize(axes);
+      std::memcpy(joy.axes.data(), data + Gateway::JOY_HEADER_SIZE, axes * 4);
+      joy.buttons.assign(data + Gateway::JOY_HEADER_SIZE + axes * 4, data + size);
+      joy_pub_->publish(joy);
+      break;
+    }
+
+    case Gateway::VIDEO_FEEDBACK:
+      if (size >= Gateway::VIDEO_FEEDBACK_SIZE && data[1] < channels_.size())
+      {
+        int64_t stamp_ns = 0;
+        std::memcpy(&stamp_ns, data + 8, 8);
+        interfaces_pkg::msg::VideoFeedback feedback;
+        feedback.stream = channels_[data[1]].topic;
+        feedback.last_frame.stamp = rclcpp::Time(stamp_ns, RCL_ROS_TIME);
+        feedback_pub_->publish(feedback);
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  /**
+   * @brief Publishes a joystick at rest, sized like the last one the driver sent, and releases the driver.
+   *        Called with clients_mutex_ held.
+   *******************************************************/
+  void publish_neutral_joy()
+  {
+    sensor_msgs::msg::Joy joy;
+    joy.header.stamp = this->now();
+    joy.axes.assign(joy_axes_, 0.0f);
+    joy.buttons.assign(joy_buttons_, 0);
+    joy_pub_->publish(joy);
+    driver_ = 0;
+  }
+
+  /**
+   * @brief Subscribes the camera topics some page watches and drops the others. Stops the
+   *        robot when the driving page has gone quiet.
+   *******************************************************/
+  void demand_callback()
+  {
+    std::vector<uint8_t> wanted(channels_.size(), 0); // Bit per format
+    {
+      std::lock_guard<std::mutex> lock(clients_mutex_);
+      for (const auto &entry : clients_)
+      {
+        for (std::size_t i = 0; i < channels_.size(); i++)
+        {
+          wanted[i] |= static_cast<uint8_t>(1u << entry.second.formats[i]);
+        }
+      }
+      if (driver_ != 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - last_joy_).count() > JOY_TIMEOUT_S)
+      {
+        RCLCPP_WARN(this->get_logger(), "No gamepad from client %d for %.1f s, stopping the robot", driver_, JOY_TIMEOUT_S);
+        publish_neutral_joy();
+      }
+    }
+
+    for (std::size_t i = 0; i < channels_.size(); i++)
+    {
+      Channel &channel = channels_[i];
+      const bool jpeg = wanted[i] & (1u << Gateway::VIDEO_JPEG);
+      const bool h264 = wanted[i] & (1u << Gateway::VIDEO_H264);
+      if (jpeg && !channel.jpeg_sub)
+      {
+        channel.jpeg_sub = this->create_subscription<sensor_msgs::msg::CompressedImage>(
+            channel.topic, rclcpp::SensorDataQoS().keep_last(1),
+            [this, i](const sensor_msgs::msg::CompressedImage::SharedPtr msg) { jpeg_callback(i, msg); });
+      }
+      else if (!jpeg && channel.jpeg_sub)
+      {
+        channel.jpeg_sub.reset();
+      }
+      if (h264 && !channel.h264_sub)
+      {
+        channel.h264_sub = this->create_subscription<interfaces_pkg::msg::EncodedVideo>(
+            channel.topic + "/h264", rclcpp::QoS(5),
+            [this, i](const interfaces_pkg::msg::EncodedVideo::SharedPtr msg) { h264_callback(i, msg); });
+      }
+      else if (!h264 && channel.h264_sub)
+      {
+        channel.h264_sub.reset();
+      }
+    }
+  }
+
+  /**
+   * @brief Sends a JPEG frame to every page watching the channel. A page still sending the
+   *        previous frame gets this one in its place.
+   * @param index Channel of the frame
+   * @param msg Compressed image
+   *******************************************************/
+  void jpeg_callback(std::size_t index, const sensor_msgs::msg::CompressedImage::SharedPtr msg)
+  {
+    Gateway::VideoHeader header;
+    header.type = Gateway::VIDEO_JPEG;
+    header.channel = static_cast<uint8_t>(index);
+    header.sequence = channels_[index].jpeg_sequence++;
+    header.stamp_ns = rclcpp::Time(msg->header.stamp).nanoseconds();
+    uint8_t bytes[Gateway::VIDEO_HEADER_SIZE];
+    header.write(bytes);
+
+    WebSocketServer::Frame frame; // Framed once, only if someone watches
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    for (const auto &entry : clients_)
+    {
+      if (entry.second.formats[index] != Gateway::VIDEO_JPEG)
+      {
+        continue;
+      }
+      if (!frame)
+      {
+        frame = WebSocketServer::binaryFrame(bytes, sizeof(bytes), msg->data.data(), msg->data.size());
+      }
+      server_->send(entry.first, frame, static_cast<int>(index), true);
+    }
+  }
+
+  /**
+   * @brief Sends an H.264 access unit to every page watching the channel. Frames depend on the
+   *        ones before them, so a page whose queue overflowed gets nothing until the next keyframe.
+   * @param index Channel of the frame
+   * @param msg Encoded video
+   *******************************************************/
+  void h264_callback(std::size_t index, const interfaces_pkg::msg::EncodedVideo::SharedPtr msg)
+  {
+    Gateway::VideoHeader header;
+    header.type = Gateway::VIDEO_H264;
+    header.channel = static_cast<uint8_t>(index);
+    header.flags = msg->keyframe ? Gateway::KEYFRAME : 0;
+    header.sequence = msg->sequence;
+    header.stamp_ns = rclcpp::Time(msg->header.stamp).nanoseconds();
+    header.width = static_cast<uint16_t>(msg->width);
+    header.height = static_cast<uint16_t>(msg->height);
+    uint8_t bytes[Gateway::VIDEO_HEADER_SIZE];
+    header.write(bytes);
+
+    WebSocketServer::Frame frame;
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    for (auto &entry : clients_)
+    {
+      PageClient &page = entry.second;
+      if (page.formats[index] != Gateway::VIDEO_H264 || (page.waiting_keyframe[index] && !msg->keyframe))
+      {
+        continue;
+      }
+      if (!frame)
+      {
+        frame = WebSocketServer::binaryFrame(bytes, sizeof(bytes), msg->data.data(), msg->data.size());
+      }
+      const auto result = server_->send(entry.first, frame, static_cast<int>(index), false);
+      page.waiting_keyframe[index] = result == WebSocketServer::SendResult::DROPPED;
+    }
+  }
+
+  /**
+   * @brief Sends the motor health to every page as JSON, at most health_rate_hz. An update
+   *        still queued for a slow page is replaced by the newer one.
+   * @param msg Motor health
+   *******************************************************/
+  void health_callback(const interfaces_pkg::msg::MotorHealth::SharedPtr msg)
+  {
+    const rclcpp::Time now = this->now();
+    if ((now - last_health_).seconds() < health_period_ || server_->clientCount() == 0)
+    {
+      return;
+    }
+    last_health_ = now;
+
+    const std::pair<const char *, double> fields[] = {
+        {"left_motor_velocity", msg->left_motor_velocity}, {"left_motor_current", msg->left_motor_current},
+        {"left_motor_voltage", msg->left_motor_voltage}, {"left_motor_temperature", msg->left_motor_temperature},
+        {"left_motor_position", msg->left_motor_position}, {"right_motor_velocity", msg->right_motor_velocity},
+        {"right_motor_current", msg->right_motor_current}, {"right_motor_voltage", msg->right_motor_voltage},
+        {"right_motor_temperature", msg->right_motor_temperature}, {"right_motor_position", msg->right_motor_position},
+        {"left_lift_position", msg->left_lift_position}, {"left_lift_current", msg->left_lift_current},
+        {"left_lift_voltage", msg->left_lift_voltage}, {"right_lift_position", msg->right_lift_position},
+        {"right_lift_current", msg->right_lift_current}, {"right_lift_voltage", msg->right_lift_voltage},
+        {"tilt_position", msg->tilt_position}, {"tilt_current", msg->tilt_current}, {"tilt_voltage", msg->tilt_voltage},
+        {"vibrator_current", msg->vibrator_current}, {"vibrator_voltage", msg->vibrator_voltage}};
+    std::ostringstream json;
+    json << "{\"type\":\"motor_health\",\"stamp\":" << now.seconds();
+    for (const auto &field : fields)
+    {
+      json << ",\"" << field.first << "\":";
+      if (std::isfinite(field.second))
+        json << field.second;
+      else
+        json << "null";
+    }
+    json << "}";
+
+    const WebSocketServer::Frame frame = WebSocketServer::textFrame(json.str());
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    for (const auto &entry : clients_)
+    {
+      server_->send(entry.first, frame, TELEMETRY_SLOT, true);
+    }
+  }
+
+  /**
+   * @brief Logs what every client received over the last period and how much was dropped.
+   *******************************************************/
+  void stats_callback()
+  {
+    for (const WebSocketServer::ClientStats &stats : server_->stats())
+    {
+      RCLCPP_INFO(this->get_logger(), "Client %d (%s): %llu messages, %.1f MB sent, %llu stale frames replaced, %llu dropped, %zu kB queued",
+                  stats.id, stats.address.c_str(), static_cast<unsigned long long>(stats.sent_messages), stats.sent_bytes / 1e6,
+                  static_cast<unsigned long long>(stats.replaced), static_cast<unsigned long long>(stats.dropped),
+                  stats.queued_bytes / 1024);
+    }
+  }
+};
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+  rclcpp::spin(std::make_shared<GatewayNode>());
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file Traversability.hpp
+ * @brief Per-cell traversability cost from a height grid: slope, step height and roughness.
+ */
+
+#ifndef TRAVERSABILITY_HPP
+#define TRAVERSABILITY_HPP
+#pragma once
+
+#include <cstdint>
+
+namespace navigation_pkg
+{
+
+// Cost values, matching the nav2_costmap_2d conventions
+const uint8_t TRAVERSABILITY_FREE = 0;
+const uint8_t TRAVERSABILITY_MAX_COST = 252; // Highest cost of a cell that can still be driven over
+const uint8_t TRAVERSABILITY_LETHAL = 254;
+const uint8_t TRAVERSABILITY_UNKNOWN = 255;
+
+/**
+ * @struct CellTraversability
+ * @brief Terrain measures of one cell, computed over its 3x3 neighborhood.
+ */
+struct CellTraversability
+{
+    float slope = 0.0f;     // Radians
+    float step = 0.0f;      // Largest height difference to a neighbor in meters
+    float roughness = 0.0f; // RMS residual of the neighborhood to the local slope in meters
+};
+
+/**
+ * @class TraversabilityEvaluator
+ * @brief Turns heights into costs. Each of slope, step and roughness is divided by its limit and
+ *        the largest ratio sets the cost: 0 on flat ground, rising to TRAVERSABILITY_MAX_COST,
+ *        and TRAVERSABILITY_LETHAL once any limit is reached.
+ */
+class TraversabilityEvaluator
+{
+public:
+    struct Limits
+    {
+        float max_slope = 0.35f;     // Radians, about 20 degrees
+        float max_step = 0.15f;      // Meters
+        float max_roughness = 0.05f; // Meters
+    };
+
+    TraversabilityEvaluator() = default;
+    explicit TraversabilityEvaluator(const Limits &limits) : limits_(limits) {}
+
+    /**
+     * @brief Terrain measures of one cell.
+     * @param heights Row-major grid of heights in meters, NaN for unknown cells
+     * @returns false if the cell or all its neighbors are unknown
+     */
+    bool measure(const float *heights, int width, int height, float resolution, int col, int row,
+                 CellTraversability &result) const;
+
+    /**
+     * @brief Costs of the cells inside inclusive bounds. Cells outside the bounds are not touched,
+     *        so a grid can be updated only where new data arrived.
+     * @param heights Row-major grid of heights in meters, NaN for unknown cells
+     * @param costs Row-major grid of the same size receiving the costs
+     */
+    void evaluate(const float *heights, int width, int height, float resolution,
+                  int col_min, int row_min, int col_max, int row_max, uint8_t *costs) const;
+
+    uint8_t cost(const CellTraversability &cell) const;
+
+    const Limits &limits() const { return limits_; }
+
+private:
+    Limits limits_;
+};
+
+} // namespace navigation_pkg
+
+#endif // TRAVERSABILITY_HPP
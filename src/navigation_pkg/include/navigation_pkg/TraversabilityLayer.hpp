@@ -0,0 +1,65 @@
+/**
+ * @file TraversabilityLayer.hpp
+ * @brief nav2 costmap layer turning the elevation grid of vision_pkg into traversability costs.
+ */
+
+#ifndef TRAVERSABILITYLAYER_HPP
+#define TRAVERSABILITYLAYER_HPP
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "nav2_costmap_2d/costmap_layer.hpp"
+#include "interfaces_pkg/msg/elevation_grid.hpp"
+#include "navigation_pkg/Traversability.hpp"
+
+namespace navigation_pkg
+{
+
+/**
+ * @class TraversabilityLayer
+ * @brief Costmap layer scoring slope, step height and roughness of the terrain.
+ *
+ * Every elevation_grid message carries the window of cells the cameras updated since the last
+ * one. Only that window, plus a one cell border for the neighborhoods, is evaluated and written
+ * into the layer, and only its bounds are reported to the layered costmap, so an update costs
+ * what the new frames touched rather than the size of the arena.
+ *
+ * Parameters, under the layer's name: enabled, topic (elevation_grid), max_slope_deg (20),
+ * max_step_m (0.15), max_roughness_m (0.05).
+ */
+class TraversabilityLayer : public nav2_costmap_2d::CostmapLayer
+{
+public:
+    TraversabilityLayer() = default;
+
+    void onInitialize() override;
+    void updateBounds(double robot_x, double robot_y, double robot_yaw,
+                      double *min_x, double *min_y, double *max_x, double *max_y) override;
+    void updateCosts(nav2_costmap_2d::Costmap2D &master_grid, int min_i, int min_j, int max_i, int max_j) override;
+    void reset() override;
+    void matchSize() override;
+    bool isClearable() override { return true; }
+
+private:
+    void elevationCallback(const interfaces_pkg::msg::ElevationGrid::ConstSharedPtr msg);
+
+    rclcpp::Subscription<interfaces_pkg::msg::ElevationGrid>::SharedPtr elevation_sub_;
+    TraversabilityEvaluator evaluator_;
+    std::vector<uint8_t> elevation_costs_; // Costs in elevation grid cells, reused between messages
+    std::vector<uint32_t> written_;        // Update in which each costmap cell was last written
+    uint32_t generation_ = 0;
+
+    // World bounds written since the last updateBounds(), empty when max < min
+    double touched_min_x_ = 0.0;
+    double touched_min_y_ = 0.0;
+    double touched_max_x_ = -1.0;
+    double touched_max_y_ = -1.0;
+};
+
+} // namespace navigation_pkg
+
+#endif // TRAVERSABILITYLAYER_HPP
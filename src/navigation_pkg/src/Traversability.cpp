@@ -0,0 +1,92 @@
+#include "navigation_pkg/Traversability.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace navigation_pkg
+{
+
+bool TraversabilityEvaluator::measure(const float *heights, int width, int height, float resolution, int col, int row,
+                                      CellTraversability &result) const
+{
+    const float center = heights[row * width + col];
+    if (std::isnan(center))
+    {
+        return false;
+    }
+
+    auto at = [&](int c, int r) {
+        return (c < 0 || r < 0 || c >= width || r >= height) ? NAN : heights[r * width + c];
+    };
+
+    // Gradient by central differences, one-sided at unknown neighbors
+    auto gradient = [&](float before, float after) {
+        if (!std::isnan(before) && !std::isnan(after))
+            return (after - before) / (2.0f * resolution);
+        if (!std::isnan(after))
+            return (after - center) / resolution;
+        if (!std::isnan(before))
+            return (center - before) / resolution;
+        return 0.0f;
+    };
+    const float gx = gradient(at(col - 1, row), at(col + 1, row));
+    const float gy = gradient(at(col, row - 1), at(col, row + 1));
+    result.slope = std::atan(std::sqrt(gx * gx + gy * gy));
+
+    // Step and roughness against the local slope over the 3x3 neighborhood
+    float step = 0.0f;
+    float sum_sq = 0.0f;
+    int known = 0;
+    for (int dr = -1; dr <= 1; dr++)
+    {
+        for (int dc = -1; dc <= 1; dc++)
+        {
+            const float h = at(col + dc, row + dr);
+            if (std::isnan(h))
+                continue;
+            step = std::max(step, std::fabs(h - center));
+            const float residual = h - (center + gx * dc * resolution + gy * dr * resolution);
+            sum_sq += residual * residual;
+            known++;
+        }
+    }
+    if (known < 2)
+    {
+        return false;
+    }
+    result.step = step;
+    result.roughness = std::sqrt(sum_sq / known);
+    return true;
+}
+
+uint8_t TraversabilityEvaluator::cost(const CellTraversability &cell) const
+{
+    const float ratio = std::max({cell.slope / limits_.max_slope, cell.step / limits_.max_step,
+                                  cell.roughness / limits_.max_roughness});
+    if (ratio >= 1.0f)
+    {
+        return TRAVERSABILITY_LETHAL;
+    }
+    return static_cast<uint8_t>(ratio * TRAVERSABILITY_MAX_COST);
+}
+
+void TraversabilityEvaluator::evaluate(const float *heights, int width, int height, float resolution,
+                                       int col_min, int row_min, int col_max, int row_max, uint8_t *costs) const
+{
+    col_min = std::max(col_min, 0);
+    row_min = std::max(row_min, 0);
+    col_max = std::min(col_max, width - 1);
+    row_max = std::min(row_max, height - 1);
+    for (int row = row_min; row <= row_max; row++)
+    {
+        for (int col = col_min; col <= col_max; col++)
+        {
+            CellTraversability cell;
+            costs[row * width + col] = measure(heights, width, height, resolution, col, row, cell)
+                                           ? cost(cell)
+                                           : TRAVERSABILITY_UNKNOWN;
+        }
+    }
+}
+
+} // namespace navigation_pkg
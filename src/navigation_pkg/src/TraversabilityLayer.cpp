@@ -0,0 +1,182 @@
+#include "navigation_pkg/TraversabilityLayer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "nav2_costmap_2d/cost_values.hpp"
+#include "pluginlib/class_list_macros.hpp"
+
+namespace navigation_pkg
+{
+
+void TraversabilityLayer::onInitialize()
+{
+    auto node = node_.lock();
+    if (!node)
+    {
+        throw std::runtime_error("TraversabilityLayer: unable to lock node");
+    }
+
+    declareParameter("enabled", rclcpp::ParameterValue(true));
+    declareParameter("topic", rclcpp::ParameterValue(std::string("elevation_grid")));
+    declareParameter("max_slope_deg", rclcpp::ParameterValue(20.0));
+    declareParameter("max_step_m", rclcpp::ParameterValue(0.15));
+    declareParameter("max_roughness_m", rclcpp::ParameterValue(0.05));
+
+    std::string topic;
+    double max_slope_deg = 20.0;
+    double max_step_m = 0.15;
+    double max_roughness_m = 0.05;
+    node->get_parameter(name_ + ".enabled", enabled_);
+    node->get_parameter(name_ + ".topic", topic);
+    node->get_parameter(name_ + ".max_slope_deg", max_slope_deg);
+    node->get_parameter(name_ + ".max_step_m", max_step_m);
+    node->get_parameter(name_ + ".max_roughness_m", max_roughness_m);
+
+    TraversabilityEvaluator::Limits limits;
+    limits.max_slope = static_cast<float>(max_slope_deg * M_PI / 180.0);
+    limits.max_step = static_cast<float>(max_step_m);
+    limits.max_roughness = static_cast<float>(max_roughness_m);
+    evaluator_ = TraversabilityEvaluator(limits);
+
+    matchSize();
+    current_ = true;
+
+    elevation_sub_ = node->create_subscription<interfaces_pkg::msg::ElevationGrid>(
+        topic, rclcpp::QoS(1),
+        std::bind(&TraversabilityLayer::elevationCallback, this, std::placeholders::_1));
+}
+
+void TraversabilityLayer::matchSize()
+{
+    std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+    CostmapLayer::matchSize();
+    written_.assign(static_cast<std::size_t>(getSizeInCellsX()) * getSizeInCellsY(), 0);
+    generation_ = 0;
+}
+
+void TraversabilityLayer::reset()
+{
+    std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+    resetMaps();
+    std::fill(written_.begin(), written_.end(), 0);
+    generation_ = 0;
+    current_ = true;
+}
+
+void TraversabilityLayer::elevationCallback(const interfaces_pkg::msg::ElevationGrid::ConstSharedPtr msg)
+{
+    if (!enabled_ || msg->updated_col_max < msg->updated_col_min || msg->updated_row_max < msg->updated_row_min)
+    {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    const int width = msg->width;
+    const int height = msg->height;
+    if (msg->heights.size() != static_cast<std::size_t>(width) * height)
+    {
+        RCLCPP_WARN(logger_, "Elevation grid holds %zu heights for %dx%d cells", msg->heights.size(), width, height);
+        return;
+    }
+
+    // The border cells change too, their neighborhoods contain updated cells
+    const int col_min = std::max(msg->updated_col_min - 1, 0);
+    const int row_min = std::max(msg->updated_row_min - 1, 0);
+    const int col_max = std::min(msg->updated_col_max + 1, width - 1);
+    const int row_max = std::min(msg->updated_row_max + 1, height - 1);
+    elevation_costs_.resize(msg->heights.size());
+    evaluator_.evaluate(msg->heights.data(), width, height, msg->resolution,
+                        col_min, row_min, col_max, row_max, elevation_costs_.data());
+
+    std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+    // Several elevation cells may fall into one costmap cell: the first one written in this
+    // update replaces the old cost, the others can only raise it
+    generation_ = (generation_ == UINT32_MAX) ? 1 : generation_ + 1;
+    const double resolution = msg->resolution;
+    for (int row = row_min; row <= row_max; row++)
+    {
+        const double wy = msg->origin_y + (row + 0.5) * resolution;
+        for (int col = col_min; col <= col_max; col++)
+        {
+            const uint8_t cost = elevation_costs_[row * width + col];
+            if (cost == TRAVERSABILITY_UNKNOWN)
+            {
+                continue;
+            }
+            const double wx = msg->origin_x + (col + 0.5) * resolution;
+            unsigned int mx;
+            unsigned int my;
+            if (!worldToMap(wx, wy, mx, my))
+            {
+                continue;
+            }
+            const unsigned int index = getIndex(mx, my);
+            if (written_[index] != generation_)
+            {
+                written_[index] = generation_;
+                costmap_[index] = cost;
+            }
+            else
+            {
+                costmap_[index] = std::max(costmap_[index], cost);
+            }
+        }
+    }
+
+    const double min_x = msg->origin_x + col_min * resolution;
+    const double min_y = msg->origin_y + row_min * resolution;
+    const double max_x = msg->origin_x + (col_max + 1) * resolution;
+    const double max_y = msg->origin_y + (row_max + 1) * resolution;
+    if (touched_max_x_ < touched_min_x_)
+    {
+        touched_min_x_ = min_x;
+        touched_min_y_ = min_y;
+        touched_max_x_ = max_x;
+        touched_max_y_ = max_y;
+    }
+    else
+    {
+        touched_min_x_ = std::min(touched_min_x_, min_x);
+        touched_min_y_ = std::min(touched_min_y_, min_y);
+        touched_max_x_ = std::max(touched_max_x_, max_x);
+        touched_max_y_ = std::max(touched_max_y_, max_y);
+    }
+
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    RCLCPP_DEBUG(logger_, "Traversability updated %dx%d cells in %.3f ms",
+                 col_max - col_min + 1, row_max - row_min + 1, ms);
+}
+
+void TraversabilityLayer::updateBounds(double /*robot_x*/, double /*robot_y*/, double /*robot_yaw*/,
+                                       double *min_x, double *min_y, double *max_x, double *max_y)
+{
+    std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+    if (!enabled_ || touched_max_x_ < touched_min_x_)
+    {
+        return;
+    }
+    *min_x = std::min(*min_x, touched_min_x_);
+    *min_y = std::min(*min_y, touched_min_y_);
+    *max_x = std::max(*max_x, touched_max_x_);
+    *max_y = std::max(*max_y, touched_max_y_);
+    touched_min_x_ = touched_min_y_ = 0.0;
+    touched_max_x_ = touched_max_y_ = -1.0;
+}
+
+void TraversabilityLayer::updateCosts(nav2_costmap_2d::Costmap2D &master_grid, int min_i, int min_j, int max_i, int max_j)
+{
+    if (!enabled_)
+    {
+        return;
+    }
+    std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+    updateWithMax(master_grid, min_i, min_j, max_i, max_j);
+}
+
+} // namespace navigation_pkg
+
+PLUGINLIB_EXPORT_CLASS(navigation_pkg::TraversabilityLayer, nav2_costmap_2d::Layer)
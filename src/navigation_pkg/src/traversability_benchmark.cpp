@@ -0,0 +1,149 @@
+// Times the traversability update of an arena-sized elevation grid, incremental versus full.
+//
+// A synthetic arena with rocks, craters and a slope is observed by a camera driving across it.
+// Every frame writes noisy heights into the cells inside the camera's field of view, like the
+// elevation map of vision_pkg does, and the cost update is timed once for the updated window
+// only and once for the whole grid.
+//
+// usage: traversability_benchmark [cells_x cells_y resolution frames]
+#include "navigation_pkg/Traversability.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+struct Rock
+{
+    float x, y, radius, height; // Negative height for craters
+};
+
+float terrain(const std::vector<Rock> &rocks, float x, float y)
+{
+    float h = 0.08f * std::max(0.0f, x - 4.0f); // Ramp toward the far end of the arena
+    for (const auto &rock : rocks)
+    {
+        const float d2 = (x - rock.x) * (x - rock.x) + (y - rock.y) * (y - rock.y);
+        if (d2 < rock.radius * rock.radius)
+        {
+            h += rock.height * std::sqrt(1.0f - d2 / (rock.radius * rock.radius));
+        }
+    }
+    return h;
+}
+
+double mean(const std::vector<double> &values)
+{
+    double sum = 0.0;
+    for (double value : values)
+        sum += value;
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+double percentile(std::vector<double> values, double p)
+{
+    std::sort(values.begin(), values.end());
+    return values[static_cast<std::size_t>(p * (values.size() - 1))];
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    // Default: 6.88 m x 5 m arena at 5 cm
+    const int width = argc > 1 ? std::atoi(argv[1]) : 138;
+    const int height = argc > 2 ? std::atoi(argv[2]) : 100;
+    const float resolution = argc > 3 ? std::atof(argv[3]) : 0.05f;
+    const int frames = argc > 4 ? std::atoi(argv[4]) : 300;
+
+    const float CAMERA_RANGE_M = 4.0f;
+    const float CAMERA_HALF_FOV = 0.75f; // D455 depth, about 87 degrees
+    const float SPEED_M_PER_FRAME = 0.5f / 15.0f;
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> ux(0.0f, width * resolution);
+    std::uniform_real_distribution<float> uy(0.0f, height * resolution);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    std::vector<Rock> rocks;
+    for (int i = 0; i < 30; i++)
+    {
+        rocks.push_back({ux(rng), uy(rng), 0.15f + 0.1f * (i % 3), (i % 4 == 0) ? -0.3f : 0.2f});
+    }
+
+    std::vector<float> heights(static_cast<std::size_t>(width) * height, NAN);
+    std::vector<uint8_t> costs(heights.size(), navigation_pkg::TRAVERSABILITY_UNKNOWN);
+    navigation_pkg::TraversabilityEvaluator evaluator;
+
+    std::vector<double> incremental_ms;
+    std::vector<double> full_ms;
+    std::size_t updated_cells = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        // Drive a lawnmower path across the arena
+        const float lane_length = width * resolution - 1.0f;
+        const float travelled = frame * SPEED_M_PER_FRAME;
+        const int lane = static_cast<int>(travelled / lane_length);
+        const float along = std::fmod(travelled, lane_length);
+        const bool forward = lane % 2 == 0;
+        const float robot_x = 0.5f + (forward ? along : lane_length - along);
+        const float robot_y = std::fmod(0.5f + lane * 1.0f, height * resolution - 0.5f);
+        const float yaw = forward ? 0.0f : static_cast<float>(M_PI);
+
+        // Observe the field of view
+        int col_min = width, row_min = height, col_max = -1, row_max = -1;
+        for (int row = 0; row < height; row++)
+        {
+            for (int col = 0; col < width; col++)
+            {
+                const float x = (col + 0.5f) * resolution - robot_x;
+                const float y = (row + 0.5f) * resolution - robot_y;
+                const float range = std::sqrt(x * x + y * y);
+                float bearing = std::atan2(y, x) - yaw;
+                bearing = std::atan2(std::sin(bearing), std::cos(bearing));
+                if (range > CAMERA_RANGE_M || range < 0.3f || std::fabs(bearing) > CAMERA_HALF_FOV)
+                {
+                    continue;
+                }
+                heights[row * width + col] = terrain(rocks, (col + 0.5f) * resolution, (row + 0.5f) * resolution) + noise(rng);
+                col_min = std::min(col_min, col);
+                row_min = std::min(row_min, row);
+                col_max = std::max(col_max, col);
+                row_max = std::max(row_max, row);
+            }
+        }
+        if (col_max < 0)
+        {
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        evaluator.evaluate(heights.data(), width, height, resolution, col_min - 1, row_min - 1, col_max + 1, row_max + 1, costs.data());
+        incremental_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        updated_cells += static_cast<std::size_t>(std::min(col_max + 1, width - 1) - std::max(col_min - 1, 0) + 1) *
+                         (std::min(row_max + 1, height - 1) - std::max(row_min - 1, 0) + 1);
+
+        start = std::chrono::steady_clock::now();
+        evaluator.evaluate(heights.data(), width, height, resolution, 0, 0, width - 1, height - 1, costs.data());
+        full_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::size_t lethal = 0;
+    for (uint8_t cost : costs)
+    {
+        lethal += cost == navigation_pkg::TRAVERSABILITY_LETHAL;
+    }
+
+    std::printf("grid %dx%d at %.3f m, %zu frames, %zu lethal cells\n", width, height, resolution, incremental_ms.size(), lethal);
+    std::printf("incremental: %.0f cells/frame, mean %.3f ms, p50 %.3f ms, p99 %.3f ms\n",
+                static_cast<double>(updated_cells) / incremental_ms.size(), mean(incremental_ms),
+                percentile(incremental_ms, 0.5), percentile(incremental_ms, 0.99));
+    std::printf("full:        %d cells/frame, mean %.3f ms, p50 %.3f ms, p99 %.3f ms\n",
+                width * height, mean(full_ms), percentile(full_ms, 0.5), percentile(full_ms, 0.99));
+    return 0;
+}
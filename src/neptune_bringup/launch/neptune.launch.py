@@ -12,6 +12,13 @@ def generate_launch_description() -> LaunchDescription:
         executable="rosbridge_websocket"
     )
 
+    # Add Video and Gamepad Gateway for the pilot page (port 9091)
+    gateway_module = Node(
+        name        ="gateway_node",
+        package     ="gateway_pkg",
+        executable  ="gateway_node"
+    )
+
     # Add Webgui
     web_user_interface = Node(
         name        ="webgui_node",
@@ -77,6 +84,7 @@ def generate_launch_description() -> LaunchDescription:
     # Add Actions to Launch Description
     ld.add_action(ros_bridge_server)
     # ld.add_action(madgwick_filter)
+    ld.add_action(gateway_module)
     ld.add_action(web_user_interface)
     ld.add_action(rs_camera_module)
     ld.add_action(hardware_controller_module)
@@ -0,0 +1,105 @@
+/**
+ * @file BucketVolume.hpp
+ * @brief Regolith volume in the bucket from the depth image, against a calibrated empty bucket.
+ */
+
+#ifndef BUCKETVOLUME_HPP
+#define BUCKETVOLUME_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vision_pkg/GroundPlane.hpp"
+
+/**
+ * @struct BucketFill
+ * @brief Fill measured on one depth frame.
+ */
+struct BucketFill
+{
+  bool calibrated = false;
+  float volume_m3 = 0.0f;       // Smoothed
+  float raw_volume_m3 = 0.0f;   // This frame only
+  float fill_fraction = 0.0f;   // Smoothed volume over the capacity
+  float valid_fraction = 0.0f;  // Calibrated pixels of the region with a depth in this frame
+  bool full = false;
+  double compute_ms = 0.0;
+};
+
+/**
+ * @class BucketVolume
+ * @brief Integrates the regolith between a reference surface and the measured depth.
+ *
+ * The reference is the mean depth of every pixel of a fixed region over a few frames of the
+ * empty bucket. Each pixel sees a small pyramid, and the volume it contributes between the
+ * measured depth d and the reference r is exactly (r^3 - d^3) / (3 fx fy), so no surface
+ * fitting is needed and the cost is one multiply-add per pixel. Pixels without a depth are
+ * assumed as full as the others. The bucket counts as full once the smoothed fill reaches
+ * full_fraction, and empty again below full_fraction - 0.1.
+ */
+class BucketVolume
+{
+public:
+  struct Config
+  {
+    float capacity_m3 = 0.03f;
+    float full_fraction = 0.9f;
+    float min_height_m = 0.01f; // Differences below this are depth noise
+    float smoothing = 0.3f;     // Weight of the newest frame
+    int calibration_frames = 30;
+  };
+
+  BucketVolume() : BucketVolume(Config()) {}
+  explicit BucketVolume(const Config &config);
+
+  /**
+   * @brief Sets the depth camera and the region showing the inside of the bucket, as a
+   *        half-open pixel rectangle. Drops the calibration if either changed.
+   */
+  void setRegion(const CameraIntrinsics &intrinsics, int x0, int y0, int x1, int y1);
+
+  /**
+   * @brief Averages the next calibration_frames frames into the empty bucket reference.
+   */
+  void startCalibration();
+  bool calibrating() const { return calibration_left_ > 0; }
+  bool calibrated() const { return calibrated_; }
+
+  /**
+   * @brief Measures the fill, or accumulates the frame while calibrating.
+   * @param depth Depth image, row stride in bytes
+   * @param units Meters per depth unit
+   */
+  const BucketFill &update(const uint16_t *depth, int width, int height, std::size_t stride, float units);
+
+  /**
+   * @brief Stores or restores the reference so it survives restarts.
+   * @returns false if the file cannot be written, or does not hold a reference for the current region
+   */
+  bool save(const std::string &path) const;
+  bool load(const std::string &path);
+
+private:
+  void finishCalibration();
+
+  Config config_;
+  CameraIntrinsics intrinsics_{1.0f, 1.0f, 0.0f, 0.0f};
+  int x0_ = 0;
+  int y0_ = 0;
+  int x1_ = 0;
+  int y1_ = 0;
+
+  std::vector<float> reference_;       // Per region pixel, meters, 0 where unknown
+  std::vector<float> reference_cube_;  // r^3 / (3 fx fy) per region pixel
+  std::vector<double> sum_;            // Calibration accumulators
+  std::vector<uint16_t> count_;        //
+  int calibration_left_ = 0;
+  bool calibrated_ = false;
+  std::size_t reference_pixels_ = 0;   // Region pixels with a reference
+  BucketFill fill_;
+};
+
+#endif // BUCKETVOLUME_HPP
@@ -0,0 +1,155 @@
+/**
+ * @file CameraSupervisor.hpp
+ * @brief Finds the cameras by serial number or USB id and brings them up and down as they are plugged.
+ */
+
+#ifndef CAMERASUPERVISOR_HPP
+#define CAMERASUPERVISOR_HPP
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+
+struct udev;
+struct udev_monitor;
+
+/**
+ * @struct CameraHealth
+ * @brief Connection state of one supervised camera.
+ */
+struct CameraHealth
+{
+  std::string name;
+  std::string device;           // Serial number or device node in use, empty while not found
+  bool present = false;         // Found on the USB bus
+  bool streaming = false;       // Frames arrived within stall_timeout_s
+  bool idle = false;            // Closed on purpose
+  uint32_t drops = 0;           // Times the camera was lost while streaming
+  double down_s = 0.0;          // Length of the current outage, 0 while up
+  double last_recovery_s = 0.0; // From the last drop to the first frame after it
+  double max_recovery_s = 0.0;
+  double last_bringup_s = 0.0;  // From the device (re)appearing to its first frame
+};
+
+/**
+ * @class CameraSupervisor
+ * @brief Owns the D455 pipelines and tracks which webcam device node belongs to which slot.
+ *
+ * D455s are matched by serial number, webcams by USB serial, vendor:product, udev ID_PATH
+ * (the USB port) or a device path, so /dev/videoN renumbering after a replug does not matter.
+ * A supervisor thread waits on librealsense device-change callbacks and udev video4linux
+ * events, starts a D455 pipeline as soon as its camera appears and stops it when it goes.
+ * Webcams are opened by the caller, which follows devicePath() and reopens whenever the
+ * generation changes. A streaming camera that delivers no frame for stall_timeout_s is
+ * restarted, which also catches USB resets that never show up as a removal.
+ *
+ * pollFrames(), frameArrived() and setIdle() are cheap and meant for the capture thread;
+ * they never wait on a pipeline being started.
+ */
+class CameraSupervisor
+{
+public:
+  struct Config
+  {
+    double stall_timeout_s = 2.0;   // A streaming camera without frames this long is restarted
+    double retry_interval_s = 1.0;  // Between attempts to start a camera that is present
+    double rescan_interval_s = 5.0; // Full rescan, in case a hotplug event was missed
+  };
+
+  using Configure = std::function<void(rs2::config &)>;
+  using EventLog = std::function<void(const std::string &)>;
+
+  CameraSupervisor() : CameraSupervisor(Config()) {}
+  explicit CameraSupervisor(const Config &config);
+  ~CameraSupervisor();
+
+  CameraSupervisor(const CameraSupervisor &) = delete;
+  CameraSupervisor &operator=(const CameraSupervisor &) = delete;
+
+  /**
+   * @brief Adds a D455. Slots are numbered in the order they are added. Call before start().
+   * @param serial Serial number, empty takes any RealSense no other slot asked for
+   * @param configure Enables the streams, the device is already selected
+   */
+  std::size_t addRealsense(const std::string &name, const std::string &serial, Configure configure);
+
+  /**
+   * @brief Adds a webcam. Call before start().
+   * @param id USB serial (ID_SERIAL_SHORT or ID_SERIAL), vendor:product such as 046d:082d,
+   *           udev ID_PATH, a /dev path (symlinks such as /dev/v4l/by-id are resolved), or a
+   *           file replayed instead of a device
+   */
+  std::size_t addWebcam(const std::string &name, const std::string &id);
+
+  /**
+   * @brief Receives one line per connection event. Called from any thread.
+   */
+  void setEventLog(EventLog log) { log_ = std::move(log); }
+
+  void start();
+  void stop();
+
+  /**
+   * @brief Polls the newest frameset of a D455 slot without waiting.
+   * @returns false if none is available or the camera is down
+   */
+  bool pollFrames(std::size_t slot, rs2::frameset &frames);
+
+  /**
+   * @brief Device node of a webcam slot. The generation changes whenever the node must be
+   *        reopened: replugged, renumbered or stalled.
+   * @returns false while the webcam is not found
+   */
+  bool devicePath(std::size_t slot, std::string &path, uint64_t &generation) const;
+
+  /**
+   * @brief Records a frame of a slot, ending the current outage if any.
+   */
+  void frameArrived(std::size_t slot);
+
+  /**
+   * @brief Marks a webcam closed on purpose, no frames are expected from it then.
+   */
+  void setIdle(std::size_t slot, bool idle);
+
+  bool streaming(std::size_t slot) const;
+  std::vector<CameraHealth> health() const;
+
+private:
+  struct Slot;
+
+  void run();
+  void rescanRealsense(int64_t now);
+  void rescanWebcams(int64_t now);
+  void supervise(int64_t now);
+  void startPipeline(Slot &slot, int64_t now);
+  void stopPipeline(Slot &slot);
+  void setPresent(Slot &slot, const std::string &device, int64_t now);
+  void dropped(Slot &slot, int64_t now, const char *reason);
+  void wake();
+  void log(const std::string &line) const;
+
+  Config config_;
+  rs2::context ctx_;
+  std::vector<std::unique_ptr<Slot>> slots_; // Fixed once started
+  mutable std::mutex mutex_;                 // Guards the device state and statistics of the slots
+  EventLog log_;
+
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> realsense_changed_{true}; // Set by the librealsense callback thread
+  int wake_fd_ = -1;                          // eventfd waking the supervisor thread
+  udev *udev_ = nullptr;
+  udev_monitor *monitor_ = nullptr;           // video4linux add and remove events
+};
+
+#endif // CAMERASUPERVISOR_HPP
@@ -0,0 +1,85 @@
+/**
+ * @file CaptureTiming.hpp
+ * @brief Camera clock to host clock offset estimation and latency histograms of the video stages.
+ */
+
+#ifndef CAPTURETIMING_HPP
+#define CAPTURETIMING_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+/**
+ * @class ClockOffset
+ * @brief Maps times of a free-running device clock onto the host clock.
+ *
+ * Every frame gives a pair: its device timestamp and the host time it arrived. Their difference
+ * is the clock offset plus a transport delay that is never negative, so the smallest difference
+ * over a sliding window is the offset plus the shortest delay seen. The window follows the drift
+ * between the two clocks; a device timestamp going backwards (camera reset) restarts the estimate.
+ * The mapped times are therefore late by the minimum transport delay, a few ms over USB.
+ */
+class ClockOffset
+{
+public:
+  explicit ClockOffset(double window_s = 5.0);
+
+  /**
+   * @param device_ns Time of the event on the device clock
+   * @param host_ns Time the event arrived on the host clock
+   * @returns Time of the event on the host clock
+   */
+  int64_t toHost(int64_t device_ns, int64_t host_ns);
+
+  void reset();
+  int64_t offsetNs() const { return window_.empty() ? 0 : window_.front().offset_ns; }
+
+private:
+  struct Sample
+  {
+    int64_t host_ns;
+    int64_t offset_ns;
+  };
+
+  int64_t window_ns_;
+  int64_t last_device_ns_ = 0;
+  std::deque<Sample> window_; // Increasing offsets, the front is the minimum of the window
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief Counts latencies into fixed buckets, spaced finer around one or two frame periods.
+ */
+class LatencyHistogram
+{
+public:
+  static const std::size_t BUCKETS = 19;
+
+  /**
+   * @brief Upper edge of every bucket in ms, the last bucket is unbounded.
+   */
+  static const std::array<float, BUCKETS> &upperEdgesMs();
+
+  void add(double ms);
+  void clear();
+
+  uint32_t count() const { return count_; }
+  double maxMs() const { return max_ms_; }
+  const std::array<uint32_t, BUCKETS> &buckets() const { return buckets_; }
+
+  /**
+   * @param fraction 0.5 for the median
+   * @returns Latency below which the fraction of samples falls, interpolated inside its bucket
+   */
+  double percentileMs(double fraction) const;
+
+private:
+  std::array<uint32_t, BUCKETS> buckets_{};
+  uint32_t count_ = 0;
+  double max_ms_ = 0.0;
+};
+
+#endif // CAPTURETIMING_HPP
@@ -0,0 +1,77 @@
+/**
+ * @file DepthStats.hpp
+ * @brief Summed-area tables over a Z16 depth frame for constant-time region statistics.
+ */
+
+#ifndef DEPTHSTATS_HPP
+#define DEPTHSTATS_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct DepthRegion
+ * @brief Statistics of the valid (non-zero) depth pixels inside a rectangle.
+ */
+struct DepthRegion
+{
+  double mean = 0.0;           // Mean depth in meters, 0 if no pixel is valid
+  double variance = 0.0;       // Depth variance in square meters
+  double valid_fraction = 0.0; // Valid pixels over all pixels of the rectangle
+  uint32_t valid = 0;          // Number of valid pixels
+};
+
+/**
+ * @class DepthStats
+ * @brief Builds sum, sum of squares and valid-count tables of a depth frame in one pass, after
+ *        which the mean, variance and valid fraction of any rectangle cost four lookups per table.
+ *        Pixels with a depth of 0 carry no measurement and are left out of every statistic.
+ */
+class DepthStats
+{
+public:
+  /**
+   * @brief Builds the tables. Storage is kept between calls, so frames of the same size
+   *        do not allocate.
+   * @param depth First pixel of the Z16 frame
+   * @param width Width in pixels
+   * @param height Height in pixels
+   * @param stride Bytes per row
+   * @param depth_units Meters per depth unit (rs2::depth_frame::get_units())
+   */
+  void build(const uint16_t *depth, int width, int height, std::size_t stride, float depth_units);
+
+  /**
+   * @brief Statistics of the rectangle [x0, x1) x [y0, y1), clipped to the frame.
+   */
+  DepthRegion region(int x0, int y0, int x1, int y1) const;
+
+  /**
+   * @brief Splits the frame into cols x rows equal cells and fills one region per cell, row by row.
+   * @param cells Resized to cols * rows
+   */
+  void grid(int cols, int rows, std::vector<DepthRegion> &cells) const;
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+private:
+  template <typename T>
+  T rectSum(const std::vector<T> &table, int x0, int y0, int x1, int y1) const
+  {
+    const std::size_t w = width_ + 1;
+    return table[y1 * w + x1] - table[y0 * w + x1] - table[y1 * w + x0] + table[y0 * w + x0];
+  }
+
+  int width_ = 0;
+  int height_ = 0;
+  float units_ = 0.001f;
+  // (width + 1) x (height + 1) tables with a zero first row and column, in raw depth units
+  std::vector<uint64_t> sum_;
+  std::vector<uint64_t> sum_sq_;
+  std::vector<uint32_t> count_;
+};
+
+#endif // DEPTHSTATS_HPP
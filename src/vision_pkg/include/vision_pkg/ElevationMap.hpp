@@ -0,0 +1,130 @@
+/**
+ * @file ElevationMap.hpp
+ * @brief Rolling robot-centered 2.5D elevation map fused from depth point clouds.
+ */
+
+#ifndef ELEVATIONMAP_HPP
+#define ELEVATIONMAP_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct RigidTransform
+ * @brief Rotation and translation mapping points of one frame into another: p' = R * p + t.
+ */
+struct RigidTransform
+{
+  float r[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1}; // Row major
+  float t[3] = {0, 0, 0};
+
+  /**
+   * @brief Transform from roll, pitch and yaw (applied in that order about fixed x, y, z) and a translation.
+   */
+  static RigidTransform fromXYZRPY(float x, float y, float z, float roll, float pitch, float yaw);
+
+  /**
+   * @brief Rotation from the camera optical frame (x right, y down, z forward) to a body
+   *        frame (x forward, y left, z up).
+   */
+  static RigidTransform opticalToBody();
+
+  RigidTransform operator*(const RigidTransform &other) const;
+};
+
+/**
+ * @class ElevationMap
+ * @brief Square grid of height cells that follows the robot.
+ *
+ * Cells live in a ring buffer addressed by world cell index modulo the map size, so moving the
+ * robot only clears the rows and columns that enter the window and nothing is copied. Every cell
+ * holds a height estimate and its variance. A measurement is fused with a 1D Kalman update
+ * whose noise grows with the square of the range, and a measurement clearly above the estimate
+ * replaces it, since the top surface is what a 2.5D map represents. The variance of a cell grows
+ * while it is not observed and the cell becomes unknown once it passes max_variance.
+ * Storage and scratch buffers are allocated once, integration does not allocate.
+ */
+class ElevationMap
+{
+public:
+  struct Config
+  {
+    float resolution = 0.05f;         // Cell size in meters
+    int size = 160;                   // Cells per side
+    float depth_noise = 0.0025f;      // Height sigma per square meter of range
+    float min_sigma = 0.01f;          // Height sigma of a measurement at close range
+    float decay_per_s = 0.0004f;      // Variance added per second without observation
+    float max_variance = 0.01f;       // Cells less certain than this are unknown
+    float outlier_sigmas = 3.0f;      // Measurements this far above the estimate replace it
+  };
+
+  ElevationMap() : ElevationMap(Config()) {}
+  explicit ElevationMap(const Config &config);
+
+  /**
+   * @brief Moves the window so it is centered on a position, clearing the cells that enter it.
+   */
+  void recenter(float x, float y);
+
+  /**
+   * @brief Fuses a point cloud into the map.
+   * @param x Camera frame x coordinates of the points
+   * @param y Camera frame y coordinates
+   * @param z Camera frame z coordinates
+   * @param count Number of points
+   * @param map_from_camera Pose of the camera optical frame in the map frame
+   * @param stamp Time of the cloud in seconds
+   */
+  void integrate(const float *x, const float *y, const float *z, std::size_t count,
+                 const RigidTransform &map_from_camera, double stamp);
+
+  /**
+   * @brief Reads a cell by its position inside the window, (0, 0) being the cell at originX(), originY().
+   * @param variance Variance including the decay up to now
+   * @returns false if the cell is unknown
+   */
+  bool cell(int col, int row, double now, float &height, float &variance) const;
+
+  /**
+   * @brief Window cells updated since the previous call, as inclusive column and row bounds.
+   *        Clears the record.
+   * @returns false if no cell inside the window was updated
+   */
+  bool takeUpdated(int &col_min, int &row_min, int &col_max, int &row_max);
+
+  int size() const { return config_.size; }
+  float resolution() const { return config_.resolution; }
+  float originX() const { return origin_x_ * config_.resolution; } // Map frame corner of the window
+  float originY() const { return origin_y_ * config_.resolution; } //
+  const Config &config() const { return config_; }
+
+private:
+  std::size_t index(int ix, int iy) const;
+  void clearColumn(int ix);
+  void clearRow(int iy);
+
+  Config config_;
+  int origin_x_ = 0; // World cell index of the window's first column
+  int origin_y_ = 0; // World cell index of the window's first row
+
+  // World cell bounds of the cells updated since takeUpdated(), empty when max < min
+  int updated_min_x_ = 0;
+  int updated_min_y_ = 0;
+  int updated_max_x_ = -1;
+  int updated_max_y_ = -1;
+
+  // Cell storage, size * size
+  std::vector<float> height_;
+  std::vector<float> variance_; // Infinite for unknown cells
+  std::vector<double> stamp_;   // Time of the last update
+
+  // Per point scratch, grows to the largest cloud seen
+  std::vector<float> mx_;
+  std::vector<float> my_;
+  std::vector<float> mz_;
+  std::vector<float> noise_;
+};
+
+#endif // ELEVATIONMAP_HPP
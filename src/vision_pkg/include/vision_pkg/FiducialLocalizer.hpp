@@ -0,0 +1,121 @@
+/**
+ * @file FiducialLocalizer.hpp
+ * @brief Absolute robot pose from ArUco / AprilTag markers at known arena positions.
+ */
+
+#ifndef FIDUCIALLOCALIZER_HPP
+#define FIDUCIALLOCALIZER_HPP
+#pragma once
+
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision_pkg/ElevationMap.hpp"
+
+/**
+ * @struct FiducialPose
+ * @brief Result and timing of one marker search.
+ */
+struct FiducialPose
+{
+  bool valid = false;
+  bool roi_search = false;        // Only the window around the previous detection was searched
+  std::vector<int> ids;           // Known markers found
+  double pose[6] = {0, 0, 0, 0, 0, 0}; // base_link in the arena: x, y, z, roll, pitch, yaw
+  double covariance[36] = {};     // Row major, same order as pose
+  double reprojection_px = 0.0;   // RMS reprojection error of the solved pose
+  double detect_ms = 0.0;
+  double pnp_ms = 0.0;
+};
+
+/**
+ * @class FiducialLocalizer
+ * @brief Finds known markers in a color image and solves the pose of the robot in the arena.
+ *
+ * The search is limited to a window around the markers of the previous frame, grown by
+ * roi_margin of its size, and falls back to the full frame when the markers leave it or every
+ * full_search_interval frames so that markers entering the view are picked up. The pose of the
+ * largest marker is solved with IPPE and refined over the corners of every visible marker.
+ * Its covariance is the pixel noise, taken as the reprojection error, propagated through the
+ * PnP Jacobian and the camera extrinsics.
+ */
+class FiducialLocalizer
+{
+public:
+  struct Config
+  {
+    std::string dictionary = "apriltag_36h11"; // See dictionaryNames()
+    double marker_size_m = 0.15;               // Black border edge length
+    double roi_margin = 0.5;
+    int full_search_interval = 15;
+    double min_pixel_sigma = 0.5;              // Floor of the pixel noise used for the covariance
+    double max_reprojection_px = 3.0;          // Poses above this are rejected
+  };
+
+  FiducialLocalizer() : FiducialLocalizer(Config()) {}
+
+  /**
+   * @exception std::invalid_argument if the dictionary is unknown
+   */
+  explicit FiducialLocalizer(const Config &config);
+  ~FiducialLocalizer();
+
+  FiducialLocalizer(FiducialLocalizer &&);
+  FiducialLocalizer &operator=(FiducialLocalizer &&);
+
+  /**
+   * @brief Adds a marker, its frame having x right, y up and z out of the printed face.
+   */
+  void addMarker(int id, const RigidTransform &arena_from_marker);
+
+  /**
+   * @brief Sets the color camera.
+   * @param camera_matrix Pinhole intrinsics in pixels
+   * @param distortion OpenCV distortion coefficients, may be empty
+   * @param base_from_camera Pose of the color optical frame in base_link
+   */
+  void setCamera(const cv::Matx33d &camera_matrix, const std::vector<double> &distortion, const RigidTransform &base_from_camera);
+  bool hasCamera() const { return has_camera_; }
+
+  /**
+   * @brief Searches a BGR image for markers and solves the robot pose.
+   */
+  const FiducialPose &locate(const cv::Mat &bgr);
+
+  static std::vector<std::string> dictionaryNames();
+
+private:
+  struct Detector;
+
+  struct Marker
+  {
+    cv::Matx44d marker_from_arena;
+    std::array<cv::Point3d, 4> corners; // In the arena frame, in detection order
+  };
+
+  bool search(const cv::Rect &region);
+  bool solve();
+  void robotPose(const cv::Vec6d &camera_from_arena, double pose[6]) const;
+
+  Config config_;
+  std::unique_ptr<Detector> detector_;
+  std::map<int, Marker> markers_;
+  cv::Matx33d camera_matrix_;
+  std::vector<double> distortion_;
+  cv::Matx44d camera_from_base_ = cv::Matx44d::eye();
+  bool has_camera_ = false;
+
+  cv::Mat gray_;
+  cv::Rect roi_;                     // Empty when the previous frame had no markers
+  int frames_since_full_ = 0;
+  std::vector<int> ids_;
+  std::vector<std::vector<cv::Point2f>> corners_;
+  FiducialPose result_;
+};
+
+#endif // FIDUCIALLOCALIZER_HPP
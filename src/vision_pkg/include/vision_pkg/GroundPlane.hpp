@@ -0,0 +1,145 @@
+/**
+ * @file GroundPlane.hpp
+ * @brief Per-frame ground plane estimation on a decimated depth point cloud.
+ */
+
+#ifndef GROUNDPLANE_HPP
+#define GROUNDPLANE_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct CameraIntrinsics
+ * @brief Pinhole intrinsics of the depth stream, in pixels.
+ */
+struct CameraIntrinsics
+{
+  float fx;
+  float fy;
+  float cx;
+  float cy;
+};
+
+/**
+ * @struct Plane
+ * @brief Plane a*x + b*y + c*z + d = 0 in the camera optical frame (x right, y down, z forward).
+ *        (a, b, c) is a unit normal pointing up, so a*x + b*y + c*z + d is the signed height
+ *        of a point above the plane.
+ */
+struct Plane
+{
+  float a = 0.0f;
+  float b = -1.0f;
+  float c = 0.0f;
+  float d = 0.0f;
+
+  float height(float x, float y, float z) const { return a * x + b * y + c * z + d; }
+};
+
+/**
+ * @struct GroundFit
+ * @brief Result and quality of one ground plane fit.
+ */
+struct GroundFit
+{
+  Plane plane;
+  bool valid = false;           // Enough points agree with the plane
+  bool warm_started = false;    // The previous plane still fit and RANSAC was skipped
+  std::size_t points = 0;       // Points in the decimated cloud
+  float inlier_fraction = 0.0f;
+  float rmse = 0.0f;            // Root mean square height of the inliers in meters
+  float normal_change_deg = 0.0f; // Rotation of the normal since the previous valid fit
+  float offset_change_m = 0.0f;   // Change of the camera height since the previous valid fit
+  double fit_ms = 0.0;            // Time spent building the cloud and fitting
+};
+
+/**
+ * @struct GroundClassification
+ * @brief Cloud points standing out of the ground plane, counted per image half.
+ */
+struct GroundClassification
+{
+  uint32_t rocks_left = 0;    // Points higher than the rock height, x < width / 2
+  uint32_t rocks_right = 0;   //
+  uint32_t craters_left = 0;  // Points deeper than the crater depth, x < width / 2
+  uint32_t craters_right = 0; //
+  uint32_t points_left = 0;   // Points of the cloud in each half
+  uint32_t points_right = 0;  //
+};
+
+/**
+ * @class GroundPlaneEstimator
+ * @brief Fits the ground plane to every depth frame.
+ *
+ * The lower part of the frame is deprojected on a coarse pixel grid into a structure-of-arrays
+ * cloud, so the inlier and height loops vectorize. The previous frame's plane is tried first
+ * and only refined when it still explains most of the cloud; otherwise RANSAC proposes a new
+ * plane. Either way the result is refined by least squares on its inliers.
+ */
+class GroundPlaneEstimator
+{
+public:
+  struct Config
+  {
+    int step = 8;                     // Pixel spacing of the decimated cloud
+    float roi_top = 0.4f;             // First image row used, as a fraction of the height
+    float max_range_m = 6.0f;         // Points farther away are ignored
+    float inlier_distance_m = 0.04f;  // Distance from the plane counted as ground
+    int ransac_iterations = 64;
+    float min_normal_up = 0.6f;       // Candidates tilted more than ~53 degrees from the camera's down axis are walls
+    float min_inlier_fraction = 0.25f; // Below this the fit is invalid
+    float warm_inlier_fraction = 0.6f; // The previous plane is kept when at least this fraction agrees
+  };
+
+  GroundPlaneEstimator() = default;
+  explicit GroundPlaneEstimator(const Config &config) : config_(config) {}
+
+  /**
+   * @brief Builds the decimated cloud of a frame and fits the ground plane to it.
+   * @param depth First pixel of the Z16 frame
+   * @param width Width in pixels
+   * @param height Height in pixels
+   * @param stride Bytes per row
+   * @param depth_units Meters per depth unit
+   * @param intrinsics Intrinsics of the depth stream
+   * @returns The fit of this frame. When it is invalid the previous plane is kept for warm starting.
+   */
+  const GroundFit &update(const uint16_t *depth, int width, int height, std::size_t stride, float depth_units,
+                          const CameraIntrinsics &intrinsics);
+
+  /**
+   * @brief Counts the points of the last cloud above rock_height_m or below -crater_depth_m.
+   */
+  GroundClassification classify(float rock_height_m, float crater_depth_m) const;
+
+  const GroundFit &fit() const { return fit_; }
+  const Config &config() const { return config_; }
+
+  // Decimated cloud of the last frame in the camera optical frame, one entry per point
+  const std::vector<float> &cloudX() const { return x_; }
+  const std::vector<float> &cloudY() const { return y_; }
+  const std::vector<float> &cloudZ() const { return z_; }
+
+private:
+  std::size_t countInliers(const Plane &plane) const;
+  bool refine(Plane &plane);
+  float nextRandom();
+
+  Config config_;
+  GroundFit fit_;
+  Plane last_valid_;
+  bool has_last_valid_ = false;
+  uint32_t rng_ = 0x9E3779B9u;
+  int image_width_ = 0;
+
+  // Decimated cloud, one entry per point
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> z_;
+  std::vector<uint16_t> column_;
+};
+
+#endif // GROUNDPLANE_HPP
@@ -0,0 +1,101 @@
+/**
+ * @file H264Encoder.hpp
+ * @brief Low latency libx264 encoder for the camera streams.
+ */
+
+#ifndef H264ENCODER_HPP
+#define H264ENCODER_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vision_pkg/JpegEncoder.hpp"
+
+/**
+ * @class H264Encoder
+ * @brief Encodes frames to H.264 with x264's ultrafast preset and zerolatency tune.
+ *
+ * Every frame in gives one access unit out, no frame is held back for B-frames or lookahead.
+ * The output is Annex B (start codes before every NAL unit) in the constrained baseline profile,
+ * and every keyframe repeats the SPS and PPS, so a viewer can start decoding at any keyframe.
+ * The encoder is opened on the first frame and reopened when the frame size changes, which
+ * starts the new size with a keyframe.
+ */
+class H264Encoder
+{
+public:
+  struct Config
+  {
+    int bitrate_kbps = 600; // Average bitrate, also the VBV maximum
+    int gop = 30;           // Frames between keyframes
+    int fps = 15;           // Nominal frame rate, used by the rate control only
+    int threads = 1;        // Slice threads, 1 keeps the latency at one frame
+  };
+
+  H264Encoder() : H264Encoder(Config()) {}
+  explicit H264Encoder(const Config &config);
+  ~H264Encoder();
+
+  H264Encoder(const H264Encoder &) = delete;
+  H264Encoder &operator=(const H264Encoder &) = delete;
+
+  /**
+   * @brief Encodes one frame into out. Odd widths and heights lose their last column or row,
+   *        4:2:0 needs even sizes.
+   * @param pixels Pointer to the first pixel
+   * @param width Width of the image in pixels
+   * @param height Height of the image in pixels
+   * @param pitch Bytes per row, 0 for tightly packed rows
+   * @param format Pixel layout of the input. GRAY is encoded with neutral chroma.
+   * @param out Destination buffer, resized to the size of the access unit on success
+   * @param keyframe Set to true if the access unit is an IDR frame
+   * @returns true on success. On failure lastError() describes the problem.
+   */
+  bool encode(const uint8_t *pixels, int width, int height, int pitch, JpegEncoder::PixelFormat format,
+              std::vector<uint8_t> &out, bool &keyframe);
+
+  /**
+   * @brief Makes the next frame a keyframe, for example when a new viewer subscribes.
+   */
+  void requestKeyframe() { keyframe_requested_ = true; }
+
+  /**
+   * @brief Changes the bitrate without restarting the stream.
+   */
+  void setBitrate(int kbps);
+  int bitrate() const { return config_.bitrate_kbps; }
+
+  /**
+   * @returns Codec string of the stream for WebCodecs (avc1.PPCCLL), empty before the first keyframe
+   */
+  const std::string &codec() const { return codec_; }
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  double lastEncodeMs() const { return last_encode_ms_; }
+  const std::string &lastError() const { return last_error_; }
+
+private:
+  bool open(int width, int height);
+  void close();
+  void convert(const uint8_t *pixels, int pitch, JpegEncoder::PixelFormat format);
+  void readCodec(const std::vector<uint8_t> &access_unit);
+
+  Config config_;
+  void *encoder_ = nullptr; // x264_t, kept opaque so x264.h stays out of the node
+  void *params_ = nullptr;  // x264_param_t of the open encoder, for reconfiguration
+  int width_ = 0;
+  int height_ = 0;
+  int64_t pts_ = 0;
+  bool keyframe_requested_ = false;
+  std::vector<uint8_t> yuv_; // I420 planes of the frame being encoded
+
+  std::string codec_;
+  double last_encode_ms_ = 0.0;
+  std::string last_error_;
+};
+
+#endif // H264ENCODER_HPP
@@ -0,0 +1,53 @@
+/**
+ * @file JpegDecoder.hpp
+ * @brief TurboJPEG decoder used when a passthrough MJPEG stream has to be downscaled.
+ */
+
+#ifndef JPEGDECODER_HPP
+#define JPEGDECODER_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class JpegDecoder
+ * @brief Decodes JPEG images to BGR, using the DCT scaling of libjpeg-turbo so that a
+ *        reduced size costs a fraction of a full decode.
+ */
+class JpegDecoder
+{
+public:
+  /**
+   * @exception std::runtime_error if the decompressor cannot be created
+   */
+  JpegDecoder();
+  ~JpegDecoder();
+
+  JpegDecoder(const JpegDecoder &) = delete;
+  JpegDecoder &operator=(const JpegDecoder &) = delete;
+
+  /**
+   * @brief Decodes an image at the largest scale that fits inside max_width x max_height.
+   * @param jpeg Compressed image
+   * @param size Size of the compressed image in bytes
+   * @param max_width Maximum output width, 0 for no limit
+   * @param max_height Maximum output height, 0 for no limit
+   * @param bgr Destination buffer, resized to width * height * 3
+   * @param width Width of the decoded image
+   * @param height Height of the decoded image
+   * @returns true on success. On failure lastError() describes the problem.
+   */
+  bool decode(const uint8_t *jpeg, std::size_t size, int max_width, int max_height,
+              std::vector<uint8_t> &bgr, int &width, int &height);
+
+  const std::string &lastError() const { return last_error_; }
+
+private:
+  void *handle_; // tjhandle
+  std::string last_error_;
+};
+
+#endif // JPEGDECODER_HPP
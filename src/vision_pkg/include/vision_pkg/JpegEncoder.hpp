@@ -0,0 +1,92 @@
+/**
+ * @file JpegEncoder.hpp
+ * @brief Reusable libjpeg-turbo encoder used by the camera publishers.
+ */
+
+#ifndef JPEGENCODER_HPP
+#define JPEGENCODER_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class JpegEncoder
+ * @brief Wraps a TurboJPEG compressor handle that lives as long as the camera stream.
+ *
+ * Each camera stream owns one encoder. The compressor handle is created once and TurboJPEG
+ * writes straight into the caller's buffer (normally CompressedImage::data), reserved to the
+ * worst-case size of the geometry on the first frame and shrunk to the JPEG afterwards, so the
+ * steady state performs no heap allocation and no copy per frame.
+ */
+class JpegEncoder
+{
+public:
+  /**
+   * @brief Layout of the pixels handed to encode().
+   */
+  enum class PixelFormat
+  {
+    BGR,  // 3 bytes per pixel, RealSense RS2_FORMAT_BGR8 and cv::Mat CV_8UC3
+    GRAY  // 1 byte per pixel
+  };
+
+  /**
+   * @brief Chroma subsampling written to the JPEG stream. GRAY produces a single-component JPEG.
+   */
+  enum class Subsampling
+  {
+    YUV444,
+    YUV422,
+    YUV420,
+    GRAY
+  };
+
+  /**
+   * @brief Creates the TurboJPEG compressor.
+   * @param quality JPEG quality in the range [1, 100]
+   * @param subsampling Chroma subsampling of the output
+   * @exception std::runtime_error if the compressor cannot be created
+   */
+  explicit JpegEncoder(int quality = 40, Subsampling subsampling = Subsampling::YUV420);
+  ~JpegEncoder();
+
+  JpegEncoder(const JpegEncoder &) = delete;
+  JpegEncoder &operator=(const JpegEncoder &) = delete;
+
+  /**
+   * @brief Compresses an image into out. out keeps its capacity, so later frames of the same
+   *        size reuse its storage.
+   * @param pixels Pointer to the first pixel
+   * @param width Width of the image in pixels
+   * @param height Height of the image in pixels
+   * @param pitch Bytes per row, 0 for tightly packed rows
+   * @param format Pixel layout of the input
+   * @param out Destination buffer, resized to the number of JPEG bytes on success and emptied on failure
+   * @returns true on success. On failure lastError() describes the problem.
+   */
+  bool encode(const uint8_t *pixels, int width, int height, int pitch, PixelFormat format, std::vector<uint8_t> &out);
+
+  void setQuality(int quality);
+  int quality() const { return quality_; }
+
+  void setSubsampling(Subsampling subsampling) { subsampling_ = subsampling; }
+  Subsampling subsampling() const { return subsampling_; }
+
+  double lastEncodeMs() const { return last_encode_ms_; }
+  std::size_t lastBytes() const { return last_bytes_; }
+  const std::string &lastError() const { return last_error_; }
+
+private:
+  void *handle_; // tjhandle, kept opaque so turbojpeg.h stays out of the node
+  int quality_;
+  Subsampling subsampling_;
+
+  double last_encode_ms_ = 0.0;
+  std::size_t last_bytes_ = 0;
+  std::string last_error_;
+};
+
+#endif // JPEGENCODER_HPP
@@ -0,0 +1,81 @@
+/**
+ * @file PointCloudBuilder.hpp
+ * @brief Depth to XYZ point cloud deprojection through a per-pixel ray lookup table.
+ */
+
+#ifndef POINTCLOUDBUILDER_HPP
+#define POINTCLOUDBUILDER_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vision_pkg/GroundPlane.hpp"
+
+/**
+ * @class PointCloudBuilder
+ * @brief Writes the points of a Z16 frame as packed float32 x, y, z triples (12 bytes per point,
+ *        camera optical frame), the layout of a PointCloud2 with fields x, y, z.
+ *
+ * The ray of every pixel is computed once from the intrinsics, so deprojecting a pixel is two
+ * multiplications. Each row is first deprojected into scratch arrays in a branch-free loop and
+ * then compacted into the output. With a voxel size set, only the first point falling into each
+ * voxel is kept, using an open-addressing hash table that is never cleared: every slot carries
+ * the number of the frame that filled it.
+ */
+class PointCloudBuilder
+{
+public:
+  static const std::size_t POINT_STEP = 12;
+
+  /**
+   * @brief Builds the ray table. Must be called again when the resolution changes.
+   */
+  void setIntrinsics(int width, int height, const CameraIntrinsics &intrinsics);
+
+  /**
+   * @param voxel_size Edge of the downsampling voxels in meters, 0 keeps every point
+   */
+  void setVoxelSize(float voxel_size);
+  void setRange(float min_m, float max_m);
+
+  /**
+   * @brief Deprojects a frame.
+   * @param depth First pixel of the Z16 frame, of the size given to setIntrinsics()
+   * @param stride Bytes per row
+   * @param depth_units Meters per depth unit
+   * @param out Destination of at least maxPoints() * POINT_STEP bytes
+   * @returns Number of points written
+   */
+  std::size_t build(const uint16_t *depth, std::size_t stride, float depth_units, uint8_t *out);
+
+  std::size_t maxPoints() const { return static_cast<std::size_t>(width_) * height_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+private:
+  static const std::size_t MAX_VOXEL_SLOTS = 1 << 17;
+
+  bool firstInVoxel(float x, float y, float z);
+
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<float> ray_x_; // x / z of every pixel
+  std::vector<float> ray_y_; // y / z of every pixel
+  std::vector<float> row_x_; // Deprojected row
+  std::vector<float> row_y_; //
+  std::vector<float> row_z_; //
+  float min_range_ = 0.1f;
+  float max_range_ = 10.0f;
+
+  float voxel_size_ = 0.0f;
+  float inv_voxel_ = 0.0f;
+  uint64_t last_key_ = UINT64_MAX; // Voxel of the previous point
+  std::vector<uint64_t> voxel_keys_;
+  std::vector<uint32_t> voxel_frames_; // Frame in which a slot was filled, 0 for never
+  uint32_t frame_ = 0;
+  std::size_t voxel_count_ = 0; // Voxels filled in this frame
+};
+
+#endif // POINTCLOUDBUILDER_HPP
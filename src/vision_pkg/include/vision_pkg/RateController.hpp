@@ -0,0 +1,121 @@
+/**
+ * @file RateController.hpp
+ * @brief Closed-loop bandwidth controller for the operator video streams.
+ */
+
+#ifndef RATECONTROLLER_HPP
+#define RATECONTROLLER_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @struct VideoRateSettings
+ * @brief Encoding settings of one step of the quality ladder.
+ */
+struct VideoRateSettings
+{
+  int quality;  // JPEG quality
+  double fps;   // Frames published per second
+  int scale;    // Resolution divisor, 1 = full resolution
+};
+
+/**
+ * @class VideoRateController
+ * @brief Holds the sum of all video streams under a bandwidth budget.
+ *
+ * Every stream sits on a step of a quality ladder (quality first, then frame rate, then
+ * resolution). Once per update() the measured rate of each stream is compared with its share
+ * of the budget and the stream moves one step down when it is over, or one step up when it is
+ * comfortably under. The stream the pilot is viewing receives a larger share and never drops
+ * below PRIORITY_MAX_LEVEL. Client backlog reported through onBacklog() shrinks the budget
+ * multiplicatively, and it recovers additively once the backlog clears or has not been
+ * reported for a few seconds.
+ */
+class VideoRateController
+{
+public:
+  static const int PRIORITY_MAX_LEVEL = 5;
+  static constexpr double CONGESTED_BACKLOG_S = 0.5;
+
+  struct Stream
+  {
+    std::string name;
+    bool active = false;
+    int level = 0;
+    int hold = 0;                  // Updates to wait before changing level again
+    uint64_t window_bytes = 0;     // Bytes published since the last update
+    uint32_t window_frames = 0;    // Frames published since the last update
+    double bytes_per_second = 0.0; // Smoothed outgoing rate
+    double frames_per_second = 0.0;
+    double allocation = 0.0;       // Share of the budget in bytes per second
+  };
+
+  /**
+   * @param stream_count Number of streams, identified by index
+   * @param budget_bytes_per_second Total outgoing video budget
+   * @param priority_share Fraction of the budget given to the viewed stream when others are active
+   */
+  VideoRateController(std::size_t stream_count, double budget_bytes_per_second, double priority_share = 0.6);
+
+  void setName(std::size_t id, const std::string &name) { streams_[id].name = name; }
+  void setActive(std::size_t id, bool active) { streams_[id].active = active; }
+  void setBudget(double budget_bytes_per_second);
+
+  /**
+   * @brief Selects the stream the pilot is viewing by topic name. Unknown names clear the priority.
+   */
+  void setPriorityStream(const std::string &name);
+  bool isPriority(std::size_t id) const { return static_cast<int>(id) == priority_; }
+
+  /**
+   * @brief Records a published frame.
+   */
+  void onFrame(std::size_t id, std::size_t bytes);
+
+  /**
+   * @brief Records how far behind the client is, in seconds between publishing and reception.
+   *        It counts until the next report, or for a few seconds of updates without one.
+   */
+  void onBacklog(double backlog_seconds)
+  {
+    backlog_s_ = backlog_seconds;
+    backlog_age_s_ = 0.0;
+  }
+
+  /**
+   * @brief Runs one control step.
+   * @param dt_seconds Time since the previous update
+   */
+  void update(double dt_seconds);
+
+  /**
+   * @brief Current settings of a stream. Level 0 keeps the source untouched, so a stream whose
+   *        source is already compressed may pass it through.
+   */
+  const VideoRateSettings &settings(std::size_t id) const { return ladder()[streams_[id].level]; }
+  bool passthrough(std::size_t id) const { return streams_[id].level == 0; }
+
+  const Stream &stream(std::size_t id) const { return streams_[id]; }
+  double budget() const { return budget_; }
+  double effectiveBudget() const { return effective_budget_; }
+  double backlog() const { return backlog_s_; }
+
+  static const std::vector<VideoRateSettings> &ladder();
+
+private:
+  void allocate();
+
+  std::vector<Stream> streams_;
+  double budget_;
+  double effective_budget_;
+  double priority_share_;
+  double backlog_s_ = 0.0;
+  double backlog_age_s_ = 0.0; // Seconds of updates since the last report
+  int priority_ = -1;
+};
+
+#endif // RATECONTROLLER_HPP
@@ -0,0 +1,257 @@
+/**
+ * @file Recording.hpp
+ * @brief Memory-mapped recording of the raw camera streams, for replay and offline benchmarks.
+ */
+
+#ifndef RECORDING_HPP
+#define RECORDING_HPP
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vision_pkg/GroundPlane.hpp"
+
+/*
+ * File layout, little endian, every record 64-byte aligned so images can be used in place:
+ *
+ *   RecordingHeader                 page 0, rewritten whenever a stream is described
+ *   RecordHeader + payload          one per frame or motion sample, from offset RECORDING_DATA_OFFSET
+ *   ...
+ *   RecordingIndexEntry[count]      written on close
+ *   RecordingFooter                 last 24 bytes of a closed file
+ *
+ * A file whose recording was cut short has no footer; the reader then rebuilds the index by
+ * walking the records.
+ */
+
+const std::size_t RECORDING_MAX_STREAMS = 16;
+const std::size_t RECORDING_DATA_OFFSET = 4096;
+const std::size_t RECORDING_ALIGN = 64;
+
+enum class RecordKind : uint8_t
+{
+  NONE = 0,
+  COLOR_BGR8 = 1,
+  DEPTH_Z16 = 2,
+  MJPEG = 3,
+  MOTION = 4
+};
+
+/**
+ * @struct RecordingStream
+ * @brief Description of one recorded stream, kept in the file header.
+ */
+struct RecordingStream
+{
+  char name[32] = {};             // NUL terminated
+  RecordKind kind = RecordKind::NONE;
+  uint8_t camera = 0;             // Streams of one camera share this, their clocks are the same
+  uint8_t reserved[2] = {};
+  uint32_t width = 0;
+  uint32_t height = 0;
+  float fps = 0.0f;
+  CameraIntrinsics intrinsics{};  // Zero when unknown
+  float depth_units = 0.0f;       // Meters per unit of a Z16 stream
+  float to_color[12] = {1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0}; // Into the camera's color stream: rotation, column-major like rs2_extrinsics, then translation
+};
+
+struct RecordingHeader
+{
+  char magic[8];                  // "VISREC01"
+  uint32_t version;
+  uint32_t stream_count;
+  RecordingStream streams[RECORDING_MAX_STREAMS];
+};
+
+struct RecordHeader
+{
+  uint32_t magic;                 // RECORD_MAGIC
+  uint16_t stream;
+  uint16_t reserved;
+  uint32_t size;                  // Payload bytes
+  uint32_t stride;                // Bytes per row of an image, 0 otherwise
+  uint32_t width;
+  uint32_t height;
+  uint64_t sequence;              // Frame number of the camera
+  int64_t device_ns;              // Timestamp given by the camera
+  int64_t host_ns;                // System time the node took the frame
+};
+
+struct RecordingIndexEntry
+{
+  uint64_t offset;                // Of the RecordHeader
+  int64_t host_ns;
+  uint16_t stream;
+  uint16_t reserved[3];
+};
+
+struct RecordingFooter
+{
+  uint64_t index_offset;
+  uint64_t count;
+  char magic[8];                  // "VISIDX01"
+};
+
+/**
+ * @struct MotionSample
+ * @brief Payload of a MOTION record.
+ */
+struct MotionSample
+{
+  enum Type : uint32_t
+  {
+    GYRO = 0,  // rad/s
+    ACCEL = 1  // m/s^2
+  };
+  float x, y, z;
+  uint32_t type;
+};
+
+/**
+ * @struct RecordView
+ * @brief One record of a mapped recording. data points into the mapping.
+ */
+struct RecordView
+{
+  uint16_t stream = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t stride = 0;
+  std::size_t size = 0;
+  uint64_t sequence = 0;
+  int64_t device_ns = 0;
+  int64_t host_ns = 0;
+  const uint8_t *data = nullptr;
+};
+
+/**
+ * @class RecordingWriter
+ * @brief Appends records from the capture thread without ever blocking it on the disk.
+ *
+ * write() copies the payload into a recycled buffer and queues it for the writer thread. When
+ * more than max_queued_bytes are waiting, frames are dropped and counted instead.
+ */
+class RecordingWriter
+{
+public:
+  struct Config
+  {
+    std::size_t max_queued_bytes = 64u << 20;
+  };
+
+  RecordingWriter() : RecordingWriter(Config()) {}
+  explicit RecordingWriter(const Config &config);
+  ~RecordingWriter();
+
+  RecordingWriter(const RecordingWriter &) = delete;
+  RecordingWriter &operator=(const RecordingWriter &) = delete;
+
+  bool open(const std::string &path);
+
+  /**
+   * @brief Writes the index and the footer, after every queued record.
+   */
+  void close();
+  bool isOpen() const { return fd_ >= 0; }
+
+  /**
+   * @brief Sets the description of a stream. Stored in the header right away, so a recording
+   *        cut short still describes its streams.
+   */
+  void describe(uint16_t stream, const RecordingStream &description);
+  bool described(uint16_t stream) const;
+
+  /**
+   * @param stream Index below RECORDING_MAX_STREAMS
+   * @param data Payload, copied before returning
+   * @param stride Bytes per row of an image, 0 otherwise
+   * @returns false if the frame was dropped
+   */
+  bool write(uint16_t stream, uint64_t sequence, int64_t device_ns, int64_t host_ns, const void *data,
+             std::size_t size, uint32_t width = 0, uint32_t height = 0, uint32_t stride = 0);
+
+  uint64_t written() const;
+  uint64_t dropped() const;
+  uint64_t bytes() const;
+  std::string lastError() const;
+
+private:
+  struct Job
+  {
+    RecordHeader header;
+    std::vector<uint8_t> payload;
+  };
+
+  void run();
+  bool writeAll(const void *data, std::size_t size);
+
+  Config config_;
+  int fd_ = -1;
+  std::thread thread_;
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<Job> queue_;
+  std::vector<std::vector<uint8_t>> spare_; // Payload buffers to reuse
+  std::size_t queued_bytes_ = 0;
+  bool stop_ = false;
+  bool header_dirty_ = false;
+  RecordingHeader header_{};
+  uint64_t dropped_ = 0;
+  uint64_t written_ = 0;
+  uint64_t bytes_ = 0;
+  std::string error_;
+
+  // Writer thread only
+  uint64_t offset_ = 0;
+  std::vector<RecordingIndexEntry> index_;
+};
+
+/**
+ * @class RecordingReader
+ * @brief Maps a recording read-only and gives access to its records in place.
+ */
+class RecordingReader
+{
+public:
+  RecordingReader() = default;
+  ~RecordingReader();
+
+  RecordingReader(const RecordingReader &) = delete;
+  RecordingReader &operator=(const RecordingReader &) = delete;
+
+  bool open(const std::string &path);
+  void close();
+
+  const RecordingStream &stream(std::size_t id) const { return header_->streams[id]; }
+  std::size_t size() const { return index_.size(); }
+  RecordView record(std::size_t i) const;
+
+  /**
+   * @returns Index of the first record taken at or after host_ns, size() if none
+   */
+  std::size_t seek(int64_t host_ns) const;
+
+  int64_t startNs() const { return index_.empty() ? 0 : index_.front().host_ns; }
+  int64_t endNs() const { return index_.empty() ? 0 : index_.back().host_ns; }
+  bool recovered() const { return recovered_; } // The index was rebuilt, the recording was cut short
+  const std::string &lastError() const { return error_; }
+
+private:
+  bool fail(const std::string &what);
+
+  const uint8_t *data_ = nullptr;
+  std::size_t length_ = 0;
+  const RecordingHeader *header_ = nullptr;
+  std::vector<RecordingIndexEntry> index_;
+  bool recovered_ = false;
+  std::string error_;
+};
+
+#endif // RECORDING_HPP
@@ -0,0 +1,121 @@
+/**
+ * @file RecordingPlayer.hpp
+ * @brief Replays a recording through librealsense software devices, in place of the live cameras.
+ */
+
+#ifndef RECORDINGPLAYER_HPP
+#define RECORDINGPLAYER_HPP
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+#include <librealsense2/hpp/rs_internal.hpp>
+
+#include "vision_pkg/Recording.hpp"
+#include "vision_pkg/V4L2Capture.hpp"
+
+/**
+ * @class RecordingPlayer
+ * @brief Plays the D455 and webcam streams of a recording back at their recorded pace.
+ *
+ * Every recorded camera becomes an rs2::software_device with a depth and a color sensor whose
+ * frames go through an rs2::syncer, so pollFrames() hands out framesets just like a live
+ * pipeline does, with the recorded intrinsics, depth units and depth to color extrinsics. Frames
+ * are injected straight from the mapped file without a copy. MJPEG streams are served by an
+ * MjpegSource. Motion records are skipped.
+ *
+ * Timestamps are replayed on the hardware clock domain and shifted on every loop, so they keep
+ * increasing. All calls are meant for one thread.
+ */
+class RecordingPlayer
+{
+public:
+  struct Config
+  {
+    double rate = 1.0; // Playback speed, 2 plays twice as fast
+    bool loop = true;  // Start over at the end, otherwise playback stops
+  };
+
+  RecordingPlayer() : RecordingPlayer(Config()) {}
+  explicit RecordingPlayer(const Config &config);
+  ~RecordingPlayer();
+
+  RecordingPlayer(const RecordingPlayer &) = delete;
+  RecordingPlayer &operator=(const RecordingPlayer &) = delete;
+
+  /**
+   * @returns false if the file cannot be read or a software device cannot be set up, see lastError()
+   */
+  bool open(const std::string &path);
+  const std::string &lastError() const { return error_; }
+  const RecordingReader &reader() const { return reader_; }
+
+  /**
+   * @brief Injects every record that is due by now. Call before polling.
+   */
+  void advance();
+  bool finished() const { return finished_; }
+
+  /**
+   * @brief Polls the newest frameset of a recorded D455 without waiting.
+   * @param camera Camera number the streams were recorded with
+   */
+  bool pollFrames(std::size_t camera, rs2::frameset &frames);
+
+  bool hasStream(std::size_t stream) const;
+
+  /**
+   * @brief Creates an opened source serving a recorded MJPEG stream, null if there is none.
+   *        The source must not outlive the player.
+   */
+  std::unique_ptr<MjpegSource> mjpegSource(std::size_t stream);
+
+  /**
+   * @brief Newest due image of an MJPEG stream, if it is not the one last handed out.
+   * @param last Record index handed out before, updated
+   */
+  bool nextMjpeg(std::size_t stream, std::size_t &last, MjpegFrame &frame) const;
+
+private:
+  struct Camera
+  {
+    std::size_t id = 0;
+    rs2::software_device device;
+    std::vector<rs2::software_sensor> sensors;
+    rs2::syncer syncer;
+  };
+
+  struct Stream
+  {
+    RecordKind kind = RecordKind::NONE;
+    Camera *camera = nullptr;
+    std::size_t sensor = 0;
+    rs2::stream_profile profile;
+    std::size_t latest = SIZE_MAX; // Newest due record of an MJPEG stream
+  };
+
+  Camera &camera(std::size_t id);
+  void inject(std::size_t index);
+
+  Config config_;
+  RecordingReader reader_; // Declared first, the injected frames point into its mapping
+  std::vector<std::unique_ptr<Camera>> cameras_;
+  std::array<Stream, RECORDING_MAX_STREAMS> streams_;
+  std::string error_;
+
+  std::size_t cursor_ = 0;    // Next record to inject
+  bool started_ = false;
+  bool finished_ = false;
+  std::chrono::steady_clock::time_point start_;
+  int64_t loop_ns_ = 0;       // Added to the device timestamps, grows on every loop
+  uint64_t loop_frames_ = 0;  // Added to the frame numbers
+};
+
+#endif // RECORDINGPLAYER_HPP
@@ -0,0 +1,96 @@
+/**
+ * @file SyntheticDepth.hpp
+ * @brief Renders D455-like Z16 depth frames of arena terrain, for accuracy and throughput checks of the depth stages.
+ */
+
+#ifndef SYNTHETICDEPTH_HPP
+#define SYNTHETICDEPTH_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vision_pkg/GroundPlane.hpp"
+
+/**
+ * @struct TerrainFeature
+ * @brief A rock or crater on the ground, shaped as a spherical cap or bowl.
+ */
+struct TerrainFeature
+{
+  enum Type
+  {
+    ROCK,
+    CRATER
+  };
+
+  Type type;
+  float x;      // Meters right of the camera
+  float y;      // Meters ahead of the camera
+  float radius; // Radius on the ground in meters
+  float height; // Height of a rock or depth of a crater in meters
+};
+
+/**
+ * @class SyntheticDepthScene
+ * @brief Ray casts a pinhole depth camera over sloped ground with rocks and craters.
+ *
+ * The camera stands camera_height_m above the ground, pitched down by pitch_rad. Every pixel gets
+ * the nearest surface along its ray plus the stereo depth noise of the D455, whose sigma grows
+ * with the square of the range: z^2 * subpixel / (fx * baseline). Some pixels drop out at random
+ * and surfaces beyond max_range_m read as no data, as on the camera.
+ */
+class SyntheticDepthScene
+{
+public:
+  struct Config
+  {
+    int width = 848;
+    int height = 480;
+    CameraIntrinsics intrinsics{427.0f, 427.0f, 424.0f, 240.0f}; // D455 depth at 848x480
+    float camera_height_m = 0.5f;
+    float pitch_rad = 0.35f;    // Camera tilted down
+    float slope_rad = 0.0f;     // Ground rising ahead of the camera
+    float depth_units = 0.001f; // Meters per Z16 unit
+    float max_range_m = 6.0f;
+    float baseline_m = 0.095f;
+    float subpixel = 0.08f;     // RMS disparity error in pixels, 0 renders without noise
+    float dropout = 0.01f;      // Fraction of pixels without data
+  };
+
+  SyntheticDepthScene() : SyntheticDepthScene(Config()) {}
+  explicit SyntheticDepthScene(const Config &config);
+
+  void addRock(float x, float y, float radius, float height);
+  void addCrater(float x, float y, float radius, float depth);
+  void add(const TerrainFeature &feature) { features_.push_back(feature); }
+  void clear() { features_.clear(); }
+
+  /**
+   * @brief Renders one frame. The terrain is the same for every seed, the noise differs.
+   * @param depth Resized to width * height, rows tightly packed
+   */
+  void render(std::vector<uint16_t> &depth, uint32_t seed) const;
+
+  /**
+   * @brief The ground without features in the camera optical frame, in the convention of GroundPlaneEstimator.
+   */
+  Plane groundPlane() const;
+
+  const Config &config() const { return config_; }
+  const std::vector<TerrainFeature> &features() const { return features_; }
+
+private:
+  /**
+   * @returns Depth of the first surface along the optical ray (dx, dy, 1), 0 if none
+   */
+  float cast(float dx, float dy) const;
+
+  Config config_;
+  std::vector<TerrainFeature> features_;
+  float axes_[9]; // Optical x, y and z axes in the ground frame (x right, y ahead, z up)
+  float normal_[3]; // Up normal of the ground
+};
+
+#endif // SYNTHETICDEPTH_HPP
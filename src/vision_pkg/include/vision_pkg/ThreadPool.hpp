@@ -0,0 +1,55 @@
+/**
+ * @file ThreadPool.hpp
+ * @brief Fixed set of worker threads running indexed tasks in parallel.
+ */
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Runs task(0) .. task(count - 1) on the workers and the calling thread, returning once
+ *        all have finished. Threads are created once, run() does not allocate.
+ */
+class ThreadPool
+{
+public:
+  /**
+   * @param threads Total threads taking part in run(), the caller included
+   */
+  explicit ThreadPool(std::size_t threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void run(std::size_t count, const std::function<void(std::size_t)> &task);
+
+  std::size_t size() const { return workers_.size() + 1; }
+
+private:
+  void work();
+  void drain();
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(std::size_t)> *task_ = nullptr;
+  std::size_t count_ = 0;
+  std::size_t next_ = 0;     // Next task index to hand out
+  std::size_t finished_ = 0; // Tasks completed in this run
+  uint64_t run_id_ = 0;
+  bool stop_ = false;
+};
+
+#endif // THREADPOOL_HPP
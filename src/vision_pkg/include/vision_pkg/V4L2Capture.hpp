@@ -0,0 +1,145 @@
+/**
+ * @file V4L2Capture.hpp
+ * @brief MJPEG frame sources for the USB webcams: a V4L2 mmap capture and a file-backed fake device.
+ */
+
+#ifndef V4L2CAPTURE_HPP
+#define V4L2CAPTURE_HPP
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @struct MjpegFrame
+ * @brief A compressed frame borrowed from an MjpegSource. The data stays valid until the
+ *        frame is handed back with MjpegSource::release().
+ */
+struct MjpegFrame
+{
+  const uint8_t *data = nullptr;
+  std::size_t size = 0;
+  uint32_t sequence = 0;
+  std::chrono::nanoseconds timestamp{0}; // Capture time on CLOCK_MONOTONIC
+  int index = -1;                        // Driver buffer index, -1 for sources without one
+};
+
+/**
+ * @class MjpegSource
+ * @brief Interface of a source producing already compressed JPEG frames.
+ */
+class MjpegSource
+{
+public:
+  virtual ~MjpegSource() = default;
+
+  /**
+   * @brief Opens the source and starts streaming.
+   * @param path Device node (/dev/videoX) or file path
+   * @param width Requested width in pixels
+   * @param height Requested height in pixels
+   * @param fps Requested frame rate
+   * @returns true if the source is streaming MJPEG. lastError() is set otherwise.
+   */
+  virtual bool open(const std::string &path, int width, int height, int fps) = 0;
+
+  /**
+   * @brief Fetches the newest available frame. Older queued frames are dropped.
+   * @param frame Filled with the borrowed frame on success
+   * @param timeout_ms Time to wait for a frame, 0 to poll
+   * @returns true if a frame was fetched
+   */
+  virtual bool grab(MjpegFrame &frame, int timeout_ms) = 0;
+
+  /**
+   * @brief Returns a frame obtained by grab() to the source.
+   */
+  virtual void release(const MjpegFrame &frame) = 0;
+
+  virtual void close() = 0;
+  virtual bool isOpened() const = 0;
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  const std::string &lastError() const { return last_error_; }
+
+  /**
+   * @brief Creates the source matching a path. Files ending in .mjpeg or .mjpg are replayed by
+   *        MjpegFileCapture, anything else is treated as a V4L2 device.
+   */
+  static std::unique_ptr<MjpegSource> create(const std::string &path);
+
+protected:
+  int width_ = 0;
+  int height_ = 0;
+  std::string last_error_;
+};
+
+/**
+ * @class V4L2Capture
+ * @brief Captures MJPEG straight from a UVC webcam through V4L2 memory-mapped buffers,
+ *        so frames never pass through a decoder.
+ */
+class V4L2Capture : public MjpegSource
+{
+public:
+  V4L2Capture() = default;
+  ~V4L2Capture() override;
+
+  V4L2Capture(const V4L2Capture &) = delete;
+  V4L2Capture &operator=(const V4L2Capture &) = delete;
+
+  bool open(const std::string &path, int width, int height, int fps) override;
+  bool grab(MjpegFrame &frame, int timeout_ms) override;
+  void release(const MjpegFrame &frame) override;
+  void close() override;
+  bool isOpened() const override { return fd_ >= 0; }
+
+  int fd() const { return fd_; }
+
+private:
+  static const int BUFFER_COUNT = 4;
+
+  struct Buffer
+  {
+    void *start = nullptr;
+    std::size_t length = 0;
+  };
+
+  bool fail(const std::string &what);
+  bool dequeue(MjpegFrame &frame);
+
+  int fd_ = -1;
+  bool streaming_ = false;
+  std::vector<Buffer> buffers_;
+};
+
+/**
+ * @class MjpegFileCapture
+ * @brief Fake device replaying a file of concatenated JPEG images at the requested frame rate,
+ *        looping at the end. Such a file can be produced with
+ *        "ffmpeg -i clip.mp4 -c:v mjpeg -q:v 5 -f mjpeg clip.mjpeg".
+ */
+class MjpegFileCapture : public MjpegSource
+{
+public:
+  bool open(const std::string &path, int width, int height, int fps) override;
+  bool grab(MjpegFrame &frame, int timeout_ms) override;
+  void release(const MjpegFrame &) override {}
+  void close() override;
+  bool isOpened() const override { return !frames_.empty(); }
+
+private:
+  std::vector<uint8_t> file_;
+  std::vector<std::pair<std::size_t, std::size_t>> frames_; // Offset and size of every image in file_
+  std::size_t next_ = 0;
+  uint32_t sequence_ = 0;
+  std::chrono::nanoseconds period_{0};
+  std::chrono::steady_clock::time_point next_due_;
+};
+
+#endif // V4L2CAPTURE_HPP
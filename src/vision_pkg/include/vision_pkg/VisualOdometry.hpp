@@ -0,0 +1,131 @@
+/**
+ * @file VisualOdometry.hpp
+ * @brief Keyframe-based RGB-D visual odometry on ORB features.
+ */
+
+#ifndef VISUALODOMETRY_HPP
+#define VISUALODOMETRY_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+#include "vision_pkg/GroundPlane.hpp"
+
+/**
+ * @struct VisualOdometryResult
+ * @brief Pose and per-stage timing of one tracked frame.
+ */
+struct VisualOdometryResult
+{
+  bool tracking = false;     // The frame was registered against the keyframe
+  bool keyframe = false;     // The frame became the new keyframe
+  std::size_t features = 0;  // ORB features detected
+  std::size_t matches = 0;   // Matches with a 3D keyframe point
+  std::size_t inliers = 0;   // PnP RANSAC inliers
+  cv::Matx44d world_from_camera = cv::Matx44d::eye(); // World is the color optical frame of the first frame
+  double detect_ms = 0.0;    // Grayscale, FAST corners and ORB descriptors
+  double match_ms = 0.0;
+  double pnp_ms = 0.0;
+  double keyframe_ms = 0.0;  // Depth lookup of a new keyframe
+  double total_ms = 0.0;
+};
+
+/**
+ * @class VisualOdometry
+ * @brief Tracks the color camera from ORB features with a depth lookup on keyframes.
+ *
+ * Every frame is matched against the current keyframe, whose features carry 3D points from
+ * the depth frame, and its pose relative to the keyframe is solved with PnP RANSAC. Registering
+ * against a keyframe instead of the previous frame keeps the drift from growing while the
+ * robot stands still or moves slowly. A new keyframe is taken when the camera moved or turned
+ * far enough, or too few inliers are left. Depth only has to be looked up for keyframes: the
+ * depth frame is projected into the color image through a z-buffer, so the two streams need
+ * not be aligned.
+ */
+class VisualOdometry
+{
+public:
+  struct Config
+  {
+    int max_features = 500;
+    int fast_threshold = 20;
+    int pyramid_levels = 4;
+    float min_depth_m = 0.3f;
+    float max_depth_m = 8.0f;
+    int ransac_iterations = 100;
+    float ransac_reprojection_px = 2.0f;
+    std::size_t min_inliers = 20;          // Fewer and the frame is lost
+    std::size_t keyframe_inliers = 80;     // Fewer and the frame becomes the next keyframe
+    double keyframe_distance_m = 0.25;
+    double keyframe_angle_rad = 0.17;
+  };
+
+  VisualOdometry() : VisualOdometry(Config()) {}
+  explicit VisualOdometry(const Config &config);
+
+  /**
+   * @param color_matrix Pinhole intrinsics of the color stream
+   * @param color_distortion OpenCV distortion coefficients of the color stream, may be empty
+   * @param depth Intrinsics of the depth stream
+   * @param color_from_depth Transform of depth optical frame points into the color optical frame
+   */
+  void setCalibration(const cv::Matx33d &color_matrix, const std::vector<double> &color_distortion,
+                      const CameraIntrinsics &depth, const cv::Matx44d &color_from_depth);
+  bool hasCalibration() const { return has_calibration_; }
+
+  /**
+   * @brief Tracks one frame.
+   * @param bgr Color image
+   * @param depth Depth image of the same instant, row stride in bytes
+   * @param units Meters per depth unit
+   */
+  const VisualOdometryResult &track(const cv::Mat &bgr, const uint16_t *depth, int depth_width, int depth_height,
+                                    std::size_t depth_stride, float units);
+
+  /**
+   * @brief Drops the keyframe, the next frame starts tracking again from the current pose.
+   */
+  void reset();
+
+  std::size_t keyframeCount() const { return keyframe_count_; }
+
+private:
+  /**
+   * @returns false if too few features have a depth, the previous keyframe is then kept
+   */
+  bool makeKeyframe(const uint16_t *depth, int depth_width, int depth_height, std::size_t depth_stride, float units);
+
+  Config config_;
+  cv::Ptr<cv::ORB> orb_;
+  cv::Ptr<cv::BFMatcher> matcher_;
+  cv::Matx33d color_matrix_;
+  std::vector<double> color_distortion_;
+  CameraIntrinsics depth_intrinsics_{};
+  cv::Matx44d color_from_depth_ = cv::Matx44d::eye();
+  bool has_calibration_ = false;
+
+  // Current frame
+  cv::Mat gray_;
+  std::vector<cv::KeyPoint> keypoints_;
+  cv::Mat descriptors_;
+  std::vector<cv::DMatch> matches_;
+  cv::Mat depth_in_color_;                     // Z-buffer of the depth frame in color pixels, meters
+
+  // Keyframe, only features with a valid depth are kept
+  bool has_keyframe_ = false;
+  std::vector<cv::Point3f> keyframe_points_;   // In the keyframe color optical frame
+  cv::Mat keyframe_descriptors_;
+  cv::Matx44d world_from_keyframe_ = cv::Matx44d::eye();
+  cv::Vec3d rvec_;                             // Last camera_from_keyframe, the next PnP guess
+  cv::Vec3d tvec_;                             //
+  std::size_t keyframe_count_ = 0;
+
+  VisualOdometryResult result_;
+};
+
+#endif // VISUALODOMETRY_HPP
@@ -0,0 +1,138 @@
+/**
+ * @file VoxelMap.hpp
+ * @brief Sparse 3D occupancy map of hashed voxel blocks with ray-cast clearing.
+ */
+
+#ifndef VOXELMAP_HPP
+#define VOXELMAP_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "vision_pkg/ElevationMap.hpp"
+
+class ThreadPool;
+
+/**
+ * @class VoxelMap
+ * @brief Occupancy of space around the robot, stored only where something was observed.
+ *
+ * Voxels hold a clamped log-odds occupancy and are grouped in blocks of 8x8x8. Blocks come from
+ * a fixed pool and are found through open-addressing hash tables, so memory never grows past
+ * max_blocks. The map is split into shards by block hash, each with its own table, pool and LRU
+ * list: a full shard reuses its least recently updated block, and evictOutside() drops blocks
+ * that fell behind the robot.
+ *
+ * insert() walks every ray from the sensor to its point, marking the end voxel as hit and the
+ * voxels before it as free. Neighbouring rays share most voxels near the sensor, and a voxel is
+ * cleared at most once per insert (per worker). The walk produces per-shard update lists, so with
+ * a thread pool the rays are traversed in parallel and then every shard applies its updates in
+ * parallel without locks.
+ */
+class VoxelMap
+{
+public:
+  static const int BLOCK_SIZE = 8; // Voxels per block edge
+
+  struct Config
+  {
+    float voxel_size = 0.05f;   // Meters
+    std::size_t max_blocks = 8192;
+    std::size_t shards = 8;
+    float max_ray_m = 4.0f;     // Points farther away only clear the first max_ray_m of their ray
+    int8_t hit = 8;             // Log-odds added by a point, in 1/10 units
+    int8_t miss = -4;           // Log-odds added by a ray passing through
+    int8_t min_log_odds = -20;
+    int8_t max_log_odds = 40;
+    int8_t occupied = 5;        // Voxels above this are occupied
+  };
+
+  VoxelMap() : VoxelMap(Config()) {}
+  explicit VoxelMap(const Config &config);
+
+  /**
+   * @brief Inserts a point cloud.
+   * @param x Sensor frame x coordinates of the points
+   * @param y Sensor frame y coordinates
+   * @param z Sensor frame z coordinates
+   * @param count Number of points
+   * @param map_from_sensor Pose of the sensor in the map frame, its translation is the ray origin
+   * @param pool Threads to use, nullptr to insert on the calling thread
+   */
+  void insert(const float *x, const float *y, const float *z, std::size_t count,
+              const RigidTransform &map_from_sensor, ThreadPool *pool = nullptr);
+
+  bool isOccupied(float x, float y, float z) const;
+
+  /**
+   * @brief Top of the highest occupied voxel of a column between z_min and z_max.
+   * @returns false if no voxel of the column is occupied
+   */
+  bool columnMaxHeight(float x, float y, float z_min, float z_max, float &height) const;
+
+  /**
+   * @brief Drops the blocks whose center is farther than radius from (x, y) in the horizontal plane.
+   */
+  void evictOutside(float x, float y, float radius);
+
+  /**
+   * @brief Calls visit with the center of every occupied voxel.
+   */
+  void forEachOccupied(const std::function<void(float, float, float)> &visit) const;
+
+  std::size_t blockCount() const;
+  const Config &config() const { return config_; }
+
+private:
+  struct Block
+  {
+    uint64_t key = 0;
+    int32_t prev = -1; // LRU list, most recently updated first
+    int32_t next = -1; //
+    int8_t voxels[BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE];
+  };
+
+  struct Shard
+  {
+    std::vector<Block> blocks;    // Pool
+    std::vector<int32_t> free;    // Unused pool entries
+    std::vector<uint64_t> keys;   // Hash table, EMPTY_KEY for empty slots
+    std::vector<int32_t> slots;   // Block of each table slot
+    int32_t head = -1;            // Most recently updated block
+    int32_t tail = -1;            // Least recently updated block
+  };
+
+  // Voxel update produced by the ray walk: voxel key and whether it was hit
+  using Update = uint64_t;
+
+  struct Worker
+  {
+    std::vector<std::vector<Update>> updates; // Per shard. Capacity is kept between frames.
+    std::vector<uint64_t> cleared;            // Direct mapped cache of voxels already cleared this frame
+  };
+
+  static uint64_t voxelKey(int64_t vx, int64_t vy, int64_t vz);
+  static uint64_t blockOf(uint64_t voxel_key);
+  static int voxelIndex(uint64_t voxel_key);
+  std::size_t shardOf(uint64_t block_key) const;
+
+  void traverse(const float *x, const float *y, const float *z, std::size_t begin, std::size_t end,
+                const RigidTransform &map_from_sensor, Worker &worker) const;
+  void apply(Shard &shard, const std::vector<Update> &updates);
+
+  const Block *find(const Shard &shard, uint64_t block_key) const;
+  Block &findOrCreate(Shard &shard, uint64_t block_key);
+  void erase(Shard &shard, int32_t block);
+  void touch(Shard &shard, int32_t block);
+  void unlink(Shard &shard, int32_t block);
+
+  Config config_;
+  float inv_voxel_;
+  std::vector<Shard> shards_;
+  std::vector<Worker> workers_;
+};
+
+#endif // VOXELMAP_HPP
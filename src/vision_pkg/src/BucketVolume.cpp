@@ -0,0 +1,185 @@
+#include "vision_pkg/BucketVolume.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+namespace
+{
+  const char MAGIC[4] = {'B', 'K', 'T', '1'};
+  const float EMPTY_HYSTERESIS = 0.1f;
+}
+
+BucketVolume::BucketVolume(const Config &config) : config_(config)
+{
+}
+
+void BucketVolume::setRegion(const CameraIntrinsics &intrinsics, int x0, int y0, int x1, int y1)
+{
+  const bool changed = x0 != x0_ || y0 != y0_ || x1 != x1_ || y1 != y1_ || intrinsics.fx != intrinsics_.fx ||
+                       intrinsics.fy != intrinsics_.fy || intrinsics.cx != intrinsics_.cx || intrinsics.cy != intrinsics_.cy;
+  if (!changed)
+  {
+    return;
+  }
+  intrinsics_ = intrinsics;
+  x0_ = x0;
+  y0_ = y0;
+  x1_ = std::max(x0, x1);
+  y1_ = std::max(y0, y1);
+  const std::size_t pixels = static_cast<std::size_t>(x1_ - x0_) * (y1_ - y0_);
+  reference_.assign(pixels, 0.0f);
+  reference_cube_.assign(pixels, 0.0f);
+  calibrated_ = false;
+  calibration_left_ = 0;
+  reference_pixels_ = 0;
+}
+
+void BucketVolume::startCalibration()
+{
+  sum_.assign(reference_.size(), 0.0);
+  count_.assign(reference_.size(), 0);
+  calibration_left_ = std::max(1, config_.calibration_frames);
+}
+
+const BucketFill &BucketVolume::update(const uint16_t *depth, int width, int height, std::size_t stride, float units)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const int x1 = std::min(x1_, width);
+  const int y1 = std::min(y1_, height);
+  const int region_width = x1_ - x0_;
+
+  if (calibrating())
+  {
+    for (int v = y0_; v < y1; v++)
+    {
+      const uint16_t *row = reinterpret_cast<const uint16_t *>(reinterpret_cast<const uint8_t *>(depth) + v * stride);
+      const std::size_t base = static_cast<std::size_t>(v - y0_) * region_width;
+      for (int u = x0_; u < x1; u++)
+      {
+        if (row[u] != 0)
+        {
+          sum_[base + u - x0_] += row[u] * units;
+          count_[base + u - x0_]++;
+        }
+      }
+    }
+    if (--calibration_left_ == 0)
+    {
+      finishCalibration();
+    }
+  }
+
+  fill_.calibrated = calibrated_;
+  if (calibrated_)
+  {
+    // Pyramid volume between the measured surface and the reference, per pixel
+    const float scale = 1.0f / (3.0f * intrinsics_.fx * intrinsics_.fy);
+    double volume = 0.0;
+    std::size_t valid = 0;
+    for (int v = y0_; v < y1; v++)
+    {
+      const uint16_t *row = reinterpret_cast<const uint16_t *>(reinterpret_cast<const uint8_t *>(depth) + v * stride);
+      const std::size_t base = static_cast<std::size_t>(v - y0_) * region_width;
+      for (int u = x0_; u < x1; u++)
+      {
+        const float r = reference_[base + u - x0_];
+        if (row[u] == 0 || r == 0.0f)
+        {
+          continue;
+        }
+        valid++;
+        const float d = row[u] * units;
+        if (d < r - config_.min_height_m)
+        {
+          volume += reference_cube_[base + u - x0_] - d * d * d * scale;
+        }
+      }
+    }
+
+    fill_.valid_fraction = reference_pixels_ > 0 ? static_cast<float>(valid) / reference_pixels_ : 0.0f;
+    fill_.raw_volume_m3 = valid > 0 ? static_cast<float>(volume * reference_pixels_ / valid) : fill_.volume_m3;
+    fill_.volume_m3 = config_.smoothing * fill_.raw_volume_m3 + (1.0f - config_.smoothing) * fill_.volume_m3;
+    fill_.fill_fraction = fill_.volume_m3 / config_.capacity_m3;
+    if (fill_.fill_fraction >= config_.full_fraction)
+    {
+      fill_.full = true;
+    }
+    else if (fill_.fill_fraction < config_.full_fraction - EMPTY_HYSTERESIS)
+    {
+      fill_.full = false;
+    }
+  }
+  fill_.compute_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return fill_;
+}
+
+void BucketVolume::finishCalibration()
+{
+  const float scale = 1.0f / (3.0f * intrinsics_.fx * intrinsics_.fy);
+  const uint16_t min_count = static_cast<uint16_t>(std::max(1, config_.calibration_frames / 2));
+  reference_pixels_ = 0;
+  for (std::size_t i = 0; i < reference_.size(); i++)
+  {
+    // Pixels that rarely had a depth are left out rather than given a noisy reference
+    const bool known = count_[i] >= min_count;
+    reference_[i] = known ? static_cast<float>(sum_[i] / count_[i]) : 0.0f;
+    reference_cube_[i] = reference_[i] * reference_[i] * reference_[i] * scale;
+    reference_pixels_ += known ? 1 : 0;
+  }
+  sum_.clear();
+  count_.clear();
+  calibrated_ = reference_pixels_ > 0;
+  fill_ = BucketFill();
+}
+
+bool BucketVolume::save(const std::string &path) const
+{
+  if (!calibrated_)
+  {
+    return false;
+  }
+  std::ofstream out(path, std::ios::binary);
+  const int32_t header[4] = {x0_, y0_, x1_, y1_};
+  out.write(MAGIC, sizeof(MAGIC));
+  out.write(reinterpret_cast<const char *>(header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(&intrinsics_), sizeof(intrinsics_));
+  out.write(reinterpret_cast<const char *>(reference_.data()), reference_.size() * sizeof(float));
+  return static_cast<bool>(out);
+}
+
+bool BucketVolume::load(const std::string &path)
+{
+  std::ifstream in(path, std::ios::binary);
+  char magic[4];
+  int32_t header[4];
+  CameraIntrinsics intrinsics;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char *>(header), sizeof(header));
+  in.read(reinterpret_cast<char *>(&intrinsics), sizeof(intrinsics));
+  if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || header[0] != x0_ || header[1] != y0_ || header[2] != x1_ ||
+      header[3] != y1_ || intrinsics.fx != intrinsics_.fx || intrinsics.fy != intrinsics_.fy)
+  {
+    return false;
+  }
+  std::vector<float> reference(reference_.size());
+  in.read(reinterpret_cast<char *>(reference.data()), reference.size() * sizeof(float));
+  if (!in)
+  {
+    return false;
+  }
+
+  const float scale = 1.0f / (3.0f * intrinsics_.fx * intrinsics_.fy);
+  reference_ = std::move(reference);
+  reference_pixels_ = 0;
+  for (std::size_t i = 0; i < reference_.size(); i++)
+  {
+    reference_cube_[i] = reference_[i] * reference_[i] * reference_[i] * scale;
+    reference_pixels_ += reference_[i] > 0.0f ? 1 : 0;
+  }
+  calibrated_ = reference_pixels_ > 0;
+  fill_ = BucketFill();
+  return calibrated_;
+}
@@ -1,11 +1,22 @@
 // Optimized for low latency and high performance on Jetson
 
 #include <list>
+#include <limits>
+#include <array>
+#include <memory>
 #include <vector>
+#include <algorithm>
 #include <iostream>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <atomic>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <sys/resource.h>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/cuda.hpp>
 #include <opencv2/cudafilters.hpp>
@@ -14,19 +25,67 @@
 
 #include "rclcpp/rclcpp.hpp"
 #include "std_msgs/msg/string.hpp"
-#include "std_msgs/msg/bool.hpp"
 #include "std_msgs/msg/float32.hpp"
 #include "sensor_msgs/msg/compressed_image.hpp"
 #include "sensor_msgs/msg/image.hpp"
+#include "sensor_msgs/msg/point_cloud2.hpp"
+#include "geometry_msgs/msg/pose_with_covariance_stamped.hpp"
+#include "geometry_msgs/msg/transform_stamped.hpp"
+#include "nav_msgs/msg/occupancy_grid.hpp"
+#include "nav_msgs/msg/odometry.hpp"
+#include "std_srvs/srv/set_bool.hpp"
+#include "std_srvs/srv/trigger.hpp"
+#include "tf2_ros/static_transform_broadcaster.h"
+#include "interfaces_pkg/msg/bucket_fill.hpp"
+#include "interfaces_pkg/msg/camera_health.hpp"
+#include "interfaces_pkg/msg/camera_pipeline_stats.hpp"
+#include "interfaces_pkg/msg/depth_grid.hpp"
+#include "interfaces_pkg/msg/elevation_grid.hpp"
+#include "interfaces_pkg/msg/encoded_video.hpp"
+#include "interfaces_pkg/msg/fiducial_detection.hpp"
+#include "interfaces_pkg/msg/ground_plane.hpp"
+#include "interfaces_pkg/msg/stream_latency.hpp"
+#include "interfaces_pkg/msg/stream_stats.hpp"
+#include "interfaces_pkg/msg/video_feedback.hpp"
+#include "interfaces_pkg/msg/visual_odometry_stats.hpp"
 
 #include "librealsense2/rs.hpp"
+#include "vision_pkg/BucketVolume.hpp"
+#include "vision_pkg/CameraSupervisor.hpp"
+#include "vision_pkg/CaptureTiming.hpp"
+#include "vision_pkg/DepthStats.hpp"
+#include "vision_pkg/ElevationMap.hpp"
+#include "vision_pkg/FiducialLocalizer.hpp"
+#include "vision_pkg/GroundPlane.hpp"
+#if VISION_HAVE_X264
+#include "vision_pkg/H264Encoder.hpp"
+#endif
+#include "vision_pkg/JpegDecoder.hpp"
+#include "vision_pkg/JpegEncoder.hpp"
+#include "vision_pkg/PointCloudBuilder.hpp"
+#include "vision_pkg/RateController.hpp"
+#include "vision_pkg/Recording.hpp"
+#include "vision_pkg/RecordingPlayer.hpp"
+#include "vision_pkg/ThreadPool.hpp"
+#include "vision_pkg/V4L2Capture.hpp"
+#include "vision_pkg/VisualOdometry.hpp"
+#include "vision_pkg/VoxelMap.hpp"
 // #include "SparkMax.hpp"
 
 #define WEBCAM_ONE_PATH "/dev/video6"
 #define WEBCAM_TWO_PATH "/dev/video8"
+#define DEPTH_CAMERA_ONE_SERIAL "318122303486"
+#define DEPTH_CAMERA_TWO_SERIAL "308222300472"
 
 using namespace std::chrono_literals;
 
+const int JPEG_QUALITY = 40;            // Initial quality, adjusted by the rate controller
+const int H264_MIN_KBPS = 100;          // Lowest H.264 bitrate the rate controller can set
+const int DEPTH_VIEW_MAX_MM = 4000;     // Depth mapped to black in the depth-assist view
+const int WEBCAM_WIDTH = 640;
+const int WEBCAM_HEIGHT = 480;
+const int WEBCAM_FPS = 15;
+
 enum Cameras
 {
   D455_ONE,
@@ -35,6 +94,92 @@ enum Cameras
   WEBCAM_TWO
 };
 
+enum Streams
+{
+  D455_ONE_COLOR,
+  D455_ONE_DEPTH,
+  D455_TWO_COLOR,
+  D455_TWO_DEPTH,
+  WEBCAM_ONE_COLOR,
+  WEBCAM_TWO_COLOR,
+  NUM_STREAMS
+};
+
+/**
+ * @struct FrameTiming
+ * @brief When the frame being published was captured and taken by the node.
+ */
+struct FrameTiming
+{
+  rclcpp::Time capture;                           // Node clock, becomes the message stamp
+  rclcpp::Time dequeue;                           // Node clock
+  std::chrono::steady_clock::time_point dequeued; // Same instant as dequeue, for the later stages
+  const char *clock = "arrival";                  // Source of the capture time
+};
+
+enum LatencyStages
+{
+  CAPTURE_TO_DEQUEUE,
+  DEQUEUE_TO_ENCODE,
+  ENCODE_TO_PUBLISH,
+  CAPTURE_TO_PUBLISH,
+  NUM_LATENCY_STAGES
+};
+
+/**
+ * @struct VideoStream
+ * @brief Publishers, encoders and reusable messages belonging to one compressed video topic.
+ *        The JPEG goes to the topic itself and H.264 to <topic>/h264, each encoded only while
+ *        it has subscribers. The message and scratch buffers keep their capacity between frames.
+ */
+struct VideoStream
+{
+  Streams id;
+  std::string name;
+  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr pub;
+  rclcpp::Publisher<interfaces_pkg::msg::StreamStats>::SharedPtr stats_pub;
+  std::unique_ptr<JpegEncoder> encoder;
+  sensor_msgs::msg::CompressedImage msg;
+  interfaces_pkg::msg::StreamStats stats;
+  std::vector<uint8_t> scratch; // 8-bit image for the depth-assist view
+  cv::Mat scaled;               // Downscaled image when the rate controller reduces resolution
+  std::chrono::steady_clock::time_point next_frame;
+
+#if VISION_HAVE_X264
+  rclcpp::Publisher<interfaces_pkg::msg::EncodedVideo>::SharedPtr h264_pub;
+  std::unique_ptr<H264Encoder> h264;         // Created when <topic>/h264 is first subscribed
+  interfaces_pkg::msg::EncodedVideo h264_msg;
+  interfaces_pkg::msg::StreamStats h264_stats;
+#endif
+
+  std::atomic<uint32_t> subscribers{0};      // Updated by the graph watcher thread
+  std::atomic<uint32_t> h264_subscribers{0}; //
+  bool enabled = false;                      // Stages of the stream run only while it has subscribers
+  bool jpeg_enabled = false;                 // Outputs of the stream that have subscribers
+  bool h264_enabled = false;                 //
+  uint32_t h264_viewers = 0;                 // H.264 subscribers seen by the timer thread
+  double stage_ms = 0.0;                     // Smoothed processing time of one frame
+
+  FrameTiming timing;                        // Frame about to be published
+  ClockOffset device_clock;                  // RealSense hardware clock to system clock, when global time is off
+  std::array<LatencyHistogram, NUM_LATENCY_STAGES> latency; // Since the last latency report
+  rclcpp::Publisher<interfaces_pkg::msg::StreamLatency>::SharedPtr latency_pub;
+};
+
+/**
+ * @struct Webcam
+ * @brief Capture state of one USB webcam. Capture is closed while nobody subscribes.
+ */
+struct Webcam
+{
+  std::string path;
+  cv::VideoCapture cap;               // Used when MJPEG passthrough is unavailable
+  std::unique_ptr<MjpegSource> mjpeg; // MJPEG passthrough source
+  bool running = false;
+  uint64_t generation = 0;                         // Supervisor generation of the device that was opened
+  std::chrono::steady_clock::time_point retry_at{}; // Next open attempt after a failure
+};
+
 /**
  * @class MultiCameraNode
  * @brief Handles a single realsense camera (by serial ID) and two Web Cameras.
@@ -45,197 +190,413 @@ class MultiCameraNode : public rclcpp::Node
 public:
   /**
    * @brief MultiCameraNode is the main constructor of the MultiCameraNode class.
-   *        It initiallizes the activeCameras array, an array to keep track of connected cameras,
-   *        and sets/creates pipelines to up to 4 cameras (2 RS and 2 Webcams). For those cameras
-   *        which are connected, a publisher is initiallized. A timer with a frequency of 15Hz is created
-   *        to publish video frames to all channels.
+   *        It creates the publishers of up to 4 cameras (2 RS and 2 Webcams) and hands the cameras
+   *        to the camera supervisor, which brings each one up whenever it is plugged in. A timer with
+   *        a frequency of 15Hz is created to publish video frames to all channels.
    * @return None
-   * @exception No cameras detected (activeCameras is ALL false)
    */
-  MultiCameraNode() : Node("multi_camera_node"), activeCameras({false, false, false, false})
+  MultiCameraNode() : Node("multi_camera_node"), rate_controller_(Streams::NUM_STREAMS, 0.0)
   {
-    // Camera Serial Numbers
-    const std::string DEPTH_CAMERA_ONE_SERIAL = "318122303486";
-    const std::string DEPTH_CAMERA_TWO_SERIAL = "308222300472";
-    // this->activeCameras[0] = false;
-    // this->activeCameras[1] = false;
-    // this->activeCameras[2] = false;
-    // this->activeCameras[3] = false;
-
     RCLCPP_INFO(this->get_logger(), "Multi-camera node startup.");
 
-    // Known D455 serials
-    rs2::config cfg_1;
-    rs2::config cfg_2;
-
     spat_.set_option(RS2_OPTION_HOLES_FILL, 2);
 
-    // Create Pipeline Configurations
-    cfg_1.enable_device(DEPTH_CAMERA_ONE_SERIAL.c_str());
-    cfg_1.enable_stream(RS2_STREAM_COLOR, 424, 240, RS2_FORMAT_BGR8, 15);
-    cfg_1.enable_stream(RS2_STREAM_DEPTH, RS2_FORMAT_Z16, 15);
-
-    cfg_2.enable_device(DEPTH_CAMERA_TWO_SERIAL.c_str());
-    cfg_2.enable_stream(RS2_STREAM_COLOR, 424, 240, RS2_FORMAT_BGR8, 15);
-    cfg_2.enable_stream(RS2_STREAM_DEPTH, 424, 240, RS2_FORMAT_Z16, 15);
+    /////
+    // Cameras are found by serial number or USB id rather than by /dev/videoN, and brought up
+    // and down by the supervisor as they are plugged. An empty camera serial takes any D455
+    // the other one does not ask for. A webcam id is its USB serial, vendor:product, udev
+    // ID_PATH (the USB port) or a device path; when empty, webcam_*_path is used as is.
+    // Paths ending in .mjpeg replay a file instead of opening a device.
+    const std::string camera1_serial = this->declare_parameter<std::string>("camera1_serial", DEPTH_CAMERA_ONE_SERIAL);
+    const std::string camera2_serial = this->declare_parameter<std::string>("camera2_serial", DEPTH_CAMERA_TWO_SERIAL);
+    webcams_[0].path = this->declare_parameter<std::string>("webcam_one_path", WEBCAM_ONE_PATH);
+    webcams_[1].path = this->declare_parameter<std::string>("webcam_two_path", WEBCAM_TWO_PATH);
+    const std::string webcam_one_id = this->declare_parameter<std::string>("webcam_one_id", "");
+    const std::string webcam_two_id = this->declare_parameter<std::string>("webcam_two_id", "");
+    mjpeg_passthrough_ = this->declare_parameter<bool>("webcam_mjpeg_passthrough", true);
+    webcam_output_width_ = this->declare_parameter<int>("webcam_output_width", 0);   // 0 publishes at capture size
+    webcam_output_height_ = this->declare_parameter<int>("webcam_output_height", 0); //
+
+    CameraSupervisor::Config supervisor_config;
+    supervisor_config.stall_timeout_s = this->declare_parameter<double>("camera_stall_timeout_s", supervisor_config.stall_timeout_s);
+    supervisor_ = std::make_unique<CameraSupervisor>(supervisor_config);
+    supervisor_->setEventLog([this](const std::string &line) { RCLCPP_WARN(this->get_logger(), "%s", line.c_str()); });
+    supervisor_->addRealsense("camera1", camera1_serial, [](rs2::config &cfg) {
+      cfg.enable_stream(RS2_STREAM_COLOR, 424, 240, RS2_FORMAT_BGR8, 15);
+      cfg.enable_stream(RS2_STREAM_DEPTH, RS2_FORMAT_Z16, 15);
+    });
+    supervisor_->addRealsense("camera2", camera2_serial, [](rs2::config &cfg) {
+      cfg.enable_stream(RS2_STREAM_COLOR, 424, 240, RS2_FORMAT_BGR8, 15);
+      cfg.enable_stream(RS2_STREAM_DEPTH, 424, 240, RS2_FORMAT_Z16, 15);
+    });
+    supervisor_->addWebcam("webcam1", webcam_one_id.empty() ? webcams_[0].path : webcam_one_id);
+    supervisor_->addWebcam("webcam2", webcam_two_id.empty() ? webcams_[1].path : webcam_two_id);
+    camera_health_pub_ = this->create_publisher<interfaces_pkg::msg::CameraHealth>("rs_node/camera_health", 5);
 
-    //////
-    // Attempt to create pipeline to First D455 Camera
-    RCLCPP_INFO(this->get_logger(), "Attempting to connect Pipeline 1");
-    if (this->ctx.query_devices().size() > 0)
+    /////
+    // Recording and replay. While recording (the record parameter or the rs_node/record service),
+    // the raw D455 color and depth and the webcam MJPEG go to record_path. A non-empty replay_path
+    // plays such a recording back in place of the cameras, and the cameras are left alone.
+    record_path_ = this->declare_parameter<std::string>("record_path", "camera_recording.visrec");
+    const bool record = this->declare_parameter<bool>("record", false);
+    const std::string replay_path = this->declare_parameter<std::string>("replay_path", "");
+    RecordingPlayer::Config replay_config;
+    replay_config.rate = this->declare_parameter<double>("replay_rate", replay_config.rate);
+    replay_config.loop = this->declare_parameter<bool>("replay_loop", replay_config.loop);
+    if (!replay_path.empty())
     {
-      try
+      player_ = std::make_unique<RecordingPlayer>(replay_config);
+      if (player_->open(replay_path))
       {
-        pipeline_1.start(cfg_1);
-        this->activeCameras[Cameras::D455_ONE] = true;
+        const RecordingReader &reader = player_->reader();
+        RCLCPP_INFO(this->get_logger(), "Replaying %s: %zu records over %.1f s%s", replay_path.c_str(), reader.size(),
+                    (reader.endNs() - reader.startNs()) * 1e-9, reader.recovered() ? ", index rebuilt" : "");
       }
-      catch (const rs2::error &exc)
+      else
       {
-        RCLCPP_ERROR(this->get_logger(), "Error connecting to camera %s, ERROR: %s", DEPTH_CAMERA_ONE_SERIAL.c_str(), exc.what());
+        RCLCPP_ERROR(this->get_logger(), "Cannot replay %s: %s. Using the cameras.", replay_path.c_str(), player_->lastError().c_str());
+        player_.reset();
       }
     }
-    else
-    {
-      RCLCPP_WARN(this->get_logger(), "D455 Camera One Not Connected");
-    }
+    record_srv_ = this->create_service<std_srvs::srv::SetBool>(
+        "rs_node/record", std::bind(&MultiCameraNode::record_callback, this, std::placeholders::_1, std::placeholders::_2));
+
+    /////
+    // Create Publishers. Every camera gets its topics, whether it is plugged in yet or not.
+    create_stream(Streams::D455_ONE_COLOR, "rs_node/camera1/compressed_video", "camera_rgb_optical_frame", JpegEncoder::Subsampling::YUV420);
+    create_stream(Streams::D455_ONE_DEPTH, "rs_node/camera1/depth_video", "camera_depth_optical_frame", JpegEncoder::Subsampling::GRAY);
+    create_stream(Streams::D455_TWO_COLOR, "rs_node/camera2/compressed_video", "camera_rgb_optical_frame", JpegEncoder::Subsampling::YUV420);
+    create_stream(Streams::D455_TWO_DEPTH, "rs_node/camera2/depth_video", "camera_depth_optical_frame", JpegEncoder::Subsampling::GRAY);
+    create_stream(Streams::WEBCAM_ONE_COLOR, "rgb_cam1/compressed", "rgb_camera_frame", JpegEncoder::Subsampling::YUV420);
+    create_stream(Streams::WEBCAM_TWO_COLOR, "rgb_cam2/compressed", "rgb_camera_frame", JpegEncoder::Subsampling::YUV420);
+
+    depth_detection_pub_ = this->create_publisher<std_msgs::msg::Float32>("depth_detection", 5);
 
-    //////
-    // Attempt to create pipeline to Second D455 Camera
-    RCLCPP_INFO(this->get_logger(), "Attempting to connect Pipeline 2");
-    if (this->ctx.query_devices().size() > 1)
+    /////
+    // Grid of region depths per D455, computed from the summed-area tables of every filtered frame
+    depth_grid_cols_ = this->declare_parameter<int>("depth_grid_cols", 16);
+    depth_grid_rows_ = this->declare_parameter<int>("depth_grid_rows", 12);
+    depth_grid_pubs_[Cameras::D455_ONE] = this->create_publisher<interfaces_pkg::msg::DepthGrid>("rs_node/camera1/depth_grid", 5);
+    depth_grid_pubs_[Cameras::D455_TWO] = this->create_publisher<interfaces_pkg::msg::DepthGrid>("rs_node/camera2/depth_grid", 5);
+
+    /////
+    // Ground plane fitted per frame. Rocks and craters are points too far above or below it.
+    rock_height_m_ = this->declare_parameter<double>("rock_height_m", 0.15);
+    crater_depth_m_ = this->declare_parameter<double>("crater_depth_m", 0.15);
+    GroundPlaneEstimator::Config ground_config;
+    ground_config.step = this->declare_parameter<int>("ground_decimation", ground_config.step);
+    ground_config.inlier_distance_m = this->declare_parameter<double>("ground_inlier_distance_m", ground_config.inlier_distance_m);
+    ground_planes_.fill(GroundPlaneEstimator(ground_config));
+    ground_plane_pubs_[Cameras::D455_ONE] = this->create_publisher<interfaces_pkg::msg::GroundPlane>("rs_node/camera1/ground_plane", 5);
+    ground_plane_pubs_[Cameras::D455_TWO] = this->create_publisher<interfaces_pkg::msg::GroundPlane>("rs_node/camera2/ground_plane", 5);
+
+    /////
+    // Point clouds of the filtered depth, built only while subscribed
+    const double cloud_voxel_m = this->declare_parameter<double>("pointcloud_voxel_m", 0.0); // 0 keeps every pixel
+    const double cloud_max_range_m = this->declare_parameter<double>("pointcloud_max_range_m", 6.0);
+    for (auto &builder : cloud_builders_)
     {
-      try
-      {
-        pipeline_2.start(cfg_2);
-        this->activeCameras[Cameras::D455_TWO] = true;
-      }
-      catch (const rs2::error &exc)
-      {
-        RCLCPP_ERROR(this->get_logger(), "Error connecting to camera %s, ERROR: %s", DEPTH_CAMERA_TWO_SERIAL.c_str(), exc.what());
-      }
+      builder.setVoxelSize(cloud_voxel_m);
+      builder.setRange(0.1, cloud_max_range_m);
     }
-    else
+    cloud_pubs_[Cameras::D455_ONE] = this->create_publisher<sensor_msgs::msg::PointCloud2>("rs_node/camera1/points", 1);
+    cloud_pubs_[Cameras::D455_TWO] = this->create_publisher<sensor_msgs::msg::PointCloud2>("rs_node/camera2/points", 1);
+
+    /////
+    // Elevation map around the robot, fused from both D455s. Camera extrinsics are
+    // [x, y, z, roll, pitch, yaw] of the camera in base_link, z being the height above the ground.
+    ElevationMap::Config map_config;
+    map_config.resolution = this->declare_parameter<double>("map_resolution", map_config.resolution);
+    map_config.size = this->declare_parameter<int>("map_size", map_config.size);
+    elevation_map_ = ElevationMap(map_config);
+    map_frame_ = this->declare_parameter<std::string>("map_frame", "odom");
+    map_min_height_m_ = this->declare_parameter<double>("map_min_height_m", -0.5);
+    map_max_height_m_ = this->declare_parameter<double>("map_max_height_m", 0.5);
+    const auto extrinsics_one = this->declare_parameter<std::vector<double>>("camera1_extrinsics", {0.3, 0.0, 0.5, 0.0, 0.35, 0.0});
+    const auto extrinsics_two = this->declare_parameter<std::vector<double>>("camera2_extrinsics", {-0.3, 0.0, 0.5, 0.0, 0.35, M_PI});
+    camera_extrinsics_[Cameras::D455_ONE] = extrinsics(extrinsics_one);
+    camera_extrinsics_[Cameras::D455_TWO] = extrinsics(extrinsics_two);
+    depth_frames_[Cameras::D455_ONE] = this->declare_parameter<std::string>("camera1_depth_frame", "camera1_depth_optical_frame");
+    depth_frames_[Cameras::D455_TWO] = this->declare_parameter<std::string>("camera2_depth_frame", "camera2_depth_optical_frame");
+    static_tf_broadcaster_ = std::make_shared<tf2_ros::StaticTransformBroadcaster>(this);
+    broadcast_camera_frames();
+    odom_sub_ = this->create_subscription<nav_msgs::msg::Odometry>(
+        this->declare_parameter<std::string>("odom_topic", "odometry/filtered"), 10,
+        std::bind(&MultiCameraNode::odom_callback, this, std::placeholders::_1));
+    elevation_map_pub_ = this->create_publisher<nav_msgs::msg::OccupancyGrid>("elevation_map", 1);
+    obstacle_map_pub_ = this->create_publisher<nav_msgs::msg::OccupancyGrid>("obstacle_map", 1);
+    elevation_grid_pub_ = this->create_publisher<interfaces_pkg::msg::ElevationGrid>("elevation_grid", 1);
+    map_timer_ = this->create_wall_timer(100ms, std::bind(&MultiCameraNode::map_callback, this));
+
+    /////
+    // 3D voxel map of both D455s, ray cast on voxel_map_threads threads. Blocks farther than
+    // voxel_map_radius from the robot are dropped once per second.
+    VoxelMap::Config voxel_config;
+    voxel_config.voxel_size = this->declare_parameter<double>("voxel_size", voxel_config.voxel_size);
+    voxel_config.max_blocks = this->declare_parameter<int>("voxel_map_max_blocks", 4096);
+    voxel_map_ = VoxelMap(voxel_config);
+    voxel_map_radius_m_ = this->declare_parameter<double>("voxel_map_radius", 6.0);
+    const int voxel_threads = this->declare_parameter<int>("voxel_map_threads", 2);
+    if (voxel_threads > 1)
     {
-      RCLCPP_WARN(this->get_logger(), "D455 Camera Two Not Connected");
+      voxel_pool_ = std::make_unique<ThreadPool>(voxel_threads);
     }
+    voxel_map_pub_ = this->create_publisher<sensor_msgs::msg::PointCloud2>("voxel_map", 1);
+    voxel_timer_ = this->create_wall_timer(1s, std::bind(&MultiCameraNode::voxel_map_callback, this));
 
     /////
-    // Open Path to Webcam One, if possible
-    RCLCPP_INFO(this->get_logger(), "Attempting to connect to Webcam 1");
-    if (cap_rgb1_.open(WEBCAM_ONE_PATH))
+    // Arena localization from fiducials on the collection bin, searched in the D455 color frames
+    // while fiducial_pose or the detection stats are subscribed. fiducial_poses holds
+    // [x, y, z, roll, pitch, yaw] of every id in fiducial_ids, the marker z axis pointing out
+    // of its face. The default is one marker 0.5 m up at the arena origin, facing +x.
+    FiducialLocalizer::Config fiducial_config;
+    fiducial_config.dictionary = this->declare_parameter<std::string>("fiducial_dictionary", fiducial_config.dictionary);
+    fiducial_config.marker_size_m = this->declare_parameter<double>("fiducial_size_m", fiducial_config.marker_size_m);
+    fiducial_frame_ = this->declare_parameter<std::string>("fiducial_frame", "map");
+    const auto fiducial_ids = this->declare_parameter<std::vector<int64_t>>("fiducial_ids", {0});
+    const auto fiducial_poses = this->declare_parameter<std::vector<double>>("fiducial_poses", {0.0, 0.0, 0.5, M_PI / 2, 0.0, M_PI / 2});
+    try
     {
-      cap_rgb1_.set(cv::CAP_PROP_FPS, 15);
-      cap_rgb1_.set(cv::CAP_PROP_FRAME_WIDTH, 640);
-      cap_rgb1_.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
-      this->activeCameras[Cameras::WEBCAM_ONE] = true;
-      RCLCPP_INFO(this->get_logger(), "Webcam at %s connected successfully", WEBCAM_ONE_PATH);
+      for (auto &fiducial : fiducials_)
+      {
+        fiducial = FiducialLocalizer(fiducial_config);
+      }
     }
-    else
+    catch (const std::invalid_argument &e)
     {
-      RCLCPP_WARN(this->get_logger(), "Webcam not found at %s", WEBCAM_ONE_PATH);
+      RCLCPP_ERROR(this->get_logger(), "%s, using %s", e.what(), FiducialLocalizer::Config().dictionary.c_str());
     }
-
-    /////
-    // Open Path to Webcam Two, if possible
-    RCLCPP_INFO(this->get_logger(), "Attempting to connect to Webcam 2");
-    if (cap_rgb2_.open(WEBCAM_TWO_PATH))
+    if (fiducial_poses.size() != 6 * fiducial_ids.size())
     {
-      cap_rgb2_.set(cv::CAP_PROP_FPS, 15);
-      cap_rgb2_.set(cv::CAP_PROP_FRAME_WIDTH, 640);
-      cap_rgb2_.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
-      this->activeCameras[Cameras::WEBCAM_TWO] = true;
-      RCLCPP_INFO(this->get_logger(), "Webcam at %s connected successfully", WEBCAM_TWO_PATH);
+      RCLCPP_ERROR(this->get_logger(), "fiducial_poses needs 6 values per fiducial id, got %zu for %zu ids",
+                   fiducial_poses.size(), fiducial_ids.size());
     }
-    else
+    for (std::size_t i = 0; i < fiducial_ids.size() && 6 * i + 5 < fiducial_poses.size(); i++)
     {
-      RCLCPP_WARN(this->get_logger(), "Webcam not found at %s", WEBCAM_TWO_PATH);
+      const double *pose = &fiducial_poses[6 * i];
+      for (auto &fiducial : fiducials_)
+      {
+        fiducial.addMarker(fiducial_ids[i], RigidTransform::fromXYZRPY(pose[0], pose[1], pose[2], pose[3], pose[4], pose[5]));
+      }
     }
+    fiducial_pose_pub_ = this->create_publisher<geometry_msgs::msg::PoseWithCovarianceStamped>("fiducial_pose", 5);
+    fiducial_detection_pub_ = this->create_publisher<interfaces_pkg::msg::FiducialDetection>("rs_node/fiducial_detection", 5);
 
     /////
-    // Create Publishers
-    if (this->activeCameras[Cameras::D455_ONE])
-    {
-      RCLCPP_INFO(this->get_logger(), "Creating D455_1_ Publishers");
-      d455_1_rgb_pub_ = this->create_publisher<sensor_msgs::msg::CompressedImage>("rs_node/camera1/compressed_video", 1);
-      d455_1_dep_pub_ = this->create_publisher<sensor_msgs::msg::CompressedImage>("rs_node/camera1/depth_video", 1);
-    }
+    // Visual odometry on one D455, run on its own thread while visual_odometry or its stats are
+    // subscribed. The camera pipeline only hands over the newest frameset, never waits on it.
+    VisualOdometry::Config vo_config;
+    vo_config.max_features = this->declare_parameter<int>("vo_max_features", vo_config.max_features);
+    vo_config.fast_threshold = this->declare_parameter<int>("vo_fast_threshold", vo_config.fast_threshold);
+    vo_config.keyframe_distance_m = this->declare_parameter<double>("vo_keyframe_distance_m", vo_config.keyframe_distance_m);
+    visual_odometry_ = VisualOdometry(vo_config);
+    vo_camera_ = this->declare_parameter<int>("vo_camera", 1) == 2 ? Cameras::D455_TWO : Cameras::D455_ONE;
+    vo_frame_ = this->declare_parameter<std::string>("vo_frame", "vo_odom");
+    vo_pub_ = this->create_publisher<nav_msgs::msg::Odometry>("visual_odometry", 10);
+    vo_stats_pub_ = this->create_publisher<interfaces_pkg::msg::VisualOdometryStats>("rs_node/visual_odometry_stats", 5);
+    vo_thread_ = std::thread(&MultiCameraNode::visual_odometry_loop, this);
 
-    if (this->activeCameras[Cameras::D455_TWO])
+    /////
+    // Bucket fill from a fixed region of bucket_camera's depth image, given as fractions of the
+    // image [x0, y0, x1, y1]. Calibrate with the bucket empty and in its carry position:
+    // ros2 service call /rs_node/calibrate_bucket std_srvs/srv/Trigger
+    BucketVolume::Config bucket_config;
+    bucket_config.capacity_m3 = this->declare_parameter<double>("bucket_capacity_m3", bucket_config.capacity_m3);
+    bucket_config.full_fraction = this->declare_parameter<double>("bucket_full_fraction", bucket_config.full_fraction);
+    bucket_volume_ = BucketVolume(bucket_config);
+    bucket_camera_ = this->declare_parameter<int>("bucket_camera", 2) == 1 ? Cameras::D455_ONE : Cameras::D455_TWO;
+    bucket_roi_ = this->declare_parameter<std::vector<double>>("bucket_roi", {0.3, 0.55, 0.7, 1.0});
+    if (bucket_roi_.size() != 4)
     {
-      RCLCPP_INFO(this->get_logger(), "Creating D455_2_ Publishers");
-      d455_2_rgb_pub_ = this->create_publisher<sensor_msgs::msg::CompressedImage>("rs_node/camera2/compressed_video", 1);
-      d455_2_dep_pub_ = this->create_publisher<sensor_msgs::msg::CompressedImage>("rs_node/camera2/depth_video", 1);
+      RCLCPP_ERROR(this->get_logger(), "bucket_roi needs 4 values, got %zu", bucket_roi_.size());
+      bucket_roi_ = {0.3, 0.55, 0.7, 1.0};
     }
+    bucket_reference_path_ = this->declare_parameter<std::string>("bucket_reference_path", "bucket_reference.bin");
+    bucket_pub_ = this->create_publisher<interfaces_pkg::msg::BucketFill>("bucket_fill", 10);
+    bucket_calibrate_srv_ = this->create_service<std_srvs::srv::Trigger>(
+        "rs_node/calibrate_bucket", std::bind(&MultiCameraNode::calibrate_bucket_callback, this, std::placeholders::_1, std::placeholders::_2));
 
-    if (this->activeCameras[Cameras::WEBCAM_ONE])
-    {
-      RCLCPP_INFO(this->get_logger(), "Creating Webcam_1_ Publisher");
-      rgb_cam1_pub_ = this->create_publisher<sensor_msgs::msg::CompressedImage>("rgb_cam1/compressed", 1);
-    }
+    /////
+    // Video rate control. The budget covers every compressed stream together.
+    const double bandwidth_kbps = this->declare_parameter<double>("video_bandwidth_kbps", 6000.0);
+    rate_controller_.setBudget(bandwidth_kbps * 1000.0 / 8.0);
+    rate_controller_.setPriorityStream(this->declare_parameter<std::string>("priority_stream", "rs_node/camera1/compressed_video"));
+    video_feedback_sub_ = this->create_subscription<interfaces_pkg::msg::VideoFeedback>(
+        "rs_node/video_feedback", 5, std::bind(&MultiCameraNode::video_feedback_callback, this, std::placeholders::_1));
+    rate_timer_ = this->create_wall_timer(500ms, std::bind(&MultiCameraNode::rate_control_callback, this));
+
+#if VISION_HAVE_X264
+    /////
+    // H.264 on <topic>/h264, for viewers that can decode it. h264_bitrate_kbps is the most a
+    // stream gets; the rate controller's allocation caps it further under congestion.
+    h264_config_.bitrate_kbps = this->declare_parameter<int>("h264_bitrate_kbps", h264_config_.bitrate_kbps);
+    h264_config_.gop = this->declare_parameter<int>("h264_gop", h264_config_.gop);
+    h264_config_.threads = this->declare_parameter<int>("h264_threads", h264_config_.threads);
+#else
+    RCLCPP_INFO(this->get_logger(), "Built without x264, the cameras are published as JPEG only");
+#endif
 
-    if (this->activeCameras[Cameras::WEBCAM_TWO])
+    /////
+    // Lazy publishing. A stream's stages only run while its topic has subscribers; the graph
+    // watcher recounts subscribers whenever the ROS graph changes. Depth filtering and obstacle
+    // detection keep running while keep_depth_warm is set.
+    keep_depth_warm_ = this->declare_parameter<bool>("keep_depth_warm", true);
+    power_sensor_path_ = this->declare_parameter<std::string>("power_sensor_path", "");
+    pipeline_stats_pub_ = this->create_publisher<interfaces_pkg::msg::CameraPipelineStats>("rs_node/pipeline_stats", 5);
+    pipeline_stats_timer_ = this->create_wall_timer(1s, std::bind(&MultiCameraNode::pipeline_stats_callback, this));
+    count_subscribers();
+    graph_thread_ = std::thread(&MultiCameraNode::watch_graph, this);
+    if (!player_)
     {
-      RCLCPP_INFO(this->get_logger(), "Creating Webcam_2_ Publisher");
-      rgb_cam2_pub_ = this->create_publisher<sensor_msgs::msg::CompressedImage>("rgb_cam2/compressed", 1);
+      supervisor_->start();
     }
-
-
-    RCLCPP_WARN(this->get_logger(), "Camera 1 Status: %s", this->activeCameras[Cameras::D455_ONE]?"ON":"OFF");
-    RCLCPP_WARN(this->get_logger(), "Camera 2 Status: %s", this->activeCameras[Cameras::D455_TWO]?"ON":"OFF");
-    RCLCPP_WARN(this->get_logger(), "Camera 3 Status: %s", this->activeCameras[Cameras::WEBCAM_ONE]?"ON":"OFF");
-    RCLCPP_WARN(this->get_logger(), "Camera 4 Status: %s", this->activeCameras[Cameras::WEBCAM_TWO]?"ON":"OFF");
-
-    // No Cameras Connected
-    if ( !this->activeCameras[Cameras::D455_ONE] &&
-         !this->activeCameras[Cameras::D455_TWO] &&
-         !this->activeCameras[Cameras::WEBCAM_ONE] &&
-         !this->activeCameras[Cameras::WEBCAM_TWO])
+    if (record && !start_recording())
     {
-
-      // Throw Error, No cameras are detected
-      RCLCPP_ERROR(this->get_logger(), "NO CAMERAS DETECTED");
-      throw std::exception();
+      RCLCPP_ERROR(this->get_logger(), "Cannot record: %s", recorder_.lastError().c_str());
     }
 
-    L_obstacle_detection_pub_ = this->create_publisher<std_msgs::msg::Bool>("obstacle_detection/left", 10);
-    R_obstacle_detection_pub_ = this->create_publisher<std_msgs::msg::Bool>("obstacle_detection/right", 10);
-    depth_detection_pub_ = this->create_publisher<std_msgs::msg::Float32>("depth_detection", 5);
-
     /////
     // Create Timer
     timer_ = this->create_wall_timer(66ms, std::bind(&MultiCameraNode::timer_callback, this)); // ~15 FPS
   }
 
+  ~MultiCameraNode()
+  {
+    graph_running_ = false;
+    if (graph_thread_.joinable())
+    {
+      graph_thread_.join();
+    }
+    {
+      std::lock_guard<std::mutex> lock(vo_mutex_);
+      vo_running_ = false;
+    }
+    vo_wake_.notify_one();
+    if (vo_thread_.joinable())
+    {
+      vo_thread_.join();
+    }
+  }
+
 private:
-  rs2::context ctx;         // Global Context used to query devices
-  rs2::pipeline pipeline_1; // Pipeline One used by the first D455 Camera
-  rs2::pipeline pipeline_2; // Pipeline Two used by the second D455 Camera
+  std::unique_ptr<CameraSupervisor> supervisor_; // Owns the D455 pipelines, slots indexed by Cameras
+  rclcpp::Publisher<interfaces_pkg::msg::CameraHealth>::SharedPtr camera_health_pub_;
+  std::unique_ptr<RecordingPlayer> player_; // Replays a recording in place of the cameras, null when live
+  RecordingWriter recorder_;                // Fed from the timer thread, writes on its own thread
+  std::string record_path_;
+  rclcpp::Service<std_srvs::srv::SetBool>::SharedPtr record_srv_;
 
   rs2::decimation_filter deci_;
   rs2::spatial_filter spat_;
   rs2::temporal_filter temp_;
 
-  cv::VideoCapture cap_rgb1_; // VideoCapture stream used by the USB Webcams
-  cv::VideoCapture cap_rgb2_; //
+  std::array<Webcam, 2> webcams_; // USB Webcams one and two
+  cv::Mat frame_;                 // Webcam frame, reused between reads
 
-  rclcpp::Publisher<std_msgs::msg::Bool>::SharedPtr L_obstacle_detection_pub_;
-  rclcpp::Publisher<std_msgs::msg::Bool>::SharedPtr R_obstacle_detection_pub_;
-  rclcpp::Publisher<std_msgs::msg::Float32>::SharedPtr depth_detection_pub_;
+  JpegDecoder mjpeg_decoder_;               // Only used when a downscaled webcam output is requested
+  std::vector<uint8_t> mjpeg_scaled_;       // Downscaled BGR webcam frame
+  bool mjpeg_passthrough_ = true;
+  int webcam_output_width_ = 0;
+  int webcam_output_height_ = 0;
 
-  // D455 RGB Camera Publishers
-  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr d455_1_rgb_pub_;
-  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr d455_1_dep_pub_;
+  rclcpp::Publisher<std_msgs::msg::Float32>::SharedPtr depth_detection_pub_;
 
-  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr d455_2_rgb_pub_;
-  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr d455_2_dep_pub_;
+  DepthStats depth_stats_;                                                         // Tables of the depth frame being processed
+  std::vector<DepthRegion> depth_grid_cells_;                                      //
+  std::array<rclcpp::Publisher<interfaces_pkg::msg::DepthGrid>::SharedPtr, 2> depth_grid_pubs_; // Indexed by D455_ONE / D455_TWO
+  interfaces_pkg::msg::DepthGrid depth_grid_msg_;
+  int depth_grid_cols_ = 16;
+  int depth_grid_rows_ = 12;
+
+  std::array<GroundPlaneEstimator, 2> ground_planes_; // Indexed by D455_ONE / D455_TWO
+  std::array<rclcpp::Publisher<interfaces_pkg::msg::GroundPlane>::SharedPtr, 2> ground_plane_pubs_;
+  interfaces_pkg::msg::GroundPlane ground_plane_msg_;
+  float rock_height_m_ = 0.15f;
+  float crater_depth_m_ = 0.15f;
+
+  std::array<PointCloudBuilder, 2> cloud_builders_; // Indexed by D455_ONE / D455_TWO
+  std::array<rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr, 2> cloud_pubs_;
+  std::array<sensor_msgs::msg::PointCloud2, 2> cloud_msgs_;
+  std::array<std::atomic<bool>, 2> cloud_wanted_{}; // Updated by the graph watcher thread
+
+  ElevationMap elevation_map_;                    // Heights around the robot, fused from both D455s
+  std::array<RigidTransform, 2> camera_extrinsics_; // Optical frame to base_link, indexed by D455_ONE / D455_TWO
+  std::array<std::string, 2> depth_frames_;         // tf frames of the depth optical frames, latched from the extrinsics
+  std::shared_ptr<tf2_ros::StaticTransformBroadcaster> static_tf_broadcaster_;
+  RigidTransform robot_pose_;                     // base_link in map_frame_, from odometry
+  std::string map_frame_;
+  float map_min_height_m_ = -0.5f; // Heights mapped to 0..100 in the elevation grid
+  float map_max_height_m_ = 0.5f;  //
+  VoxelMap voxel_map_;                            // Occupied space around the robot, fused from both D455s
+  std::unique_ptr<ThreadPool> voxel_pool_;        // Null when voxel_map_threads is 1
+  float voxel_map_radius_m_ = 6.0f;
+  rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr voxel_map_pub_;
+  sensor_msgs::msg::PointCloud2 voxel_map_msg_;
+  rclcpp::TimerBase::SharedPtr voxel_timer_; // Evicts far blocks and publishes occupied voxels at 1 Hz
+  std::array<FiducialLocalizer, 2> fiducials_;    // Indexed by D455_ONE / D455_TWO, each tracks its own window
+  std::array<std::chrono::steady_clock::time_point, 2> fiducial_last_{}; // Previous search, for the frame rate
+  std::array<float, 2> fiducial_fps_{};
+  std::string fiducial_frame_;
+  std::atomic<bool> fiducial_wanted_{false}; // Updated by the graph watcher thread
+  rclcpp::Publisher<geometry_msgs::msg::PoseWithCovarianceStamped>::SharedPtr fiducial_pose_pub_;
+  rclcpp::Publisher<interfaces_pkg::msg::FiducialDetection>::SharedPtr fiducial_detection_pub_;
+  VisualOdometry visual_odometry_; // Only used on vo_thread_
+  Cameras vo_camera_ = Cameras::D455_ONE;
+  std::string vo_frame_;
+  std::thread vo_thread_;
+  std::mutex vo_mutex_;             // Guards the hand-off below
+  std::condition_variable vo_wake_; //
+  rs2::frameset vo_frames_;         // Newest frameset not yet taken by vo_thread_
+  rclcpp::Time vo_capture_;         // Capture time of its color frame
+  std::chrono::steady_clock::time_point vo_handoff_;
+  bool vo_pending_ = false;
+  bool vo_running_ = true;
+  uint32_t vo_dropped_ = 0;
+  std::atomic<bool> vo_wanted_{false}; // Updated by the graph watcher thread
+  rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr vo_pub_;
+  rclcpp::Publisher<interfaces_pkg::msg::VisualOdometryStats>::SharedPtr vo_stats_pub_;
+  BucketVolume bucket_volume_; // Only used on the timer thread
+  Cameras bucket_camera_ = Cameras::D455_TWO;
+  std::vector<double> bucket_roi_;
+  std::string bucket_reference_path_;
+  bool bucket_loaded_ = false;               // Loading of the saved reference was attempted
+  std::atomic<bool> bucket_calibrate_{false}; // Set by the service, taken by the timer thread
+  std::atomic<bool> bucket_wanted_{false};    // Updated by the graph watcher thread
+  rclcpp::Publisher<interfaces_pkg::msg::BucketFill>::SharedPtr bucket_pub_;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr bucket_calibrate_srv_;
+  nav_msgs::msg::OccupancyGrid elevation_msg_;
+  nav_msgs::msg::OccupancyGrid obstacle_msg_;
+  rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_sub_;
+  rclcpp::Publisher<nav_msgs::msg::OccupancyGrid>::SharedPtr elevation_map_pub_;
+  rclcpp::Publisher<nav_msgs::msg::OccupancyGrid>::SharedPtr obstacle_map_pub_;
+  rclcpp::Publisher<interfaces_pkg::msg::ElevationGrid>::SharedPtr elevation_grid_pub_; // Float heights for the traversability costmap layer
+  interfaces_pkg::msg::ElevationGrid elevation_grid_msg_;
+  rclcpp::TimerBase::SharedPtr map_timer_; // Publishes both grids at 10 Hz
+
+  // Compressed video streams (D455 color/depth and webcams), indexed by Streams
+  std::array<VideoStream, Streams::NUM_STREAMS> streams_;
 
   rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr edge_cam1_pub_;
-  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr rgb_cam1_pub_;
-  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr rgb_cam2_pub_;
 
   rclcpp::TimerBase::SharedPtr timer_; // Timer of ~15Hz, callback processes and publishes frames when and where available
 
-  std::array<bool, 4> activeCameras; // Store the active cameras used by the class
+  VideoRateController rate_controller_;     // Holds all video streams under video_bandwidth_kbps
+  rclcpp::TimerBase::SharedPtr rate_timer_; // Runs the rate controller every 500 ms
+  rclcpp::Subscription<interfaces_pkg::msg::VideoFeedback>::SharedPtr video_feedback_sub_;
+#if VISION_HAVE_X264
+  H264Encoder::Config h264_config_;         // Settings of every stream's H.264 encoder
+#endif
+
+  std::thread graph_thread_;                  // Recounts subscribers on graph changes
+  std::atomic<bool> graph_running_{true};     //
+  std::atomic<bool> depth_wanted_{false};     // Someone listens to the obstacle or depth topics
+  bool keep_depth_warm_ = true;
+  bool depth_processing_ = false;
+  std::string power_sensor_path_;
+  rclcpp::Publisher<interfaces_pkg::msg::CameraPipelineStats>::SharedPtr pipeline_stats_pub_;
+  rclcpp::TimerBase::SharedPtr pipeline_stats_timer_;
+  std::chrono::steady_clock::time_point last_stats_time_ = std::chrono::steady_clock::now();
+  double last_cpu_s_ = 0.0;
 
   // cv::cuda::Filter filt;
 
@@ -276,318 +637,1726 @@ private:
   {
     rs2::frameset frames;
 
-    // If D455 One is Active AND a frame is available
+    apply_stream_demand();
+    if (player_)
+    {
+      player_->advance();
+    }
+
+    // A D455 is only polled while the supervisor has its pipeline running
 
     /////
     // D455 Camera One
-    if (this->activeCameras[Cameras::D455_ONE])
+    if (poll_realsense(Cameras::D455_ONE, frames))
     {
-      if (pipeline_1.poll_for_frames(&frames))
-      {
-        // 1) Get raw frames
-        rs2::video_frame color_fr = frames.get_color_frame();
-        rs2::depth_frame depth_fr = frames.get_depth_frame();
+      process_realsense_frames(frames, Cameras::D455_ONE, streams_[Streams::D455_ONE_COLOR], streams_[Streams::D455_ONE_DEPTH]);
+    }
 
-        // 2) Publish color
-        if (color_fr)
-        {
-          publish_realsense_image(color_fr, d455_1_rgb_pub_);
-        }
+    /////
+    // D455 Camera two
+    if (poll_realsense(Cameras::D455_TWO, frames))
+    {
+      process_realsense_frames(frames, Cameras::D455_TWO, streams_[Streams::D455_TWO_COLOR], streams_[Streams::D455_TWO_DEPTH]);
+    }
 
-        // 3) Filter & publish depth‐detection
-        if (depth_fr && depth_fr.get_data())
-        {
-          rs2::frame f = depth_fr;
-          f = spat_.process(f);
-          f = temp_.process(f);
-          auto filtered_depth = f.as<rs2::depth_frame>();
+    // 4) Publish plugged-in Webcams that have subscribers
+    process_webcam(Cameras::WEBCAM_ONE, webcams_[0], streams_[Streams::WEBCAM_ONE_COLOR]);
+    process_webcam(Cameras::WEBCAM_TWO, webcams_[1], streams_[Streams::WEBCAM_TWO_COLOR]);
+  }
 
-          (void)obstacle_detection_callback(filtered_depth);
-        }
-      }
-      else
-      {
-        RCLCPP_WARN(this->get_logger(), "No D455 frames available.");
-      }
+  /**
+   * @brief Polls the newest frameset of a D455, from the replayed recording when there is one.
+   * @returns true if a frameset was available
+   *******************************************************/
+  bool poll_realsense(Cameras camera, rs2::frameset &frames)
+  {
+    return player_ ? player_->pollFrames(camera, frames) : supervisor_->pollFrames(camera, frames);
+  }
+
+  /**
+   * @brief Runs the stages of one D455 frameset. The frameset is always captured so the pipeline
+   *        stays warm; color is only encoded when subscribed and depth is only filtered when
+   *        the depth view, the obstacle topics or keep_depth_warm need it.
+   * @param frames Frameset polled from the camera's pipeline
+   * @param camera Camera the frameset belongs to
+   * @param color_stream Stream of the camera's color image
+   * @param depth_stream Stream of the camera's depth-assist view
+   *******************************************************/
+  void process_realsense_frames(rs2::frameset &frames, Cameras camera, VideoStream &color_stream, VideoStream &depth_stream)
+  {
+    // 1) Get raw frames
+    rs2::video_frame color_fr = frames.get_color_frame();
+    rs2::depth_frame depth_fr = frames.get_depth_frame();
+    color_stream.timing.dequeue = depth_stream.timing.dequeue = this->now();
+    color_stream.timing.dequeued = depth_stream.timing.dequeued = std::chrono::steady_clock::now();
+    if (recorder_.isOpen())
+    {
+      record_realsense_frames(frames, camera, color_stream.id, depth_stream.id);
     }
 
-    /////
-    // D455 Camera two
-    if (this->activeCameras[Cameras::D455_TWO])
+    // 2) Publish color
+    if (color_fr && color_stream.enabled)
+    {
+      auto start = std::chrono::steady_clock::now();
+      publish_realsense_image(color_fr, color_stream);
+      record_stage_time(color_stream, start);
+    }
+    if (color_fr && fiducial_wanted_)
     {
-      if (pipeline_2.poll_for_frames(&frames))
+      locate_fiducials(camera, color_fr, depth_fr);
+    }
+    if (camera == vo_camera_ && color_fr && depth_fr && vo_wanted_)
+    {
+      // The stream's clock offset is only used on this thread, so the capture time goes with the frames
+      const rclcpp::Time capture = realsense_capture_time(color_fr, color_stream.device_clock, color_stream.timing.clock);
       {
-        rs2::video_frame color_fr = frames.get_color_frame();
-        rs2::depth_frame depth_fr = frames.get_depth_frame();
+        std::lock_guard<std::mutex> lock(vo_mutex_);
+        vo_dropped_ += vo_pending_ ? 1 : 0;
+        vo_frames_ = frames; // Reference counted, nothing is copied
+        vo_capture_ = capture;
+        vo_handoff_ = std::chrono::steady_clock::now();
+        vo_pending_ = true;
+      }
+      vo_wake_.notify_one();
+    }
 
-        // 2.) Publish Color
-        if (color_fr)
-        {
-          publish_realsense_image(color_fr, d455_2_rgb_pub_);
-        }
+    // 3) Filter & publish depth‐detection
+    const bool cloud_wanted = cloud_wanted_[camera];
+    const bool bucket_wanted = camera == bucket_camera_ && (bucket_wanted_ || bucket_calibrate_ || bucket_volume_.calibrating());
+    if (depth_fr && depth_fr.get_data() && (depth_processing_ || depth_stream.enabled || cloud_wanted || bucket_wanted))
+    {
+      auto start = std::chrono::steady_clock::now();
+      rs2::frame f = depth_fr;
+      f = spat_.process(f);
+      f = temp_.process(f);
+      auto filtered_depth = f.as<rs2::depth_frame>();
 
-        // 3.) Filter and Publish Depth->Detection
-        if (depth_fr && depth_fr.get_data())
-        {
-          rs2::frame f = depth_fr;
-          f = spat_.process(f);
-          f = temp_.process(f);
-          auto filtered_depth = f.as<rs2::depth_frame>();
-          (void)obstacle_detection_callback(filtered_depth);
-        }
+      if (depth_stream.enabled)
+      {
+        publish_depth_view(filtered_depth, depth_stream);
+        record_stage_time(depth_stream, start);
       }
-      else
+      if (cloud_wanted)
+      {
+        publish_point_cloud(camera, filtered_depth, realsense_capture_time(depth_fr, depth_stream.device_clock, depth_stream.timing.clock));
+      }
+      if (bucket_wanted)
+      {
+        measure_bucket(filtered_depth);
+      }
+      if (depth_processing_)
       {
-        RCLCPP_WARN(this->get_logger(), "No D455 frames available.");
+        depth_stats_.build(static_cast<const uint16_t *>(filtered_depth.get_data()), filtered_depth.get_width(),
+                           filtered_depth.get_height(), filtered_depth.get_stride_in_bytes(), filtered_depth.get_units());
+        publish_depth_grid(camera, filtered_depth);
+        obstacle_detection_callback(camera, filtered_depth);
       }
     }
+  }
+
+  /**
+   * @brief Opens or closes a webcam to follow its stream's demand and the device the supervisor
+   *        found for it, and publishes a frame while open. The webcam is reopened whenever the
+   *        supervisor reports it replugged, renumbered or stalled.
+   * @param camera Supervisor slot of the webcam
+   * @param webcam Webcam to process
+   * @param stream Stream of the webcam
+   *******************************************************/
+  void process_webcam(Cameras camera, Webcam &webcam, VideoStream &stream)
+  {
+    if (player_)
+    {
+      replay_webcam(webcam, stream);
+      return;
+    }
+
+    std::string path;
+    uint64_t generation = 0;
+    const bool present = supervisor_->devicePath(camera, path, generation);
+    if (webcam.running && (!present || generation != webcam.generation))
+    {
+      RCLCPP_INFO(this->get_logger(), "Closing %s, the device went away", webcam.path.c_str());
+      close_webcam(webcam);
+    }
 
-    // 4) Always publish available Webcams
-    if (this->activeCameras[Cameras::WEBCAM_ONE])
+    const auto now = std::chrono::steady_clock::now();
+    if (stream.enabled && !webcam.running && present && now >= webcam.retry_at)
+    {
+      webcam.path = path;
+      webcam.generation = generation;
+      RCLCPP_INFO(this->get_logger(), "Starting capture of %s", webcam.path.c_str());
+      if (!open_webcam(webcam))
+      {
+        webcam.retry_at = now + 1s;
+      }
+    }
+    else if (!stream.enabled && webcam.running)
+    {
+      RCLCPP_INFO(this->get_logger(), "Stopping capture of %s, no subscribers", webcam.path.c_str());
+      close_webcam(webcam);
+    }
+    supervisor_->setIdle(camera, !webcam.running);
+    if (!webcam.running)
     {
-      publish_rgb_camera(cap_rgb1_, rgb_cam1_pub_);
+      return;
     }
-    if (this->activeCameras[Cameras::WEBCAM_TWO])
+
+    auto start = std::chrono::steady_clock::now();
+    const bool captured = webcam.mjpeg ? publish_mjpeg_camera(*webcam.mjpeg, stream) : publish_rgb_camera(webcam.cap, stream);
+    if (captured)
     {
-      publish_rgb_camera(cap_rgb2_, rgb_cam2_pub_);
+      supervisor_->frameArrived(camera);
     }
+    record_stage_time(stream, start);
   }
 
   /**
-   * @brief Publishes a realsense frame to the passed publisher.
-   * @param color_frame rs2::frame passed by reference. The color_frame to be sent.
-   * @param pub a rclcpp::publisher to a Compressed Image.
+   * @brief Publishes a webcam from the replayed recording while its stream has subscribers.
+   *        Webcams that were not recorded stay silent.
+   * @param webcam Webcam to process
+   * @param stream Stream of the webcam
    *******************************************************/
-  void publish_realsense_image(rs2::frame &color_frame, rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr pub)
+  void replay_webcam(Webcam &webcam, VideoStream &stream)
   {
-    std::vector<uchar> buffer;
-    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, 40}; // Lower quality for faster encoding
-    sensor_msgs::msg::CompressedImage msg;
-    msg.header.stamp = this->now();
-    msg.header.frame_id = "camera_rgb_optical_frame";
-    msg.format = "jpeg";
-
-    cv::Mat frame(cv::Size(color_frame.as<rs2::video_frame>().get_width(),
-                           color_frame.as<rs2::video_frame>().get_height()),
-                  CV_8UC3,
-                  (void *)color_frame.get_data(),
-                  cv::Mat::AUTO_STEP);
-    if (!cv::imencode(".jpg", frame, buffer, params))
+    if (stream.enabled && !webcam.running)
     {
-      RCLCPP_ERROR(this->get_logger(), "Failed to encode RealSense image to JPEG.");
-      return;
+      webcam.mjpeg = player_->mjpegSource(stream.id);
+      webcam.running = webcam.mjpeg != nullptr;
+    }
+    else if (!stream.enabled && webcam.running)
+    {
+      close_webcam(webcam);
+    }
+    if (webcam.running)
+    {
+      auto start = std::chrono::steady_clock::now();
+      publish_mjpeg_camera(*webcam.mjpeg, stream);
+      record_stage_time(stream, start);
     }
-    msg.data = buffer;
-    pub->publish(msg);
   }
 
   /**
-   * @brief Takes a cv::VideoCapture by reference and reads a frame. Frame is encoded and sent along message topic.
-   * @param cap cv::VideoCapture reference object.
-   * @param pub sensor_msgs::msg::CompressedImage.
-   */
-  void publish_rgb_camera(cv::VideoCapture &cap, rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr pub)
+   * @brief Opens record_path and starts recording the raw camera streams. Streams are
+   *        described in the file as their first frame arrives.
+   * @returns false if the file cannot be created, see recorder_.lastError()
+   *******************************************************/
+  bool start_recording()
   {
-    cv::Mat frame;
-    if (!cap.read(frame))
+    if (!recorder_.open(record_path_))
     {
-      RCLCPP_WARN(this->get_logger(), "Failed to capture frame from USB RGB camera.");
-      return;
+      return false;
     }
+    RCLCPP_INFO(this->get_logger(), "Recording the cameras to %s", record_path_.c_str());
+    return true;
+  }
 
-    // Publish original image
-    std::vector<uchar> buffer;
-    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, 40};
-    sensor_msgs::msg::CompressedImage msg;
-    msg.header.stamp = this->now();
-    msg.header.frame_id = "rgb_camera_frame";
-    msg.format = "jpeg";
-
-    if (!cv::imencode(".jpg", frame, buffer, params))
+  /**
+   * @brief Service starting or stopping the recording. Stopping waits for the queued frames
+   *        to reach the disk.
+   *******************************************************/
+  void record_callback(const std::shared_ptr<std_srvs::srv::SetBool::Request> request,
+                       std::shared_ptr<std_srvs::srv::SetBool::Response> response)
+  {
+    if (request->data == recorder_.isOpen())
     {
-      RCLCPP_ERROR(this->get_logger(), "Failed to encode USB RGB image to JPEG.");
+      response->success = true;
+      response->message = recorder_.isOpen() ? "Already recording to " + record_path_ : "Not recording";
       return;
     }
-    msg.data = buffer;
-    pub->publish(msg);
-
-    /**
-    cv::Mat gray, edges, edges_bgr;
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-
-    // Improve contrast first
-    cv::equalizeHist(gray, gray);
-
-    // Adjust thresholds here if needed
-    cv::Canny(gray, edges, 50, 150);
-
-    // Colorize edges as red
-    edges_bgr = cv::Mat::zeros(frame.size(), CV_8UC3);
-    edges_bgr.setTo(cv::Scalar(0, 0, 255), edges);  // Red where edges exist
-
-    // Encode edge image
-
-    std::vector<uchar> edge_buffer;
-    sensor_msgs::msg::CompressedImage edge_msg;
-    edge_msg.header.stamp = this->now();
-    edge_msg.header.frame_id = "rgb_camera_frame_edge";
-    edge_msg.format = "jpeg";
-
-    if (!cv::imencode(".jpg", edges_bgr, edge_buffer, params)) {
-      RCLCPP_ERROR(this->get_logger(), "Failed to encode Canny edge image.");
+    if (request->data)
+    {
+      response->success = start_recording();
+      response->message = response->success ? "Recording to " + record_path_ : recorder_.lastError();
       return;
     }
 
-    edge_msg.data = edge_buffer;
-    if (edge_cam1_pub_) {
-      edge_cam1_pub_->publish(edge_msg);
-      RCLCPP_INFO(this->get_logger(), "Published Canny edge image.");
-    }
-   */
+    recorder_.close();
+    const std::string error = recorder_.lastError();
+    response->success = error.empty();
+    response->message = "Recorded " + std::to_string(recorder_.written()) + " frames (" +
+                        std::to_string(recorder_.bytes() >> 20) + " MiB) to " + record_path_ + ", " +
+                        std::to_string(recorder_.dropped()) + " dropped" + (error.empty() ? "" : ": " + error);
+    RCLCPP_INFO(this->get_logger(), "%s", response->message.c_str());
   }
 
   /**
-   * Function: average_depth
-   * @brief Get the average depth pixel value across a rectangular region in the depth camera. Does not provide bounds checking.
-   *
-   * @param depth The depth frame passed by reference to the function call
-   * @param x_bounds The lower and the upper bounds in the x-direction
-   * @param y_bounds The lower and the upper bounds in the y-direction
-   * @param increment The value to increment by between pixels
-   * @returns double The average depth value across a region
-   **********************************************************************/
-  double average_depth(const rs2::depth_frame &depth, std::pair<int, int> x_bounds, std::pair<int, int> y_bounds, int increment = 1)
+   * @brief Writes the raw color and depth of a D455 frameset, and its motion samples if the
+   *        camera streams any, to the recording.
+   * @param frames Frameset polled from the camera
+   * @param camera Camera the frameset belongs to
+   * @param color_id Recording stream of the color frames
+   * @param depth_id Recording stream of the depth frames
+   *******************************************************/
+  void record_realsense_frames(const rs2::frameset &frames, Cameras camera, Streams color_id, Streams depth_id)
   {
-    int numberPixels = (x_bounds.second - x_bounds.first) * (y_bounds.second - y_bounds.first) / (increment * increment);
-    double average_depth = 0.0;
+    const int64_t host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    rs2::video_frame color = frames.get_color_frame();
+    rs2::depth_frame depth = frames.get_depth_frame();
+    if (color && color.get_profile().format() == RS2_FORMAT_BGR8)
+    {
+      if (!recorder_.described(color_id))
+      {
+        describe_recorded_stream(color_id, camera, RecordKind::COLOR_BGR8, color, color);
+      }
+      record_video_frame(color_id, color, host_ns);
+    }
+    if (depth)
+    {
+      if (!recorder_.described(depth_id))
+      {
+        describe_recorded_stream(depth_id, camera, RecordKind::DEPTH_Z16, depth, color);
+      }
+      record_video_frame(depth_id, depth, host_ns);
+    }
 
-    for (int i = x_bounds.first; i <= x_bounds.second; i += increment)
+    // Motion frames only show up when the IMU streams are enabled in the pipeline
+    const uint16_t motion_id = Streams::NUM_STREAMS + camera;
+    for (std::size_t i = 0; i < frames.size(); i++)
     {
-      for (int j = y_bounds.first; j <= y_bounds.second; j += increment)
+      const rs2::motion_frame motion = frames[i].as<rs2::motion_frame>();
+      if (!motion)
+      {
+        continue;
+      }
+      if (!recorder_.described(motion_id))
       {
-        average_depth += depth.get_distance(i, j);
+        RecordingStream description;
+        std::snprintf(description.name, sizeof(description.name), "rs_node/camera%d/imu", camera + 1);
+        description.kind = RecordKind::MOTION;
+        description.camera = static_cast<uint8_t>(camera);
+        recorder_.describe(motion_id, description);
       }
+      const rs2_vector data = motion.get_motion_data();
+      const MotionSample sample{data.x, data.y, data.z,
+                                motion.get_profile().stream_type() == RS2_STREAM_GYRO ? MotionSample::GYRO : MotionSample::ACCEL};
+      recorder_.write(motion_id, motion.get_frame_number(), static_cast<int64_t>(motion.get_timestamp() * 1e6), host_ns,
+                      &sample, sizeof(sample));
     }
-    return average_depth / numberPixels;
   }
 
   /**
-   * TODO: If possible, try to modularize the obstacle detection callback function.
-   *  TODO: Aim to have the function length extend no further than 60 lines of code.
-   */
-  /**
-   * @brief Obstacle detection callback function. Detects obstacles in the depth frame and publishes the results.
-   * @param depth_frame The depth frame passed by reference to the function call
-   * @param pub_left The publisher for the left side obstacle detection
-   * @param pub_right The publisher for the right side obstacle detection
-   * @param pub_depth The publisher for the average depth value
-   * @returns None
-   */
-  void obstacle_detection_callback(const rs2::frame &depth_frame)
+   * @brief Stores the size, intrinsics and, for depth, the units and the extrinsics to color of
+   *        a D455 stream in the recording.
+   * @param color Color frame of the same frameset, may be empty. Only used for depth.
+   *******************************************************/
+  void describe_recorded_stream(Streams id, Cameras camera, RecordKind kind, const rs2::video_frame &frame, const rs2::video_frame &color)
   {
-    const int GROUND_DEPTH_MM = 700;
-    const int POS_THRESHOLD = 250;
-    const int NEG_THRESHOLD = 800;
-    const int OBSTACLE_THRESHOLD = 200;
-
-    const rs2::depth_frame depth = depth_frame.as<rs2::depth_frame>();
-    const int width = depth.get_width();
-    const int height = depth.get_height(); // 848 x 480
-
-    int pos_count = 0;
-    int neg_count = 0;
-    int left_count = 0;
-    int right_count = 0;
-
-    float average_depth = 0.0;
-    for (int y = 228; y <= 252; y += 4)
+    RecordingStream description;
+    std::strncpy(description.name, streams_[id].name.c_str(), sizeof(description.name) - 1);
+    description.kind = kind;
+    description.camera = static_cast<uint8_t>(camera);
+    description.width = frame.get_width();
+    description.height = frame.get_height();
+    const auto profile = frame.get_profile().as<rs2::video_stream_profile>();
+    const rs2_intrinsics intrinsics = profile.get_intrinsics();
+    description.fps = static_cast<float>(profile.fps());
+    description.intrinsics = {intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy};
+    if (kind == RecordKind::DEPTH_Z16)
     {
-      for (int x = 412; x <= 436; x += 4)
+      description.depth_units = frame.as<rs2::depth_frame>().get_units();
+      if (color)
       {
-        float dist_m = depth.get_distance(x, y);
-        average_depth += dist_m;
+        const rs2_extrinsics extrinsics = profile.get_extrinsics_to(color.get_profile());
+        std::copy(extrinsics.rotation, extrinsics.rotation + 9, description.to_color);
+        std::copy(extrinsics.translation, extrinsics.translation + 3, description.to_color + 9);
       }
     }
-    // double val = average_depth(depth_frame, {228, 252}, {412, 436}, 4);
+    recorder_.describe(id, description);
+  }
 
-    average_depth = average_depth / 49; // average of 49 pixels
-    std_msgs::msg::Float32 depth_msg;
+  /**
+   * @brief Queues a raw D455 image for the recording, rows and padding as the camera gave them.
+   *******************************************************/
+  void record_video_frame(Streams id, const rs2::video_frame &frame, int64_t host_ns)
+  {
+    const int stride = frame.get_stride_in_bytes();
+    recorder_.write(id, frame.get_frame_number(), static_cast<int64_t>(frame.get_timestamp() * 1e6), host_ns, frame.get_data(),
+                    static_cast<std::size_t>(stride) * frame.get_height(), frame.get_width(), frame.get_height(), stride);
+  }
 
-    depth_msg.data = average_depth;
-    // depth_msg.data = average_depth(depth, {235,245}, {420, 428}, 1);
+  /**
+   * @brief Queues a compressed webcam frame for the recording, as it came from the camera.
+   *******************************************************/
+  void record_mjpeg_frame(const MjpegSource &source, const MjpegFrame &frame, VideoStream &stream)
+  {
+    if (!recorder_.described(stream.id))
+    {
+      RecordingStream description;
+      std::strncpy(description.name, stream.name.c_str(), sizeof(description.name) - 1);
+      description.kind = RecordKind::MJPEG;
+      description.camera = static_cast<uint8_t>(stream.id == Streams::WEBCAM_ONE_COLOR ? Cameras::WEBCAM_ONE : Cameras::WEBCAM_TWO);
+      description.width = source.width();
+      description.height = source.height();
+      description.fps = WEBCAM_FPS;
+      recorder_.describe(stream.id, description);
+    }
+    const int64_t host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    recorder_.write(stream.id, frame.sequence, frame.timestamp.count(), host_ns, frame.data, frame.size, source.width(), source.height());
+  }
 
-    depth_detection_pub_->publish(depth_msg);
+  /**
+   * @brief Updates the smoothed per-frame processing time of a stream.
+   *******************************************************/
+  void record_stage_time(VideoStream &stream, std::chrono::steady_clock::time_point start)
+  {
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stream.stage_ms = (stream.stage_ms == 0.0) ? ms : 0.9 * stream.stage_ms + 0.1 * ms;
+  }
 
-    for (int y = height / 2; y < height; y += 5)
+  /**
+   * @brief Graph watcher thread. Blocks on the node's graph event and recounts subscribers
+   *        whenever a participant, publisher or subscription appears or disappears.
+   *******************************************************/
+  void watch_graph()
+  {
+    auto event = this->get_graph_event();
+    while (graph_running_ && rclcpp::ok())
     {
-      for (int x = 0; x < width / 2; x += 5)
+      try
       {
-        float dist_m = depth.get_distance(x, y);
-        if (dist_m <= 0.0f)
-          continue;
-
-        int depth_mm = static_cast<int>(dist_m * 1000);
-        int delta = GROUND_DEPTH_MM - depth_mm;
-
-        if (delta > POS_THRESHOLD)
-        {
-          pos_count++;
-          right_count++;
-        }
-        else if (-delta > NEG_THRESHOLD)
-        {
-          neg_count++;
-          right_count++;
-        }
+        this->wait_for_graph_change(event, 500ms);
+      }
+      catch (const rclcpp::exceptions::RCLError &)
+      {
+        break; // Context shut down
       }
-    } // right side detection
+      if (event->check_and_clear())
+      {
+        count_subscribers();
+      }
+    }
+  }
 
-    for (int y = height / 2; y < height; y += 5)
+  /**
+   * @brief Counts the subscribers of every stream and of the depth topics.
+   *******************************************************/
+  void count_subscribers()
+  {
+    for (auto &stream : streams_)
     {
-      for (int x = width / 2; x < width; x += 5)
+      if (stream.pub)
       {
-        float dist_m = depth.get_distance(x, y);
-        if (dist_m <= 0.0f)
-          continue;
+        stream.subscribers = static_cast<uint32_t>(stream.pub->get_subscription_count());
+#if VISION_HAVE_X264
+        stream.h264_subscribers = static_cast<uint32_t>(stream.h264_pub->get_subscription_count());
+#endif
+      }
+    }
+    bool depth_wanted = elevation_map_pub_->get_subscription_count() > 0 ||
+                        elevation_grid_pub_->get_subscription_count() > 0 ||
+                        obstacle_map_pub_->get_subscription_count() > 0 ||
+                        voxel_map_pub_->get_subscription_count() > 0 ||
+                        depth_detection_pub_->get_subscription_count() > 0;
+    for (const auto &pub : depth_grid_pubs_)
+    {
+      depth_wanted = depth_wanted || (pub && pub->get_subscription_count() > 0);
+    }
+    for (const auto &pub : ground_plane_pubs_)
+    {
+      depth_wanted = depth_wanted || (pub && pub->get_subscription_count() > 0);
+    }
+    depth_wanted_ = depth_wanted;
+    fiducial_wanted_ = fiducial_pose_pub_->get_subscription_count() > 0 ||
+                       fiducial_detection_pub_->get_subscription_count() > 0;
+    vo_wanted_ = vo_pub_->get_subscription_count() > 0 || vo_stats_pub_->get_subscription_count() > 0;
+    bucket_wanted_ = bucket_pub_->get_subscription_count() > 0;
+    for (std::size_t i = 0; i < cloud_pubs_.size(); i++)
+    {
+      cloud_wanted_[i] = cloud_pubs_[i] && cloud_pubs_[i]->get_subscription_count() > 0;
+    }
+  }
+
+  /**
+   * @brief Applies the subscriber counts gathered by the graph watcher on the timer thread,
+   *        so stages never change state in the middle of a frame.
+   *******************************************************/
+  void apply_stream_demand()
+  {
+    for (auto &stream : streams_)
+    {
+      if (!stream.pub)
+      {
+        continue;
+      }
+      stream.jpeg_enabled = stream.subscribers > 0;
+      const uint32_t viewers = stream.h264_subscribers;
+#if VISION_HAVE_X264
+      if (viewers > stream.h264_viewers && stream.h264)
+      {
+        stream.h264->requestKeyframe(); // A new viewer can start decoding right away
+      }
+#endif
+      stream.h264_viewers = viewers;
+      if ((viewers > 0) != stream.h264_enabled)
+      {
+        RCLCPP_INFO(this->get_logger(), "%s/h264 %s", stream.name.c_str(), viewers > 0 ? "has subscribers, enabled" : "has no subscribers, idle");
+        stream.h264_enabled = viewers > 0;
+      }
+      const bool wanted = stream.jpeg_enabled || stream.h264_enabled;
+      if (wanted != stream.enabled)
+      {
+        RCLCPP_INFO(this->get_logger(), "%s %s", stream.name.c_str(), wanted ? "has subscribers, enabled" : "has no subscribers, idle");
+        stream.enabled = wanted;
+        stream.next_frame = std::chrono::steady_clock::now();
+        rate_controller_.setActive(stream.id, wanted);
+      }
+    }
+
+    const bool depth = keep_depth_warm_ || depth_wanted_;
+    if (depth != depth_processing_)
+    {
+      RCLCPP_INFO(this->get_logger(), "Depth processing %s", depth ? "enabled" : "idle");
+      depth_processing_ = depth;
+    }
+  }
+
+  /**
+   * @brief Publishes which streams are running, the CPU used by the node and the CPU time
+   *        saved by idle streams, estimated from each stream's last measured stage time.
+   *        The connection state of every camera goes out alongside.
+   *******************************************************/
+  void pipeline_stats_callback()
+  {
+    interfaces_pkg::msg::CameraPipelineStats msg;
+    msg.header.stamp = this->now();
+
+    double saved_ms = 0.0;
+    for (const auto &stream : streams_)
+    {
+      if (!stream.pub)
+      {
+        continue;
+      }
+      msg.streams.push_back(stream.name);
+      msg.enabled.push_back(stream.enabled);
+      msg.subscribers.push_back(stream.subscribers + stream.h264_subscribers);
+      if (!stream.enabled)
+      {
+        saved_ms += stream.stage_ms * rate_controller_.settings(stream.id).fps;
+      }
+    }
+    msg.depth_processing = depth_processing_;
+    msg.saved_cpu_ms_per_s = saved_ms;
+    publish_latency(msg.header.stamp);
+
+    // Process CPU time over wall time since the previous report
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    const double cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+                         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+    const auto now = std::chrono::steady_clock::now();
+    const double wall_s = std::chrono::duration<double>(now - last_stats_time_).count();
+    msg.cpu_percent = wall_s > 0.0 ? 100.0 * (cpu_s - last_cpu_s_) / wall_s : 0.0;
+    last_cpu_s_ = cpu_s;
+    last_stats_time_ = now;
+
+    msg.power_mw = -1.0f;
+    if (!power_sensor_path_.empty())
+    {
+      std::ifstream sensor(power_sensor_path_);
+      double power = 0.0;
+      if (sensor >> power)
+      {
+        msg.power_mw = power;
+      }
+    }
+    pipeline_stats_pub_->publish(msg);
+
+    interfaces_pkg::msg::CameraHealth health_msg;
+    health_msg.header.stamp = msg.header.stamp;
+    for (const CameraHealth &health : supervisor_->health())
+    {
+      health_msg.cameras.push_back(health.name);
+      health_msg.devices.push_back(health.device);
+      health_msg.present.push_back(health.present);
+      health_msg.streaming.push_back(health.streaming);
+      health_msg.idle.push_back(health.idle);
+      health_msg.drops.push_back(health.drops);
+      health_msg.down_s.push_back(health.down_s);
+      health_msg.last_recovery_s.push_back(health.last_recovery_s);
+      health_msg.max_recovery_s.push_back(health.max_recovery_s);
+      health_msg.last_bringup_s.push_back(health.last_bringup_s);
+    }
+    camera_health_pub_->publish(health_msg);
+  }
+
+  /**
+   * @brief Publishes the latency histograms of every stream that sent frames since the last
+   *        report, then starts new ones.
+   * @param stamp Time of the report
+   *******************************************************/
+  void publish_latency(const rclcpp::Time &stamp)
+  {
+    const auto &edges = LatencyHistogram::upperEdgesMs();
+    for (auto &stream : streams_)
+    {
+      if (!stream.latency_pub || stream.latency[CAPTURE_TO_PUBLISH].count() == 0)
+      {
+        continue;
+      }
+      interfaces_pkg::msg::StreamLatency msg;
+      msg.header.stamp = stamp;
+      msg.stream = stream.name;
+      msg.clock = stream.timing.clock;
+      msg.frames = stream.latency[CAPTURE_TO_PUBLISH].count();
+      msg.bucket_upper_ms.assign(edges.begin(), edges.end());
+      msg.capture_to_dequeue.assign(stream.latency[CAPTURE_TO_DEQUEUE].buckets().begin(), stream.latency[CAPTURE_TO_DEQUEUE].buckets().end());
+      msg.dequeue_to_encode.assign(stream.latency[DEQUEUE_TO_ENCODE].buckets().begin(), stream.latency[DEQUEUE_TO_ENCODE].buckets().end());
+      msg.encode_to_publish.assign(stream.latency[ENCODE_TO_PUBLISH].buckets().begin(), stream.latency[ENCODE_TO_PUBLISH].buckets().end());
+      msg.capture_to_publish.assign(stream.latency[CAPTURE_TO_PUBLISH].buckets().begin(), stream.latency[CAPTURE_TO_PUBLISH].buckets().end());
+      for (auto &histogram : stream.latency)
+      {
+        msg.p50_ms.push_back(histogram.percentileMs(0.5));
+        msg.p95_ms.push_back(histogram.percentileMs(0.95));
+        msg.max_ms.push_back(histogram.maxMs());
+        histogram.clear();
+      }
+      stream.latency_pub->publish(msg);
+    }
+  }
+
+  /**
+   * @brief Creates the publishers, encoder and reusable message of a video stream.
+   * @param id Index of the stream in streams_
+   * @param topic Topic the JPEG frames are published on. H.264 goes to <topic>/h264, statistics
+   *              of both to <topic>/stats and latency histograms to <topic>/latency.
+   * @param frame_id frame_id written into every message header
+   * @param subsampling Chroma subsampling used by the stream's encoder
+   *******************************************************/
+  void create_stream(Streams id, const std::string &topic, const std::string &frame_id, JpegEncoder::Subsampling subsampling)
+  {
+    VideoStream &stream = streams_[id];
+    stream.id = id;
+    stream.name = topic;
+    stream.pub = this->create_publisher<sensor_msgs::msg::CompressedImage>(topic, 1);
+    stream.stats_pub = this->create_publisher<interfaces_pkg::msg::StreamStats>(topic + "/stats", 5);
+    stream.latency_pub = this->create_publisher<interfaces_pkg::msg::StreamLatency>(topic + "/latency", 5);
+    stream.encoder = std::make_unique<JpegEncoder>(JPEG_QUALITY, subsampling);
+    stream.msg.header.frame_id = frame_id;
+    stream.msg.format = "jpeg";
+    stream.stats.stream = topic;
+    stream.stats.format = "jpeg";
+#if VISION_HAVE_X264
+    stream.h264_pub = this->create_publisher<interfaces_pkg::msg::EncodedVideo>(topic + "/h264", 5);
+    stream.h264_msg.header.frame_id = frame_id;
+    stream.h264_msg.format = "h264";
+    stream.h264_stats.stream = topic;
+    stream.h264_stats.format = "h264";
+#endif
+    stream.next_frame = std::chrono::steady_clock::now();
+    rate_controller_.setName(id, topic);
+    rate_controller_.setActive(id, false); // Activated once the topic has subscribers
+  }
+
+  /**
+   * @brief Decides whether a stream publishes on this tick, following the frame rate chosen
+   *        by the rate controller.
+   * @param stream Stream to check
+   * @returns true if a frame should be published now
+   *******************************************************/
+  bool frame_due(VideoStream &stream)
+  {
+    if (!stream.pub)
+    {
+      return false;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now + 5ms < stream.next_frame) // Tolerate timer jitter
+    {
+      return false;
+    }
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate_controller_.settings(stream.id).fps));
+    stream.next_frame += period;
+    if (stream.next_frame < now)
+    {
+      stream.next_frame = now + period;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Runs one step of the video rate controller and applies the new quality to the JPEG
+   *        encoders and the stream's allocation to the H.264 bitrate.
+   *******************************************************/
+  void rate_control_callback()
+  {
+    rate_controller_.update(0.5);
+    for (auto &stream : streams_)
+    {
+      if (stream.encoder)
+      {
+        stream.encoder->setQuality(rate_controller_.settings(stream.id).quality);
+      }
+#if VISION_HAVE_X264
+      if (stream.h264)
+      {
+        const int allocation_kbps = static_cast<int>(rate_controller_.stream(stream.id).allocation * 8.0 / 1000.0);
+        stream.h264->setBitrate(allocation_kbps > 0 ? std::clamp(allocation_kbps, H264_MIN_KBPS, h264_config_.bitrate_kbps)
+                                                    : h264_config_.bitrate_kbps);
+      }
+#endif
+    }
+  }
+
+  /**
+   * @brief Feedback from the pilot UI: which stream is being viewed and how far behind it is.
+   * @param msg Feedback message
+   *******************************************************/
+  void video_feedback_callback(const interfaces_pkg::msg::VideoFeedback::SharedPtr msg)
+  {
+    rate_controller_.setPriorityStream(msg->stream);
+    const double backlog = (this->now() - rclcpp::Time(msg->last_frame.stamp)).seconds();
+    rate_controller_.onBacklog(std::max(0.0, backlog));
+  }
+
+  /**
+   * @brief Publishes raw pixels on a stream at the resolution chosen by the rate controller,
+   *        as JPEG and as H.264 depending on which of the two has subscribers.
+   * @param stream Stream to publish on, must have been created with create_stream
+   * @param pixels Pointer to the first pixel
+   * @param width Width in pixels
+   * @param height Height in pixels
+   * @param pitch Bytes per row
+   * @param format Pixel layout of the input
+   * @returns true if the frame was published
+   *******************************************************/
+  bool publish_video(VideoStream &stream, const uint8_t *pixels, int width, int height, int pitch, JpegEncoder::PixelFormat format)
+  {
+    const int scale = rate_controller_.settings(stream.id).scale;
+    if (scale > 1)
+    {
+      const int type = (format == JpegEncoder::PixelFormat::GRAY) ? CV_8UC1 : CV_8UC3;
+      cv::Mat src(height, width, type, const_cast<uint8_t *>(pixels), pitch);
+      cv::resize(src, stream.scaled, cv::Size(width / scale, height / scale), 0, 0, cv::INTER_AREA);
+      pixels = stream.scaled.data;
+      width = stream.scaled.cols;
+      height = stream.scaled.rows;
+      pitch = static_cast<int>(stream.scaled.step);
+    }
+    bool published = false;
+    if (stream.jpeg_enabled)
+    {
+      published |= encode_jpeg(stream, pixels, width, height, pitch, format);
+    }
+#if VISION_HAVE_X264
+    if (stream.h264_enabled)
+    {
+      published |= encode_h264(stream, pixels, width, height, pitch, format);
+    }
+#endif
+    return published;
+  }
+
+  /**
+   * @brief Encodes pixels straight into the stream's preallocated message and publishes it,
+   *        followed by the encode time and size of the frame on the stats topic.
+   * @param stream Stream to publish on, must have been created with create_stream
+   * @param pixels Pointer to the first pixel
+   * @param width Width in pixels
+   * @param height Height in pixels
+   * @param pitch Bytes per row
+   * @param format Pixel layout of the input
+   * @returns true if the frame was published
+   *******************************************************/
+  bool encode_jpeg(VideoStream &stream, const uint8_t *pixels, int width, int height, int pitch, JpegEncoder::PixelFormat format)
+  {
+    // CompressedImage is unbounded and cannot be loaned, the message is reused instead
+    if (!stream.encoder->encode(pixels, width, height, pitch, format, stream.msg.data))
+    {
+      RCLCPP_ERROR(this->get_logger(), "Failed to encode %s to JPEG: %s", stream.name.c_str(), stream.encoder->lastError().c_str());
+      return false;
+    }
+    publish_frame(stream, width, height, stream.encoder->quality(), stream.encoder->lastEncodeMs());
+    return true;
+  }
+
+#if VISION_HAVE_X264
+  /**
+   * @brief Encodes pixels to H.264 and publishes the access unit on <topic>/h264, followed by its
+   *        statistics. The encoder is created on the first frame.
+   * @param stream Stream to publish on, must have been created with create_stream
+   * @param pixels Pointer to the first pixel
+   * @param width Width in pixels
+   * @param height Height in pixels
+   * @param pitch Bytes per row
+   * @param format Pixel layout of the input
+   * @returns true if the frame was published
+   *******************************************************/
+  bool encode_h264(VideoStream &stream, const uint8_t *pixels, int width, int height, int pitch, JpegEncoder::PixelFormat format)
+  {
+    if (!stream.h264)
+    {
+      stream.h264 = std::make_unique<H264Encoder>(h264_config_);
+    }
+    bool keyframe = false;
+    if (!stream.h264->encode(pixels, width, height, pitch, format, stream.h264_msg.data, keyframe))
+    {
+      RCLCPP_ERROR(this->get_logger(), "Failed to encode %s to H.264: %s", stream.name.c_str(), stream.h264->lastError().c_str());
+      return false;
+    }
+    const auto encoded = std::chrono::steady_clock::now();
+    stream.h264_msg.header.stamp = stream.timing.capture;
+    stream.h264_msg.codec = stream.h264->codec();
+    stream.h264_msg.width = stream.h264->width();
+    stream.h264_msg.height = stream.h264->height();
+    stream.h264_msg.keyframe = keyframe;
+    stream.h264_msg.sequence++;
+    stream.h264_pub->publish(stream.h264_msg);
+    report_frame(stream, stream.h264_stats, encoded, stream.h264_msg.data.size(), stream.h264->width(), stream.h264->height(), 0,
+                 stream.h264->lastEncodeMs());
+    return true;
+  }
+#endif
+
+  /**
+   * @brief Publishes the JPEG already held in stream.msg.data, stamped with the capture time in
+   *        stream.timing, and its statistics.
+   * @param stream Stream to publish on
+   * @param width Width of the image in pixels
+   * @param height Height of the image in pixels
+   * @param quality JPEG quality of the image, 0 if unknown
+   * @param encode_ms Time spent encoding the image
+   *******************************************************/
+  void publish_frame(VideoStream &stream, int width, int height, int quality, double encode_ms)
+  {
+    const auto encoded = std::chrono::steady_clock::now();
+    stream.msg.header.stamp = stream.timing.capture;
+    stream.pub->publish(stream.msg);
+    report_frame(stream, stream.stats, encoded, stream.msg.data.size(), width, height, quality, encode_ms);
+  }
+
+  /**
+   * @brief Accounts for a frame that was just published: the time spent in every stage goes to
+   *        the stream's latency histograms, its size to the rate controller, and both to stats.
+   * @param stream Stream the frame was published on
+   * @param stats Statistics message of the output that published it
+   * @param encoded Time the frame was ready to publish
+   * @param bytes Size of the published frame
+   * @param width Width of the image in pixels
+   * @param height Height of the image in pixels
+   * @param quality JPEG quality of the image, 0 if unknown or not JPEG
+   * @param encode_ms Time spent encoding the image
+   *******************************************************/
+  void report_frame(VideoStream &stream, interfaces_pkg::msg::StreamStats &stats, std::chrono::steady_clock::time_point encoded,
+                    std::size_t bytes, int width, int height, int quality, double encode_ms)
+  {
+    const auto published = std::chrono::steady_clock::now();
+
+    const double capture_ms = (stream.timing.dequeue - stream.timing.capture).seconds() * 1000.0;
+    const double encode_stage_ms = std::chrono::duration<double, std::milli>(encoded - stream.timing.dequeued).count();
+    const double publish_ms = std::chrono::duration<double, std::milli>(published - encoded).count();
+    stream.latency[CAPTURE_TO_DEQUEUE].add(capture_ms);
+    stream.latency[DEQUEUE_TO_ENCODE].add(encode_stage_ms);
+    stream.latency[ENCODE_TO_PUBLISH].add(publish_ms);
+    stream.latency[CAPTURE_TO_PUBLISH].add(capture_ms + encode_stage_ms + publish_ms);
+
+    stats.header.stamp = stream.timing.capture;
+    stats.width = width;
+    stats.height = height;
+    stats.quality = quality;
+    stats.encode_time_ms = encode_ms;
+    stats.latency_ms = capture_ms + encode_stage_ms + publish_ms;
+    stats.bytes = bytes;
+
+    rate_controller_.onFrame(stream.id, bytes);
+    const auto &state = rate_controller_.stream(stream.id);
+    const auto &settings = rate_controller_.settings(stream.id);
+    stats.level = state.level;
+    stats.scale = settings.scale;
+    stats.target_fps = settings.fps;
+    stats.bitrate_kbps = state.bytes_per_second * 8.0 / 1000.0;
+    stats.allocation_kbps = state.allocation * 8.0 / 1000.0;
+    stats.budget_kbps = rate_controller_.effectiveBudget() * 8.0 / 1000.0;
+    stats.priority = rate_controller_.isPriority(stream.id);
+    stream.stats_pub->publish(stats);
+  }
+
+  /**
+   * @brief Capture time of a RealSense frame on the node clock. Global and system time stamps are
+   *        already on the host clock; hardware clock stamps go through the stream's clock offset,
+   *        estimated against the frame arrival times. The sensor timestamp (middle of exposure)
+   *        is preferred when the frame carries metadata.
+   * @param frame Frame to stamp
+   * @param device_clock Offset of the camera clock, only used in the hardware clock domain
+   * @param clock Set to the name of the clock the time came from
+   * @returns Capture time
+   *******************************************************/
+  rclcpp::Time realsense_capture_time(const rs2::frame &frame, ClockOffset &device_clock, const char *&clock)
+  {
+    const auto domain = frame.get_frame_timestamp_domain();
+    if (domain == RS2_TIMESTAMP_DOMAIN_GLOBAL_TIME || domain == RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME)
+    {
+      clock = domain == RS2_TIMESTAMP_DOMAIN_GLOBAL_TIME ? "global_time" : "system_time";
+      return from_system_time(static_cast<int64_t>(frame.get_timestamp() * 1e6));
+    }
+
+    int64_t device_ns = static_cast<int64_t>(frame.get_timestamp() * 1e6);
+    if (frame.supports_frame_metadata(RS2_FRAME_METADATA_SENSOR_TIMESTAMP))
+    {
+      device_ns = frame.get_frame_metadata(RS2_FRAME_METADATA_SENSOR_TIMESTAMP) * 1000; // us
+    }
+    int64_t arrival_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if (frame.supports_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL))
+    {
+      arrival_ns = frame.get_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL) * 1000000; // ms
+    }
+    clock = "hardware_clock";
+    return from_system_time(device_clock.toHost(device_ns, arrival_ns));
+  }
+
+  /**
+   * @brief Converts a system clock time to the node clock. The offset is sampled on every call,
+   *        so it follows sim time and clock steps.
+   * @param system_ns Nanoseconds since the epoch on the system clock
+   *******************************************************/
+  rclcpp::Time from_system_time(int64_t system_ns)
+  {
+    const rclcpp::Time now = this->now();
+    const int64_t system_now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return now - rclcpp::Duration::from_nanoseconds(system_now - system_ns);
+  }
+
+  /**
+   * @brief Converts a CLOCK_MONOTONIC time, such as a V4L2 buffer timestamp, to the node clock.
+   * @param steady_ns Nanoseconds on std::chrono::steady_clock
+   *******************************************************/
+  rclcpp::Time from_steady_time(int64_t steady_ns)
+  {
+    const rclcpp::Time now = this->now();
+    const int64_t steady_now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    return now - rclcpp::Duration::from_nanoseconds(steady_now - steady_ns);
+  }
+
+  /**
+   * @brief Publishes a realsense frame to the passed stream.
+   * @param color_frame rs2::frame passed by reference. The color_frame to be sent.
+   * @param stream VideoStream the color frame is published on.
+   *******************************************************/
+  void publish_realsense_image(rs2::frame &color_frame, VideoStream &stream)
+  {
+    if (!frame_due(stream))
+    {
+      return;
+    }
+    stream.timing.capture = realsense_capture_time(color_frame, stream.device_clock, stream.timing.clock);
+    auto video = color_frame.as<rs2::video_frame>();
+    publish_video(stream, static_cast<const uint8_t *>(video.get_data()), video.get_width(), video.get_height(),
+                 video.get_stride_in_bytes(), JpegEncoder::PixelFormat::BGR);
+  }
+
+  /**
+   * @brief Publishes a grayscale depth-assist view of a depth frame. Near surfaces are bright,
+   *        far surfaces fade to black at DEPTH_VIEW_MAX_MM and missing depth is black.
+   * @param depth Filtered depth frame
+   * @param stream VideoStream the view is published on.
+   *******************************************************/
+  void publish_depth_view(const rs2::depth_frame &depth, VideoStream &stream)
+  {
+    if (!frame_due(stream))
+    {
+      return;
+    }
+    stream.timing.capture = realsense_capture_time(depth, stream.device_clock, stream.timing.clock);
+    const int width = depth.get_width();
+    const int height = depth.get_height();
+    const int stride = depth.get_stride_in_bytes() / static_cast<int>(sizeof(uint16_t));
+    const float max_units = DEPTH_VIEW_MAX_MM / (depth.get_units() * 1000.0f);
+    const float gain = 255.0f / max_units;
+    const auto *src = static_cast<const uint16_t *>(depth.get_data());
+
+    stream.scratch.resize(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; y++)
+    {
+      const uint16_t *row = src + static_cast<size_t>(y) * stride;
+      uint8_t *out = stream.scratch.data() + static_cast<size_t>(y) * width;
+      for (int x = 0; x < width; x++)
+      {
+        float v = 255.0f - row[x] * gain;
+        out[x] = (row[x] == 0) ? 0 : static_cast<uint8_t>(std::clamp(v, 1.0f, 255.0f));
+      }
+    }
+    publish_video(stream, stream.scratch.data(), width, height, width, JpegEncoder::PixelFormat::GRAY);
+  }
+
+  /**
+   * @brief Opens a webcam, preferring MJPEG passthrough and falling back to cv::VideoCapture
+   *        when the device cannot stream MJPEG.
+   * @param webcam Webcam to open, webcam.path must be set
+   * @returns true if the webcam is connected
+   *******************************************************/
+  bool open_webcam(Webcam &webcam)
+  {
+    const std::string &path = webcam.path;
+    webcam.running = false;
+    if (mjpeg_passthrough_)
+    {
+      webcam.mjpeg = MjpegSource::create(path);
+      if (webcam.mjpeg->open(path, WEBCAM_WIDTH, WEBCAM_HEIGHT, WEBCAM_FPS))
+      {
+        RCLCPP_INFO(this->get_logger(), "Webcam at %s streaming MJPEG %dx%d", path.c_str(), webcam.mjpeg->width(), webcam.mjpeg->height());
+        webcam.running = true;
+        return true;
+      }
+      RCLCPP_WARN(this->get_logger(), "MJPEG passthrough unavailable (%s), falling back to OpenCV", webcam.mjpeg->lastError().c_str());
+      webcam.mjpeg.reset();
+    }
+
+    if (webcam.cap.open(path))
+    {
+      webcam.cap.set(cv::CAP_PROP_FPS, WEBCAM_FPS);
+      webcam.cap.set(cv::CAP_PROP_FRAME_WIDTH, WEBCAM_WIDTH);
+      webcam.cap.set(cv::CAP_PROP_FRAME_HEIGHT, WEBCAM_HEIGHT);
+      RCLCPP_INFO(this->get_logger(), "Webcam at %s connected successfully", path.c_str());
+      webcam.running = true;
+      return true;
+    }
+    RCLCPP_WARN(this->get_logger(), "Webcam not found at %s", path.c_str());
+    return false;
+  }
+
+  /**
+   * @brief Stops capturing from a webcam, letting the camera idle.
+   *******************************************************/
+  void close_webcam(Webcam &webcam)
+  {
+    webcam.mjpeg.reset();
+    webcam.cap.release();
+    webcam.running = false;
+  }
+
+  /**
+   * @brief Publishes the newest MJPEG frame of a webcam without decoding it. The frame is only
+   *        decoded and re-encoded when webcam_output_width/height request a smaller image, or
+   *        when the stream's H.264 output has subscribers.
+   * @param source MJPEG source of the webcam
+   * @param stream VideoStream the frame is published on.
+   * @returns true if a frame was captured, whether or not it was due for publishing
+   *******************************************************/
+  bool publish_mjpeg_camera(MjpegSource &source, VideoStream &stream)
+  {
+    MjpegFrame frame;
+    if (!source.grab(frame, 0))
+    {
+      return false;
+    }
+    if (recorder_.isOpen())
+    {
+      record_mjpeg_frame(source, frame, stream);
+    }
+    if (!frame_due(stream))
+    {
+      source.release(frame);
+      return true;
+    }
+    // V4L2 stamps the buffer on CLOCK_MONOTONIC when its first packet arrives
+    stream.timing.dequeue = this->now();
+    stream.timing.dequeued = std::chrono::steady_clock::now();
+    stream.timing.capture = stream.timing.dequeue;
+    stream.timing.clock = "arrival";
+    if (frame.timestamp.count() > 0)
+    {
+      stream.timing.capture = from_steady_time(frame.timestamp.count());
+      stream.timing.clock = "v4l2";
+    }
+
+    // Output size: the requested webcam size, reduced further by the rate controller
+    const int scale = rate_controller_.settings(stream.id).scale;
+    int max_width = source.width() / scale;
+    int max_height = source.height() / scale;
+    if (webcam_output_width_ > 0)
+      max_width = std::min(max_width, webcam_output_width_ / scale);
+    if (webcam_output_height_ > 0)
+      max_height = std::min(max_height, webcam_output_height_ / scale);
+
+    const bool downscale = max_width < source.width() || max_height < source.height();
+    const bool passthrough = stream.jpeg_enabled && !downscale && rate_controller_.passthrough(stream.id);
+    if (passthrough)
+    {
+      stream.msg.data.assign(frame.data, frame.data + frame.size);
+      publish_frame(stream, source.width(), source.height(), 0, 0.0);
+    }
+    if (passthrough && !stream.h264_enabled)
+    {
+      source.release(frame);
+      return true;
+    }
+
+    int width = 0;
+    int height = 0;
+    bool decoded = mjpeg_decoder_.decode(frame.data, frame.size, max_width, max_height, mjpeg_scaled_, width, height);
+    source.release(frame);
+    if (!decoded)
+    {
+      RCLCPP_WARN(this->get_logger(), "Failed to decode webcam MJPEG: %s", mjpeg_decoder_.lastError().c_str());
+      return true;
+    }
+    if (stream.jpeg_enabled && !passthrough)
+    {
+      encode_jpeg(stream, mjpeg_scaled_.data(), width, height, width * 3, JpegEncoder::PixelFormat::BGR);
+    }
+#if VISION_HAVE_X264
+    if (stream.h264_enabled)
+    {
+      encode_h264(stream, mjpeg_scaled_.data(), width, height, width * 3, JpegEncoder::PixelFormat::BGR);
+    }
+#endif
+    return true;
+  }
+
+  /**
+   * @brief Takes a cv::VideoCapture by reference and reads a frame. Frame is encoded and sent along message topic.
+   * @param cap cv::VideoCapture reference object.
+   * @param stream VideoStream the frame is published on.
+   * @returns true if a frame was read
+   */
+  bool publish_rgb_camera(cv::VideoCapture &cap, VideoStream &stream)
+  {
+    if (!cap.read(frame_))
+    {
+      RCLCPP_WARN(this->get_logger(), "Failed to capture frame from USB RGB camera.");
+      return false;
+    }
+    if (!frame_due(stream))
+    {
+      return true;
+    }
+    // OpenCV gives no capture time, the frame is stamped on arrival
+    stream.timing.dequeue = stream.timing.capture = this->now();
+    stream.timing.dequeued = std::chrono::steady_clock::now();
+    stream.timing.clock = "arrival";
+
+    // Publish original image
+    publish_video(stream, frame_.data, frame_.cols, frame_.rows, static_cast<int>(frame_.step), JpegEncoder::PixelFormat::BGR);
+
+    /**
+    cv::Mat gray, edges, edges_bgr;
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+
+    // Improve contrast first
+    cv::equalizeHist(gray, gray);
+
+    // Adjust thresholds here if needed
+    cv::Canny(gray, edges, 50, 150);
+
+    // Colorize edges as red
+    edges_bgr = cv::Mat::zeros(frame.size(), CV_8UC3);
+    edges_bgr.setTo(cv::Scalar(0, 0, 255), edges);  // Red where edges exist
+
+    // Encode edge image
+
+    std::vector<uchar> edge_buffer;
+    sensor_msgs::msg::CompressedImage edge_msg;
+    edge_msg.header.stamp = this->now();
+    edge_msg.header.frame_id = "rgb_camera_frame_edge";
+    edge_msg.format = "jpeg";
+
+    if (!cv::imencode(".jpg", edges_bgr, edge_buffer, params)) {
+      RCLCPP_ERROR(this->get_logger(), "Failed to encode Canny edge image.");
+      return;
+    }
+
+    edge_msg.data = edge_buffer;
+    if (edge_cam1_pub_) {
+      edge_cam1_pub_->publish(edge_msg);
+      RCLCPP_INFO(this->get_logger(), "Published Canny edge image.");
+    }
+   */
+    return true;
+  }
+
+  /**
+   * @brief Mean depth of the valid pixels inside inclusive pixel bounds, read from the
+   *        summed-area tables of the frame being processed.
+   * @param x_bounds First and last column
+   * @param y_bounds First and last row
+   * @returns Mean depth in meters, 0 if no pixel inside the bounds has a measurement
+   *******************************************************/
+  double average_depth(std::pair<int, int> x_bounds, std::pair<int, int> y_bounds) const
+  {
+    return depth_stats_.region(x_bounds.first, y_bounds.first, x_bounds.second + 1, y_bounds.second + 1).mean;
+  }
+
+  /**
+   * @brief Publishes the mean, spread and coverage of every cell of the depth grid.
+   * @param camera D455 the frame belongs to
+   * @param depth Filtered depth frame, depth_stats_ must have been built from it
+   *******************************************************/
+  void publish_depth_grid(Cameras camera, const rs2::depth_frame &depth)
+  {
+    const auto &pub = depth_grid_pubs_[camera];
+    if (!pub || depth_grid_cols_ <= 0 || depth_grid_rows_ <= 0)
+    {
+      return;
+    }
+
+    depth_stats_.grid(depth_grid_cols_, depth_grid_rows_, depth_grid_cells_);
+    auto &msg = depth_grid_msg_;
+    msg.header.stamp = this->now();
+    msg.header.frame_id = depth_frames_[camera];
+    msg.cols = depth_grid_cols_;
+    msg.rows = depth_grid_rows_;
+    msg.cell_width = depth.get_width() / depth_grid_cols_;
+    msg.cell_height = depth.get_height() / depth_grid_rows_;
+    msg.mean.resize(depth_grid_cells_.size());
+    msg.stddev.resize(depth_grid_cells_.size());
+    msg.valid_fraction.resize(depth_grid_cells_.size());
+    for (std::size_t i = 0; i < depth_grid_cells_.size(); i++)
+    {
+      msg.mean[i] = depth_grid_cells_[i].mean;
+      msg.stddev[i] = std::sqrt(depth_grid_cells_[i].variance);
+      msg.valid_fraction[i] = depth_grid_cells_[i].valid_fraction;
+    }
+    pub->publish(msg);
+  }
+
+  /**
+   * @brief Searches a color frame for the arena fiducials and publishes the robot pose with its
+   *        covariance, together with the detection timing. The color camera is placed in base_link
+   *        through the depth camera's extrinsics and the factory color-to-depth calibration.
+   * @param camera D455 the frame belongs to
+   * @param color Color frame, BGR8
+   * @param depth Depth frame of the same frameset, only its profile is used
+   *******************************************************/
+  void locate_fiducials(Cameras camera, const rs2::video_frame &color, const rs2::depth_frame &depth)
+  {
+    auto &fiducial = fiducials_[camera];
+    if (!fiducial.hasCamera())
+    {
+      const rs2_intrinsics intr = color.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+      const cv::Matx33d camera_matrix(intr.fx, 0, intr.ppx, 0, intr.fy, intr.ppy, 0, 0, 1);
+      const std::vector<double> distortion(intr.coeffs, intr.coeffs + 5);
+
+      RigidTransform depth_from_color;
+      if (depth)
+      {
+        const rs2_extrinsics e = color.get_profile().get_extrinsics_to(depth.get_profile());
+        for (int row = 0; row < 3; row++)
+        {
+          for (int col = 0; col < 3; col++)
+          {
+            depth_from_color.r[row * 3 + col] = e.rotation[col * 3 + row]; // librealsense is column major
+          }
+          depth_from_color.t[row] = e.translation[row];
+        }
+      }
+      fiducial.setCamera(camera_matrix, distortion, camera_extrinsics_[camera] * depth_from_color);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (fiducial_last_[camera].time_since_epoch().count() != 0)
+    {
+      const double fps = 1.0 / std::chrono::duration<double>(now - fiducial_last_[camera]).count();
+      fiducial_fps_[camera] = (fiducial_fps_[camera] == 0.0f) ? fps : 0.9f * fiducial_fps_[camera] + 0.1f * fps;
+    }
+    fiducial_last_[camera] = now;
+
+    const cv::Mat image(cv::Size(color.get_width(), color.get_height()), CV_8UC3, const_cast<void *>(color.get_data()),
+                        color.get_stride_in_bytes());
+    const FiducialPose &result = fiducial.locate(image);
+
+    // Capture time on the clock of the camera's color stream
+    VideoStream &color_stream = streams_[camera == Cameras::D455_ONE ? Streams::D455_ONE_COLOR : Streams::D455_TWO_COLOR];
+    const rclcpp::Time stamp = realsense_capture_time(color, color_stream.device_clock, color_stream.timing.clock);
+
+    if (result.valid)
+    {
+      geometry_msgs::msg::PoseWithCovarianceStamped pose_msg;
+      pose_msg.header.stamp = stamp;
+      pose_msg.header.frame_id = fiducial_frame_;
+      pose_msg.pose.pose.position.x = result.pose[0];
+      pose_msg.pose.pose.position.y = result.pose[1];
+      pose_msg.pose.pose.position.z = result.pose[2];
+      const double cr = std::cos(result.pose[3] / 2), sr = std::sin(result.pose[3] / 2);
+      const double cp = std::cos(result.pose[4] / 2), sp = std::sin(result.pose[4] / 2);
+      const double cy = std::cos(result.pose[5] / 2), sy = std::sin(result.pose[5] / 2);
+      pose_msg.pose.pose.orientation.w = cr * cp * cy + sr * sp * sy;
+      pose_msg.pose.pose.orientation.x = sr * cp * cy - cr * sp * sy;
+      pose_msg.pose.pose.orientation.y = cr * sp * cy + sr * cp * sy;
+      pose_msg.pose.pose.orientation.z = cr * cp * sy - sr * sp * cy;
+      std::copy(result.covariance, result.covariance + 36, pose_msg.pose.covariance.begin());
+      fiducial_pose_pub_->publish(pose_msg);
+    }
+
+    interfaces_pkg::msg::FiducialDetection detection;
+    detection.header.stamp = stamp;
+    detection.header.frame_id = fiducial_frame_;
+    detection.camera = camera == Cameras::D455_ONE ? 1 : 2;
+    detection.valid = result.valid;
+    detection.roi_search = result.roi_search;
+    detection.ids = result.ids;
+    detection.reprojection_px = result.reprojection_px;
+    detection.detect_ms = result.detect_ms;
+    detection.pnp_ms = result.pnp_ms;
+    detection.latency_ms = (this->now() - stamp).seconds() * 1000.0;
+    detection.fps = fiducial_fps_[camera];
+    fiducial_detection_pub_->publish(detection);
+  }
 
-        int depth_mm = static_cast<int>(dist_m * 1000);
-        int delta = GROUND_DEPTH_MM - depth_mm;
+  /**
+   * @brief Visual odometry thread. Tracks every frameset handed over by the camera pipeline and
+   *        publishes the pose of base_link in vo_frame, whose origin is where tracking started,
+   *        with the per-stage timing.
+   *******************************************************/
+  void visual_odometry_loop()
+  {
+    nav_msgs::msg::Odometry odom;
+    odom.header.frame_id = vo_frame_;
+    odom.child_frame_id = "base_link";
+    interfaces_pkg::msg::VisualOdometryStats stats;
+    stats.header.frame_id = vo_frame_;
+    float fps = 0.0f;
+    std::chrono::steady_clock::time_point last;
+    cv::Matx44d previous = cv::Matx44d::eye();
+    cv::Matx44d base_from_camera = cv::Matx44d::eye();
+    cv::Matx44d camera_from_base = cv::Matx44d::eye();
+
+    while (true)
+    {
+      rs2::frameset frames;
+      rclcpp::Time capture;
+      std::chrono::steady_clock::time_point handoff;
+      {
+        std::unique_lock<std::mutex> lock(vo_mutex_);
+        vo_wake_.wait(lock, [this] { return vo_pending_ || !vo_running_; });
+        if (!vo_running_)
+        {
+          return;
+        }
+        frames = std::move(vo_frames_);
+        capture = vo_capture_;
+        handoff = vo_handoff_;
+        vo_pending_ = false;
+        stats.dropped_frames = vo_dropped_;
+      }
 
-        if (delta > POS_THRESHOLD)
+      rs2::video_frame color = frames.get_color_frame();
+      rs2::depth_frame depth = frames.get_depth_frame();
+      if (!visual_odometry_.hasCalibration())
+      {
+        const rs2_intrinsics ci = color.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+        const rs2_intrinsics di = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+        const rs2_extrinsics e = depth.get_profile().get_extrinsics_to(color.get_profile());
+        cv::Matx44d color_from_depth = cv::Matx44d::eye();
+        for (int row = 0; row < 3; row++)
         {
-          pos_count++;
-          left_count++;
+          for (int col = 0; col < 3; col++)
+          {
+            color_from_depth(row, col) = e.rotation[col * 3 + row]; // librealsense is column major
+          }
+          color_from_depth(row, 3) = e.translation[row];
         }
-        else if (-delta > NEG_THRESHOLD)
+        visual_odometry_.setCalibration(cv::Matx33d(ci.fx, 0, ci.ppx, 0, ci.fy, ci.ppy, 0, 0, 1),
+                                        std::vector<double>(ci.coeffs, ci.coeffs + 5),
+                                        CameraIntrinsics{di.fx, di.fy, di.ppx, di.ppy}, color_from_depth);
+
+        // The color optical frame in base_link, through the depth extrinsics
+        const RigidTransform &depth_extrinsics = camera_extrinsics_[vo_camera_];
+        cv::Matx44d base_from_depth = cv::Matx44d::eye();
+        for (int row = 0; row < 3; row++)
+        {
+          for (int col = 0; col < 3; col++)
+          {
+            base_from_depth(row, col) = depth_extrinsics.r[row * 3 + col];
+          }
+          base_from_depth(row, 3) = depth_extrinsics.t[row];
+        }
+        base_from_camera = base_from_depth * color_from_depth.inv();
+        camera_from_base = base_from_camera.inv();
+      }
+
+      const cv::Mat image(cv::Size(color.get_width(), color.get_height()), CV_8UC3, const_cast<void *>(color.get_data()),
+                          color.get_stride_in_bytes());
+      const VisualOdometryResult &result = visual_odometry_.track(image, static_cast<const uint16_t *>(depth.get_data()),
+                                                                  depth.get_width(), depth.get_height(),
+                                                                  depth.get_stride_in_bytes(), depth.get_units());
+
+      const auto now = std::chrono::steady_clock::now();
+      double dt = 0.0;
+      if (last.time_since_epoch().count() != 0)
+      {
+        dt = std::chrono::duration<double>(now - last).count();
+        fps = (fps == 0.0f) ? 1.0f / dt : 0.9f * fps + 0.1f / dt;
+      }
+      last = now;
+
+      // base_link motion since the start, the first base_link pose being the origin
+      const cv::Matx44d pose = base_from_camera * result.world_from_camera * camera_from_base;
+      if (result.tracking)
+      {
+        odom.header.stamp = capture; // The pose is of when the color frame was taken, not when tracking ended
+        odom.pose.pose.position.x = pose(0, 3);
+        odom.pose.pose.position.y = pose(1, 3);
+        odom.pose.pose.position.z = pose(2, 3);
+        const double w = std::sqrt(std::max(0.0, 1.0 + pose(0, 0) + pose(1, 1) + pose(2, 2))) / 2.0;
+        const double x = std::copysign(std::sqrt(std::max(0.0, 1.0 + pose(0, 0) - pose(1, 1) - pose(2, 2))) / 2.0, pose(2, 1) - pose(1, 2));
+        const double y = std::copysign(std::sqrt(std::max(0.0, 1.0 - pose(0, 0) + pose(1, 1) - pose(2, 2))) / 2.0, pose(0, 2) - pose(2, 0));
+        const double z = std::copysign(std::sqrt(std::max(0.0, 1.0 - pose(0, 0) - pose(1, 1) + pose(2, 2))) / 2.0, pose(1, 0) - pose(0, 1));
+        odom.pose.pose.orientation.w = w;
+        odom.pose.pose.orientation.x = x;
+        odom.pose.pose.orientation.y = y;
+        odom.pose.pose.orientation.z = z;
+
+        // Velocity in base_link from the motion since the previous frame
+        if (dt > 0.0)
         {
-          neg_count++;
-          left_count++;
+          const cv::Matx44d delta = previous.inv() * pose;
+          odom.twist.twist.linear.x = delta(0, 3) / dt;
+          odom.twist.twist.linear.y = delta(1, 3) / dt;
+          odom.twist.twist.linear.z = delta(2, 3) / dt;
+          odom.twist.twist.angular.z = std::atan2(delta(1, 0), delta(0, 0)) / dt;
         }
+        vo_pub_->publish(odom);
+      }
+      previous = pose;
+
+      stats.header.stamp = capture;
+      stats.tracking = result.tracking;
+      stats.keyframe = result.keyframe;
+      stats.features = result.features;
+      stats.matches = result.matches;
+      stats.inliers = result.inliers;
+      stats.keyframes = visual_odometry_.keyframeCount();
+      stats.detect_ms = result.detect_ms;
+      stats.match_ms = result.match_ms;
+      stats.pnp_ms = result.pnp_ms;
+      stats.keyframe_ms = result.keyframe_ms;
+      stats.total_ms = result.total_ms;
+      stats.latency_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - handoff).count();
+      stats.fps = fps;
+      vo_stats_pub_->publish(stats);
+    }
+  }
+
+  /**
+   * @brief Measures the regolith in the bucket on a filtered depth frame and publishes it. The
+   *        saved empty bucket reference is loaded on the first frame, once the intrinsics are known.
+   * @param depth Filtered depth frame of bucket_camera
+   *******************************************************/
+  void measure_bucket(const rs2::depth_frame &depth)
+  {
+    const int width = depth.get_width();
+    const int height = depth.get_height();
+    const rs2_intrinsics intr = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+    auto clampRoi = [](double fraction, int size) { return static_cast<int>(std::clamp(fraction, 0.0, 1.0) * size); };
+    bucket_volume_.setRegion(CameraIntrinsics{intr.fx, intr.fy, intr.ppx, intr.ppy}, clampRoi(bucket_roi_[0], width),
+                             clampRoi(bucket_roi_[1], height), clampRoi(bucket_roi_[2], width), clampRoi(bucket_roi_[3], height));
+    if (!bucket_loaded_)
+    {
+      bucket_loaded_ = true;
+      if (bucket_volume_.load(bucket_reference_path_))
+      {
+        RCLCPP_INFO(this->get_logger(), "Loaded the empty bucket reference from %s", bucket_reference_path_.c_str());
+      }
+      else
+      {
+        RCLCPP_WARN(this->get_logger(), "No empty bucket reference in %s, call rs_node/calibrate_bucket", bucket_reference_path_.c_str());
+      }
+    }
+    if (bucket_calibrate_.exchange(false))
+    {
+      bucket_volume_.startCalibration();
+    }
+
+    const bool was_calibrating = bucket_volume_.calibrating();
+    const BucketFill &fill = bucket_volume_.update(static_cast<const uint16_t *>(depth.get_data()), width, height,
+                                                   depth.get_stride_in_bytes(), depth.get_units());
+    if (was_calibrating && !bucket_volume_.calibrating())
+    {
+      if (bucket_volume_.save(bucket_reference_path_))
+        RCLCPP_INFO(this->get_logger(), "Saved the empty bucket reference to %s", bucket_reference_path_.c_str());
+      else
+        RCLCPP_ERROR(this->get_logger(), "Could not save the empty bucket reference to %s", bucket_reference_path_.c_str());
+    }
+
+    interfaces_pkg::msg::BucketFill msg;
+    msg.header.stamp = this->now();
+    msg.header.frame_id = "camera_depth_optical_frame";
+    msg.calibrated = fill.calibrated;
+    msg.calibrating = bucket_volume_.calibrating();
+    msg.volume_m3 = fill.volume_m3;
+    msg.raw_volume_m3 = fill.raw_volume_m3;
+    msg.fill_fraction = fill.fill_fraction;
+    msg.valid_fraction = fill.valid_fraction;
+    msg.full = fill.full;
+    msg.compute_ms = fill.compute_ms;
+    bucket_pub_->publish(msg);
+  }
+
+  /**
+   * @brief Starts recording the empty bucket reference on the next depth frames.
+   *******************************************************/
+  void calibrate_bucket_callback(const std::shared_ptr<std_srvs::srv::Trigger::Request>,
+                                 std::shared_ptr<std_srvs::srv::Trigger::Response> response)
+  {
+    if (!player_ && !supervisor_->streaming(bucket_camera_))
+    {
+      response->success = false;
+      response->message = "bucket_camera is not streaming";
+      return;
+    }
+    bucket_calibrate_ = true;
+    response->success = true;
+    response->message = "Recording the empty bucket reference, keep the bucket empty and still for 2 s";
+  }
+
+  /**
+   * @brief Deprojects the filtered depth into the camera's reusable PointCloud2. The ray table
+   *        is rebuilt only when the depth resolution changes.
+   * @param camera D455 the frame belongs to, the cloud is in its depth optical frame
+   * @param depth Filtered depth frame
+   * @param capture Capture time of the depth frame
+   *******************************************************/
+  void publish_point_cloud(Cameras camera, const rs2::depth_frame &depth, const rclcpp::Time &capture)
+  {
+    auto &builder = cloud_builders_[camera];
+    auto &msg = cloud_msgs_[camera];
+    if (builder.width() != depth.get_width() || builder.height() != depth.get_height())
+    {
+      const rs2_intrinsics intr = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+      builder.setIntrinsics(depth.get_width(), depth.get_height(), CameraIntrinsics{intr.fx, intr.fy, intr.ppx, intr.ppy});
+
+      msg.header.frame_id = depth_frames_[camera];
+      msg.height = 1;
+      msg.is_bigendian = false;
+      msg.is_dense = true;
+      msg.point_step = PointCloudBuilder::POINT_STEP;
+      msg.fields.resize(3);
+      const char *names[3] = {"x", "y", "z"};
+      for (uint32_t i = 0; i < 3; i++)
+      {
+        msg.fields[i].name = names[i];
+        msg.fields[i].offset = 4 * i;
+        msg.fields[i].datatype = sensor_msgs::msg::PointField::FLOAT32;
+        msg.fields[i].count = 1;
       }
-    } // left side detection
+      msg.data.reserve(builder.maxPoints() * PointCloudBuilder::POINT_STEP);
+    }
+
+    // Capacity is kept, growing back to the full size does not allocate
+    msg.data.resize(builder.maxPoints() * PointCloudBuilder::POINT_STEP);
+    const std::size_t points = builder.build(static_cast<const uint16_t *>(depth.get_data()), depth.get_stride_in_bytes(),
+                                             depth.get_units(), msg.data.data());
+    msg.data.resize(points * PointCloudBuilder::POINT_STEP);
+    msg.width = points;
+    msg.row_step = msg.data.size();
+    msg.header.stamp = capture;
+    cloud_pubs_[camera]->publish(msg);
+  }
+
+  /**
+   * @brief Obstacle detection callback function. Fits the ground plane to the depth frame, counts
+   *        rocks and craters by their signed height above it and fuses the frame into the elevation map.
+   * @param camera D455 the frame belongs to, each camera keeps its own plane for warm starting
+   * @param depth The filtered depth frame, depth_stats_ must have been built from it
+   * @returns None
+   */
+  void obstacle_detection_callback(Cameras camera, const rs2::depth_frame &depth)
+  {
+    const int width = depth.get_width();
+    const int height = depth.get_height(); // 848 x 480
+
+    // Mean of the valid pixels in the 25x25 window at the image center
+    std_msgs::msg::Float32 depth_msg;
+    depth_msg.data = average_depth({width / 2 - 12, width / 2 + 12}, {height / 2 - 12, height / 2 + 12});
+
+    depth_detection_pub_->publish(depth_msg);
+
+    const rs2_intrinsics intr = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+    auto &estimator = ground_planes_[camera];
+    const GroundFit &fit = estimator.update(static_cast<const uint16_t *>(depth.get_data()), width, height,
+                                            depth.get_stride_in_bytes(), depth.get_units(),
+                                            CameraIntrinsics{intr.fx, intr.fy, intr.ppx, intr.ppy});
+    // Heights above a plane that was not fitted mean nothing, an invalid fit reports no obstacles
+    const GroundClassification counts = fit.valid ? estimator.classify(rock_height_m_, crater_depth_m_) : GroundClassification();
+
+    auto &plane_msg = ground_plane_msg_;
+    plane_msg.header.stamp = this->now();
+    plane_msg.header.frame_id = depth_frames_[camera];
+    plane_msg.valid = fit.valid;
+    plane_msg.warm_started = fit.warm_started;
+    plane_msg.a = fit.plane.a;
+    plane_msg.b = fit.plane.b;
+    plane_msg.c = fit.plane.c;
+    plane_msg.d = fit.plane.d;
+    plane_msg.inlier_fraction = fit.inlier_fraction;
+    plane_msg.rmse = fit.rmse;
+    plane_msg.normal_change_deg = fit.normal_change_deg;
+    plane_msg.offset_change_m = fit.offset_change_m;
+    plane_msg.fit_time_ms = fit.fit_ms;
+    plane_msg.points = fit.points;
+    plane_msg.rocks = counts.rocks_left + counts.rocks_right;
+    plane_msg.craters = counts.craters_left + counts.craters_right;
+    if (ground_plane_pubs_[camera])
+    {
+      ground_plane_pubs_[camera]->publish(plane_msg);
+    }
+
+    // Fuse the same decimated cloud into the elevation and voxel maps
+    const RigidTransform map_from_camera = robot_pose_ * camera_extrinsics_[camera];
+    elevation_map_.recenter(robot_pose_.t[0], robot_pose_.t[1]);
+    elevation_map_.integrate(estimator.cloudX().data(), estimator.cloudY().data(), estimator.cloudZ().data(),
+                             estimator.cloudX().size(), map_from_camera, this->now().seconds());
+    voxel_map_.insert(estimator.cloudX().data(), estimator.cloudY().data(), estimator.cloudZ().data(),
+                      estimator.cloudX().size(), map_from_camera, voxel_pool_.get());
+  }
+
+  /**
+   * @brief Converts [x, y, z, roll, pitch, yaw] of a camera in base_link to the transform of its optical frame.
+   *******************************************************/
+  RigidTransform extrinsics(const std::vector<double> &pose)
+  {
+    if (pose.size() != 6)
+    {
+      RCLCPP_ERROR(this->get_logger(), "Camera extrinsics need 6 values, got %zu", pose.size());
+      return RigidTransform::opticalToBody();
+    }
+    return RigidTransform::fromXYZRPY(pose[0], pose[1], pose[2], pose[3], pose[4], pose[5]) * RigidTransform::opticalToBody();
+  }
+
+  /**
+   * @brief Latches the depth optical frame of both D455s in base_link, from their extrinsics, so
+   *        the point clouds and ground planes of each camera can be transformed.
+   *******************************************************/
+  void broadcast_camera_frames()
+  {
+    std::vector<geometry_msgs::msg::TransformStamped> transforms;
+    for (Cameras camera : {Cameras::D455_ONE, Cameras::D455_TWO})
+    {
+      const RigidTransform &e = camera_extrinsics_[camera];
+      geometry_msgs::msg::TransformStamped transform;
+      transform.header.stamp = this->now();
+      transform.header.frame_id = "base_link";
+      transform.child_frame_id = depth_frames_[camera];
+      transform.transform.translation.x = e.t[0];
+      transform.transform.translation.y = e.t[1];
+      transform.transform.translation.z = e.t[2];
+      // Rotation matrix to quaternion, r is row major
+      transform.transform.rotation.w = std::sqrt(std::max(0.0, 1.0 + e.r[0] + e.r[4] + e.r[8])) / 2.0;
+      transform.transform.rotation.x = std::copysign(std::sqrt(std::max(0.0, 1.0 + e.r[0] - e.r[4] - e.r[8])) / 2.0, e.r[7] - e.r[5]);
+      transform.transform.rotation.y = std::copysign(std::sqrt(std::max(0.0, 1.0 - e.r[0] + e.r[4] - e.r[8])) / 2.0, e.r[2] - e.r[6]);
+      transform.transform.rotation.z = std::copysign(std::sqrt(std::max(0.0, 1.0 - e.r[0] - e.r[4] + e.r[8])) / 2.0, e.r[3] - e.r[1]);
+      transforms.push_back(transform);
+    }
+    static_tf_broadcaster_->sendTransform(transforms);
+  }
+
+  /**
+   * @brief Keeps the latest robot pose for placing depth frames in the elevation map.
+   * @param msg Odometry of base_link in map_frame
+   *******************************************************/
+  void odom_callback(const nav_msgs::msg::Odometry::SharedPtr msg)
+  {
+    const auto &p = msg->pose.pose.position;
+    const auto &q = msg->pose.pose.orientation;
+    const double roll = std::atan2(2.0 * (q.w * q.x + q.y * q.z), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+    const double pitch = std::asin(std::clamp(2.0 * (q.w * q.y - q.z * q.x), -1.0, 1.0));
+    const double yaw = std::atan2(2.0 * (q.w * q.z + q.x * q.y), 1.0 - 2.0 * (q.y * q.y + q.z * q.z));
+    robot_pose_ = RigidTransform::fromXYZRPY(p.x, p.y, p.z, roll, pitch, yaw);
+  }
 
-    std_msgs::msg::Bool left_msg;
-    std_msgs::msg::Bool right_msg;
+  /**
+   * @brief Publishes the elevation map and the rocks and craters in it as occupancy grids.
+   *        Heights are scaled from map_min_height_m..map_max_height_m to 0..100 and unknown
+   *        cells are -1. Obstacle cells are 100 when their height is beyond rock_height_m or
+   *        crater_depth_m and 0 otherwise. The unscaled heights go out on elevation_grid together
+   *        with the window of cells updated since the last publish.
+   *******************************************************/
+  void map_callback()
+  {
+    if (!depth_processing_)
+    {
+      return;
+    }
 
-    if (pos_count > OBSTACLE_THRESHOLD)
+    const double now = this->now().seconds();
+    const int n = elevation_map_.size();
+    for (auto *msg : {&elevation_msg_, &obstacle_msg_})
     {
-      right_msg.data = true;
-      left_msg.data = false;
+      msg->header.stamp = this->now();
+      msg->header.frame_id = map_frame_;
+      msg->info.resolution = elevation_map_.resolution();
+      msg->info.width = n;
+      msg->info.height = n;
+      msg->info.origin.position.x = elevation_map_.originX();
+      msg->info.origin.position.y = elevation_map_.originY();
+      msg->data.resize(static_cast<std::size_t>(n) * n); // Only allocates once
     }
-    else if (neg_count > OBSTACLE_THRESHOLD)
+    auto &grid = elevation_grid_msg_;
+    grid.header = elevation_msg_.header;
+    grid.resolution = elevation_map_.resolution();
+    grid.width = n;
+    grid.height = n;
+    grid.origin_x = elevation_map_.originX();
+    grid.origin_y = elevation_map_.originY();
+    grid.heights.resize(static_cast<std::size_t>(n) * n);
+    (void)elevation_map_.takeUpdated(grid.updated_col_min, grid.updated_row_min, grid.updated_col_max, grid.updated_row_max);
+
+    const float scale = 100.0f / (map_max_height_m_ - map_min_height_m_);
+    for (int row = 0; row < n; row++)
     {
-      right_msg.data = false;
-      left_msg.data = true;
+      for (int col = 0; col < n; col++)
+      {
+        const std::size_t i = static_cast<std::size_t>(row) * n + col;
+        float height;
+        float variance;
+        if (!elevation_map_.cell(col, row, now, height, variance))
+        {
+          elevation_msg_.data[i] = -1;
+          obstacle_msg_.data[i] = -1;
+          grid.heights[i] = std::numeric_limits<float>::quiet_NaN();
+          continue;
+        }
+        elevation_msg_.data[i] = static_cast<int8_t>(std::clamp((height - map_min_height_m_) * scale, 0.0f, 100.0f));
+        obstacle_msg_.data[i] = (height > rock_height_m_ || height < -crater_depth_m_) ? 100 : 0;
+        grid.heights[i] = height;
+      }
     }
-    else
+    elevation_map_pub_->publish(elevation_msg_);
+    obstacle_map_pub_->publish(obstacle_msg_);
+    elevation_grid_pub_->publish(grid);
+  }
+
+  /**
+   * @brief Drops the voxel blocks beyond voxel_map_radius and, while subscribed, publishes
+   *        the centers of the occupied voxels as a point cloud in map_frame.
+   *******************************************************/
+  void voxel_map_callback()
+  {
+    voxel_map_.evictOutside(robot_pose_.t[0], robot_pose_.t[1], voxel_map_radius_m_);
+    if (voxel_map_pub_->get_subscription_count() == 0)
     {
-      right_msg.data = false;
-      left_msg.data = false;
+      return;
     }
 
-    // Publish Messages
-    this->L_obstacle_detection_pub_->publish(left_msg);
-    this->R_obstacle_detection_pub_->publish(right_msg);
+    auto &msg = voxel_map_msg_;
+    if (msg.fields.empty())
+    {
+      msg.height = 1;
+      msg.is_bigendian = false;
+      msg.is_dense = true;
+      msg.point_step = 12;
+      msg.fields.resize(3);
+      const char *names[3] = {"x", "y", "z"};
+      for (uint32_t i = 0; i < 3; i++)
+      {
+        msg.fields[i].name = names[i];
+        msg.fields[i].offset = 4 * i;
+        msg.fields[i].datatype = sensor_msgs::msg::PointField::FLOAT32;
+        msg.fields[i].count = 1;
+      }
+    }
+    msg.data.clear(); // Capacity is kept
+    voxel_map_.forEachOccupied([&msg](float x, float y, float z) {
+      const float point[3] = {x, y, z};
+      const uint8_t *bytes = reinterpret_cast<const uint8_t *>(point);
+      msg.data.insert(msg.data.end(), bytes, bytes + sizeof(point));
+    });
+    msg.header.stamp = this->now();
+    msg.header.frame_id = map_frame_;
+    msg.width = msg.data.size() / msg.point_step;
+    msg.row_step = msg.data.size();
+    voxel_map_pub_->publish(msg);
   }
 };
 
@@ -0,0 +1,644 @@
+#include "vision_pkg/CameraSupervisor.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <libudev.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace
+{
+  int64_t nowNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  int64_t toNs(double seconds)
+  {
+    return static_cast<int64_t>(seconds * 1e9);
+  }
+
+  std::string formatSeconds(int64_t ns)
+  {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.2f s", ns * 1e-9);
+    return text;
+  }
+
+  bool isReplayFile(const std::string &id)
+  {
+    auto endsWith = [&id](const char *suffix) {
+      const std::size_t n = std::strlen(suffix);
+      return id.size() >= n && id.compare(id.size() - n, n, suffix) == 0;
+    };
+    return endsWith(".mjpeg") || endsWith(".mjpg");
+  }
+
+  /**
+   * @brief Identifiers udev gives a V4L2 capture node.
+   */
+  struct V4L2Device
+  {
+    std::string node;
+    std::string serial_short;
+    std::string serial;
+    std::string vendor_model;
+    std::string path;
+
+    bool matches(const std::string &id) const
+    {
+      return id == serial_short || id == serial || id == vendor_model || id == path;
+    }
+  };
+
+  std::string property(udev_device *device, const char *key)
+  {
+    const char *value = udev_device_get_property_value(device, key);
+    return value ? value : "";
+  }
+}
+
+struct CameraSupervisor::Slot
+{
+  std::string name;
+  std::string id; // Serial number or webcam id as configured
+  bool realsense = false;
+  bool file = false; // Webcam replayed from a file, always present
+  Configure configure;
+  std::unique_ptr<rs2::pipeline> pipeline; // D455 only, never reassigned
+
+  std::atomic<bool> running{false};      // D455 pipeline started
+  std::atomic<bool> idle{false};         // Webcam closed by the caller
+  std::atomic<bool> waiting{false};      // No frame since the device appeared or dropped
+  std::atomic<int64_t> started_ns{0};    // Pipeline started or webcam opened, begins the stall window
+  std::atomic<int64_t> last_frame_ns{0};
+  std::atomic<int64_t> down_since_ns{0}; // 0 unless an outage is running
+
+  // Guarded by mutex_
+  std::string device;
+  uint64_t generation = 0;
+  int64_t present_since_ns = 0;
+  int64_t retry_at_ns = 0;
+  uint32_t drops = 0;
+  double last_recovery_s = 0.0;
+  double max_recovery_s = 0.0;
+  double last_bringup_s = 0.0;
+};
+
+CameraSupervisor::CameraSupervisor(const Config &config) : config_(config)
+{
+}
+
+CameraSupervisor::~CameraSupervisor()
+{
+  stop();
+}
+
+std::size_t CameraSupervisor::addRealsense(const std::string &name, const std::string &serial, Configure configure)
+{
+  auto slot = std::make_unique<Slot>();
+  slot->name = name;
+  slot->id = serial;
+  slot->realsense = true;
+  slot->configure = std::move(configure);
+  slot->pipeline = std::make_unique<rs2::pipeline>(ctx_);
+  slots_.push_back(std::move(slot));
+  return slots_.size() - 1;
+}
+
+std::size_t CameraSupervisor::addWebcam(const std::string &name, const std::string &id)
+{
+  auto slot = std::make_unique<Slot>();
+  slot->name = name;
+  slot->id = id;
+  slot->file = isReplayFile(id);
+  slot->idle = true; // Until the caller opens it
+  slots_.push_back(std::move(slot));
+  return slots_.size() - 1;
+}
+
+void CameraSupervisor::start()
+{
+  if (running_)
+  {
+    return;
+  }
+  udev_ = udev_new();
+  if (udev_)
+  {
+    monitor_ = udev_monitor_new_from_netlink(udev_, "udev");
+    if (monitor_ && (udev_monitor_filter_add_match_subsystem_devtype(monitor_, "video4linux", nullptr) < 0 ||
+                     udev_monitor_enable_receiving(monitor_) < 0))
+    {
+      udev_monitor_unref(monitor_);
+      monitor_ = nullptr;
+    }
+  }
+  if (!monitor_)
+  {
+    log("udev events unavailable, webcams are rescanned every " + formatSeconds(toNs(config_.rescan_interval_s)));
+  }
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  ctx_.set_devices_changed_callback([this](rs2::event_information &)
+  {
+    realsense_changed_ = true;
+    wake();
+  });
+  running_ = true;
+  thread_ = std::thread(&CameraSupervisor::run, this);
+}
+
+void CameraSupervisor::stop()
+{
+  if (running_.exchange(false))
+  {
+    wake();
+  }
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+  try
+  {
+    ctx_.set_devices_changed_callback([](rs2::event_information &) {});
+  }
+  catch (const rs2::error &)
+  {
+  }
+  for (auto &slot : slots_)
+  {
+    if (slot->running)
+    {
+      stopPipeline(*slot);
+    }
+  }
+  if (wake_fd_ >= 0)
+  {
+    ::close(wake_fd_);
+    wake_fd_ = -1;
+  }
+  if (monitor_)
+  {
+    udev_monitor_unref(monitor_);
+    monitor_ = nullptr;
+  }
+  if (udev_)
+  {
+    udev_unref(udev_);
+    udev_ = nullptr;
+  }
+}
+
+void CameraSupervisor::wake()
+{
+  if (wake_fd_ >= 0)
+  {
+    const uint64_t one = 1;
+    (void)!::write(wake_fd_, &one, sizeof(one));
+  }
+}
+
+void CameraSupervisor::log(const std::string &line) const
+{
+  if (log_)
+  {
+    log_(line);
+  }
+}
+
+void CameraSupervisor::run()
+{
+  int64_t next_rescan = 0;
+  while (running_)
+  {
+    pollfd fds[2] = {{wake_fd_, POLLIN, 0}, {monitor_ ? udev_monitor_get_fd(monitor_) : -1, POLLIN, 0}};
+    (void)poll(fds, 2, 250);
+    if (fds[0].revents & POLLIN)
+    {
+      uint64_t count = 0;
+      (void)!::read(wake_fd_, &count, sizeof(count));
+    }
+    bool webcams_changed = false;
+    if (fds[1].revents & POLLIN)
+    {
+      while (udev_device *device = udev_monitor_receive_device(monitor_))
+      {
+        udev_device_unref(device);
+        webcams_changed = true;
+      }
+    }
+
+    const int64_t now = nowNs();
+    if (now >= next_rescan)
+    {
+      realsense_changed_ = true;
+      webcams_changed = true;
+      next_rescan = now + toNs(config_.rescan_interval_s);
+    }
+    if (realsense_changed_.exchange(false))
+    {
+      rescanRealsense(now);
+    }
+    if (webcams_changed)
+    {
+      rescanWebcams(now);
+    }
+    supervise(now);
+  }
+}
+
+void CameraSupervisor::rescanRealsense(int64_t now)
+{
+  std::vector<std::string> serials;
+  try
+  {
+    for (auto &&device : ctx_.query_devices())
+    {
+      if (device.supports(RS2_CAMERA_INFO_SERIAL_NUMBER))
+      {
+        serials.push_back(device.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
+      }
+    }
+  }
+  catch (const rs2::error &e)
+  {
+    log(std::string("RealSense query failed: ") + e.what());
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<bool> taken(serials.size(), false);
+  std::vector<std::string> found(slots_.size());
+  auto claim = [&](std::size_t i, const std::string &serial) {
+    for (std::size_t j = 0; j < serials.size(); j++)
+    {
+      if (!taken[j] && serials[j] == serial)
+      {
+        taken[j] = true;
+        found[i] = serial;
+        return true;
+      }
+    }
+    return false;
+  };
+  // Slots asking for a serial first, then the others keep their camera or take any free one
+  for (std::size_t i = 0; i < slots_.size(); i++)
+  {
+    if (slots_[i]->realsense && !slots_[i]->id.empty())
+    {
+      (void)claim(i, slots_[i]->id);
+    }
+  }
+  for (std::size_t i = 0; i < slots_.size(); i++)
+  {
+    if (!slots_[i]->realsense || !slots_[i]->id.empty() || claim(i, slots_[i]->device))
+    {
+      continue;
+    }
+    for (std::size_t j = 0; j < serials.size() && found[i].empty(); j++)
+    {
+      (void)claim(i, serials[j]);
+    }
+  }
+  for (std::size_t i = 0; i < slots_.size(); i++)
+  {
+    if (slots_[i]->realsense)
+    {
+      setPresent(*slots_[i], found[i], now);
+    }
+  }
+}
+
+void CameraSupervisor::rescanWebcams(int64_t now)
+{
+  std::vector<V4L2Device> devices;
+  if (udev_)
+  {
+    udev_enumerate *enumerate = udev_enumerate_new(udev_);
+    udev_enumerate_add_match_subsystem(enumerate, "video4linux");
+    udev_enumerate_scan_devices(enumerate);
+    udev_list_entry *entry;
+    udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate))
+    {
+      udev_device *device = udev_device_new_from_syspath(udev_, udev_list_entry_get_name(entry));
+      if (!device)
+      {
+        continue;
+      }
+      // Only the first node of a UVC camera captures video, the next one carries metadata
+      const char *node = udev_device_get_devnode(device);
+      const char *index = udev_device_get_sysattr_value(device, "index");
+      if (node && (!index || std::strcmp(index, "0") == 0))
+      {
+        V4L2Device v4l2;
+        v4l2.node = node;
+        v4l2.serial_short = property(device, "ID_SERIAL_SHORT");
+        v4l2.serial = property(device, "ID_SERIAL");
+        v4l2.vendor_model = property(device, "ID_VENDOR_ID") + ":" + property(device, "ID_MODEL_ID");
+        v4l2.path = property(device, "ID_PATH");
+        devices.push_back(v4l2);
+      }
+      udev_device_unref(device);
+    }
+    udev_enumerate_unref(enumerate);
+  }
+  // Lowest node first, so two identical webcams matched by vendor:product keep a stable order
+  std::sort(devices.begin(), devices.end(), [](const V4L2Device &a, const V4L2Device &b) {
+    return a.node.size() != b.node.size() ? a.node.size() < b.node.size() : a.node < b.node;
+  });
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<bool> taken(devices.size(), false);
+  auto take = [&](const std::string &node) {
+    for (std::size_t j = 0; j < devices.size(); j++)
+    {
+      if (devices[j].node == node)
+      {
+        taken[j] = true;
+      }
+    }
+  };
+
+  // Files and device paths first, they cannot move
+  std::vector<std::string> found(slots_.size());
+  for (std::size_t i = 0; i < slots_.size(); i++)
+  {
+    const Slot &slot = *slots_[i];
+    if (slot.realsense)
+    {
+      continue;
+    }
+    if (slot.file)
+    {
+      found[i] = slot.id;
+    }
+    else if (slot.id.rfind("/dev/", 0) == 0)
+    {
+      char resolved[PATH_MAX];
+      if (realpath(slot.id.c_str(), resolved))
+      {
+        found[i] = resolved;
+        take(found[i]);
+      }
+    }
+  }
+  // USB ids next, keeping the current node while it still matches
+  for (std::size_t i = 0; i < slots_.size(); i++)
+  {
+    const Slot &slot = *slots_[i];
+    if (slot.realsense || slot.file || slot.id.rfind("/dev/", 0) == 0)
+    {
+      continue;
+    }
+    std::size_t best = devices.size();
+    for (std::size_t j = 0; j < devices.size(); j++)
+    {
+      if (!taken[j] && devices[j].matches(slot.id) && (best == devices.size() || devices[j].node == slot.device))
+      {
+        best = j;
+      }
+    }
+    if (best < devices.size())
+    {
+      taken[best] = true;
+      found[i] = devices[best].node;
+    }
+  }
+  for (std::size_t i = 0; i < slots_.size(); i++)
+  {
+    if (!slots_[i]->realsense)
+    {
+      setPresent(*slots_[i], found[i], now);
+    }
+  }
+}
+
+void CameraSupervisor::setPresent(Slot &slot, const std::string &device, int64_t now)
+{
+  if (device == slot.device)
+  {
+    return;
+  }
+  const bool in_use = slot.realsense ? slot.running.load() : !slot.idle;
+  if (!slot.device.empty() && in_use)
+  {
+    dropped(slot, now, device.empty() ? "unplugged" : ("moved to " + device).c_str());
+  }
+  else if (device.empty())
+  {
+    log(slot.name + " unplugged");
+  }
+  slot.device = device;
+  slot.generation++;
+  if (!device.empty())
+  {
+    slot.present_since_ns = now;
+    slot.retry_at_ns = now;
+    slot.waiting = true;
+    log(slot.name + " found: " + device);
+  }
+}
+
+void CameraSupervisor::dropped(Slot &slot, int64_t now, const char *reason)
+{
+  if (slot.down_since_ns == 0)
+  {
+    slot.down_since_ns = now;
+    slot.drops++;
+  }
+  slot.waiting = true;
+  log(slot.name + " lost, " + reason);
+}
+
+void CameraSupervisor::supervise(int64_t now)
+{
+  const int64_t stall_ns = toNs(config_.stall_timeout_s);
+  for (auto &pointer : slots_)
+  {
+    Slot &slot = *pointer;
+    bool stop = false;
+    bool start = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const int64_t last = std::max(slot.last_frame_ns.load(), slot.started_ns.load());
+      const bool stalled = now - last > stall_ns;
+      if (slot.realsense)
+      {
+        if (slot.running && slot.device.empty())
+        {
+          stop = true;
+        }
+        else if (slot.running && stalled)
+        {
+          dropped(slot, now, ("no frames for " + formatSeconds(now - last)).c_str());
+          stop = true;
+          start = true;
+        }
+        else if (!slot.running && !slot.device.empty() && now >= slot.retry_at_ns)
+        {
+          start = true;
+        }
+      }
+      else if (!slot.idle && !slot.device.empty() && stalled)
+      {
+        // The caller reopens the webcam when the generation changes
+        dropped(slot, now, ("no frames for " + formatSeconds(now - last)).c_str());
+        slot.generation++;
+        slot.started_ns = now;
+      }
+    }
+    if (stop)
+    {
+      stopPipeline(slot);
+    }
+    if (start)
+    {
+      startPipeline(slot, now);
+    }
+  }
+}
+
+void CameraSupervisor::startPipeline(Slot &slot, int64_t now)
+{
+  std::string serial;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    serial = slot.device;
+  }
+  try
+  {
+    rs2::config config;
+    config.enable_device(serial);
+    slot.configure(config);
+    slot.pipeline->start(config);
+  }
+  catch (const rs2::error &e)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slot.retry_at_ns = now + toNs(config_.retry_interval_s);
+    log(slot.name + " failed to start: " + e.what());
+    return;
+  }
+  slot.started_ns = nowNs();
+  slot.running = true;
+  log(slot.name + " streaming from " + serial + " after " + formatSeconds(slot.started_ns - now));
+}
+
+void CameraSupervisor::stopPipeline(Slot &slot)
+{
+  slot.running = false;
+  try
+  {
+    slot.pipeline->stop();
+  }
+  catch (const rs2::error &)
+  {
+    // Already gone with the device
+  }
+}
+
+bool CameraSupervisor::pollFrames(std::size_t slot, rs2::frameset &frames)
+{
+  Slot &s = *slots_[slot];
+  if (!s.running)
+  {
+    return false;
+  }
+  try
+  {
+    if (!s.pipeline->poll_for_frames(&frames))
+    {
+      return false;
+    }
+  }
+  catch (const rs2::error &)
+  {
+    return false; // Stopped by the supervisor thread in the meantime
+  }
+  frameArrived(slot);
+  return true;
+}
+
+bool CameraSupervisor::devicePath(std::size_t slot, std::string &path, uint64_t &generation) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Slot &s = *slots_[slot];
+  path = s.device;
+  generation = s.generation;
+  return !s.device.empty();
+}
+
+void CameraSupervisor::frameArrived(std::size_t slot)
+{
+  Slot &s = *slots_[slot];
+  const int64_t now = nowNs();
+  s.last_frame_ns.store(now, std::memory_order_relaxed);
+  if (!s.waiting.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!s.waiting.exchange(false))
+  {
+    return;
+  }
+  s.last_bringup_s = (now - s.present_since_ns) * 1e-9;
+  const int64_t down = s.down_since_ns.exchange(0);
+  if (down != 0)
+  {
+    s.last_recovery_s = (now - down) * 1e-9;
+    s.max_recovery_s = std::max(s.max_recovery_s, s.last_recovery_s);
+    log(s.name + " recovered after " + formatSeconds(now - down) + ", first frame " +
+        formatSeconds(now - s.present_since_ns) + " after it was found");
+  }
+}
+
+void CameraSupervisor::setIdle(std::size_t slot, bool idle)
+{
+  Slot &s = *slots_[slot];
+  if (s.idle.exchange(idle) != idle && !idle)
+  {
+    s.started_ns = nowNs();
+  }
+}
+
+bool CameraSupervisor::streaming(std::size_t slot) const
+{
+  const Slot &s = *slots_[slot];
+  const int64_t last = s.last_frame_ns.load(std::memory_order_relaxed);
+  return (s.realsense ? s.running.load() : !s.idle.load()) && last != 0 &&
+         nowNs() - last < toNs(config_.stall_timeout_s);
+}
+
+std::vector<CameraHealth> CameraSupervisor::health() const
+{
+  std::vector<CameraHealth> result;
+  const int64_t now = nowNs();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::size_t i = 0; i < slots_.size(); i++)
+  {
+    const Slot &s = *slots_[i];
+    CameraHealth h;
+    h.name = s.name;
+    h.device = s.device;
+    h.present = !s.device.empty();
+    h.streaming = streaming(i);
+    h.idle = s.idle;
+    h.drops = s.drops;
+    const int64_t down = s.down_since_ns;
+    h.down_s = down != 0 && !s.idle ? (now - down) * 1e-9 : 0.0;
+    h.last_recovery_s = s.last_recovery_s;
+    h.max_recovery_s = s.max_recovery_s;
+    h.last_bringup_s = s.last_bringup_s;
+    result.push_back(h);
+  }
+  return result;
+}
@@ -0,0 +1,80 @@
+#include "vision_pkg/CaptureTiming.hpp"
+
+#include <algorithm>
+
+ClockOffset::ClockOffset(double window_s) : window_ns_(static_cast<int64_t>(window_s * 1e9))
+{
+}
+
+void ClockOffset::reset()
+{
+  window_.clear();
+  last_device_ns_ = 0;
+}
+
+int64_t ClockOffset::toHost(int64_t device_ns, int64_t host_ns)
+{
+  if (device_ns < last_device_ns_)
+  {
+    reset();
+  }
+  last_device_ns_ = device_ns;
+
+  const int64_t offset = host_ns - device_ns;
+  while (!window_.empty() && window_.back().offset_ns >= offset)
+  {
+    window_.pop_back();
+  }
+  window_.push_back({host_ns, offset});
+  while (window_.front().host_ns < host_ns - window_ns_)
+  {
+    window_.pop_front();
+  }
+  return device_ns + window_.front().offset_ns;
+}
+
+const std::array<float, LatencyHistogram::BUCKETS> &LatencyHistogram::upperEdgesMs()
+{
+  static const std::array<float, BUCKETS> edges = {1.0f, 2.0f, 4.0f, 8.0f, 12.0f, 16.0f, 24.0f, 33.0f, 50.0f, 66.0f,
+                                                   83.0f, 100.0f, 133.0f, 166.0f, 200.0f, 300.0f, 500.0f, 1000.0f,
+                                                   1e9f};
+  return edges;
+}
+
+void LatencyHistogram::add(double ms)
+{
+  const auto &edges = upperEdgesMs();
+  const auto bucket = std::upper_bound(edges.begin(), edges.end() - 1, static_cast<float>(ms)) - edges.begin();
+  buckets_[bucket]++;
+  count_++;
+  max_ms_ = std::max(max_ms_, ms);
+}
+
+void LatencyHistogram::clear()
+{
+  buckets_.fill(0);
+  count_ = 0;
+  max_ms_ = 0.0;
+}
+
+double LatencyHistogram::percentileMs(double fraction) const
+{
+  if (count_ == 0)
+  {
+    return 0.0;
+  }
+  const auto &edges = upperEdgesMs();
+  const double target = fraction * count_;
+  double below = 0.0;
+  for (std::size_t i = 0; i < BUCKETS; i++)
+  {
+    if (buckets_[i] > 0 && below + buckets_[i] >= target)
+    {
+      const double lower = i == 0 ? 0.0 : edges[i - 1];
+      const double upper = std::min<double>(edges[i], max_ms_);
+      return std::max(lower, lower + (upper - lower) * (target - below) / buckets_[i]);
+    }
+    below += buckets_[i];
+  }
+  return max_ms_;
+}
@@ -0,0 +1,85 @@
+#include "vision_pkg/DepthStats.hpp"
+
+#include <algorithm>
+
+void DepthStats::build(const uint16_t *depth, int width, int height, std::size_t stride, float depth_units)
+{
+  width_ = width;
+  height_ = height;
+  units_ = depth_units;
+
+  const std::size_t w = width + 1;
+  const std::size_t size = w * (height + 1);
+  sum_.resize(size);
+  sum_sq_.resize(size);
+  count_.resize(size);
+  std::fill(sum_.begin(), sum_.begin() + w, 0);
+  std::fill(sum_sq_.begin(), sum_sq_.begin() + w, 0);
+  std::fill(count_.begin(), count_.begin() + w, 0);
+
+  const uint8_t *row_bytes = reinterpret_cast<const uint8_t *>(depth);
+  for (int y = 0; y < height; y++)
+  {
+    const uint16_t *row = reinterpret_cast<const uint16_t *>(row_bytes + y * stride);
+    const std::size_t above = y * w;
+    const std::size_t here = above + w;
+    uint64_t row_sum = 0;
+    uint64_t row_sum_sq = 0;
+    uint32_t row_count = 0;
+
+    sum_[here] = 0;
+    sum_sq_[here] = 0;
+    count_[here] = 0;
+    for (int x = 0; x < width; x++)
+    {
+      const uint64_t d = row[x];
+      row_sum += d;
+      row_sum_sq += d * d;
+      row_count += d != 0;
+      sum_[here + x + 1] = sum_[above + x + 1] + row_sum;
+      sum_sq_[here + x + 1] = sum_sq_[above + x + 1] + row_sum_sq;
+      count_[here + x + 1] = count_[above + x + 1] + row_count;
+    }
+  }
+}
+
+DepthRegion DepthStats::region(int x0, int y0, int x1, int y1) const
+{
+  DepthRegion result;
+  x0 = std::clamp(x0, 0, width_);
+  x1 = std::clamp(x1, 0, width_);
+  y0 = std::clamp(y0, 0, height_);
+  y1 = std::clamp(y1, 0, height_);
+  if (x1 <= x0 || y1 <= y0)
+  {
+    return result;
+  }
+
+  const uint32_t valid = rectSum(count_, x0, y0, x1, y1);
+  result.valid = valid;
+  result.valid_fraction = static_cast<double>(valid) / ((x1 - x0) * (y1 - y0));
+  if (valid == 0)
+  {
+    return result;
+  }
+
+  const double mean = static_cast<double>(rectSum(sum_, x0, y0, x1, y1)) / valid;
+  const double mean_sq = static_cast<double>(rectSum(sum_sq_, x0, y0, x1, y1)) / valid;
+  result.mean = mean * units_;
+  result.variance = std::max(0.0, mean_sq - mean * mean) * units_ * units_;
+  return result;
+}
+
+void DepthStats::grid(int cols, int rows, std::vector<DepthRegion> &cells) const
+{
+  cells.resize(static_cast<std::size_t>(cols) * rows);
+  for (int r = 0; r < rows; r++)
+  {
+    const int y0 = r * height_ / rows;
+    const int y1 = (r + 1) * height_ / rows;
+    for (int c = 0; c < cols; c++)
+    {
+      cells[r * cols + c] = region(c * width_ / cols, y0, (c + 1) * width_ / cols, y1);
+    }
+  }
+}
@@ -0,0 +1,214 @@
+#include "vision_pkg/ElevationMap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+  const float UNKNOWN = std::numeric_limits<float>::infinity();
+
+  int floorDiv(float value, float resolution)
+  {
+    return static_cast<int>(std::floor(value / resolution));
+  }
+
+  int positiveModulo(int value, int modulus)
+  {
+    const int m = value % modulus;
+    return m < 0 ? m + modulus : m;
+  }
+}
+
+/////
+// RigidTransform
+
+RigidTransform RigidTransform::fromXYZRPY(float x, float y, float z, float roll, float pitch, float yaw)
+{
+  const float cr = std::cos(roll), sr = std::sin(roll);
+  const float cp = std::cos(pitch), sp = std::sin(pitch);
+  const float cy = std::cos(yaw), sy = std::sin(yaw);
+  RigidTransform result;
+  result.r[0] = cy * cp;
+  result.r[1] = cy * sp * sr - sy * cr;
+  result.r[2] = cy * sp * cr + sy * sr;
+  result.r[3] = sy * cp;
+  result.r[4] = sy * sp * sr + cy * cr;
+  result.r[5] = sy * sp * cr - cy * sr;
+  result.r[6] = -sp;
+  result.r[7] = cp * sr;
+  result.r[8] = cp * cr;
+  result.t[0] = x;
+  result.t[1] = y;
+  result.t[2] = z;
+  return result;
+}
+
+RigidTransform RigidTransform::opticalToBody()
+{
+  RigidTransform result;
+  const float r[9] = {0, 0, 1, -1, 0, 0, 0, -1, 0};
+  std::copy(r, r + 9, result.r);
+  return result;
+}
+
+RigidTransform RigidTransform::operator*(const RigidTransform &other) const
+{
+  RigidTransform result;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      result.r[i * 3 + j] = r[i * 3] * other.r[j] + r[i * 3 + 1] * other.r[3 + j] + r[i * 3 + 2] * other.r[6 + j];
+    }
+    result.t[i] = r[i * 3] * other.t[0] + r[i * 3 + 1] * other.t[1] + r[i * 3 + 2] * other.t[2] + t[i];
+  }
+  return result;
+}
+
+/////
+// ElevationMap
+
+ElevationMap::ElevationMap(const Config &config)
+    : config_(config),
+      height_(static_cast<std::size_t>(config.size) * config.size, 0.0f),
+      variance_(height_.size(), UNKNOWN),
+      stamp_(height_.size(), 0.0)
+{
+  origin_x_ = -config_.size / 2;
+  origin_y_ = -config_.size / 2;
+}
+
+std::size_t ElevationMap::index(int ix, int iy) const
+{
+  return static_cast<std::size_t>(positiveModulo(iy, config_.size)) * config_.size + positiveModulo(ix, config_.size);
+}
+
+void ElevationMap::clearColumn(int ix)
+{
+  const std::size_t col = positiveModulo(ix, config_.size);
+  for (int row = 0; row < config_.size; row++)
+  {
+    variance_[row * config_.size + col] = UNKNOWN;
+  }
+}
+
+void ElevationMap::clearRow(int iy)
+{
+  const std::size_t start = static_cast<std::size_t>(positiveModulo(iy, config_.size)) * config_.size;
+  std::fill(variance_.begin() + start, variance_.begin() + start + config_.size, UNKNOWN);
+}
+
+void ElevationMap::recenter(float x, float y)
+{
+  const int n = config_.size;
+  const int new_x = floorDiv(x, config_.resolution) - n / 2;
+  const int new_y = floorDiv(y, config_.resolution) - n / 2;
+
+  if (std::abs(new_x - origin_x_) >= n || std::abs(new_y - origin_y_) >= n)
+  {
+    std::fill(variance_.begin(), variance_.end(), UNKNOWN);
+  }
+  else
+  {
+    // Columns and rows entering the window still hold cells that left it on the other side
+    for (int ix = origin_x_ + n; ix < new_x + n; ix++)
+      clearColumn(ix);
+    for (int ix = new_x; ix < origin_x_; ix++)
+      clearColumn(ix);
+    for (int iy = origin_y_ + n; iy < new_y + n; iy++)
+      clearRow(iy);
+    for (int iy = new_y; iy < origin_y_; iy++)
+      clearRow(iy);
+  }
+  origin_x_ = new_x;
+  origin_y_ = new_y;
+}
+
+void ElevationMap::integrate(const float *x, const float *y, const float *z, std::size_t count,
+                             const RigidTransform &map_from_camera, double stamp)
+{
+  if (mx_.size() < count)
+  {
+    mx_.resize(count);
+    my_.resize(count);
+    mz_.resize(count);
+    noise_.resize(count);
+  }
+
+  /////
+  // Transform and measurement noise, a branch-free loop over the structure-of-arrays cloud
+  const float *r = map_from_camera.r;
+  const float *t = map_from_camera.t;
+  const float k = config_.depth_noise;
+  const float min_sigma = config_.min_sigma;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    mx_[i] = r[0] * x[i] + r[1] * y[i] + r[2] * z[i] + t[0];
+    my_[i] = r[3] * x[i] + r[4] * y[i] + r[5] * z[i] + t[1];
+    mz_[i] = r[6] * x[i] + r[7] * y[i] + r[8] * z[i] + t[2];
+    const float sigma = std::max(min_sigma, k * z[i] * z[i]);
+    noise_[i] = sigma * sigma;
+  }
+
+  /////
+  // Fuse into the cells
+  const float inv_res = 1.0f / config_.resolution;
+  const float outlier = config_.outlier_sigmas * config_.outlier_sigmas;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    const int ix = static_cast<int>(std::floor(mx_[i] * inv_res));
+    const int iy = static_cast<int>(std::floor(my_[i] * inv_res));
+    if (ix < origin_x_ || iy < origin_y_ || ix >= origin_x_ + config_.size || iy >= origin_y_ + config_.size)
+    {
+      continue;
+    }
+
+    const std::size_t c = index(ix, iy);
+    const float h = mz_[i];
+    const float noise = noise_[i];
+    const float variance = variance_[c] + config_.decay_per_s * static_cast<float>(stamp - stamp_[c]);
+    const float diff = h - height_[c];
+    if (!(variance <= config_.max_variance) || (diff > 0.0f && diff * diff > outlier * (variance + noise)))
+    {
+      height_[c] = h;
+      variance_[c] = noise;
+    }
+    else
+    {
+      const float gain = variance / (variance + noise);
+      height_[c] += gain * diff;
+      variance_[c] = (1.0f - gain) * variance;
+    }
+    stamp_[c] = stamp;
+
+    if (updated_max_x_ < updated_min_x_)
+    {
+      updated_min_x_ = updated_max_x_ = ix;
+      updated_min_y_ = updated_max_y_ = iy;
+    }
+    updated_min_x_ = std::min(updated_min_x_, ix);
+    updated_max_x_ = std::max(updated_max_x_, ix);
+    updated_min_y_ = std::min(updated_min_y_, iy);
+    updated_max_y_ = std::max(updated_max_y_, iy);
+  }
+}
+
+bool ElevationMap::takeUpdated(int &col_min, int &row_min, int &col_max, int &row_max)
+{
+  col_min = std::max(updated_min_x_, origin_x_) - origin_x_;
+  row_min = std::max(updated_min_y_, origin_y_) - origin_y_;
+  col_max = std::min(updated_max_x_, origin_x_ + config_.size - 1) - origin_x_;
+  row_max = std::min(updated_max_y_, origin_y_ + config_.size - 1) - origin_y_;
+  updated_min_x_ = updated_min_y_ = 0;
+  updated_max_x_ = updated_max_y_ = -1;
+  return col_min <= col_max && row_min <= row_max;
+}
+
+bool ElevationMap::cell(int col, int row, double now, float &height, float &variance) const
+{
+  const std::size_t c = index(origin_x_ + col, origin_y_ + row);
+  variance = variance_[c] + config_.decay_per_s * static_cast<float>(now - stamp_[c]);
+  height = height_[c];
+  return variance <= config_.max_variance;
+}
@@ -0,0 +1,348 @@
+#include "vision_pkg/FiducialLocalizer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+// The ArUco detector moved from opencv_contrib into objdetect with a new API in OpenCV 4.7
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 7)
+#define FIDUCIAL_ARUCO_DETECTOR 1
+#include <opencv2/objdetect/aruco_detector.hpp>
+#else
+#define FIDUCIAL_ARUCO_DETECTOR 0
+#include <opencv2/aruco.hpp>
+#endif
+
+namespace
+{
+  const std::pair<const char *, int> DICTIONARIES[] = {
+      {"aruco_4x4_50", cv::aruco::DICT_4X4_50},
+      {"aruco_4x4_100", cv::aruco::DICT_4X4_100},
+      {"aruco_5x5_100", cv::aruco::DICT_5X5_100},
+      {"aruco_6x6_250", cv::aruco::DICT_6X6_250},
+      {"aruco_original", cv::aruco::DICT_ARUCO_ORIGINAL},
+      {"apriltag_16h5", cv::aruco::DICT_APRILTAG_16h5},
+      {"apriltag_25h9", cv::aruco::DICT_APRILTAG_25h9},
+      {"apriltag_36h10", cv::aruco::DICT_APRILTAG_36h10},
+      {"apriltag_36h11", cv::aruco::DICT_APRILTAG_36h11},
+  };
+
+  double elapsedMs(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  cv::Matx44d toMatx(const RigidTransform &transform)
+  {
+    const float *r = transform.r;
+    const float *t = transform.t;
+    return cv::Matx44d(r[0], r[1], r[2], t[0],
+                       r[3], r[4], r[5], t[1],
+                       r[6], r[7], r[8], t[2],
+                       0, 0, 0, 1);
+  }
+
+  cv::Matx44d fromRotation(const cv::Matx33d &r, const cv::Vec3d &t)
+  {
+    return cv::Matx44d(r(0, 0), r(0, 1), r(0, 2), t[0],
+                       r(1, 0), r(1, 1), r(1, 2), t[1],
+                       r(2, 0), r(2, 1), r(2, 2), t[2],
+                       0, 0, 0, 1);
+  }
+
+  cv::Matx44d invertRigid(const cv::Matx44d &m)
+  {
+    const cv::Matx33d rt = cv::Matx33d(m(0, 0), m(0, 1), m(0, 2), m(1, 0), m(1, 1), m(1, 2), m(2, 0), m(2, 1), m(2, 2)).t();
+    const cv::Vec3d t = -(rt * cv::Vec3d(m(0, 3), m(1, 3), m(2, 3)));
+    return fromRotation(rt, t);
+  }
+
+  double wrapAngle(double angle)
+  {
+    return std::atan2(std::sin(angle), std::cos(angle));
+  }
+}
+
+/////
+// Detector, hides the two OpenCV APIs
+
+struct FiducialLocalizer::Detector
+{
+#if FIDUCIAL_ARUCO_DETECTOR
+  explicit Detector(int dictionary) : detector(cv::aruco::getPredefinedDictionary(dictionary), parameters()) {}
+
+  static cv::aruco::DetectorParameters parameters()
+  {
+    cv::aruco::DetectorParameters params;
+    params.cornerRefinementMethod = cv::aruco::CORNER_REFINE_SUBPIX;
+    return params;
+  }
+
+  void detect(const cv::Mat &image, std::vector<std::vector<cv::Point2f>> &corners, std::vector<int> &ids)
+  {
+    detector.detectMarkers(image, corners, ids);
+  }
+
+  cv::aruco::ArucoDetector detector;
+#else
+  explicit Detector(int dictionary)
+      : dictionary(cv::aruco::getPredefinedDictionary(dictionary)), params(cv::aruco::DetectorParameters::create())
+  {
+    params->cornerRefinementMethod = cv::aruco::CORNER_REFINE_SUBPIX;
+  }
+
+  void detect(const cv::Mat &image, std::vector<std::vector<cv::Point2f>> &corners, std::vector<int> &ids)
+  {
+    cv::aruco::detectMarkers(image, dictionary, corners, ids, params);
+  }
+
+  cv::Ptr<cv::aruco::Dictionary> dictionary;
+  cv::Ptr<cv::aruco::DetectorParameters> params;
+#endif
+};
+
+/////
+// FiducialLocalizer
+
+FiducialLocalizer::FiducialLocalizer(const Config &config) : config_(config)
+{
+  for (const auto &entry : DICTIONARIES)
+  {
+    if (config_.dictionary == entry.first)
+    {
+      detector_ = std::make_unique<Detector>(entry.second);
+    }
+  }
+  if (!detector_)
+  {
+    throw std::invalid_argument("Unknown fiducial dictionary " + config_.dictionary);
+  }
+}
+
+FiducialLocalizer::~FiducialLocalizer() = default;
+FiducialLocalizer::FiducialLocalizer(FiducialLocalizer &&) = default;
+FiducialLocalizer &FiducialLocalizer::operator=(FiducialLocalizer &&) = default;
+
+std::vector<std::string> FiducialLocalizer::dictionaryNames()
+{
+  std::vector<std::string> names;
+  for (const auto &entry : DICTIONARIES)
+  {
+    names.emplace_back(entry.first);
+  }
+  return names;
+}
+
+void FiducialLocalizer::addMarker(int id, const RigidTransform &arena_from_marker)
+{
+  const cv::Matx44d transform = toMatx(arena_from_marker);
+  const double h = config_.marker_size_m / 2.0;
+  const cv::Vec4d local[4] = {{-h, h, 0, 1}, {h, h, 0, 1}, {h, -h, 0, 1}, {-h, -h, 0, 1}};
+
+  Marker &marker = markers_[id];
+  marker.marker_from_arena = invertRigid(transform);
+  for (int i = 0; i < 4; i++)
+  {
+    const cv::Vec4d p = transform * local[i];
+    marker.corners[i] = cv::Point3d(p[0], p[1], p[2]);
+  }
+}
+
+void FiducialLocalizer::setCamera(const cv::Matx33d &camera_matrix, const std::vector<double> &distortion,
+                                  const RigidTransform &base_from_camera)
+{
+  camera_matrix_ = camera_matrix;
+  distortion_ = distortion;
+  camera_from_base_ = invertRigid(toMatx(base_from_camera));
+  has_camera_ = true;
+}
+
+const FiducialPose &FiducialLocalizer::locate(const cv::Mat &bgr)
+{
+  const auto start = std::chrono::steady_clock::now();
+  result_.valid = false;
+  result_.roi_search = false;
+  result_.pnp_ms = 0.0;
+
+  cv::cvtColor(bgr, gray_, cv::COLOR_BGR2GRAY);
+  const cv::Rect full(0, 0, gray_.cols, gray_.rows);
+
+  // Window around the previous markers first, the full frame when they left it
+  bool found = false;
+  if (!roi_.empty() && frames_since_full_ < config_.full_search_interval)
+  {
+    found = search(roi_ & full);
+    result_.roi_search = found;
+    frames_since_full_++;
+  }
+  if (!found)
+  {
+    found = search(full);
+    frames_since_full_ = 0;
+  }
+
+  roi_ = cv::Rect();
+  if (found)
+  {
+    std::vector<cv::Point2f> all;
+    for (const auto &marker : corners_)
+    {
+      all.insert(all.end(), marker.begin(), marker.end());
+    }
+    const cv::Rect box = cv::boundingRect(all);
+    const int margin = static_cast<int>(config_.roi_margin * std::max(box.width, box.height)) + 8;
+    roi_ = cv::Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & full;
+  }
+  result_.detect_ms = elapsedMs(start);
+  result_.ids = ids_;
+
+  if (found && has_camera_)
+  {
+    const auto pnp_start = std::chrono::steady_clock::now();
+    result_.valid = solve();
+    result_.pnp_ms = elapsedMs(pnp_start);
+  }
+  return result_;
+}
+
+bool FiducialLocalizer::search(const cv::Rect &region)
+{
+  detector_->detect(gray_(region), corners_, ids_);
+
+  // Keep the markers with a known position, in image coordinates
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < ids_.size(); i++)
+  {
+    if (markers_.count(ids_[i]) == 0)
+    {
+      continue;
+    }
+    for (auto &corner : corners_[i])
+    {
+      corner.x += region.x;
+      corner.y += region.y;
+    }
+    ids_[kept] = ids_[i];
+    std::swap(corners_[kept], corners_[i]);
+    kept++;
+  }
+  ids_.resize(kept);
+  corners_.resize(kept);
+  return kept > 0;
+}
+
+bool FiducialLocalizer::solve()
+{
+  std::vector<cv::Point3d> object;
+  std::vector<cv::Point2d> image;
+  std::size_t largest = 0;
+  double largest_area = 0.0;
+  for (std::size_t i = 0; i < ids_.size(); i++)
+  {
+    const Marker &marker = markers_.at(ids_[i]);
+    for (int c = 0; c < 4; c++)
+    {
+      object.push_back(marker.corners[c]);
+      image.emplace_back(corners_[i][c].x, corners_[i][c].y);
+    }
+    const double area = cv::contourArea(corners_[i]);
+    if (area > largest_area)
+    {
+      largest = i;
+      largest_area = area;
+    }
+  }
+
+  // 1) IPPE on the largest marker, in its own frame
+  const double h = config_.marker_size_m / 2.0;
+  const std::vector<cv::Point3d> square = {{-h, h, 0}, {h, h, 0}, {h, -h, 0}, {-h, -h, 0}};
+  const std::vector<cv::Point2d> square_image(image.begin() + 4 * largest, image.begin() + 4 * largest + 4);
+  cv::Vec3d rvec;
+  cv::Vec3d tvec;
+  if (!cv::solvePnP(square, square_image, camera_matrix_, distortion_, rvec, tvec, false, cv::SOLVEPNP_IPPE_SQUARE))
+  {
+    return false;
+  }
+  cv::Matx33d rotation;
+  cv::Rodrigues(rvec, rotation);
+  const cv::Matx44d camera_from_arena = fromRotation(rotation, tvec) * markers_.at(ids_[largest]).marker_from_arena;
+  rotation = camera_from_arena.get_minor<3, 3>(0, 0);
+  cv::Rodrigues(rotation, rvec);
+  tvec = cv::Vec3d(camera_from_arena(0, 3), camera_from_arena(1, 3), camera_from_arena(2, 3));
+
+  // 2) Refine over every marker
+  if (ids_.size() > 1)
+  {
+    cv::solvePnP(object, image, camera_matrix_, distortion_, rvec, tvec, true, cv::SOLVEPNP_ITERATIVE);
+  }
+
+  // 3) Covariance of the camera pose from the reprojection Jacobian
+  std::vector<cv::Point2d> projected;
+  cv::Mat jacobian;
+  cv::projectPoints(object, rvec, tvec, camera_matrix_, distortion_, projected, jacobian);
+  double squared = 0.0;
+  for (std::size_t i = 0; i < image.size(); i++)
+  {
+    const cv::Point2d d = projected[i] - image[i];
+    squared += d.dot(d);
+  }
+  result_.reprojection_px = std::sqrt(squared / image.size());
+  if (result_.reprojection_px > config_.max_reprojection_px)
+  {
+    return false;
+  }
+  const cv::Mat j = jacobian.colRange(0, 6);
+  cv::Mat information = j.t() * j;
+  cv::Mat inverse;
+  if (cv::invert(information, inverse, cv::DECOMP_CHOLESKY) == 0.0)
+  {
+    return false;
+  }
+  const double sigma = std::max(result_.reprojection_px, config_.min_pixel_sigma);
+  const cv::Matx66d camera_covariance = cv::Matx66d(inverse.ptr<double>()) * (sigma * sigma);
+
+  // 4) Robot pose and its covariance, propagated with a numeric Jacobian
+  const cv::Vec6d params(rvec[0], rvec[1], rvec[2], tvec[0], tvec[1], tvec[2]);
+  robotPose(params, result_.pose);
+  cv::Matx66d f;
+  const double eps = 1e-6;
+  for (int k = 0; k < 6; k++)
+  {
+    cv::Vec6d plus = params;
+    cv::Vec6d minus = params;
+    plus[k] += eps;
+    minus[k] -= eps;
+    double pose_plus[6];
+    double pose_minus[6];
+    robotPose(plus, pose_plus);
+    robotPose(minus, pose_minus);
+    for (int r = 0; r < 6; r++)
+    {
+      const double d = pose_plus[r] - pose_minus[r];
+      f(r, k) = (r < 3 ? d : wrapAngle(d)) / (2.0 * eps);
+    }
+  }
+  const cv::Matx66d covariance = f * camera_covariance * f.t();
+  std::copy(covariance.val, covariance.val + 36, result_.covariance);
+  return true;
+}
+
+void FiducialLocalizer::robotPose(const cv::Vec6d &camera_from_arena, double pose[6]) const
+{
+  cv::Matx33d rotation;
+  cv::Rodrigues(cv::Vec3d(camera_from_arena[0], camera_from_arena[1], camera_from_arena[2]), rotation);
+  const cv::Vec3d t(camera_from_arena[3], camera_from_arena[4], camera_from_arena[5]);
+  const cv::Matx44d arena_from_base = invertRigid(fromRotation(rotation, t)) * camera_from_base_;
+
+  pose[0] = arena_from_base(0, 3);
+  pose[1] = arena_from_base(1, 3);
+  pose[2] = arena_from_base(2, 3);
+  pose[3] = std::atan2(arena_from_base(2, 1), arena_from_base(2, 2));
+  pose[4] = std::asin(std::clamp(-arena_from_base(2, 0), -1.0, 1.0));
+  pose[5] = std::atan2(arena_from_base(1, 0), arena_from_base(0, 0));
+}
@@ -0,0 +1,308 @@
+#include "vision_pkg/GroundPlane.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+  const float RAD_TO_DEG = 57.2957795f;
+
+  /**
+   * @brief Eigenvector of the smallest eigenvalue of a symmetric 3x3 matrix, by cyclic Jacobi rotations.
+   */
+  void smallestEigenvector(double m[3][3], double v[3])
+  {
+    double e[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    for (int sweep = 0; sweep < 16; sweep++)
+    {
+      const double off = m[0][1] * m[0][1] + m[0][2] * m[0][2] + m[1][2] * m[1][2];
+      if (off < 1e-18)
+      {
+        break;
+      }
+      for (int p = 0; p < 2; p++)
+      {
+        for (int q = p + 1; q < 3; q++)
+        {
+          if (std::fabs(m[p][q]) < 1e-30)
+          {
+            continue;
+          }
+          const double theta = (m[q][q] - m[p][p]) / (2.0 * m[p][q]);
+          const double t = (theta >= 0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+          const double c = 1.0 / std::sqrt(t * t + 1.0);
+          const double s = t * c;
+          for (int k = 0; k < 3; k++)
+          {
+            const double mkp = m[k][p];
+            const double mkq = m[k][q];
+            m[k][p] = c * mkp - s * mkq;
+            m[k][q] = s * mkp + c * mkq;
+          }
+          for (int k = 0; k < 3; k++)
+          {
+            const double mpk = m[p][k];
+            const double mqk = m[q][k];
+            m[p][k] = c * mpk - s * mqk;
+            m[q][k] = s * mpk + c * mqk;
+          }
+          for (int k = 0; k < 3; k++)
+          {
+            const double ekp = e[k][p];
+            const double ekq = e[k][q];
+            e[k][p] = c * ekp - s * ekq;
+            e[k][q] = s * ekp + c * ekq;
+          }
+        }
+      }
+    }
+    int smallest = 0;
+    for (int i = 1; i < 3; i++)
+    {
+      if (m[i][i] < m[smallest][smallest])
+      {
+        smallest = i;
+      }
+    }
+    for (int k = 0; k < 3; k++)
+    {
+      v[k] = e[k][smallest];
+    }
+  }
+
+  /**
+   * @brief Scales the normal to unit length and flips it to point up (negative y in the optical frame).
+   * @returns false for a degenerate normal
+   */
+  bool normalize(Plane &plane)
+  {
+    const float length = std::sqrt(plane.a * plane.a + plane.b * plane.b + plane.c * plane.c);
+    if (length < 1e-6f)
+    {
+      return false;
+    }
+    const float sign = plane.b > 0.0f ? -1.0f : 1.0f;
+    plane.a *= sign / length;
+    plane.b *= sign / length;
+    plane.c *= sign / length;
+    plane.d *= sign / length;
+    return true;
+  }
+}
+
+const GroundFit &GroundPlaneEstimator::update(const uint16_t *depth, int width, int height, std::size_t stride,
+                                              float depth_units, const CameraIntrinsics &intrinsics)
+{
+  const auto start = std::chrono::steady_clock::now();
+  image_width_ = width;
+
+  /////
+  // Decimated cloud of the lower part of the frame. Capacity is kept between frames.
+  const int step = std::max(1, config_.step);
+  const int first_row = static_cast<int>(height * config_.roi_top);
+  const std::size_t capacity = static_cast<std::size_t>((height - first_row) / step + 1) * (width / step + 1);
+  x_.resize(capacity);
+  y_.resize(capacity);
+  z_.resize(capacity);
+  column_.resize(capacity);
+
+  const float max_raw = config_.max_range_m / depth_units;
+  const float inv_fx = 1.0f / intrinsics.fx;
+  const float inv_fy = 1.0f / intrinsics.fy;
+  std::size_t n = 0;
+  for (int v = first_row; v < height; v += step)
+  {
+    const uint16_t *row = reinterpret_cast<const uint16_t *>(reinterpret_cast<const uint8_t *>(depth) + v * stride);
+    const float ray_y = (v - intrinsics.cy) * inv_fy;
+    for (int u = 0; u < width; u += step)
+    {
+      const uint16_t raw = row[u];
+      if (raw == 0 || raw > max_raw)
+      {
+        continue;
+      }
+      const float z = raw * depth_units;
+      x_[n] = (u - intrinsics.cx) * inv_fx * z;
+      y_[n] = ray_y * z;
+      z_[n] = z;
+      column_[n] = static_cast<uint16_t>(u);
+      n++;
+    }
+  }
+  x_.resize(n);
+  y_.resize(n);
+  z_.resize(n);
+  column_.resize(n);
+
+  GroundFit result;
+  result.points = n;
+
+  /////
+  // Warm start from the previous plane, RANSAC when it no longer fits
+  Plane plane = last_valid_;
+  std::size_t inliers = has_last_valid_ ? countInliers(plane) : 0;
+  result.warm_started = has_last_valid_ && n > 0 && inliers >= config_.warm_inlier_fraction * n;
+  if (!result.warm_started && n >= 3)
+  {
+    for (int i = 0; i < config_.ransac_iterations; i++)
+    {
+      const std::size_t i0 = static_cast<std::size_t>(nextRandom() * n);
+      const std::size_t i1 = static_cast<std::size_t>(nextRandom() * n);
+      const std::size_t i2 = static_cast<std::size_t>(nextRandom() * n);
+      const float ux = x_[i1] - x_[i0], uy = y_[i1] - y_[i0], uz = z_[i1] - z_[i0];
+      const float vx = x_[i2] - x_[i0], vy = y_[i2] - y_[i0], vz = z_[i2] - z_[i0];
+      Plane candidate;
+      candidate.a = uy * vz - uz * vy;
+      candidate.b = uz * vx - ux * vz;
+      candidate.c = ux * vy - uy * vx;
+      candidate.d = 0.0f;
+      if (!normalize(candidate) || -candidate.b < config_.min_normal_up)
+      {
+        continue;
+      }
+      candidate.d = -(candidate.a * x_[i0] + candidate.b * y_[i0] + candidate.c * z_[i0]);
+      const std::size_t count = countInliers(candidate);
+      if (count > inliers)
+      {
+        inliers = count;
+        plane = candidate;
+      }
+    }
+  }
+
+  /////
+  // Least squares refinement on the inliers
+  if (n > 0 && inliers >= config_.min_inlier_fraction * n && refine(plane) && refine(plane))
+  {
+    inliers = countInliers(plane);
+    double sum_sq = 0.0;
+    for (std::size_t i = 0; i < n; i++)
+    {
+      const float h = plane.height(x_[i], y_[i], z_[i]);
+      sum_sq += std::fabs(h) < config_.inlier_distance_m ? h * h : 0.0f;
+    }
+    result.plane = plane;
+    result.inlier_fraction = static_cast<float>(inliers) / n;
+    result.rmse = inliers > 0 ? std::sqrt(sum_sq / inliers) : 0.0f;
+    result.valid = result.inlier_fraction >= config_.min_inlier_fraction;
+  }
+
+  if (result.valid)
+  {
+    if (has_last_valid_)
+    {
+      const float dot = plane.a * last_valid_.a + plane.b * last_valid_.b + plane.c * last_valid_.c;
+      result.normal_change_deg = std::acos(std::clamp(dot, -1.0f, 1.0f)) * RAD_TO_DEG;
+      result.offset_change_m = std::fabs(plane.d - last_valid_.d);
+    }
+    last_valid_ = plane;
+    has_last_valid_ = true;
+  }
+  else
+  {
+    result.plane = last_valid_;
+  }
+
+  result.fit_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  fit_ = result;
+  return fit_;
+}
+
+GroundClassification GroundPlaneEstimator::classify(float rock_height_m, float crater_depth_m) const
+{
+  GroundClassification counts;
+  const Plane &plane = fit_.plane;
+  const uint16_t split = static_cast<uint16_t>(image_width_ / 2);
+  for (std::size_t i = 0; i < x_.size(); i++)
+  {
+    const float h = plane.height(x_[i], y_[i], z_[i]);
+    const bool left = column_[i] < split;
+    const uint32_t rock = h > rock_height_m;
+    const uint32_t crater = h < -crater_depth_m;
+    counts.rocks_left += left ? rock : 0;
+    counts.rocks_right += left ? 0 : rock;
+    counts.craters_left += left ? crater : 0;
+    counts.craters_right += left ? 0 : crater;
+    counts.points_left += left;
+    counts.points_right += !left;
+  }
+  return counts;
+}
+
+std::size_t GroundPlaneEstimator::countInliers(const Plane &plane) const
+{
+  const float a = plane.a, b = plane.b, c = plane.c, d = plane.d;
+  const float t = config_.inlier_distance_m;
+  const std::size_t n = x_.size();
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < n; i++)
+  {
+    count += std::fabs(a * x_[i] + b * y_[i] + c * z_[i] + d) < t;
+  }
+  return count;
+}
+
+bool GroundPlaneEstimator::refine(Plane &plane)
+{
+  const float t = config_.inlier_distance_m;
+  double sx = 0, sy = 0, sz = 0;
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < x_.size(); i++)
+  {
+    if (std::fabs(plane.height(x_[i], y_[i], z_[i])) < t)
+    {
+      sx += x_[i];
+      sy += y_[i];
+      sz += z_[i];
+      count++;
+    }
+  }
+  if (count < 3)
+  {
+    return false;
+  }
+  const double mx = sx / count, my = sy / count, mz = sz / count;
+
+  double cov[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+  for (std::size_t i = 0; i < x_.size(); i++)
+  {
+    if (std::fabs(plane.height(x_[i], y_[i], z_[i])) < t)
+    {
+      const double dx = x_[i] - mx, dy = y_[i] - my, dz = z_[i] - mz;
+      cov[0][0] += dx * dx;
+      cov[0][1] += dx * dy;
+      cov[0][2] += dx * dz;
+      cov[1][1] += dy * dy;
+      cov[1][2] += dy * dz;
+      cov[2][2] += dz * dz;
+    }
+  }
+  cov[1][0] = cov[0][1];
+  cov[2][0] = cov[0][2];
+  cov[2][1] = cov[1][2];
+
+  double normal[3];
+  smallestEigenvector(cov, normal);
+  Plane refined;
+  refined.a = static_cast<float>(normal[0]);
+  refined.b = static_cast<float>(normal[1]);
+  refined.c = static_cast<float>(normal[2]);
+  refined.d = 0.0f;
+  if (!normalize(refined))
+  {
+    return false;
+  }
+  refined.d = -static_cast<float>(refined.a * mx + refined.b * my + refined.c * mz);
+  plane = refined;
+  return true;
+}
+
+float GroundPlaneEstimator::nextRandom()
+{
+  // xorshift32, deterministic so fits can be reproduced on recorded data
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 17;
+  rng_ ^= rng_ << 5;
+  return (rng_ >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,243 @@
+#include "vision_pkg/H264Encoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+extern "C"
+{
+#include <x264.h>
+}
+
+namespace
+{
+  // BT.601 limited range, the default of every H.264 decoder, in 8-bit fixed point
+  inline uint8_t lumaOf(int b, int g, int r)
+  {
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+  }
+
+  inline uint8_t blueDiffOf(int b, int g, int r)
+  {
+    return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+  }
+
+  inline uint8_t redDiffOf(int b, int g, int r)
+  {
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+  }
+}
+
+H264Encoder::H264Encoder(const Config &config) : config_(config)
+{
+}
+
+H264Encoder::~H264Encoder()
+{
+  close();
+}
+
+void H264Encoder::close()
+{
+  if (encoder_ != nullptr)
+  {
+    x264_encoder_close(static_cast<x264_t *>(encoder_));
+    encoder_ = nullptr;
+  }
+  delete static_cast<x264_param_t *>(params_);
+  params_ = nullptr;
+  width_ = 0;
+  height_ = 0;
+}
+
+bool H264Encoder::open(int width, int height)
+{
+  close();
+  auto *params = new x264_param_t;
+  params_ = params;
+  if (x264_param_default_preset(params, "ultrafast", "zerolatency") < 0)
+  {
+    last_error_ = "x264 has no ultrafast preset";
+    return false;
+  }
+  params->i_width = width;
+  params->i_height = height;
+  params->i_csp = X264_CSP_I420;
+  params->i_fps_num = std::max(1, config_.fps);
+  params->i_fps_den = 1;
+  params->i_keyint_max = std::max(1, config_.gop);
+  params->i_threads = std::max(1, config_.threads);
+  params->i_log_level = X264_LOG_NONE;
+  params->b_repeat_headers = 1; // SPS and PPS in front of every keyframe
+  params->b_annexb = 1;
+  params->rc.i_rc_method = X264_RC_ABR;
+  params->rc.i_bitrate = std::max(1, config_.bitrate_kbps);
+  params->rc.i_vbv_max_bitrate = params->rc.i_bitrate;
+  params->rc.i_vbv_buffer_size = params->rc.i_bitrate / 2; // Half a second, keyframes stay small
+  if (x264_param_apply_profile(params, "baseline") < 0)
+  {
+    last_error_ = "x264 cannot apply the baseline profile";
+    return false;
+  }
+
+  encoder_ = x264_encoder_open(params);
+  if (encoder_ == nullptr)
+  {
+    last_error_ = "x264_encoder_open failed for " + std::to_string(width) + "x" + std::to_string(height);
+    return false;
+  }
+  width_ = width;
+  height_ = height;
+  yuv_.resize(static_cast<std::size_t>(width) * height * 3 / 2);
+  codec_.clear();
+  return true;
+}
+
+void H264Encoder::setBitrate(int kbps)
+{
+  kbps = std::max(1, kbps);
+  if (kbps == config_.bitrate_kbps)
+  {
+    return;
+  }
+  config_.bitrate_kbps = kbps;
+  if (encoder_ != nullptr)
+  {
+    auto *params = static_cast<x264_param_t *>(params_);
+    params->rc.i_bitrate = kbps;
+    params->rc.i_vbv_max_bitrate = kbps;
+    params->rc.i_vbv_buffer_size = kbps / 2;
+    x264_encoder_reconfig(static_cast<x264_t *>(encoder_), params);
+  }
+}
+
+void H264Encoder::convert(const uint8_t *pixels, int pitch, JpegEncoder::PixelFormat format)
+{
+  const int chroma_width = width_ / 2;
+  uint8_t *y_plane = yuv_.data();
+  uint8_t *u_plane = y_plane + static_cast<std::size_t>(width_) * height_;
+  uint8_t *v_plane = u_plane + static_cast<std::size_t>(chroma_width) * (height_ / 2);
+
+  if (format == JpegEncoder::PixelFormat::GRAY)
+  {
+    // Full range gray to limited range luma, chroma stays neutral
+    for (int y = 0; y < height_; y++)
+    {
+      const uint8_t *src = pixels + static_cast<std::size_t>(y) * pitch;
+      uint8_t *dst = y_plane + static_cast<std::size_t>(y) * width_;
+      for (int x = 0; x < width_; x++)
+      {
+        dst[x] = static_cast<uint8_t>(((src[x] * 219 + 128) >> 8) + 16);
+      }
+    }
+    std::memset(u_plane, 128, static_cast<std::size_t>(chroma_width) * (height_ / 2) * 2);
+    return;
+  }
+
+  // Two rows at a time, chroma from the mean of each 2x2 block
+  for (int y = 0; y < height_; y += 2)
+  {
+    const uint8_t *top = pixels + static_cast<std::size_t>(y) * pitch;
+    const uint8_t *bottom = top + pitch;
+    uint8_t *y_top = y_plane + static_cast<std::size_t>(y) * width_;
+    uint8_t *y_bottom = y_top + width_;
+    uint8_t *u = u_plane + static_cast<std::size_t>(y / 2) * chroma_width;
+    uint8_t *v = v_plane + static_cast<std::size_t>(y / 2) * chroma_width;
+    for (int x = 0; x < width_; x += 2)
+    {
+      const uint8_t *p = top + x * 3;
+      const uint8_t *q = bottom + x * 3;
+      y_top[x] = lumaOf(p[0], p[1], p[2]);
+      y_top[x + 1] = lumaOf(p[3], p[4], p[5]);
+      y_bottom[x] = lumaOf(q[0], q[1], q[2]);
+      y_bottom[x + 1] = lumaOf(q[3], q[4], q[5]);
+      const int b = (p[0] + p[3] + q[0] + q[3] + 2) >> 2;
+      const int g = (p[1] + p[4] + q[1] + q[4] + 2) >> 2;
+      const int r = (p[2] + p[5] + q[2] + q[5] + 2) >> 2;
+      u[x / 2] = blueDiffOf(b, g, r);
+      v[x / 2] = redDiffOf(b, g, r);
+    }
+  }
+}
+
+void H264Encoder::readCodec(const std::vector<uint8_t> &access_unit)
+{
+  // profile_idc, constraint flags and level_idc follow the SPS NAL header
+  for (std::size_t i = 0; i + 6 < access_unit.size(); i++)
+  {
+    if (access_unit[i] == 0 && access_unit[i + 1] == 0 && access_unit[i + 2] == 1 && (access_unit[i + 3] & 0x1f) == 7)
+    {
+      char codec[16];
+      std::snprintf(codec, sizeof(codec), "avc1.%02x%02x%02x", access_unit[i + 4], access_unit[i + 5], access_unit[i + 6]);
+      codec_ = codec;
+      return;
+    }
+  }
+}
+
+bool H264Encoder::encode(const uint8_t *pixels, int width, int height, int pitch, JpegEncoder::PixelFormat format,
+                         std::vector<uint8_t> &out, bool &keyframe)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  width &= ~1;
+  height &= ~1;
+  if (width <= 0 || height <= 0)
+  {
+    last_error_ = "frame too small";
+    return false;
+  }
+  if (pitch == 0)
+  {
+    pitch = width * (format == JpegEncoder::PixelFormat::GRAY ? 1 : 3);
+  }
+  if ((width != width_ || height != height_) && !open(width, height))
+  {
+    close();
+    return false;
+  }
+  convert(pixels, pitch, format);
+
+  x264_picture_t in;
+  x264_picture_t coded;
+  x264_picture_init(&in);
+  in.img.i_csp = X264_CSP_I420;
+  in.img.i_plane = 3;
+  in.img.i_stride[0] = width_;
+  in.img.i_stride[1] = width_ / 2;
+  in.img.i_stride[2] = width_ / 2;
+  in.img.plane[0] = yuv_.data();
+  in.img.plane[1] = in.img.plane[0] + static_cast<std::size_t>(width_) * height_;
+  in.img.plane[2] = in.img.plane[1] + static_cast<std::size_t>(width_ / 2) * (height_ / 2);
+  in.i_pts = pts_++;
+  in.i_type = keyframe_requested_ ? X264_TYPE_IDR : X264_TYPE_AUTO;
+  keyframe_requested_ = false;
+
+  x264_nal_t *nals = nullptr;
+  int nal_count = 0;
+  const int size = x264_encoder_encode(static_cast<x264_t *>(encoder_), &nals, &nal_count, &in, &coded);
+  if (size < 0)
+  {
+    last_error_ = "x264_encoder_encode failed";
+    return false;
+  }
+  // The payloads of one call are contiguous, starting at the first NAL unit
+  if (size > 0 && nal_count > 0)
+  {
+    out.assign(nals[0].p_payload, nals[0].p_payload + size);
+  }
+  else
+  {
+    out.clear();
+  }
+  keyframe = coded.b_keyframe != 0;
+  if (keyframe)
+  {
+    readCodec(out);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  last_encode_ms_ = std::chrono::duration<double, std::milli>(end - start).count();
+  return true;
+}
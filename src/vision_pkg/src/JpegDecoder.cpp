@@ -0,0 +1,61 @@
+#include "vision_pkg/JpegDecoder.hpp"
+
+#include <stdexcept>
+
+#include <turbojpeg.h>
+
+JpegDecoder::JpegDecoder() : handle_(tjInitDecompress())
+{
+  if (handle_ == nullptr)
+  {
+    throw std::runtime_error(std::string("tjInitDecompress failed: ") + tjGetErrorStr2(nullptr));
+  }
+}
+
+JpegDecoder::~JpegDecoder()
+{
+  if (handle_ != nullptr)
+  {
+    tjDestroy(static_cast<tjhandle>(handle_));
+  }
+}
+
+bool JpegDecoder::decode(const uint8_t *jpeg, std::size_t size, int max_width, int max_height,
+                         std::vector<uint8_t> &bgr, int &width, int &height)
+{
+  auto handle = static_cast<tjhandle>(handle_);
+  int src_width = 0;
+  int src_height = 0;
+  int subsamp = 0;
+  int colorspace = 0;
+  if (tjDecompressHeader3(handle, jpeg, size, &src_width, &src_height, &subsamp, &colorspace) != 0)
+  {
+    last_error_ = tjGetErrorStr2(handle);
+    return false;
+  }
+
+  // Scaling factors are sorted from largest to smallest, take the first one that fits
+  width = src_width;
+  height = src_height;
+  int num_factors = 0;
+  const tjscalingfactor *factors = tjGetScalingFactors(&num_factors);
+  for (int i = 0; i < num_factors; i++)
+  {
+    const int w = TJSCALED(src_width, factors[i]);
+    const int h = TJSCALED(src_height, factors[i]);
+    if ((max_width <= 0 || w <= max_width) && (max_height <= 0 || h <= max_height))
+    {
+      width = w;
+      height = h;
+      break;
+    }
+  }
+
+  bgr.resize(static_cast<std::size_t>(width) * height * 3);
+  if (tjDecompress2(handle, jpeg, size, bgr.data(), width, 0, height, TJPF_BGR, TJFLAG_FASTDCT | TJFLAG_FASTUPSAMPLE) != 0)
+  {
+    last_error_ = tjGetErrorStr2(handle);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,85 @@
+#include "vision_pkg/JpegEncoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <turbojpeg.h>
+
+namespace
+{
+  int toTjSubsampling(JpegEncoder::Subsampling subsampling)
+  {
+    switch (subsampling)
+    {
+    case JpegEncoder::Subsampling::YUV444:
+      return TJSAMP_444;
+    case JpegEncoder::Subsampling::YUV422:
+      return TJSAMP_422;
+    case JpegEncoder::Subsampling::GRAY:
+      return TJSAMP_GRAY;
+    case JpegEncoder::Subsampling::YUV420:
+    default:
+      return TJSAMP_420;
+    }
+  }
+}
+
+JpegEncoder::JpegEncoder(int quality, Subsampling subsampling)
+    : handle_(tjInitCompress()), quality_(std::clamp(quality, 1, 100)), subsampling_(subsampling)
+{
+  if (handle_ == nullptr)
+  {
+    throw std::runtime_error(std::string("tjInitCompress failed: ") + tjGetErrorStr2(nullptr));
+  }
+}
+
+JpegEncoder::~JpegEncoder()
+{
+  if (handle_ != nullptr)
+  {
+    tjDestroy(static_cast<tjhandle>(handle_));
+  }
+}
+
+void JpegEncoder::setQuality(int quality)
+{
+  quality_ = std::clamp(quality, 1, 100);
+}
+
+bool JpegEncoder::encode(const uint8_t *pixels, int width, int height, int pitch, PixelFormat format, std::vector<uint8_t> &out)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  // A single-channel source can only produce a grayscale JPEG
+  const int tj_format = (format == PixelFormat::GRAY) ? TJPF_GRAY : TJPF_BGR;
+  const int tj_subsamp = (format == PixelFormat::GRAY) ? TJSAMP_GRAY : toTjSubsampling(subsampling_);
+
+  // Worst case size for this geometry. out is reserved to it once and TurboJPEG writes straight
+  // into it without reallocating; growing it back only fills the tail past the last frame's JPEG
+  const unsigned long max_size = tjBufSize(width, height, tj_subsamp);
+  if (out.capacity() < max_size)
+  {
+    out.reserve(max_size);
+  }
+  out.resize(max_size);
+
+  unsigned char *jpeg_buf = out.data();
+  unsigned long jpeg_size = max_size;
+  int result = tjCompress2(static_cast<tjhandle>(handle_), pixels, width, pitch, height, tj_format,
+                           &jpeg_buf, &jpeg_size, tj_subsamp, quality_,
+                           TJFLAG_NOREALLOC | TJFLAG_FASTDCT);
+  if (result != 0)
+  {
+    out.clear();
+    last_error_ = tjGetErrorStr2(static_cast<tjhandle>(handle_));
+    last_bytes_ = 0;
+    return false;
+  }
+
+  out.resize(jpeg_size); // Shrinks in place, the capacity stays for the next frame
+
+  last_bytes_ = jpeg_size;
+  last_encode_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
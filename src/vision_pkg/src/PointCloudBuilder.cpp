@@ -0,0 +1,132 @@
+#include "vision_pkg/PointCloudBuilder.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void PointCloudBuilder::setIntrinsics(int width, int height, const CameraIntrinsics &intrinsics)
+{
+  width_ = width;
+  height_ = height;
+  ray_x_.resize(static_cast<std::size_t>(width) * height);
+  ray_y_.resize(ray_x_.size());
+  row_x_.resize(width);
+  row_y_.resize(width);
+  row_z_.resize(width);
+  for (int v = 0; v < height; v++)
+  {
+    for (int u = 0; u < width; u++)
+    {
+      ray_x_[v * width + u] = (u - intrinsics.cx) / intrinsics.fx;
+      ray_y_[v * width + u] = (v - intrinsics.cy) / intrinsics.fy;
+    }
+  }
+
+  // Small enough to stay in cache. Once three quarters full, further voxels keep all their points.
+  std::size_t slots = 1;
+  while (slots < 2 * ray_x_.size() && slots < MAX_VOXEL_SLOTS)
+  {
+    slots <<= 1;
+  }
+  voxel_keys_.assign(slots, 0);
+  voxel_frames_.assign(slots, 0);
+  frame_ = 0;
+}
+
+void PointCloudBuilder::setVoxelSize(float voxel_size)
+{
+  voxel_size_ = std::max(0.0f, voxel_size);
+  inv_voxel_ = voxel_size_ > 0.0f ? 1.0f / voxel_size_ : 0.0f;
+}
+
+void PointCloudBuilder::setRange(float min_m, float max_m)
+{
+  min_range_ = min_m;
+  max_range_ = max_m;
+}
+
+bool PointCloudBuilder::firstInVoxel(float x, float y, float z)
+{
+  // 21 bits per axis, offset so that truncation rounds down like floor() within +-4096 voxels
+  const float offset = 4096.0f;
+  const uint64_t ix = static_cast<uint64_t>(x * inv_voxel_ + offset) & 0x1FFFFF;
+  const uint64_t iy = static_cast<uint64_t>(y * inv_voxel_ + offset) & 0x1FFFFF;
+  const uint64_t iz = static_cast<uint64_t>(z * inv_voxel_ + offset) & 0x1FFFFF;
+  const uint64_t key = (ix << 42) | (iy << 21) | iz;
+
+  // Neighboring pixels mostly land in the same voxel
+  if (key == last_key_)
+  {
+    return false;
+  }
+  last_key_ = key;
+
+  if (voxel_count_ >= voxel_keys_.size() * 3 / 4)
+  {
+    return true;
+  }
+  const std::size_t mask = voxel_keys_.size() - 1;
+  std::size_t slot = static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+  while (voxel_frames_[slot] == frame_)
+  {
+    if (voxel_keys_[slot] == key)
+    {
+      return false;
+    }
+    slot = (slot + 1) & mask;
+  }
+  voxel_frames_[slot] = frame_;
+  voxel_keys_[slot] = key;
+  voxel_count_++;
+  return true;
+}
+
+std::size_t PointCloudBuilder::build(const uint16_t *depth, std::size_t stride, float depth_units, uint8_t *out)
+{
+  if (++frame_ == 0) // Wrapped, forget every slot
+  {
+    std::fill(voxel_frames_.begin(), voxel_frames_.end(), 0);
+    frame_ = 1;
+  }
+  last_key_ = UINT64_MAX;
+  voxel_count_ = 0;
+
+  const uint16_t min_raw = static_cast<uint16_t>(std::clamp(min_range_ / depth_units, 1.0f, 65535.0f));
+  const uint16_t max_raw = static_cast<uint16_t>(std::clamp(max_range_ / depth_units, 1.0f, 65535.0f));
+  const bool voxels = voxel_size_ > 0.0f;
+  std::size_t count = 0;
+
+  for (int v = 0; v < height_; v++)
+  {
+    const uint16_t *row = reinterpret_cast<const uint16_t *>(reinterpret_cast<const uint8_t *>(depth) + v * stride);
+    const float *rx = ray_x_.data() + static_cast<std::size_t>(v) * width_;
+    const float *ry = ray_y_.data() + static_cast<std::size_t>(v) * width_;
+    float *px = row_x_.data();
+    float *py = row_y_.data();
+    float *pz = row_z_.data();
+
+    // Deproject the whole row, invalid pixels included, so the loop vectorizes
+    for (int u = 0; u < width_; u++)
+    {
+      const float z = row[u] * depth_units;
+      px[u] = rx[u] * z;
+      py[u] = ry[u] * z;
+      pz[u] = z;
+    }
+
+    for (int u = 0; u < width_; u++)
+    {
+      if (row[u] < min_raw || row[u] > max_raw)
+      {
+        continue;
+      }
+      if (voxels && !firstInVoxel(px[u], py[u], pz[u]))
+      {
+        continue;
+      }
+      const float point[3] = {px[u], py[u], pz[u]};
+      std::memcpy(out + count * POINT_STEP, point, POINT_STEP);
+      count++;
+    }
+  }
+  return count;
+}
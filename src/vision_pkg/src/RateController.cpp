@@ -0,0 +1,175 @@
+#include "vision_pkg/RateController.hpp"
+
+#include <algorithm>
+
+namespace
+{
+  const double SMOOTHING = 0.5;        // Weight of the newest measurement
+  const double OVER_BUDGET = 1.05;     // Step down above 105% of the allocation
+  const double STEP_UP_TARGET = 0.90;  // Step up if the predicted rate stays below 90% of the allocation
+  const double BACKOFF = 0.75;         // Budget multiplier while the client is congested
+  const double RECOVERY_PER_S = 0.10;  // Budget fraction recovered per second without congestion
+  const double MIN_BUDGET_FRACTION = 0.10;
+  const double BACKLOG_STALE_S = 3.0;  // A backlog report older than this no longer counts, the client went quiet
+  const int HOLD_UPDATES = 2;
+
+  /**
+   * @brief Rough relative bandwidth of a ladder step, used to predict the rate one step up.
+   *        JPEG size grows slower than linearly with quality in the range used here.
+   */
+  double relativeCost(const VideoRateSettings &step)
+  {
+    return step.fps * (step.quality + 20.0) / (step.scale * step.scale);
+  }
+}
+
+const std::vector<VideoRateSettings> &VideoRateController::ladder()
+{
+  static const std::vector<VideoRateSettings> steps = {
+      {60, 15.0, 1},
+      {50, 15.0, 1},
+      {40, 15.0, 1},
+      {30, 15.0, 1},
+      {30, 10.0, 1},
+      {25, 10.0, 2},
+      {25, 7.0, 2},
+      {20, 5.0, 2},
+      {20, 2.0, 2},
+  };
+  return steps;
+}
+
+VideoRateController::VideoRateController(std::size_t stream_count, double budget_bytes_per_second, double priority_share)
+    : streams_(stream_count), budget_(budget_bytes_per_second), effective_budget_(budget_bytes_per_second),
+      priority_share_(std::clamp(priority_share, 0.0, 1.0))
+{
+}
+
+void VideoRateController::setBudget(double budget_bytes_per_second)
+{
+  budget_ = budget_bytes_per_second;
+  effective_budget_ = std::min(effective_budget_, budget_);
+}
+
+void VideoRateController::setPriorityStream(const std::string &name)
+{
+  priority_ = -1;
+  for (std::size_t i = 0; i < streams_.size(); i++)
+  {
+    if (streams_[i].name == name)
+    {
+      priority_ = static_cast<int>(i);
+    }
+  }
+}
+
+void VideoRateController::onFrame(std::size_t id, std::size_t bytes)
+{
+  streams_[id].window_bytes += bytes;
+  streams_[id].window_frames++;
+}
+
+void VideoRateController::allocate()
+{
+  int active = 0;
+  for (const auto &s : streams_)
+  {
+    active += s.active ? 1 : 0;
+  }
+  if (active == 0)
+  {
+    return;
+  }
+
+  const bool priority_active = priority_ >= 0 && streams_[priority_].active;
+  for (std::size_t i = 0; i < streams_.size(); i++)
+  {
+    auto &s = streams_[i];
+    if (!s.active)
+    {
+      s.allocation = 0.0;
+    }
+    else if (!priority_active || active == 1)
+    {
+      s.allocation = effective_budget_ / active;
+    }
+    else if (static_cast<int>(i) == priority_)
+    {
+      s.allocation = effective_budget_ * priority_share_;
+    }
+    else
+    {
+      s.allocation = effective_budget_ * (1.0 - priority_share_) / (active - 1);
+    }
+  }
+}
+
+void VideoRateController::update(double dt_seconds)
+{
+  if (dt_seconds <= 0.0)
+  {
+    return;
+  }
+
+  // A client that stops reporting, e.g. a closed page, does not hold the budget down
+  backlog_age_s_ += dt_seconds;
+  if (backlog_age_s_ > BACKLOG_STALE_S)
+  {
+    backlog_s_ = 0.0;
+  }
+
+  // AIMD on the budget, driven by the client backlog
+  if (backlog_s_ > CONGESTED_BACKLOG_S)
+  {
+    effective_budget_ = std::max(effective_budget_ * BACKOFF, budget_ * MIN_BUDGET_FRACTION);
+  }
+  else
+  {
+    effective_budget_ = std::min(effective_budget_ + budget_ * RECOVERY_PER_S * dt_seconds, budget_);
+  }
+  allocate();
+
+  const int last_level = static_cast<int>(ladder().size()) - 1;
+  for (std::size_t i = 0; i < streams_.size(); i++)
+  {
+    auto &s = streams_[i];
+    const double rate = s.window_bytes / dt_seconds;
+    s.bytes_per_second = SMOOTHING * rate + (1.0 - SMOOTHING) * s.bytes_per_second;
+    s.frames_per_second = SMOOTHING * (s.window_frames / dt_seconds) + (1.0 - SMOOTHING) * s.frames_per_second;
+    s.window_bytes = 0;
+    s.window_frames = 0;
+
+    if (!s.active)
+    {
+      continue;
+    }
+
+    const int max_level = isPriority(i) ? PRIORITY_MAX_LEVEL : last_level;
+    if (s.level > max_level)
+    {
+      s.level = max_level;
+      s.hold = HOLD_UPDATES;
+      continue;
+    }
+    if (s.hold > 0)
+    {
+      s.hold--;
+      continue;
+    }
+
+    if (s.bytes_per_second > s.allocation * OVER_BUDGET && s.level < max_level)
+    {
+      s.level++;
+      s.hold = HOLD_UPDATES;
+    }
+    else if (s.level > 0)
+    {
+      const double predicted = s.bytes_per_second * relativeCost(ladder()[s.level - 1]) / relativeCost(ladder()[s.level]);
+      if (predicted < s.allocation * STEP_UP_TARGET)
+      {
+        s.level--;
+        s.hold = HOLD_UPDATES;
+      }
+    }
+  }
+}
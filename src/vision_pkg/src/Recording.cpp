@@ -0,0 +1,395 @@
+#include "vision_pkg/Recording.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const char FILE_MAGIC[8] = {'V', 'I', 'S', 'R', 'E', 'C', '0', '1'};
+const char INDEX_MAGIC[8] = {'V', 'I', 'S', 'I', 'D', 'X', '0', '1'};
+const uint32_t RECORD_MAGIC = 0x44524352; // "RCRD"
+const uint32_t VERSION = 1;
+
+static_assert(sizeof(RecordingHeader) <= RECORDING_DATA_OFFSET, "Header must fit before the records");
+static_assert(sizeof(RecordHeader) <= RECORDING_ALIGN, "Record header must fit in its alignment");
+
+uint64_t align(uint64_t offset)
+{
+  return (offset + RECORDING_ALIGN - 1) & ~static_cast<uint64_t>(RECORDING_ALIGN - 1);
+}
+} // namespace
+
+RecordingWriter::RecordingWriter(const Config &config) : config_(config)
+{
+}
+
+RecordingWriter::~RecordingWriter()
+{
+  close();
+}
+
+bool RecordingWriter::open(const std::string &path)
+{
+  close();
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+  {
+    error_ = "open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  header_ = RecordingHeader{};
+  std::memcpy(header_.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+  header_.version = VERSION;
+  header_.stream_count = RECORDING_MAX_STREAMS;
+  header_dirty_ = false;
+  offset_ = RECORDING_DATA_OFFSET;
+  index_.clear();
+  written_ = 0;
+  bytes_ = 0;
+  dropped_ = 0;
+  error_.clear();
+  stop_ = false;
+
+  // The records start after a full page, the header is rewritten in place as streams appear
+  std::vector<uint8_t> page(RECORDING_DATA_OFFSET, 0);
+  std::memcpy(page.data(), &header_, sizeof(header_));
+  if (!writeAll(page.data(), page.size()))
+  {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  thread_ = std::thread(&RecordingWriter::run, this);
+  return true;
+}
+
+void RecordingWriter::close()
+{
+  if (fd_ < 0)
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  thread_.join();
+
+  // The writer thread has finished, everything below is single threaded
+  if (error_.empty())
+  {
+    RecordingFooter footer{offset_, index_.size(), {}};
+    std::memcpy(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    if (writeAll(index_.data(), index_.size() * sizeof(RecordingIndexEntry)))
+    {
+      writeAll(&footer, sizeof(footer));
+    }
+  }
+  if (::pwrite(fd_, &header_, sizeof(header_), 0) != static_cast<ssize_t>(sizeof(header_)) && error_.empty())
+  {
+    error_ = std::string("write header: ") + std::strerror(errno);
+  }
+  ::close(fd_);
+  fd_ = -1;
+  queue_.clear();
+  spare_.clear();
+  queued_bytes_ = 0;
+}
+
+void RecordingWriter::describe(uint16_t stream, const RecordingStream &description)
+{
+  if (stream >= RECORDING_MAX_STREAMS)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  header_.streams[stream] = description;
+  header_.streams[stream].name[sizeof(description.name) - 1] = '\0';
+  header_dirty_ = true;
+  wake_.notify_one();
+}
+
+bool RecordingWriter::described(uint16_t stream) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stream < RECORDING_MAX_STREAMS && header_.streams[stream].kind != RecordKind::NONE;
+}
+
+bool RecordingWriter::write(uint16_t stream, uint64_t sequence, int64_t device_ns, int64_t host_ns,
+                            const void *data, std::size_t size, uint32_t width, uint32_t height, uint32_t stride)
+{
+  if (fd_ < 0 || stream >= RECORDING_MAX_STREAMS || size > UINT32_MAX)
+  {
+    return false;
+  }
+
+  std::vector<uint8_t> payload;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_.empty() || queued_bytes_ + size > config_.max_queued_bytes)
+    {
+      dropped_++;
+      return false;
+    }
+    queued_bytes_ += size;
+    if (!spare_.empty())
+    {
+      payload = std::move(spare_.back());
+      spare_.pop_back();
+    }
+  }
+
+  // Copied outside the lock, the writer thread may be busy with the previous frame
+  payload.resize(size);
+  std::memcpy(payload.data(), data, size);
+
+  Job job;
+  job.header = RecordHeader{RECORD_MAGIC, stream, 0, static_cast<uint32_t>(size), stride, width, height,
+                            sequence, device_ns, host_ns};
+  job.payload = std::move(payload);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(job));
+  }
+  wake_.notify_one();
+  return true;
+}
+
+void RecordingWriter::run()
+{
+  std::vector<uint8_t> padding(RECORDING_ALIGN, 0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    wake_.wait(lock, [this] { return stop_ || header_dirty_ || !queue_.empty(); });
+
+    if (header_dirty_)
+    {
+      const RecordingHeader header = header_;
+      header_dirty_ = false;
+      lock.unlock();
+      const bool ok = ::pwrite(fd_, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+      lock.lock();
+      if (!ok && error_.empty())
+      {
+        error_ = std::string("write header: ") + std::strerror(errno);
+      }
+    }
+
+    if (queue_.empty())
+    {
+      if (stop_)
+      {
+        return;
+      }
+      continue;
+    }
+
+    Job job = std::move(queue_.front());
+    queue_.pop_front();
+    const bool failed = !error_.empty();
+    lock.unlock();
+
+    // Header padded to the alignment, then the payload padded to the next record
+    bool ok = true;
+    if (!failed)
+    {
+      RecordingIndexEntry entry{offset_, job.header.host_ns, job.header.stream, {}};
+      std::memcpy(padding.data(), &job.header, sizeof(job.header));
+      std::memset(padding.data() + sizeof(job.header), 0, RECORDING_ALIGN - sizeof(job.header));
+      const uint64_t end = align(offset_ + RECORDING_ALIGN + job.payload.size());
+      ok = writeAll(padding.data(), RECORDING_ALIGN) && writeAll(job.payload.data(), job.payload.size());
+      if (ok)
+      {
+        std::memset(padding.data(), 0, RECORDING_ALIGN);
+        ok = writeAll(padding.data(), end - (offset_ + RECORDING_ALIGN + job.payload.size()));
+      }
+      if (ok)
+      {
+        offset_ = end;
+        index_.push_back(entry);
+      }
+    }
+
+    lock.lock();
+    queued_bytes_ -= job.payload.size();
+    if (ok && !failed)
+    {
+      written_++;
+      bytes_ = offset_;
+    }
+    if (!ok && error_.empty())
+    {
+      error_ = std::string("write record: ") + std::strerror(errno);
+    }
+    if (spare_.size() < 8)
+    {
+      spare_.push_back(std::move(job.payload));
+    }
+  }
+}
+
+bool RecordingWriter::writeAll(const void *data, std::size_t size)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  while (size > 0)
+  {
+    const ssize_t n = ::write(fd_, bytes, size);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    bytes += n;
+    size -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+uint64_t RecordingWriter::written() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return written_;
+}
+
+uint64_t RecordingWriter::dropped() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_;
+}
+
+uint64_t RecordingWriter::bytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+std::string RecordingWriter::lastError() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return error_;
+}
+
+RecordingReader::~RecordingReader()
+{
+  close();
+}
+
+bool RecordingReader::fail(const std::string &what)
+{
+  error_ = what;
+  close();
+  return false;
+}
+
+bool RecordingReader::open(const std::string &path)
+{
+  close();
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return fail("open " + path + ": " + std::strerror(errno));
+  }
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < RECORDING_DATA_OFFSET)
+  {
+    ::close(fd);
+    return fail(path + " is not a recording");
+  }
+  length_ = static_cast<std::size_t>(info.st_size);
+  void *mapping = ::mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    length_ = 0;
+    return fail(std::string("mmap: ") + std::strerror(errno));
+  }
+  data_ = static_cast<const uint8_t *>(mapping);
+  // Replay and benchmarks walk the file front to back
+  ::madvise(mapping, length_, MADV_SEQUENTIAL);
+
+  header_ = reinterpret_cast<const RecordingHeader *>(data_);
+  if (std::memcmp(header_->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header_->version != VERSION)
+  {
+    return fail(path + " is not a recording");
+  }
+
+  RecordingFooter footer{};
+  if (length_ >= RECORDING_DATA_OFFSET + sizeof(footer))
+  {
+    std::memcpy(&footer, data_ + length_ - sizeof(footer), sizeof(footer));
+  }
+  if (std::memcmp(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 && footer.index_offset >= RECORDING_DATA_OFFSET &&
+      footer.index_offset + footer.count * sizeof(RecordingIndexEntry) + sizeof(footer) == length_)
+  {
+    index_.resize(footer.count);
+    std::memcpy(index_.data(), data_ + footer.index_offset, footer.count * sizeof(RecordingIndexEntry));
+    return true;
+  }
+
+  // No footer: the recording was cut short, keep every complete record
+  recovered_ = true;
+  uint64_t offset = RECORDING_DATA_OFFSET;
+  while (offset + RECORDING_ALIGN <= length_)
+  {
+    RecordHeader record;
+    std::memcpy(&record, data_ + offset, sizeof(record));
+    if (record.magic != RECORD_MAGIC || record.stream >= RECORDING_MAX_STREAMS ||
+        offset + RECORDING_ALIGN + record.size > length_)
+    {
+      break;
+    }
+    index_.push_back({offset, record.host_ns, record.stream, {}});
+    offset = align(offset + RECORDING_ALIGN + record.size);
+  }
+  return true;
+}
+
+void RecordingReader::close()
+{
+  if (data_ != nullptr)
+  {
+    ::munmap(const_cast<uint8_t *>(data_), length_);
+  }
+  data_ = nullptr;
+  length_ = 0;
+  header_ = nullptr;
+  index_.clear();
+  recovered_ = false;
+}
+
+RecordView RecordingReader::record(std::size_t i) const
+{
+  RecordHeader header;
+  std::memcpy(&header, data_ + index_[i].offset, sizeof(header));
+
+  RecordView view;
+  view.stream = header.stream;
+  view.width = header.width;
+  view.height = header.height;
+  view.stride = header.stride;
+  view.size = header.size;
+  view.sequence = header.sequence;
+  view.device_ns = header.device_ns;
+  view.host_ns = header.host_ns;
+  view.data = data_ + index_[i].offset + RECORDING_ALIGN;
+  return view;
+}
+
+std::size_t RecordingReader::seek(int64_t host_ns) const
+{
+  const auto it = std::lower_bound(index_.begin(), index_.end(), host_ns,
+                                   [](const RecordingIndexEntry &entry, int64_t t) { return entry.host_ns < t; });
+  return static_cast<std::size_t>(it - index_.begin());
+}
@@ -0,0 +1,277 @@
+#include "vision_pkg/RecordingPlayer.hpp"
+
+#include <algorithm>
+
+namespace
+{
+/**
+ * @class RecordingMjpegSource
+ * @brief Serves the newest due image of a recorded MJPEG stream.
+ */
+class RecordingMjpegSource : public MjpegSource
+{
+public:
+  RecordingMjpegSource(const RecordingPlayer &player, std::size_t stream) : player_(player), stream_(stream)
+  {
+  }
+
+  bool open(const std::string &, int, int, int) override
+  {
+    const RecordingStream &description = player_.reader().stream(stream_);
+    width_ = static_cast<int>(description.width);
+    height_ = static_cast<int>(description.height);
+    opened_ = true;
+    return true;
+  }
+
+  bool grab(MjpegFrame &frame, int) override
+  {
+    return opened_ && player_.nextMjpeg(stream_, last_, frame);
+  }
+
+  void release(const MjpegFrame &) override {}
+  void close() override { opened_ = false; }
+  bool isOpened() const override { return opened_; }
+
+private:
+  const RecordingPlayer &player_;
+  std::size_t stream_;
+  std::size_t last_ = SIZE_MAX;
+  bool opened_ = false;
+};
+} // namespace
+
+RecordingPlayer::RecordingPlayer(const Config &config) : config_(config)
+{
+  config_.rate = std::max(config_.rate, 0.01);
+}
+
+RecordingPlayer::~RecordingPlayer()
+{
+  // Stop the sensors before the mapping goes away
+  for (auto &camera : cameras_)
+  {
+    for (auto &sensor : camera->sensors)
+    {
+      try
+      {
+        sensor.stop();
+        sensor.close();
+      }
+      catch (const rs2::error &)
+      {
+      }
+    }
+  }
+  cameras_.clear();
+}
+
+RecordingPlayer::Camera &RecordingPlayer::camera(std::size_t id)
+{
+  for (auto &camera : cameras_)
+  {
+    if (camera->id == id)
+    {
+      return *camera;
+    }
+  }
+  cameras_.push_back(std::make_unique<Camera>());
+  cameras_.back()->id = id;
+  return *cameras_.back();
+}
+
+bool RecordingPlayer::open(const std::string &path)
+{
+  if (!reader_.open(path))
+  {
+    error_ = reader_.lastError();
+    return false;
+  }
+
+  try
+  {
+    for (std::size_t id = 0; id < RECORDING_MAX_STREAMS; id++)
+    {
+      const RecordingStream &description = reader_.stream(id);
+      Stream &stream = streams_[id];
+      stream.kind = description.kind;
+      if (description.kind != RecordKind::COLOR_BGR8 && description.kind != RecordKind::DEPTH_Z16)
+      {
+        continue;
+      }
+
+      const bool depth = description.kind == RecordKind::DEPTH_Z16;
+      Camera &owner = camera(description.camera);
+      rs2::software_sensor sensor = owner.device.add_sensor(description.name);
+
+      rs2_video_stream video{};
+      video.type = depth ? RS2_STREAM_DEPTH : RS2_STREAM_COLOR;
+      video.index = 0;
+      video.uid = static_cast<int>(id);
+      video.width = static_cast<int>(description.width);
+      video.height = static_cast<int>(description.height);
+      video.fps = static_cast<int>(description.fps);
+      video.bpp = depth ? 2 : 3;
+      video.fmt = depth ? RS2_FORMAT_Z16 : RS2_FORMAT_BGR8;
+      video.intrinsics = {video.width, video.height, description.intrinsics.cx, description.intrinsics.cy,
+                          description.intrinsics.fx, description.intrinsics.fy, RS2_DISTORTION_BROWN_CONRADY, {0, 0, 0, 0, 0}};
+      stream.profile = sensor.add_video_stream(video, true);
+      if (depth)
+      {
+        sensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, description.depth_units);
+      }
+      stream.camera = &owner;
+      stream.sensor = owner.sensors.size();
+      owner.sensors.push_back(sensor);
+    }
+
+    for (auto &owner : cameras_)
+    {
+      // The depth to color extrinsics are what visual odometry and the fiducials use
+      for (std::size_t id = 0; id < RECORDING_MAX_STREAMS; id++)
+      {
+        if (streams_[id].camera != owner.get() || streams_[id].kind != RecordKind::DEPTH_Z16)
+        {
+          continue;
+        }
+        for (const Stream &color : streams_)
+        {
+          if (color.camera == owner.get() && color.kind == RecordKind::COLOR_BGR8)
+          {
+            rs2_extrinsics extrinsics;
+            std::copy(reader_.stream(id).to_color, reader_.stream(id).to_color + 9, extrinsics.rotation);
+            std::copy(reader_.stream(id).to_color + 9, reader_.stream(id).to_color + 12, extrinsics.translation);
+            streams_[id].profile.register_extrinsics_to(color.profile, extrinsics);
+          }
+        }
+      }
+
+      owner->device.create_matcher(RS2_MATCHER_DLR_C);
+      for (std::size_t id = 0; id < RECORDING_MAX_STREAMS; id++)
+      {
+        if (streams_[id].camera == owner.get())
+        {
+          owner->sensors[streams_[id].sensor].open(streams_[id].profile);
+        }
+      }
+      for (auto &sensor : owner->sensors)
+      {
+        sensor.start(owner->syncer);
+      }
+    }
+  }
+  catch (const rs2::error &e)
+  {
+    error_ = std::string("Cannot set up the replay devices: ") + e.what();
+    return false;
+  }
+  return true;
+}
+
+void RecordingPlayer::advance()
+{
+  if (reader_.size() == 0 || finished_)
+  {
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  if (!started_)
+  {
+    start_ = now;
+    cursor_ = 0;
+    started_ = true;
+  }
+
+  const int64_t elapsed_ns = static_cast<int64_t>(std::chrono::duration<double, std::nano>(now - start_).count() * config_.rate);
+  const int64_t due_ns = reader_.startNs() + elapsed_ns;
+  for (; cursor_ < reader_.size(); cursor_++)
+  {
+    const RecordView view = reader_.record(cursor_);
+    if (view.host_ns > due_ns)
+    {
+      return;
+    }
+    inject(cursor_);
+  }
+
+  if (!config_.loop)
+  {
+    finished_ = true;
+    return;
+  }
+  // One frame period between the end and the restart, so the timestamps keep increasing
+  loop_ns_ += reader_.endNs() - reader_.startNs() + 66000000;
+  loop_frames_ += reader_.size();
+  started_ = false;
+}
+
+void RecordingPlayer::inject(std::size_t index)
+{
+  const RecordView view = reader_.record(index);
+  Stream &stream = streams_[view.stream];
+  if (stream.kind == RecordKind::MJPEG)
+  {
+    stream.latest = index;
+    return;
+  }
+  if (stream.camera == nullptr)
+  {
+    return; // Motion, or a stream the player could not set up
+  }
+
+  rs2_software_video_frame frame{};
+  frame.pixels = const_cast<uint8_t *>(view.data); // Read only mapping, the filters never write in place
+  frame.deleter = [](void *) {};
+  frame.stride = static_cast<int>(view.stride);
+  frame.bpp = stream.kind == RecordKind::DEPTH_Z16 ? 2 : 3;
+  frame.timestamp = static_cast<double>(view.device_ns + loop_ns_) * 1e-6;
+  frame.domain = RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK;
+  frame.frame_number = static_cast<int>(view.sequence + loop_frames_);
+  frame.profile = stream.profile.get();
+  stream.camera->sensors[stream.sensor].on_video_frame(frame);
+}
+
+bool RecordingPlayer::pollFrames(std::size_t camera, rs2::frameset &frames)
+{
+  for (auto &owner : cameras_)
+  {
+    if (owner->id == camera)
+    {
+      return owner->syncer.poll_for_frames(&frames);
+    }
+  }
+  return false;
+}
+
+bool RecordingPlayer::hasStream(std::size_t stream) const
+{
+  return stream < RECORDING_MAX_STREAMS && streams_[stream].kind != RecordKind::NONE;
+}
+
+std::unique_ptr<MjpegSource> RecordingPlayer::mjpegSource(std::size_t stream)
+{
+  if (stream >= RECORDING_MAX_STREAMS || streams_[stream].kind != RecordKind::MJPEG)
+  {
+    return nullptr;
+  }
+  auto source = std::make_unique<RecordingMjpegSource>(*this, stream);
+  source->open("", 0, 0, 0);
+  return source;
+}
+
+bool RecordingPlayer::nextMjpeg(std::size_t stream, std::size_t &last, MjpegFrame &frame) const
+{
+  const std::size_t latest = streams_[stream].latest;
+  if (latest == SIZE_MAX || latest == last)
+  {
+    return false;
+  }
+  last = latest;
+  const RecordView view = reader_.record(latest);
+  frame.data = view.data;
+  frame.size = view.size;
+  frame.sequence = static_cast<uint32_t>(view.sequence);
+  frame.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()); // Replayed frames arrive now
+  frame.index = -1;
+  return true;
+}
@@ -0,0 +1,169 @@
+#include "vision_pkg/SyntheticDepth.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace
+{
+float dot(const float *a, const float *b)
+{
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/**
+ * @brief Sphere of a cap or bowl whose rim is a circle of the given radius, sagging or rising by height.
+ */
+float sphereRadius(float radius, float height)
+{
+  return (radius * radius + height * height) / (2.0f * height);
+}
+
+/**
+ * @brief Intersects the ray origin + t * dir with a sphere.
+ * @returns false if the ray misses it
+ */
+bool intersect(const float *origin, const float *dir, const float *center, float radius, float &near, float &far)
+{
+  const float o[3] = {origin[0] - center[0], origin[1] - center[1], origin[2] - center[2]};
+  const float a = dot(dir, dir);
+  const float b = dot(dir, o);
+  const float c = dot(o, o) - radius * radius;
+  const float disc = b * b - a * c;
+  if (disc < 0.0f)
+  {
+    return false;
+  }
+  const float root = std::sqrt(disc);
+  near = (-b - root) / a;
+  far = (-b + root) / a;
+  return true;
+}
+} // namespace
+
+SyntheticDepthScene::SyntheticDepthScene(const Config &config) : config_(config)
+{
+  const float sp = std::sin(config_.pitch_rad), cp = std::cos(config_.pitch_rad);
+  const float ss = std::sin(config_.slope_rad), cs = std::cos(config_.slope_rad);
+  const float axes[9] = {1.0f, 0.0f, 0.0f,  // Optical x: right
+                         0.0f, -sp, -cp,    // Optical y: down, tilted with the camera
+                         0.0f, cp, -sp};    // Optical z: ahead and down
+  std::copy(axes, axes + 9, axes_);
+  normal_[0] = 0.0f;
+  normal_[1] = -ss;
+  normal_[2] = cs;
+}
+
+void SyntheticDepthScene::addRock(float x, float y, float radius, float height)
+{
+  features_.push_back({TerrainFeature::ROCK, x, y, radius, height});
+}
+
+void SyntheticDepthScene::addCrater(float x, float y, float radius, float depth)
+{
+  features_.push_back({TerrainFeature::CRATER, x, y, radius, depth});
+}
+
+Plane SyntheticDepthScene::groundPlane() const
+{
+  // Height above the ground of an optical point p is normal . (camera + axes * p)
+  Plane plane;
+  plane.a = dot(normal_, axes_);
+  plane.b = dot(normal_, axes_ + 3);
+  plane.c = dot(normal_, axes_ + 6);
+  plane.d = normal_[2] * config_.camera_height_m;
+  return plane;
+}
+
+float SyntheticDepthScene::cast(float dx, float dy) const
+{
+  const float origin[3] = {0.0f, 0.0f, config_.camera_height_m};
+  float dir[3];
+  for (int i = 0; i < 3; i++)
+  {
+    dir[i] = dx * axes_[i] + dy * axes_[3 + i] + axes_[6 + i];
+  }
+  const float slope = std::tan(config_.slope_rad);
+  float best = std::numeric_limits<float>::infinity();
+
+  // Ground, or the bottom of a crater the ground hit falls into
+  const float descent = dot(normal_, dir);
+  if (descent < 0.0f)
+  {
+    float t = -dot(normal_, origin) / descent;
+    const float hit_x = origin[0] + t * dir[0];
+    const float hit_y = origin[1] + t * dir[1];
+    for (const TerrainFeature &f : features_)
+    {
+      const float dxf = hit_x - f.x, dyf = hit_y - f.y;
+      if (f.type != TerrainFeature::CRATER || dxf * dxf + dyf * dyf >= f.radius * f.radius)
+      {
+        continue;
+      }
+      const float radius = sphereRadius(f.radius, f.height);
+      const float center[3] = {f.x, f.y, f.y * slope + radius - f.height};
+      float near = 0.0f, far = 0.0f;
+      if (intersect(origin, dir, center, radius, near, far))
+      {
+        t = std::max(t, far); // Inside the bowl the ray leaves the sphere through its bottom
+      }
+    }
+    best = t;
+  }
+
+  // Rocks in front of the ground
+  for (const TerrainFeature &f : features_)
+  {
+    if (f.type != TerrainFeature::ROCK)
+    {
+      continue;
+    }
+    const float radius = sphereRadius(f.radius, f.height);
+    const float center[3] = {f.x, f.y, f.y * slope - (radius - f.height)};
+    float near = 0.0f, far = 0.0f;
+    if (!intersect(origin, dir, center, radius, near, far) || near <= 0.0f || near >= best)
+    {
+      continue;
+    }
+    const float hit[3] = {origin[0] + near * dir[0], origin[1] + near * dir[1], origin[2] + near * dir[2]};
+    if (dot(normal_, hit) >= 0.0f)
+    {
+      best = near; // Only the cap above the ground exists
+    }
+  }
+
+  // dir has a unit optical z, so t is the depth
+  return std::isfinite(best) ? best : 0.0f;
+}
+
+void SyntheticDepthScene::render(std::vector<uint16_t> &depth, uint32_t seed) const
+{
+  const int width = config_.width;
+  const int height = config_.height;
+  const CameraIntrinsics &k = config_.intrinsics;
+  const float noise_gain = config_.subpixel / (k.fx * config_.baseline_m);
+  const float max_units = static_cast<float>(std::numeric_limits<uint16_t>::max());
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+  depth.resize(static_cast<std::size_t>(width) * height);
+  for (int v = 0; v < height; v++)
+  {
+    const float dy = (v - k.cy) / k.fy;
+    uint16_t *row = depth.data() + static_cast<std::size_t>(v) * width;
+    for (int u = 0; u < width; u++)
+    {
+      float z = cast((u - k.cx) / k.fx, dy);
+      if (z <= 0.0f || z > config_.max_range_m || uniform(rng) < config_.dropout)
+      {
+        row[u] = 0;
+        continue;
+      }
+      z += noise(rng) * z * z * noise_gain;
+      row[u] = static_cast<uint16_t>(std::clamp(std::round(z / config_.depth_units), 1.0f, max_units));
+    }
+  }
+}
@@ -0,0 +1,75 @@
+#include "vision_pkg/ThreadPool.hpp"
+
+ThreadPool::ThreadPool(std::size_t threads)
+{
+  for (std::size_t i = 1; i < threads; i++)
+  {
+    workers_.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker : workers_)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(std::size_t count, const std::function<void(std::size_t)> &task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    next_ = 0;
+    finished_ = 0;
+    run_id_++;
+  }
+  wake_.notify_all();
+  drain();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return finished_ == count_; });
+  task_ = nullptr;
+}
+
+void ThreadPool::drain()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (task_ != nullptr && next_ < count_)
+  {
+    const std::size_t index = next_++;
+    const auto *task = task_;
+    lock.unlock();
+    (*task)(index);
+    lock.lock();
+    if (++finished_ == count_)
+    {
+      done_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::work()
+{
+  uint64_t seen = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stop_ || run_id_ != seen; });
+      if (stop_)
+      {
+        return;
+      }
+      seen = run_id_;
+    }
+    drain();
+  }
+}
@@ -0,0 +1,349 @@
+#include "vision_pkg/V4L2Capture.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+namespace
+{
+  /**
+   * @brief ioctl wrapper retrying when interrupted by a signal.
+   */
+  int xioctl(int fd, unsigned long request, void *arg)
+  {
+    int result;
+    do
+    {
+      result = ioctl(fd, request, arg);
+    } while (result == -1 && errno == EINTR);
+    return result;
+  }
+
+  bool endsWith(const std::string &value, const std::string &suffix)
+  {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  /**
+   * @brief Reads the image size from the first SOF marker of a JPEG image.
+   * @returns false if no SOF marker is found
+   */
+  bool jpegSize(const uint8_t *data, std::size_t size, int &width, int &height)
+  {
+    std::size_t i = 2; // Skip SOI
+    while (i + 9 < size)
+    {
+      if (data[i] != 0xFF)
+      {
+        return false;
+      }
+      const uint8_t marker = data[i + 1];
+      const std::size_t length = (static_cast<std::size_t>(data[i + 2]) << 8) | data[i + 3];
+      if (marker >= 0xC0 && marker <= 0xC3)
+      {
+        height = (data[i + 5] << 8) | data[i + 6];
+        width = (data[i + 7] << 8) | data[i + 8];
+        return true;
+      }
+      i += 2 + length;
+    }
+    return false;
+  }
+}
+
+std::unique_ptr<MjpegSource> MjpegSource::create(const std::string &path)
+{
+  if (endsWith(path, ".mjpeg") || endsWith(path, ".mjpg"))
+  {
+    return std::make_unique<MjpegFileCapture>();
+  }
+  return std::make_unique<V4L2Capture>();
+}
+
+/////
+// V4L2Capture
+
+V4L2Capture::~V4L2Capture()
+{
+  close();
+}
+
+bool V4L2Capture::fail(const std::string &what)
+{
+  last_error_ = what + ": " + std::strerror(errno);
+  close();
+  return false;
+}
+
+bool V4L2Capture::open(const std::string &path, int width, int height, int fps)
+{
+  close();
+
+  fd_ = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+  if (fd_ < 0)
+  {
+    return fail("open " + path);
+  }
+
+  v4l2_capability cap{};
+  if (xioctl(fd_, VIDIOC_QUERYCAP, &cap) < 0)
+  {
+    return fail("VIDIOC_QUERYCAP");
+  }
+  const uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+  if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING))
+  {
+    errno = ENODEV;
+    return fail(path + " is not a streaming capture device");
+  }
+
+  // Ask for MJPEG, the driver adjusts the size to the closest supported mode
+  v4l2_format fmt{};
+  fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  fmt.fmt.pix.width = width;
+  fmt.fmt.pix.height = height;
+  fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+  fmt.fmt.pix.field = V4L2_FIELD_ANY;
+  if (xioctl(fd_, VIDIOC_S_FMT, &fmt) < 0)
+  {
+    return fail("VIDIOC_S_FMT");
+  }
+  if (fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_MJPEG)
+  {
+    errno = EINVAL;
+    return fail(path + " does not support MJPEG");
+  }
+  width_ = fmt.fmt.pix.width;
+  height_ = fmt.fmt.pix.height;
+
+  v4l2_streamparm parm{};
+  parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  parm.parm.capture.timeperframe.numerator = 1;
+  parm.parm.capture.timeperframe.denominator = fps;
+  (void)xioctl(fd_, VIDIOC_S_PARM, &parm); // Not every driver supports frame intervals
+
+  v4l2_requestbuffers req{};
+  req.count = BUFFER_COUNT;
+  req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  req.memory = V4L2_MEMORY_MMAP;
+  if (xioctl(fd_, VIDIOC_REQBUFS, &req) < 0 || req.count < 2)
+  {
+    return fail("VIDIOC_REQBUFS");
+  }
+
+  buffers_.resize(req.count);
+  for (uint32_t i = 0; i < req.count; i++)
+  {
+    v4l2_buffer buf{};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = i;
+    if (xioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0)
+    {
+      return fail("VIDIOC_QUERYBUF");
+    }
+    buffers_[i].length = buf.length;
+    buffers_[i].start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+    if (buffers_[i].start == MAP_FAILED)
+    {
+      buffers_[i].start = nullptr;
+      return fail("mmap");
+    }
+    if (xioctl(fd_, VIDIOC_QBUF, &buf) < 0)
+    {
+      return fail("VIDIOC_QBUF");
+    }
+  }
+
+  v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (xioctl(fd_, VIDIOC_STREAMON, &type) < 0)
+  {
+    return fail("VIDIOC_STREAMON");
+  }
+  streaming_ = true;
+  return true;
+}
+
+bool V4L2Capture::dequeue(MjpegFrame &frame)
+{
+  v4l2_buffer buf{};
+  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  if (xioctl(fd_, VIDIOC_DQBUF, &buf) < 0)
+  {
+    if (errno != EAGAIN)
+    {
+      last_error_ = std::string("VIDIOC_DQBUF: ") + std::strerror(errno);
+    }
+    return false;
+  }
+  frame.data = static_cast<const uint8_t *>(buffers_[buf.index].start);
+  frame.size = buf.bytesused;
+  frame.sequence = buf.sequence;
+  frame.timestamp = std::chrono::seconds(buf.timestamp.tv_sec) + std::chrono::microseconds(buf.timestamp.tv_usec);
+  frame.index = static_cast<int>(buf.index);
+  return true;
+}
+
+bool V4L2Capture::grab(MjpegFrame &frame, int timeout_ms)
+{
+  if (fd_ < 0)
+  {
+    return false;
+  }
+
+  pollfd pfd{fd_, POLLIN, 0};
+  if (poll(&pfd, 1, timeout_ms) <= 0 || !(pfd.revents & POLLIN))
+  {
+    return false;
+  }
+  if (!dequeue(frame))
+  {
+    return false;
+  }
+
+  // Keep only the newest frame so a slow consumer never sees stale video
+  MjpegFrame newer;
+  while (dequeue(newer))
+  {
+    release(frame);
+    frame = newer;
+  }
+  return true;
+}
+
+void V4L2Capture::release(const MjpegFrame &frame)
+{
+  if (fd_ < 0 || frame.index < 0)
+  {
+    return;
+  }
+  v4l2_buffer buf{};
+  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  buf.index = frame.index;
+  (void)xioctl(fd_, VIDIOC_QBUF, &buf);
+}
+
+void V4L2Capture::close()
+{
+  if (fd_ < 0)
+  {
+    return;
+  }
+  if (streaming_)
+  {
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    (void)xioctl(fd_, VIDIOC_STREAMOFF, &type);
+    streaming_ = false;
+  }
+  for (auto &buffer : buffers_)
+  {
+    if (buffer.start != nullptr)
+    {
+      munmap(buffer.start, buffer.length);
+    }
+  }
+  buffers_.clear();
+  ::close(fd_);
+  fd_ = -1;
+}
+
+/////
+// MjpegFileCapture
+
+bool MjpegFileCapture::open(const std::string &path, int width, int height, int fps)
+{
+  close();
+
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+  {
+    last_error_ = "Cannot open " + path;
+    return false;
+  }
+  file_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+  // Split at SOI/EOI markers. 0xFF bytes inside entropy coded data are always stuffed,
+  // so an EOI marker can only appear at the end of an image.
+  std::size_t start = std::string::npos;
+  for (std::size_t i = 0; i + 1 < file_.size(); i++)
+  {
+    if (file_[i] != 0xFF)
+    {
+      continue;
+    }
+    if (file_[i + 1] == 0xD8 && start == std::string::npos)
+    {
+      start = i;
+    }
+    else if (file_[i + 1] == 0xD9 && start != std::string::npos)
+    {
+      frames_.emplace_back(start, i + 2 - start);
+      start = std::string::npos;
+    }
+  }
+  if (frames_.empty())
+  {
+    last_error_ = path + " contains no JPEG images";
+    file_.clear();
+    return false;
+  }
+
+  width_ = width;
+  height_ = height;
+  (void)jpegSize(file_.data() + frames_[0].first, frames_[0].second, width_, height_);
+
+  period_ = std::chrono::nanoseconds(1000000000LL / (fps > 0 ? fps : 15));
+  next_due_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool MjpegFileCapture::grab(MjpegFrame &frame, int timeout_ms)
+{
+  if (frames_.empty())
+  {
+    return false;
+  }
+
+  // Pace the replay like a real camera
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_due_)
+  {
+    if (now + std::chrono::milliseconds(timeout_ms) < next_due_)
+    {
+      return false;
+    }
+    std::this_thread::sleep_until(next_due_);
+    now = next_due_;
+  }
+  next_due_ = std::max(next_due_ + period_, now);
+
+  const auto &entry = frames_[next_];
+  next_ = (next_ + 1) % frames_.size();
+
+  frame.data = file_.data() + entry.first;
+  frame.size = entry.second;
+  frame.sequence = sequence_++;
+  frame.timestamp = now.time_since_epoch();
+  frame.index = -1;
+  return true;
+}
+
+void MjpegFileCapture::close()
+{
+  file_.clear();
+  frames_.clear();
+  next_ = 0;
+  sequence_ = 0;
+}
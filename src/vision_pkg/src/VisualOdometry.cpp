@@ -0,0 +1,237 @@
+#include "vision_pkg/VisualOdometry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace
+{
+  double elapsedMs(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  cv::Matx44d fromRvecTvec(const cv::Vec3d &rvec, const cv::Vec3d &tvec)
+  {
+    cv::Matx33d r;
+    cv::Rodrigues(rvec, r);
+    return cv::Matx44d(r(0, 0), r(0, 1), r(0, 2), tvec[0],
+                       r(1, 0), r(1, 1), r(1, 2), tvec[1],
+                       r(2, 0), r(2, 1), r(2, 2), tvec[2],
+                       0, 0, 0, 1);
+  }
+
+  cv::Matx44d invertRigid(const cv::Matx44d &m)
+  {
+    const cv::Matx33d rt(m(0, 0), m(1, 0), m(2, 0), m(0, 1), m(1, 1), m(2, 1), m(0, 2), m(1, 2), m(2, 2));
+    const cv::Vec3d t = -(rt * cv::Vec3d(m(0, 3), m(1, 3), m(2, 3)));
+    return cv::Matx44d(rt(0, 0), rt(0, 1), rt(0, 2), t[0],
+                       rt(1, 0), rt(1, 1), rt(1, 2), t[1],
+                       rt(2, 0), rt(2, 1), rt(2, 2), t[2],
+                       0, 0, 0, 1);
+  }
+}
+
+VisualOdometry::VisualOdometry(const Config &config)
+    : config_(config),
+      orb_(cv::ORB::create(config.max_features, 1.2f, config.pyramid_levels, 19, 0, 2, cv::ORB::FAST_SCORE, 31,
+                           config.fast_threshold)),
+      matcher_(cv::BFMatcher::create(cv::NORM_HAMMING, true))
+{
+}
+
+void VisualOdometry::setCalibration(const cv::Matx33d &color_matrix, const std::vector<double> &color_distortion,
+                                    const CameraIntrinsics &depth, const cv::Matx44d &color_from_depth)
+{
+  color_matrix_ = color_matrix;
+  color_distortion_ = color_distortion;
+  depth_intrinsics_ = depth;
+  color_from_depth_ = color_from_depth;
+  has_calibration_ = true;
+  reset();
+}
+
+void VisualOdometry::reset()
+{
+  has_keyframe_ = false;
+  rvec_ = cv::Vec3d();
+  tvec_ = cv::Vec3d();
+}
+
+const VisualOdometryResult &VisualOdometry::track(const cv::Mat &bgr, const uint16_t *depth, int depth_width,
+                                                  int depth_height, std::size_t depth_stride, float units)
+{
+  const auto start = std::chrono::steady_clock::now();
+  result_.tracking = false;
+  result_.keyframe = false;
+  result_.matches = 0;
+  result_.inliers = 0;
+  result_.match_ms = 0.0;
+  result_.pnp_ms = 0.0;
+  result_.keyframe_ms = 0.0;
+
+  // 1) Features
+  cv::cvtColor(bgr, gray_, cv::COLOR_BGR2GRAY);
+  orb_->detectAndCompute(gray_, cv::noArray(), keypoints_, descriptors_);
+  result_.features = keypoints_.size();
+  result_.detect_ms = elapsedMs(start);
+
+  bool need_keyframe = !has_keyframe_;
+  if (has_keyframe_ && !descriptors_.empty())
+  {
+    // 2) Cross-checked matches against the keyframe
+    auto stage = std::chrono::steady_clock::now();
+    matcher_->match(descriptors_, keyframe_descriptors_, matches_);
+    std::vector<cv::Point3f> object;
+    std::vector<cv::Point2f> image;
+    object.reserve(matches_.size());
+    image.reserve(matches_.size());
+    for (const auto &match : matches_)
+    {
+      object.push_back(keyframe_points_[match.trainIdx]);
+      image.push_back(keypoints_[match.queryIdx].pt);
+    }
+    result_.matches = matches_.size();
+    result_.match_ms = elapsedMs(stage);
+
+    // 3) Pose relative to the keyframe, starting from the previous one
+    stage = std::chrono::steady_clock::now();
+    std::vector<int> inliers;
+    cv::Vec3d rvec = rvec_;
+    cv::Vec3d tvec = tvec_;
+    const bool solved = object.size() >= config_.min_inliers &&
+                        cv::solvePnPRansac(object, image, color_matrix_, color_distortion_, rvec, tvec, true,
+                                           config_.ransac_iterations, config_.ransac_reprojection_px, 0.99, inliers,
+                                           cv::SOLVEPNP_ITERATIVE);
+    result_.inliers = inliers.size();
+    result_.pnp_ms = elapsedMs(stage);
+
+    if (solved && inliers.size() >= config_.min_inliers)
+    {
+      rvec_ = rvec;
+      tvec_ = tvec;
+      result_.tracking = true;
+      result_.world_from_camera = world_from_keyframe_ * invertRigid(fromRvecTvec(rvec, tvec));
+      need_keyframe = inliers.size() < config_.keyframe_inliers ||
+                      cv::norm(tvec) > config_.keyframe_distance_m ||
+                      cv::norm(rvec) > config_.keyframe_angle_rad;
+    }
+    else
+    {
+      // Lost: restart from the last known pose, a gap is better than a jump
+      need_keyframe = true;
+    }
+  }
+
+  if (need_keyframe)
+  {
+    const auto stage = std::chrono::steady_clock::now();
+    result_.keyframe = makeKeyframe(depth, depth_width, depth_height, depth_stride, units);
+    result_.keyframe_ms = elapsedMs(stage);
+  }
+  result_.total_ms = elapsedMs(start);
+  return result_;
+}
+
+bool VisualOdometry::makeKeyframe(const uint16_t *depth, int depth_width, int depth_height, std::size_t depth_stride,
+                                  float units)
+{
+  // Z-buffer of the depth frame in color pixels. The color distortion is small enough to ignore here.
+  depth_in_color_.create(gray_.size(), CV_32F);
+  depth_in_color_.setTo(std::numeric_limits<float>::infinity());
+  const float fx = static_cast<float>(color_matrix_(0, 0));
+  const float fy = static_cast<float>(color_matrix_(1, 1));
+  const float cx = static_cast<float>(color_matrix_(0, 2));
+  const float cy = static_cast<float>(color_matrix_(1, 2));
+  const cv::Matx44f t = color_from_depth_;
+  // Color is at most half the depth resolution here, every other depth pixel still covers it
+  const int step = depth_width >= 2 * gray_.cols ? 2 : 1;
+  for (int v = 0; v < depth_height; v += step)
+  {
+    const uint16_t *row = reinterpret_cast<const uint16_t *>(reinterpret_cast<const uint8_t *>(depth) + v * depth_stride);
+    const float ry = (v - depth_intrinsics_.cy) / depth_intrinsics_.fy;
+    for (int u = 0; u < depth_width; u += step)
+    {
+      const float z = row[u] * units;
+      if (z < config_.min_depth_m || z > config_.max_depth_m)
+      {
+        continue;
+      }
+      const float x = (u - depth_intrinsics_.cx) / depth_intrinsics_.fx * z;
+      const float y = ry * z;
+      const float xc = t(0, 0) * x + t(0, 1) * y + t(0, 2) * z + t(0, 3);
+      const float yc = t(1, 0) * x + t(1, 1) * y + t(1, 2) * z + t(1, 3);
+      const float zc = t(2, 0) * x + t(2, 1) * y + t(2, 2) * z + t(2, 3);
+      if (zc <= 0.0f)
+      {
+        continue;
+      }
+      const int uc = static_cast<int>(fx * xc / zc + cx + 0.5f);
+      const int vc = static_cast<int>(fy * yc / zc + cy + 0.5f);
+      if (uc < 0 || vc < 0 || uc >= depth_in_color_.cols || vc >= depth_in_color_.rows)
+      {
+        continue;
+      }
+      float &cell = depth_in_color_.at<float>(vc, uc);
+      cell = std::min(cell, zc);
+    }
+  }
+
+  // 3D points of the features, nearest depth of the 3x3 neighbourhood to fill z-buffer holes
+  std::vector<cv::Point2f> pixels;
+  pixels.reserve(keypoints_.size());
+  for (const auto &keypoint : keypoints_)
+  {
+    pixels.push_back(keypoint.pt);
+  }
+  std::vector<cv::Point2f> normalized;
+  if (!pixels.empty())
+  {
+    cv::undistortPoints(pixels, normalized, color_matrix_, color_distortion_);
+  }
+
+  std::vector<cv::Point3f> points;
+  cv::Mat descriptors;
+  for (std::size_t i = 0; i < keypoints_.size(); i++)
+  {
+    const int u = static_cast<int>(keypoints_[i].pt.x + 0.5f);
+    const int v = static_cast<int>(keypoints_[i].pt.y + 0.5f);
+    float z = std::numeric_limits<float>::infinity();
+    for (int dv = -1; dv <= 1; dv++)
+    {
+      for (int du = -1; du <= 1; du++)
+      {
+        const int uu = u + du;
+        const int vv = v + dv;
+        if (uu >= 0 && vv >= 0 && uu < depth_in_color_.cols && vv < depth_in_color_.rows)
+        {
+          z = std::min(z, depth_in_color_.at<float>(vv, uu));
+        }
+      }
+    }
+    if (!std::isfinite(z))
+    {
+      continue;
+    }
+    points.emplace_back(normalized[i].x * z, normalized[i].y * z, z);
+    descriptors.push_back(descriptors_.row(static_cast<int>(i)));
+  }
+
+  if (points.size() < config_.min_inliers)
+  {
+    return false; // Keep the previous keyframe, if any
+  }
+  world_from_keyframe_ = result_.world_from_camera; // The last tracked pose when the frame was lost
+  keyframe_points_ = std::move(points);
+  keyframe_descriptors_ = descriptors;
+  has_keyframe_ = true;
+  rvec_ = cv::Vec3d();
+  tvec_ = cv::Vec3d();
+  keyframe_count_++;
+  return true;
+}
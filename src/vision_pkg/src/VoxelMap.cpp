@@ -0,0 +1,447 @@
+#include "vision_pkg/VoxelMap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "vision_pkg/ThreadPool.hpp"
+
+namespace
+{
+  const uint64_t EMPTY_KEY = UINT64_MAX;
+  const uint64_t HIT_BIT = 1ull << 63;
+  const int64_t COORD_OFFSET = 1 << 20; // Voxel coordinates are stored in 21 bits each
+  const int BLOCK_SHIFT = 3;            // log2(BLOCK_SIZE)
+  const std::size_t CLEARED_CACHE_SIZE = 1 << 14;
+
+  uint64_t mix(uint64_t key)
+  {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return key;
+  }
+
+  int64_t coordinate(uint64_t key, int shift)
+  {
+    return static_cast<int64_t>((key >> shift) & 0x1FFFFF) - COORD_OFFSET;
+  }
+}
+
+VoxelMap::VoxelMap(const Config &config)
+    : config_(config), inv_voxel_(1.0f / config.voxel_size), shards_(std::max<std::size_t>(1, config.shards))
+{
+  const std::size_t per_shard = std::max<std::size_t>(1, config_.max_blocks / shards_.size());
+  std::size_t table = 1;
+  while (table < 2 * per_shard)
+  {
+    table <<= 1;
+  }
+  for (auto &shard : shards_)
+  {
+    shard.blocks.resize(per_shard);
+    shard.free.reserve(per_shard);
+    for (std::size_t i = per_shard; i-- > 0;)
+    {
+      shard.free.push_back(static_cast<int32_t>(i));
+    }
+    shard.keys.assign(table, EMPTY_KEY);
+    shard.slots.assign(table, -1);
+  }
+}
+
+/////
+// Keys
+
+uint64_t VoxelMap::voxelKey(int64_t vx, int64_t vy, int64_t vz)
+{
+  return (static_cast<uint64_t>(vx + COORD_OFFSET) & 0x1FFFFF) << 42 |
+         (static_cast<uint64_t>(vy + COORD_OFFSET) & 0x1FFFFF) << 21 |
+         (static_cast<uint64_t>(vz + COORD_OFFSET) & 0x1FFFFF);
+}
+
+uint64_t VoxelMap::blockOf(uint64_t voxel_key)
+{
+  // Clear the low bits of each coordinate. The offset is a multiple of BLOCK_SIZE, so this floors.
+  const uint64_t low = (BLOCK_SIZE - 1);
+  return voxel_key & ~((low << 42) | (low << 21) | low) & ~HIT_BIT;
+}
+
+int VoxelMap::voxelIndex(uint64_t voxel_key)
+{
+  const int lx = static_cast<int>((voxel_key >> 42) & (BLOCK_SIZE - 1));
+  const int ly = static_cast<int>((voxel_key >> 21) & (BLOCK_SIZE - 1));
+  const int lz = static_cast<int>(voxel_key & (BLOCK_SIZE - 1));
+  return (lz << (2 * BLOCK_SHIFT)) | (ly << BLOCK_SHIFT) | lx;
+}
+
+std::size_t VoxelMap::shardOf(uint64_t block_key) const
+{
+  return (mix(block_key) >> 48) % shards_.size();
+}
+
+/////
+// Insertion
+
+void VoxelMap::insert(const float *x, const float *y, const float *z, std::size_t count,
+                      const RigidTransform &map_from_sensor, ThreadPool *pool)
+{
+  const std::size_t workers = pool != nullptr ? pool->size() : 1;
+  if (workers_.size() < workers)
+  {
+    workers_.resize(workers);
+  }
+  for (std::size_t w = 0; w < workers; w++)
+  {
+    workers_[w].updates.resize(shards_.size());
+    for (auto &list : workers_[w].updates)
+    {
+      list.clear();
+    }
+    workers_[w].cleared.assign(CLEARED_CACHE_SIZE, EMPTY_KEY);
+  }
+
+  // 1) Walk the rays, each worker a contiguous range of points
+  auto walk = [&](std::size_t w) {
+    const std::size_t begin = count * w / workers;
+    const std::size_t end = count * (w + 1) / workers;
+    traverse(x, y, z, begin, end, map_from_sensor, workers_[w]);
+  };
+  // 2) Apply, each worker a set of shards. Lists are applied in worker order.
+  auto commit = [&](std::size_t s) {
+    for (std::size_t w = 0; w < workers; w++)
+    {
+      apply(shards_[s], workers_[w].updates[s]);
+    }
+  };
+
+  if (pool != nullptr)
+  {
+    pool->run(workers, walk);
+    pool->run(shards_.size(), commit);
+  }
+  else
+  {
+    walk(0);
+    for (std::size_t s = 0; s < shards_.size(); s++)
+    {
+      commit(s);
+    }
+  }
+}
+
+void VoxelMap::traverse(const float *x, const float *y, const float *z, std::size_t begin, std::size_t end,
+                        const RigidTransform &map_from_sensor, Worker &worker) const
+{
+  auto &out = worker.updates;
+  uint64_t *cleared = worker.cleared.data();
+  const float *r = map_from_sensor.r;
+  const float *t = map_from_sensor.t;
+  const float ox = t[0] * inv_voxel_;
+  const float oy = t[1] * inv_voxel_;
+  const float oz = t[2] * inv_voxel_;
+
+  for (std::size_t i = begin; i < end; i++)
+  {
+    // Ray from the sensor to the point, in voxel units
+    const float px = (r[0] * x[i] + r[1] * y[i] + r[2] * z[i] + t[0]) * inv_voxel_;
+    const float py = (r[3] * x[i] + r[4] * y[i] + r[5] * z[i] + t[1]) * inv_voxel_;
+    const float pz = (r[6] * x[i] + r[7] * y[i] + r[8] * z[i] + t[2]) * inv_voxel_;
+    float dx = px - ox;
+    float dy = py - oy;
+    float dz = pz - oz;
+    const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+    if (length < 1e-6f)
+    {
+      continue;
+    }
+    const float max_length = config_.max_ray_m * inv_voxel_;
+    const bool hit = length <= max_length;
+    const float walk_length = hit ? length : max_length;
+    dx /= length;
+    dy /= length;
+    dz /= length;
+
+    // Amanatides-Woo traversal from the origin voxel toward the end voxel
+    int64_t vx = static_cast<int64_t>(std::floor(ox));
+    int64_t vy = static_cast<int64_t>(std::floor(oy));
+    int64_t vz = static_cast<int64_t>(std::floor(oz));
+    const int64_t ex = static_cast<int64_t>(std::floor(ox + dx * walk_length));
+    const int64_t ey = static_cast<int64_t>(std::floor(oy + dy * walk_length));
+    const int64_t ez = static_cast<int64_t>(std::floor(oz + dz * walk_length));
+    const int sx = dx > 0 ? 1 : -1;
+    const int sy = dy > 0 ? 1 : -1;
+    const int sz = dz > 0 ? 1 : -1;
+    const float inf = INFINITY;
+    const float delta_x = dx != 0 ? std::fabs(1.0f / dx) : inf;
+    const float delta_y = dy != 0 ? std::fabs(1.0f / dy) : inf;
+    const float delta_z = dz != 0 ? std::fabs(1.0f / dz) : inf;
+    float next_x = dx != 0 ? ((sx > 0 ? (vx + 1 - ox) : (ox - vx)) * delta_x) : inf;
+    float next_y = dy != 0 ? ((sy > 0 ? (vy + 1 - oy) : (oy - vy)) * delta_y) : inf;
+    float next_z = dz != 0 ? ((sz > 0 ? (vz + 1 - oz) : (oz - vz)) * delta_z) : inf;
+
+    // Consecutive voxels of a ray mostly share a block, so the shard is looked up once per block
+    uint64_t last_block = EMPTY_KEY;
+    std::vector<Update> *list = nullptr;
+    const int max_steps = static_cast<int>(walk_length * 3.0f) + 3;
+    for (int step = 0; step < max_steps && !(vx == ex && vy == ey && vz == ez); step++)
+    {
+      const uint64_t key = voxelKey(vx, vy, vz);
+      uint64_t &seen = cleared[(key * 0x9E3779B97F4A7C15ull) >> 50];
+      if (seen != key)
+      {
+        seen = key;
+        const uint64_t block = blockOf(key);
+        if (block != last_block)
+        {
+          list = &out[shardOf(block)];
+          last_block = block;
+        }
+        list->push_back(key);
+      }
+      if (next_x < next_y && next_x < next_z)
+      {
+        vx += sx;
+        next_x += delta_x;
+      }
+      else if (next_y < next_z)
+      {
+        vy += sy;
+        next_y += delta_y;
+      }
+      else
+      {
+        vz += sz;
+        next_z += delta_z;
+      }
+    }
+    if (hit)
+    {
+      const uint64_t key = voxelKey(ex, ey, ez);
+      out[shardOf(blockOf(key))].push_back(key | HIT_BIT);
+    }
+  }
+}
+
+void VoxelMap::apply(Shard &shard, const std::vector<Update> &updates)
+{
+  uint64_t cached_key = EMPTY_KEY;
+  Block *cached = nullptr;
+  for (const Update update : updates)
+  {
+    const uint64_t block_key = blockOf(update);
+    if (block_key != cached_key)
+    {
+      cached = &findOrCreate(shard, block_key);
+      cached_key = block_key;
+    }
+    int8_t &voxel = cached->voxels[voxelIndex(update)];
+    const int value = voxel + ((update & HIT_BIT) ? config_.hit : config_.miss);
+    voxel = static_cast<int8_t>(std::clamp(value, static_cast<int>(config_.min_log_odds), static_cast<int>(config_.max_log_odds)));
+  }
+}
+
+/////
+// Blocks
+
+const VoxelMap::Block *VoxelMap::find(const Shard &shard, uint64_t block_key) const
+{
+  const std::size_t mask = shard.keys.size() - 1;
+  for (std::size_t slot = mix(block_key) & mask;; slot = (slot + 1) & mask)
+  {
+    if (shard.keys[slot] == block_key)
+    {
+      return &shard.blocks[shard.slots[slot]];
+    }
+    if (shard.keys[slot] == EMPTY_KEY)
+    {
+      return nullptr;
+    }
+  }
+}
+
+VoxelMap::Block &VoxelMap::findOrCreate(Shard &shard, uint64_t block_key)
+{
+  const std::size_t mask = shard.keys.size() - 1;
+  std::size_t slot = mix(block_key) & mask;
+  for (; shard.keys[slot] != EMPTY_KEY; slot = (slot + 1) & mask)
+  {
+    if (shard.keys[slot] == block_key)
+    {
+      touch(shard, shard.slots[slot]);
+      return shard.blocks[shard.slots[slot]];
+    }
+  }
+
+  if (shard.free.empty())
+  {
+    erase(shard, shard.tail); // Reuse the least recently updated block
+    return findOrCreate(shard, block_key);
+  }
+  const int32_t index = shard.free.back();
+  shard.free.pop_back();
+  Block &block = shard.blocks[index];
+  block.key = block_key;
+  std::memset(block.voxels, 0, sizeof(block.voxels));
+  shard.keys[slot] = block_key;
+  shard.slots[slot] = index;
+  block.prev = block.next = -1;
+  touch(shard, index);
+  return block;
+}
+
+void VoxelMap::erase(Shard &shard, int32_t block)
+{
+  const std::size_t mask = shard.keys.size() - 1;
+  std::size_t slot = mix(shard.blocks[block].key) & mask;
+  while (shard.slots[slot] != block)
+  {
+    slot = (slot + 1) & mask;
+  }
+
+  // Backward shift deletion keeps probe chains intact without tombstones
+  std::size_t hole = slot;
+  for (std::size_t next = (hole + 1) & mask; shard.keys[next] != EMPTY_KEY; next = (next + 1) & mask)
+  {
+    const std::size_t home = mix(shard.keys[next]) & mask;
+    const bool movable = (hole <= next) ? (home <= hole || home > next) : (home <= hole && home > next);
+    if (movable)
+    {
+      shard.keys[hole] = shard.keys[next];
+      shard.slots[hole] = shard.slots[next];
+      hole = next;
+    }
+  }
+  shard.keys[hole] = EMPTY_KEY;
+  shard.slots[hole] = -1;
+
+  unlink(shard, block);
+  shard.free.push_back(block);
+}
+
+void VoxelMap::unlink(Shard &shard, int32_t block)
+{
+  Block &b = shard.blocks[block];
+  if (b.prev >= 0)
+    shard.blocks[b.prev].next = b.next;
+  else if (shard.head == block)
+    shard.head = b.next;
+  if (b.next >= 0)
+    shard.blocks[b.next].prev = b.prev;
+  else if (shard.tail == block)
+    shard.tail = b.prev;
+  b.prev = b.next = -1;
+}
+
+void VoxelMap::touch(Shard &shard, int32_t block)
+{
+  if (shard.head == block)
+  {
+    return;
+  }
+  unlink(shard, block);
+  Block &b = shard.blocks[block];
+  b.next = shard.head;
+  if (shard.head >= 0)
+    shard.blocks[shard.head].prev = block;
+  shard.head = block;
+  if (shard.tail < 0)
+    shard.tail = block;
+}
+
+void VoxelMap::evictOutside(float x, float y, float radius)
+{
+  const float block_m = BLOCK_SIZE * config_.voxel_size;
+  const float radius_sq = radius * radius;
+  for (auto &shard : shards_)
+  {
+    for (int32_t block = shard.head; block >= 0;)
+    {
+      const int32_t next = shard.blocks[block].next;
+      const uint64_t key = shard.blocks[block].key;
+      const float cx = (coordinate(key, 42) + BLOCK_SIZE / 2) * config_.voxel_size - x;
+      const float cy = (coordinate(key, 21) + BLOCK_SIZE / 2) * config_.voxel_size - y;
+      if (cx * cx + cy * cy > radius_sq + block_m * block_m)
+      {
+        erase(shard, block);
+      }
+      block = next;
+    }
+  }
+}
+
+/////
+// Queries
+
+bool VoxelMap::isOccupied(float x, float y, float z) const
+{
+  const uint64_t key = voxelKey(static_cast<int64_t>(std::floor(x * inv_voxel_)), static_cast<int64_t>(std::floor(y * inv_voxel_)),
+                                static_cast<int64_t>(std::floor(z * inv_voxel_)));
+  const uint64_t block_key = blockOf(key);
+  const Block *block = find(shards_[shardOf(block_key)], block_key);
+  return block != nullptr && block->voxels[voxelIndex(key)] > config_.occupied;
+}
+
+bool VoxelMap::columnMaxHeight(float x, float y, float z_min, float z_max, float &height) const
+{
+  const int64_t vx = static_cast<int64_t>(std::floor(x * inv_voxel_));
+  const int64_t vy = static_cast<int64_t>(std::floor(y * inv_voxel_));
+  const int64_t bottom = static_cast<int64_t>(std::floor(z_min * inv_voxel_));
+  uint64_t cached_key = EMPTY_KEY;
+  const Block *cached = nullptr;
+  for (int64_t vz = static_cast<int64_t>(std::floor(z_max * inv_voxel_)); vz >= bottom; vz--)
+  {
+    const uint64_t key = voxelKey(vx, vy, vz);
+    const uint64_t block_key = blockOf(key);
+    if (block_key != cached_key)
+    {
+      cached = find(shards_[shardOf(block_key)], block_key);
+      cached_key = block_key;
+    }
+    if (cached == nullptr)
+    {
+      vz = (vz & ~static_cast<int64_t>(BLOCK_SIZE - 1)); // Skip the rest of the missing block
+      continue;
+    }
+    if (cached->voxels[voxelIndex(key)] > config_.occupied)
+    {
+      height = (vz + 1) * config_.voxel_size;
+      return true;
+    }
+  }
+  return false;
+}
+
+void VoxelMap::forEachOccupied(const std::function<void(float, float, float)> &visit) const
+{
+  for (const auto &shard : shards_)
+  {
+    for (int32_t block = shard.head; block >= 0; block = shard.blocks[block].next)
+    {
+      const Block &b = shard.blocks[block];
+      const int64_t bx = coordinate(b.key, 42);
+      const int64_t by = coordinate(b.key, 21);
+      const int64_t bz = coordinate(b.key, 0);
+      for (int i = 0; i < BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE; i++)
+      {
+        if (b.voxels[i] > config_.occupied)
+        {
+          const int lx = i & (BLOCK_SIZE - 1);
+          const int ly = (i >> BLOCK_SHIFT) & (BLOCK_SIZE - 1);
+          const int lz = i >> (2 * BLOCK_SHIFT);
+          visit((bx + lx + 0.5f) * config_.voxel_size, (by + ly + 0.5f) * config_.voxel_size, (bz + lz + 0.5f) * config_.voxel_size);
+        }
+      }
+    }
+  }
+}
+
+std::size_t VoxelMap::blockCount() const
+{
+  std::size_t count = 0;
+  for (const auto &shard : shards_)
+  {
+    count += shard.blocks.size() - shard.free.size();
+  }
+  return count;
+}
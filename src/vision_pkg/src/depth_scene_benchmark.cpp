@@ -0,0 +1,179 @@
+// Runs the obstacle detection stages over rendered terrain: flat and sloped ground, rocks and
+// craters above and below the detection thresholds. Prints the ground plane error, how often
+// each obstacle was detected and the time of every stage. No camera or ROS needed.
+//
+// usage: depth_scene_benchmark [frames] [voxel_threads]
+// Exits with 1 if a scene is misclassified in more than a tenth of its frames.
+#include "vision_pkg/DepthStats.hpp"
+#include "vision_pkg/ElevationMap.hpp"
+#include "vision_pkg/GroundPlane.hpp"
+#include "vision_pkg/PointCloudBuilder.hpp"
+#include "vision_pkg/SyntheticDepth.hpp"
+#include "vision_pkg/ThreadPool.hpp"
+#include "vision_pkg/VoxelMap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace
+{
+  const float ROCK_HEIGHT_M = 0.15f;   // Node defaults of rock_height_m and crater_depth_m
+  const float CRATER_DEPTH_M = 0.15f;  //
+  const uint32_t MIN_POINTS = 3;       // Cloud points above the threshold that count as a detection
+  const int NOISE_FRAMES = 8;          // Rendered noise realizations, cycled through
+
+  struct Scene
+  {
+    const char *name;
+    float slope_rad;
+    std::vector<TerrainFeature> features;
+    bool rocks;   // Expected detections
+    bool craters; //
+  };
+
+  /**
+   * @brief Test scenes. With the camera 0.5 m high and pitched 0.35 rad down, as on the robot,
+   *        the estimator's region of interest ends about 1.5 m ahead on flat ground.
+   */
+  std::vector<Scene> scenes()
+  {
+    return {
+        {"flat", 0.0f, {}, false, false},
+        {"slope 8 deg", 0.14f, {}, false, false},
+        {"rock 0.25 m at 1.2 m", 0.0f, {{TerrainFeature::ROCK, 0.3f, 1.2f, 0.25f, 0.25f}}, true, false},
+        {"rock 0.08 m at 1.2 m", 0.0f, {{TerrainFeature::ROCK, 0.3f, 1.2f, 0.25f, 0.08f}}, false, false},
+        {"crater 0.30 m at 1.5 m", 0.0f, {{TerrainFeature::CRATER, -0.3f, 1.5f, 0.4f, 0.3f}}, false, true},
+        {"field on 5 deg slope", 0.09f,
+         {{TerrainFeature::ROCK, -0.5f, 1.1f, 0.2f, 0.3f},
+          {TerrainFeature::ROCK, 0.8f, 3.5f, 0.3f, 0.35f}, // Above the estimator's region of interest
+          {TerrainFeature::CRATER, 0.2f, 1.6f, 0.45f, 0.3f}},
+         true, true},
+    };
+  }
+
+  struct Timer
+  {
+    double total_ms = 0.0;
+    int count = 0;
+
+    template <typename F>
+    void time(F &&stage)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      stage();
+      total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      count++;
+    }
+
+    double meanMs() const { return count > 0 ? total_ms / count : 0.0; }
+  };
+
+  /**
+   * @returns true if the scene was classified as expected
+   */
+  bool run(const Scene &scene, int width, int height, int frames, ThreadPool *pool)
+  {
+    SyntheticDepthScene::Config config;
+    const float scale = width / 848.0f;
+    config.width = width;
+    config.height = height;
+    config.intrinsics = {427.0f * scale, 427.0f * scale, width / 2.0f, height / 2.0f};
+    config.slope_rad = scene.slope_rad;
+    SyntheticDepthScene synthetic(config);
+    for (const TerrainFeature &feature : scene.features)
+    {
+      synthetic.add(feature);
+    }
+
+    std::vector<std::vector<uint16_t>> depth(NOISE_FRAMES);
+    for (int i = 0; i < NOISE_FRAMES; i++)
+    {
+      synthetic.render(depth[i], static_cast<uint32_t>(i + 1));
+    }
+
+    const std::size_t stride = width * sizeof(uint16_t);
+    const RigidTransform map_from_camera =
+        RigidTransform::fromXYZRPY(0.0f, 0.0f, config.camera_height_m, 0.0f, config.pitch_rad, 0.0f) * RigidTransform::opticalToBody();
+    DepthStats stats;
+    std::vector<DepthRegion> cells;
+    GroundPlaneEstimator ground;
+    ElevationMap elevation;
+    VoxelMap voxels;
+    PointCloudBuilder cloud;
+    cloud.setIntrinsics(width, height, config.intrinsics);
+    cloud.setRange(0.1f, 6.0f);
+    std::vector<uint8_t> points(cloud.maxPoints() * PointCloudBuilder::POINT_STEP);
+    Timer stats_timer, ground_timer, elevation_timer, voxel_timer, cloud_timer;
+
+    const Plane truth = synthetic.groundPlane();
+    int rock_frames = 0, crater_frames = 0, valid_frames = 0;
+    double normal_error_deg = 0.0, height_error_m = 0.0;
+    for (int i = 0; i < frames; i++)
+    {
+      const uint16_t *frame = depth[i % NOISE_FRAMES].data();
+      stats_timer.time([&] {
+        stats.build(frame, width, height, stride, config.depth_units);
+        stats.grid(16, 12, cells);
+      });
+
+      GroundClassification counts;
+      ground_timer.time([&] {
+        ground.update(frame, width, height, stride, config.depth_units, config.intrinsics);
+        counts = ground.classify(ROCK_HEIGHT_M, CRATER_DEPTH_M);
+      });
+      const GroundFit &fit = ground.fit();
+      if (fit.valid)
+      {
+        valid_frames++;
+        const float cosine = fit.plane.a * truth.a + fit.plane.b * truth.b + fit.plane.c * truth.c;
+        normal_error_deg = std::max(normal_error_deg, std::acos(std::min(1.0f, cosine)) * 180.0 / M_PI);
+        height_error_m = std::max(height_error_m, static_cast<double>(std::fabs(fit.plane.d - truth.d)));
+      }
+      rock_frames += counts.rocks_left + counts.rocks_right >= MIN_POINTS;
+      crater_frames += counts.craters_left + counts.craters_right >= MIN_POINTS;
+
+      elevation_timer.time([&] {
+        elevation.integrate(ground.cloudX().data(), ground.cloudY().data(), ground.cloudZ().data(), ground.cloudX().size(),
+                            map_from_camera, i / 15.0);
+      });
+      voxel_timer.time([&] {
+        voxels.insert(ground.cloudX().data(), ground.cloudY().data(), ground.cloudZ().data(), ground.cloudX().size(),
+                      map_from_camera, pool);
+      });
+      cloud_timer.time([&] { cloud.build(frame, stride, config.depth_units, points.data()); });
+    }
+
+    const double rock_rate = static_cast<double>(rock_frames) / frames;
+    const double crater_rate = static_cast<double>(crater_frames) / frames;
+    const bool ok = valid_frames == frames && (scene.rocks ? rock_rate >= 0.9 : rock_rate <= 0.1) &&
+                    (scene.craters ? crater_rate >= 0.9 : crater_rate <= 0.1);
+    const double total_ms = stats_timer.meanMs() + ground_timer.meanMs() + elevation_timer.meanMs() + voxel_timer.meanMs();
+
+    std::printf("%-24s %4dx%-4d %s  plane %5.2f deg %5.1f cm  rocks %3.0f%%  craters %3.0f%%  |  stats %6.3f  ground %6.3f  "
+                "elevation %6.3f  voxels %6.3f  cloud %6.3f ms  -> %6.1f frames/s\n",
+                scene.name, width, height, ok ? "ok  " : "FAIL", normal_error_deg, 100.0 * height_error_m, 100.0 * rock_rate,
+                100.0 * crater_rate, stats_timer.meanMs(), ground_timer.meanMs(), elevation_timer.meanMs(), voxel_timer.meanMs(),
+                cloud_timer.meanMs(), 1000.0 / total_ms);
+    return ok;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const int frames = argc > 1 ? std::max(1, std::atoi(argv[1])) : 30;
+  const int threads = argc > 2 ? std::atoi(argv[2]) : 1;
+  std::unique_ptr<ThreadPool> pool = threads > 1 ? std::make_unique<ThreadPool>(threads) : nullptr;
+
+  bool ok = true;
+  for (const Scene &scene : scenes())
+  {
+    ok &= run(scene, 424, 240, frames, pool.get());
+    ok &= run(scene, 848, 480, frames, pool.get());
+  }
+  return ok ? 0 : 1;
+}
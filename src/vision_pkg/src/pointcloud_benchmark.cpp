@@ -0,0 +1,69 @@
+// Measures PointCloudBuilder throughput in points per second on synthetic D455 frames.
+//
+// usage: pointcloud_benchmark [frames]
+#include "vision_pkg/PointCloudBuilder.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+  /**
+   * @brief Runs the builder over a frame of floor, wall and holes and prints the throughput.
+   */
+  void run(int width, int height, float voxel_size, int frames)
+  {
+    // D455 depth intrinsics scale with the resolution
+    const float scale = width / 848.0f;
+    const CameraIntrinsics intrinsics{425.0f * scale, 425.0f * scale, width / 2.0f, height / 2.0f};
+
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> jitter(-5, 5);
+    std::vector<uint16_t> depth(static_cast<std::size_t>(width) * height);
+    for (int v = 0; v < height; v++)
+    {
+      for (int u = 0; u < width; u++)
+      {
+        const float ray = (v - intrinsics.cy) / intrinsics.fy + 0.35f; // Camera pitched down
+        uint16_t mm = ray > 0.05f ? static_cast<uint16_t>(std::min(6000.0f, 500.0f / ray)) : 6000;
+        if ((u * 7 + v * 13) % 50 == 0)
+        {
+          mm = 0; // Holes without a measurement
+        }
+        depth[v * width + u] = mm == 0 ? 0 : static_cast<uint16_t>(mm + jitter(rng));
+      }
+    }
+
+    PointCloudBuilder builder;
+    builder.setIntrinsics(width, height, intrinsics);
+    builder.setRange(0.1f, 10.0f);
+    builder.setVoxelSize(voxel_size);
+    std::vector<uint8_t> out(builder.maxPoints() * PointCloudBuilder::POINT_STEP);
+
+    std::size_t points = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+      points = builder.build(depth.data(), width * sizeof(uint16_t), 0.001f, out.data());
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%4dx%-4d voxel %.2f m: %7zu points/frame, %.3f ms/frame, %.1f Mpixels/s, %.1f Mpoints/s out\n",
+                width, height, voxel_size, points, 1000.0 * seconds / frames,
+                static_cast<double>(width) * height * frames / seconds / 1e6, static_cast<double>(points) * frames / seconds / 1e6);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const int frames = argc > 1 ? std::atoi(argv[1]) : 200;
+  for (float voxel : {0.0f, 0.05f})
+  {
+    run(424, 240, voxel, frames);
+    run(848, 480, voxel, frames);
+  }
+  return 0;
+}
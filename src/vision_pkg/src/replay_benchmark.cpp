@@ -0,0 +1,188 @@
+// Runs the depth and color stages of the camera node over a recording as fast as they go,
+// so changes to them can be compared on the same frames. No camera or ROS needed.
+//
+// usage: replay_benchmark <recording> [passes] [voxel_threads]
+#include "vision_pkg/DepthStats.hpp"
+#include "vision_pkg/ElevationMap.hpp"
+#include "vision_pkg/GroundPlane.hpp"
+#include "vision_pkg/JpegEncoder.hpp"
+#include "vision_pkg/PointCloudBuilder.hpp"
+#include "vision_pkg/Recording.hpp"
+#include "vision_pkg/ThreadPool.hpp"
+#include "vision_pkg/VoxelMap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+  enum Stage
+  {
+    DEPTH_STATS,
+    GROUND_PLANE,
+    POINT_CLOUD,
+    VOXEL_MAP,
+    JPEG_COLOR,
+    NUM_STAGES
+  };
+
+  const char *const STAGE_NAMES[NUM_STAGES] = {"depth stats + grid", "ground plane", "point cloud", "voxel map", "color jpeg"};
+
+  /**
+   * @brief Stage state of one recorded depth stream.
+   */
+  struct DepthPipeline
+  {
+    GroundPlaneEstimator ground;
+    PointCloudBuilder cloud;
+    std::vector<uint8_t> points;
+    std::vector<float> x, y, z;
+  };
+
+  struct Timer
+  {
+    std::vector<double> ms;
+
+    template <typename F>
+    void time(F &&stage)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      stage();
+      ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    void print(const char *name)
+    {
+      if (ms.empty())
+      {
+        return;
+      }
+      std::sort(ms.begin(), ms.end());
+      double total = 0.0;
+      for (double v : ms)
+      {
+        total += v;
+      }
+      std::printf("%-20s %7zu frames  mean %7.3f ms  p50 %7.3f ms  p95 %7.3f ms  max %7.3f ms\n", name, ms.size(),
+                  total / ms.size(), ms[ms.size() / 2], ms[std::min(ms.size() - 1, ms.size() * 95 / 100)], ms.back());
+    }
+  };
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    std::fprintf(stderr, "usage: %s <recording> [passes] [voxel_threads]\n", argv[0]);
+    return 1;
+  }
+  const int passes = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1;
+  const int threads = argc > 3 ? std::atoi(argv[3]) : 1;
+
+  RecordingReader reader;
+  if (!reader.open(argv[1]))
+  {
+    std::fprintf(stderr, "%s\n", reader.lastError().c_str());
+    return 1;
+  }
+  std::printf("%s: %zu records over %.1f s%s\n", argv[1], reader.size(), (reader.endNs() - reader.startNs()) * 1e-9,
+              reader.recovered() ? " (cut short, index rebuilt)" : "");
+  for (std::size_t id = 0; id < RECORDING_MAX_STREAMS; id++)
+  {
+    const RecordingStream &stream = reader.stream(id);
+    if (stream.kind != RecordKind::NONE)
+    {
+      std::printf("  stream %2zu %-32s kind %d camera %d %ux%u\n", id, stream.name, static_cast<int>(stream.kind), stream.camera,
+                  stream.width, stream.height);
+    }
+  }
+
+  std::unique_ptr<ThreadPool> pool = threads > 1 ? std::make_unique<ThreadPool>(threads) : nullptr;
+  std::array<std::unique_ptr<DepthPipeline>, RECORDING_MAX_STREAMS> depth;
+  DepthStats stats;
+  std::vector<DepthRegion> cells;
+  VoxelMap voxels;
+  JpegEncoder encoder;
+  std::vector<uint8_t> jpeg;
+  const RigidTransform sensor = RigidTransform::fromXYZRPY(0.0f, 0.0f, 0.5f, 0.0f, 0.35f, 0.0f) * RigidTransform::opticalToBody();
+  std::array<Timer, NUM_STAGES> timers;
+  std::size_t bytes = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (std::size_t i = 0; i < reader.size(); i++)
+    {
+      const RecordView record = reader.record(i);
+      const RecordingStream &stream = reader.stream(record.stream);
+      bytes += record.size;
+
+      if (stream.kind == RecordKind::COLOR_BGR8)
+      {
+        timers[JPEG_COLOR].time([&] {
+          encoder.encode(record.data, record.width, record.height, record.stride, JpegEncoder::PixelFormat::BGR, jpeg);
+        });
+        continue;
+      }
+      if (stream.kind != RecordKind::DEPTH_Z16)
+      {
+        continue;
+      }
+
+      if (!depth[record.stream])
+      {
+        depth[record.stream] = std::make_unique<DepthPipeline>();
+        depth[record.stream]->cloud.setIntrinsics(record.width, record.height, stream.intrinsics);
+        depth[record.stream]->cloud.setRange(0.1f, 6.0f);
+        depth[record.stream]->points.resize(depth[record.stream]->cloud.maxPoints() * PointCloudBuilder::POINT_STEP);
+      }
+      DepthPipeline &pipeline = *depth[record.stream];
+      const auto *pixels = reinterpret_cast<const uint16_t *>(record.data);
+      const int width = static_cast<int>(record.width);
+      const int height = static_cast<int>(record.height);
+
+      timers[DEPTH_STATS].time([&] {
+        stats.build(pixels, width, height, record.stride, stream.depth_units);
+        stats.grid(16, 12, cells);
+      });
+      timers[GROUND_PLANE].time([&] {
+        pipeline.ground.update(pixels, width, height, record.stride, stream.depth_units, stream.intrinsics);
+      });
+
+      std::size_t count = 0;
+      timers[POINT_CLOUD].time([&] {
+        count = pipeline.cloud.build(pixels, record.stride, stream.depth_units, pipeline.points.data());
+      });
+      pipeline.x.resize(count);
+      pipeline.y.resize(count);
+      pipeline.z.resize(count);
+      for (std::size_t p = 0; p < count; p++)
+      {
+        float xyz[3];
+        std::memcpy(xyz, pipeline.points.data() + p * PointCloudBuilder::POINT_STEP, sizeof(xyz));
+        pipeline.x[p] = xyz[0];
+        pipeline.y[p] = xyz[1];
+        pipeline.z[p] = xyz[2];
+      }
+      timers[VOXEL_MAP].time([&] {
+        voxels.insert(pipeline.x.data(), pipeline.y.data(), pipeline.z.data(), count, sensor, pool.get());
+      });
+    }
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (int stage = 0; stage < NUM_STAGES; stage++)
+  {
+    timers[stage].print(STAGE_NAMES[stage]);
+  }
+  std::printf("%d pass(es) in %.2f s, %.1f MB/s of recording, %zu voxel blocks\n", passes, seconds, bytes / seconds / 1e6,
+              voxels.blockCount());
+  return 0;
+}
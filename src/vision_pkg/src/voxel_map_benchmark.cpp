@@ -0,0 +1,98 @@
+// Measures VoxelMap insertion on one core and on a thread pool, with synthetic D455 frames.
+//
+// usage: voxel_map_benchmark [frames] [threads]
+#include "vision_pkg/PointCloudBuilder.hpp"
+#include "vision_pkg/ThreadPool.hpp"
+#include "vision_pkg/VoxelMap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  struct Cloud
+  {
+    std::vector<float> x, y, z;
+  };
+
+  /**
+   * @brief Deprojects a frame of floor pitched away from the camera, with a box standing on it.
+   * @param voxel_size Downsampling of the deprojected cloud, 0 for every pixel
+   */
+  Cloud makeCloud(int width, int height, float voxel_size)
+  {
+    const float scale = width / 848.0f;
+    const CameraIntrinsics intrinsics{425.0f * scale, 425.0f * scale, width / 2.0f, height / 2.0f};
+    std::vector<uint16_t> depth(static_cast<std::size_t>(width) * height);
+    for (int v = 0; v < height; v++)
+    {
+      for (int u = 0; u < width; u++)
+      {
+        const float ray = (v - intrinsics.cy) / intrinsics.fy + 0.35f;
+        float mm = ray > 0.05f ? std::min(6000.0f, 500.0f / ray) : 6000.0f;
+        if (u > width / 3 && u < width / 2 && mm > 2000.0f)
+        {
+          mm = 2000.0f; // Box 2 m ahead
+        }
+        depth[v * width + u] = static_cast<uint16_t>(mm);
+      }
+    }
+
+    PointCloudBuilder builder;
+    builder.setIntrinsics(width, height, intrinsics);
+    builder.setRange(0.1f, 10.0f);
+    builder.setVoxelSize(voxel_size);
+    std::vector<uint8_t> out(builder.maxPoints() * PointCloudBuilder::POINT_STEP);
+    const std::size_t points = builder.build(depth.data(), width * sizeof(uint16_t), 0.001f, out.data());
+
+    Cloud cloud;
+    for (std::size_t i = 0; i < points; i++)
+    {
+      float p[3];
+      std::memcpy(p, out.data() + i * PointCloudBuilder::POINT_STEP, sizeof(p));
+      cloud.x.push_back(p[0]);
+      cloud.y.push_back(p[1]);
+      cloud.z.push_back(p[2]);
+    }
+    return cloud;
+  }
+
+  void run(int width, int height, float voxel_size, int frames, ThreadPool *pool)
+  {
+    const Cloud cloud = makeCloud(width, height, voxel_size);
+    VoxelMap map;
+    const RigidTransform sensor = RigidTransform::fromXYZRPY(0.0f, 0.0f, 0.5f, 0.0f, 0.35f, 0.0f) * RigidTransform::opticalToBody();
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+      map.insert(cloud.x.data(), cloud.y.data(), cloud.z.data(), cloud.x.size(), sensor, pool);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%4dx%-4d cloud voxel %.2f m, %2zu thread(s): %7zu points/frame, %.2f ms/frame, %.1f frames/s, %.1f Mpoints/s, %zu blocks\n",
+                width, height, voxel_size, pool != nullptr ? pool->size() : 1, cloud.x.size(), 1000.0 * seconds / frames, frames / seconds,
+                static_cast<double>(cloud.x.size()) * frames / seconds / 1e6, map.blockCount());
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const int frames = argc > 1 ? std::atoi(argv[1]) : 30;
+  const std::size_t threads = argc > 2 ? std::atoi(argv[2]) : std::max(2u, std::thread::hardware_concurrency());
+  ThreadPool pool(threads);
+  for (float voxel : {0.0f, 0.05f})
+  {
+    for (ThreadPool *p : {static_cast<ThreadPool *>(nullptr), &pool})
+    {
+      run(424, 240, voxel, frames, p);
+      run(848, 480, voxel, frames, p);
+    }
+  }
+  return 0;
+}
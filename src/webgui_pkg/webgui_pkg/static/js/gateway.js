@@ -0,0 +1,153 @@
+//////////////////////////////////////////////////
+// Setup Gateway Connection
+//
+//  Description:
+//    Binary WebSocket to the gateway node (gateway_pkg),
+//    which serves the cameras and the motor health and
+//    takes the gamepad without going through rosbridge.
+//    Message layout is in gateway_pkg/Protocol.hpp.
+//////////////////////////////////////
+
+const GATEWAY_PORT = 9091;
+const GATEWAY_RECONNECT_MS = 1000;
+
+const GATEWAY_VIDEO_JPEG = 1;
+const GATEWAY_VIDEO_H264 = 2;
+const GATEWAY_SUBSCRIBE = 16;
+const GATEWAY_JOY = 17;
+const GATEWAY_VIDEO_FEEDBACK = 18;
+const GATEWAY_KEYFRAME = 1;
+const GATEWAY_VIDEO_HEADER_SIZE = 20;
+const GATEWAY_JOY_HEADER_SIZE = 16;
+
+/**
+ * @class Gateway
+ * @brief Connects to the gateway, reconnects when the link drops and subscribes again.
+ *
+ * Handlers:
+ *   onHello(channels)   topics the gateway serves, in channel order
+ *   onVideo(frame)      {type, channel, keyframe, sequence, stamp (BigInt ns), width, height, data (Uint8Array)}
+ *   onTelemetry(json)   parsed text messages other than hello, e.g. {type: 'motor_health', ...}
+ */
+class Gateway {
+    constructor(url) {
+        this.url = url;
+        this.socket = null;
+        this.channels = [];
+        this.subscriptions = new Map(); // topic -> format
+        this.onHello = () => {};
+        this.onVideo = () => {};
+        this.onTelemetry = () => {};
+        this.connect();
+    }
+
+    connect() {
+        this.socket = new WebSocket(this.url);
+        this.socket.binaryType = 'arraybuffer';
+
+        this.socket.onopen = () => {
+            console.log('Connected to the gateway.');
+        };
+        this.socket.onclose = () => {
+            console.log('Connection to the gateway closed, retrying.');
+            this.channels = [];
+            setTimeout(() => this.connect(), GATEWAY_RECONNECT_MS);
+        };
+        this.socket.onerror = (error) => {
+            console.log('Error connecting to the gateway: ', error);
+        };
+        this.socket.onmessage = (event) => {
+            if (typeof event.data === 'string') {
+                this.handleText(JSON.parse(event.data));
+            } else {
+                this.handleBinary(event.data);
+            }
+        };
+    }
+
+    isOpen() {
+        return this.socket !== null && this.socket.readyState === WebSocket.OPEN;
+    }
+
+    handleText(message) {
+        if (message.type === 'hello') {
+            this.channels = message.channels;
+            this.subscriptions.forEach((format, topic) => this.sendSubscribe(topic, format));
+            this.onHello(this.channels);
+        } else {
+            this.onTelemetry(message);
+        }
+    }
+
+    handleBinary(buffer) {
+        if (buffer.byteLength < GATEWAY_VIDEO_HEADER_SIZE) {
+            return;
+        }
+        const view = new DataView(buffer);
+        const type = view.getUint8(0);
+        if (type !== GATEWAY_VIDEO_JPEG && type !== GATEWAY_VIDEO_H264) {
+            return;
+        }
+        this.onVideo({
+            type: type,
+            channel: view.getUint8(1),
+            keyframe: (view.getUint8(2) & GATEWAY_KEYFRAME) !== 0,
+            sequence: view.getUint32(4, true),
+            stamp: view.getBigInt64(8, true),
+            width: view.getUint16(16, true),
+            height: view.getUint16(18, true),
+            data: new Uint8Array(buffer, GATEWAY_VIDEO_HEADER_SIZE)
+        });
+    }
+
+    channelOf(topic) {
+        return this.channels.indexOf(topic.replace(/^\//, ''));
+    }
+
+    /**
+     * @brief Asks for a camera topic in GATEWAY_VIDEO_JPEG or GATEWAY_VIDEO_H264, 0 stops it.
+     *        Kept across reconnects.
+     */
+    subscribe(topic, format) {
+        this.subscriptions.set(topic, format);
+        this.sendSubscribe(topic, format);
+    }
+
+    sendSubscribe(topic, format) {
+        const channel = this.channelOf(topic);
+        if (!this.isOpen() || channel < 0) {
+            return; // Sent again on hello
+        }
+        this.socket.send(new Uint8Array([GATEWAY_SUBSCRIBE, channel, format, 0]));
+    }
+
+    // frameId and stamp (BigInt ns since the epoch) let the controller trace the message back to the gamepad
+    sendJoy(axes, buttons, frameId, stamp) {
+        if (!this.isOpen()) {
+            return;
+        }
+        const buffer = new ArrayBuffer(GATEWAY_JOY_HEADER_SIZE + 4 * axes.length + buttons.length);
+        const view = new DataView(buffer);
+        view.setUint8(0, GATEWAY_JOY);
+        view.setUint8(1, axes.length);
+        view.setUint8(2, buttons.length);
+        view.setUint32(4, frameId, true);
+        view.setBigInt64(8, stamp, true);
+        axes.forEach((value, i) => view.setFloat32(GATEWAY_JOY_HEADER_SIZE + 4 * i, value, true));
+        buttons.forEach((pressed, i) => view.setUint8(GATEWAY_JOY_HEADER_SIZE + 4 * axes.length + i, pressed ? 1 : 0));
+        this.socket.send(buffer);
+    }
+
+    // Capture stamp of the newest frame shown, for the camera node's rate controller
+    sendFeedback(channel, stamp) {
+        if (!this.isOpen()) {
+            return;
+        }
+        const buffer = new ArrayBuffer(16);
+        const view = new DataView(buffer);
+        view.setUint8(0, GATEWAY_VIDEO_FEEDBACK);
+        view.setUint8(1, channel);
+        view.setBigInt64(8, stamp, true);
+        this.socket.send(buffer);
+    }
+}
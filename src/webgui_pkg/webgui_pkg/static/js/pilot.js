@@ -52,9 +52,22 @@ function publishGamepadMessage() {
     }
     FRAME_ID += 1;
 
+    // The frame id and the time the gamepad was read follow the message to the CAN bus,
+    // controller_pkg's joy_latency_report shows the delay of every hop
+    const stampMs = performance.timeOrigin + performance.now();
+    const sec = Math.floor(stampMs / 1000);
+    const nanosec = Math.min(999999999, Math.round((stampMs - sec * 1000) * 1e6));
+
+    if (gateway) {
+        gateway.sendJoy(gamepadState.axes, gamepadState.buttons, FRAME_ID,
+            BigInt(sec) * 1000000000n + BigInt(nanosec));
+        return;
+    }
+
     // Create Message
     var message = new ROSLIB.Message({
         header: {
+            stamp: { sec: sec, nanosec: nanosec },
             frame_id: `${FRAME_ID}`
         },
         axes: gamepadState.axes,
@@ -68,19 +81,280 @@ function publishGamepadMessage() {
 ////////////////////////////////////////////////////////////////////////////////////////
 
 
-const listener = new ROSLIB.Topic({
+const CAMERA_TOPIC = '/rs_node/camera1/compressed_video';
+const FEEDBACK_PERIOD_MS = 250;
+const MAX_DECODE_QUEUE = 3;
+const H264_KEYFRAME_TIMEOUT_MS = 5000; // A few GOPs, longer means the camera node has no H.264 (built without x264)
+const PAGE_OPTIONS = new URLSearchParams(window.location.search);
+
+// Video and the gamepad go through the gateway node as binary WebSocket messages.
+// With ?transport=rosbridge they go through rosbridge as JSON, as they used to.
+const USE_GATEWAY = PAGE_OPTIONS.get('transport') !== 'rosbridge';
+
+// H.264 is decoded with WebCodecs, which browsers only offer on https or localhost pages.
+// Elsewhere, or with ?video=jpeg in the URL, the JPEG stream is shown instead. The page also
+// switches to JPEG when no H.264 keyframe arrives, e.g. from a camera node built without x264.
+const USE_H264 = ('VideoDecoder' in window) && PAGE_OPTIONS.get('video') !== 'jpeg';
+
+const gateway = USE_GATEWAY ? new Gateway(`ws://${serverIP}:${GATEWAY_PORT}`) : null;
+
+// Tells the camera node which stream is on screen and how old the newest frame is,
+// so its rate controller can favor this stream and back off when the link is congested
+var videoFeedbackPublisher = new ROSLIB.Topic({
     ros: ROS,
-    name: '/rs_node/camera1/compressed_video',
-    messageType: 'sensor_msgs/CompressedImage'
+    name: '/rs_node/video_feedback',
+    messageType: 'interfaces_pkg/VideoFeedback'
 });
+var lastFeedbackTime = 0;
+
+function feedbackDue() {
+    const now = Date.now();
+    if (now - lastFeedbackTime < FEEDBACK_PERIOD_MS) {
+        return false;
+    }
+    lastFeedbackTime = now;
+    return true;
+}
+
+function sendVideoFeedback(header) {
+    if (feedbackDue()) {
+        videoFeedbackPublisher.publish(new ROSLIB.Message({
+            stream: CAMERA_TOPIC.substring(1),
+            last_frame: header
+        }));
+    }
+}
+
+/**
+ * @function showJpegStream
+ * @brief Shows every JPEG frame of the camera in the image element
+ */
+function showJpegStream() {
+    if (gateway) {
+        var frameUrl = null;
+        gateway.onVideo = (frame) => {
+            const imgEl = document.getElementById('main-camera-frame');
+            if (imgEl && frame.type === GATEWAY_VIDEO_JPEG) {
+                if (frameUrl) {
+                    URL.revokeObjectURL(frameUrl);
+                }
+                frameUrl = URL.createObjectURL(new Blob([frame.data], { type: 'image/jpeg' }));
+                imgEl.src = frameUrl;
+            }
+            if (feedbackDue()) {
+                gateway.sendFeedback(frame.channel, frame.stamp);
+            }
+        };
+        gateway.subscribe(CAMERA_TOPIC, GATEWAY_VIDEO_JPEG);
+        return;
+    }
+
+    const listener = new ROSLIB.Topic({
+        ros: ROS,
+        name: CAMERA_TOPIC,
+        messageType: 'sensor_msgs/CompressedImage'
+    });
+
+    listener.subscribe((message)=>{
+        const imgEl = document.getElementById('main-camera-frame');
+        if(imgEl) {
+            imgEl.src = "data:image/jpeg;base64, " + message.data;
+        }
+        sendVideoFeedback(message.header);
+    });
+}
+
+// rosbridge sends uint8[] fields as base64 text
+function base64ToBytes(data) {
+    const binary = atob(data);
+    const bytes = new Uint8Array(binary.length);
+    for (let i = 0; i < binary.length; i++) {
+        bytes[i] = binary.charCodeAt(i);
+    }
+    return bytes;
+}
+
+// WebCodecs codec string ("avc1.PPCCLL") from the SPS of an Annex B keyframe, '' without one
+function h264Codec(data) {
+    for (let i = 0; i + 6 < data.length; i++) {
+        if (data[i] === 0 && data[i + 1] === 0 && data[i + 2] === 1 && (data[i + 3] & 0x1f) === 7) {
+            const hex = (value) => value.toString(16).padStart(2, '0');
+            return 'avc1.' + hex(data[i + 4]) + hex(data[i + 5]) + hex(data[i + 6]);
+        }
+    }
+    return '';
+}
+
+/**
+ * @function createH264Player
+ * @brief Decodes H.264 access units with WebCodecs and draws them on the canvas.
+ *        Decoding starts at a keyframe and starts over at the next one after a lost frame.
+ * @returns function taking {keyframe, sequence, codec, width, height, timestamp (us), data}
+ */
+function createH264Player(canvas) {
+    const context = canvas.getContext('2d');
+    var decoder = null;
+    var codec = '';
+    var width = 0;
+    var height = 0;
+    var waitForKeyframe = true;
+    var lastSequence = -1;
 
-listener.subscribe((message)=>{
+    function resetDecoder() {
+        if (decoder && decoder.state !== 'closed') {
+            decoder.close();
+        }
+        decoder = null;
+        waitForKeyframe = true;
+    }
+
+    function createDecoder(unit) {
+        resetDecoder();
+        decoder = new VideoDecoder({
+            output: (frame) => {
+                if (canvas.width !== frame.displayWidth || canvas.height !== frame.displayHeight) {
+                    canvas.width = frame.displayWidth;
+                    canvas.height = frame.displayHeight;
+                }
+                context.drawImage(frame, 0, 0);
+                frame.close();
+            },
+            error: (error) => {
+                console.error('H.264 decoding failed: ', error);
+                resetDecoder();
+            }
+        });
+        // Without a description the decoder expects Annex B, as the camera node sends it
+        decoder.configure({
+            codec: unit.codec,
+            codedWidth: unit.width,
+            codedHeight: unit.height,
+            optimizeForLatency: true
+        });
+        codec = unit.codec;
+        width = unit.width;
+        height = unit.height;
+    }
+
+    return (unit) => {
+        // A lost frame breaks every frame up to the next keyframe
+        if (lastSequence >= 0 && unit.sequence !== lastSequence + 1) {
+            waitForKeyframe = true;
+        }
+        lastSequence = unit.sequence;
+        if (decoder && decoder.decodeQueueSize > MAX_DECODE_QUEUE) {
+            resetDecoder(); // Falling behind, skip ahead to the next keyframe
+        }
+        if (waitForKeyframe && !unit.keyframe) {
+            return;
+        }
+        if (unit.keyframe && (!decoder || unit.codec !== codec || unit.width !== width || unit.height !== height)) {
+            createDecoder(unit);
+        }
+
+        decoder.decode(new EncodedVideoChunk({
+            type: unit.keyframe ? 'key' : 'delta',
+            timestamp: unit.timestamp,
+            data: unit.data
+        }));
+        waitForKeyframe = false;
+    };
+}
+
+/**
+ * @function showH264Stream
+ * @brief Shows the camera's H.264 stream on the canvas, or the JPEG stream if no keyframe arrives
+ *        within H264_KEYFRAME_TIMEOUT_MS of the camera topic being reachable
+ */
+function showH264Stream() {
+    const canvas = document.getElementById('main-camera-canvas');
     const imgEl = document.getElementById('main-camera-frame');
-    console.log("Updating Image");
-    if(imgEl) {
-        imgEl.src = "data:image/jpeg;base64, " + message.data;
+    imgEl.classList.add('hidden');
+    canvas.classList.remove('hidden');
+    const play = createH264Player(canvas);
+
+    var keyframeSeen = false;
+    var fallbackTimer = null;
+    var listener = null;
+    function fallBackToJpeg() {
+        if (keyframeSeen) {
+            return;
+        }
+        console.log('[ Video ] No H.264 keyframe in ' + H264_KEYFRAME_TIMEOUT_MS + ' ms, showing JPEG');
+        if (listener) {
+            listener.unsubscribe();
+        }
+        canvas.classList.add('hidden');
+        imgEl.classList.remove('hidden');
+        showJpegStream(); // Replaces the gateway's handler and subscription
     }
-});
+    function startFallbackTimer() {
+        if (fallbackTimer === null) {
+            fallbackTimer = setTimeout(fallBackToJpeg, H264_KEYFRAME_TIMEOUT_MS);
+        }
+    }
+
+    if (gateway) {
+        var codec = '';
+        // The timer starts once the gateway serves the camera, not while the robot is still booting
+        gateway.onHello = () => {
+            if (gateway.channelOf(CAMERA_TOPIC) >= 0) {
+                startFallbackTimer();
+            }
+        };
+        gateway.onVideo = (frame) => {
+            if (frame.type !== GATEWAY_VIDEO_H264) {
+                return;
+            }
+            keyframeSeen = keyframeSeen || frame.keyframe;
+            if (feedbackDue()) {
+                gateway.sendFeedback(frame.channel, frame.stamp);
+            }
+            if (frame.keyframe) {
+                codec = h264Codec(frame.data) || codec;
+            }
+            play({
+                keyframe: frame.keyframe,
+                sequence: frame.sequence,
+                codec: codec,
+                width: frame.width,
+                height: frame.height,
+                timestamp: Number(frame.stamp / 1000n),
+                data: frame.data
+            });
+        };
+        gateway.subscribe(CAMERA_TOPIC, GATEWAY_VIDEO_H264);
+        return;
+    }
+
+    listener = new ROSLIB.Topic({
+        ros: ROS,
+        name: CAMERA_TOPIC + '/h264',
+        messageType: 'interfaces_pkg/EncodedVideo',
+        queue_length: 5
+    });
+    startFallbackTimer();
+
+    listener.subscribe((message)=>{
+        keyframeSeen = keyframeSeen || message.keyframe;
+        sendVideoFeedback(message.header);
+        play({
+            keyframe: message.keyframe,
+            sequence: message.sequence,
+            codec: message.codec,
+            width: message.width,
+            height: message.height,
+            timestamp: message.header.stamp.sec * 1e6 + Math.floor(message.header.stamp.nanosec / 1000),
+            data: base64ToBytes(message.data)
+        });
+    });
+}
+
+if (USE_H264) {
+    showH264Stream();
+} else {
+    showJpegStream();
+}
 
 // Main Code
 ////////////////////////////////////////////////////////////////////////////////////////